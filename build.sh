@@ -4,9 +4,9 @@ set -e
 
 FLAGS="-g -Wall -Wextra -Werror -Og -fpic"
 BUILDTYPE=static
-SOURCES="src/http.c src/json.c src/common.c src/base64.c src/threadpool.c src/log.c"
+SOURCES="src/http.c src/json.c src/common.c src/base64.c src/threadpool.c src/log.c src/compress.c src/http2.c src/dns.c"
 
-while getopts "de" flag; do
+while getopts "deuzZ" flag; do
     case $flag in
         d)
             BUILDTYPE=dynamic
@@ -15,6 +15,16 @@ while getopts "de" flag; do
             FLAGS=$FLAGS" -DWEB_USE_HTTPS_OPENSSL $(pkg-config --cflags --libs openssl)"
             SOURCES=$SOURCES" src/openssl.c"
         ;;
+        u)
+            FLAGS=$FLAGS" -DWEB_USE_IO_URING"
+            SOURCES=$SOURCES" src/uring.c"
+        ;;
+        z)
+            FLAGS=$FLAGS" -DWEB_USE_ZLIB $(pkg-config --cflags --libs zlib)"
+        ;;
+        Z)
+            FLAGS=$FLAGS" -DWEB_USE_ZSTD $(pkg-config --cflags --libs libzstd)"
+        ;;
         \?)
             echo "Unrecognized flag '$flag'"
         ;;
@@ -2,4 +2,4 @@
 
 set -xe
 
-cc -Wall -Wextra -Werror -g -Og -o "$1" "./examples/$1.c" -L. -lweb -lssl -lcrypto -Wl,-rpath=$(pwd)
+cc -Wall -Wextra -Werror -g -Og -o "$1" "./examples/$1.c" -L. -lweb -lssl -lcrypto -lz -Wl,-rpath=$(pwd)
@@ -102,6 +102,21 @@ static inline b32 WebStringViewEqualCStr(web_string_view Sv, const char *CStr) {
     return 1;
 }
 
+static inline u8 WebCharToLower(u8 Char) {
+    return (Char >= 'A' && Char <= 'Z') ? Char + ('a' - 'A') : Char;
+}
+
+static inline b32 WebStringViewEqualCStrIgnoreCase(web_string_view Sv, const char *CStr) {
+    uz CStrLength = strlen(CStr);
+    if (Sv.Count != CStrLength) return 0;
+
+    for (uz I = 0; I < Sv.Count; ++I) {
+        if (WebCharToLower(Sv.Items[I]) != WebCharToLower(CStr[I])) return 0;
+    }
+
+    return 1;
+}
+
 static inline b32 WebStringViewEqual(web_string_view Lhs, web_string_view Rhs) {
     if (Lhs.Count != Rhs.Count) return 0;
 
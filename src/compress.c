@@ -0,0 +1,259 @@
+#include "compress.h"
+
+#include <limits.h>
+#include <pthread.h>
+
+#ifdef WEB_USE_ZLIB
+#include <zlib.h>
+#endif // WEB_USE_ZLIB
+
+#ifdef WEB_USE_ZSTD
+#include <zstd.h>
+#endif // WEB_USE_ZSTD
+
+#define COMPRESSION_ZLIB_LEVEL 6
+#define COMPRESSION_ZSTD_LEVEL 3
+
+static const char *CompressionEncodingNames[WEB_COMPRESSION_ENCODINGS_COUNT] = {
+    [WEB_COMPRESSION_IDENTITY] = "identity",
+#define X(Name, Token) [WEB_COMPRESSION_##Name] = Token,
+    WEB_ENUM_COMPRESSION_ENCODINGS
+#undef X
+};
+
+const char *WebCompressionEncodingName(web_compression_encoding Encoding) {
+    WEB_ASSERT(Encoding < WEB_COMPRESSION_ENCODINGS_COUNT);
+    return CompressionEncodingNames[Encoding];
+}
+
+b32 WebCompressionIsAvailable(web_compression_encoding Encoding) {
+    switch (Encoding) {
+    case WEB_COMPRESSION_IDENTITY: return 1;
+#ifdef WEB_USE_ZLIB
+    case WEB_COMPRESSION_GZIP:
+    case WEB_COMPRESSION_DEFLATE: return 1;
+#endif // WEB_USE_ZLIB
+#ifdef WEB_USE_ZSTD
+    case WEB_COMPRESSION_ZSTD: return 1;
+#endif // WEB_USE_ZSTD
+    default: return 0;
+    }
+}
+
+static web_string_view CompressionTrim(web_string_view Sv) {
+    while (Sv.Count > 0 && (Sv.Items[0] == ' ' || Sv.Items[0] == '\t')) {
+        ++Sv.Items;
+        --Sv.Count;
+    }
+
+    while (Sv.Count > 0 && (Sv.Items[Sv.Count - 1] == ' ' || Sv.Items[Sv.Count - 1] == '\t')) --Sv.Count;
+
+    return Sv;
+}
+
+// NOTE(oleh): q-values are kept in thousandths, so "0.5" is 500. Anything malformed counts as 0.
+static s32 CompressionParseQuality(web_string_view Value) {
+    if (Value.Count == 0 || Value.Count > 5) return 0;
+    if (Value.Items[0] != '0' && Value.Items[0] != '1') return 0;
+
+    s32 Quality = (Value.Items[0] - '0') * 1000;
+    if (Value.Count == 1) return Quality;
+    if (Value.Items[1] != '.') return 0;
+
+    s32 Scale = 100;
+    for (uz I = 2; I < Value.Count; ++I) {
+        if (Value.Items[I] < '0' || Value.Items[I] > '9') return 0;
+        Quality += (Value.Items[I] - '0') * Scale;
+        Scale /= 10;
+    }
+
+    return WEB_MIN(Quality, 1000);
+}
+
+web_compression_encoding WebCompressionNegotiate(web_string_view AcceptEncoding) {
+    // NOTE(oleh): -1 means that the encoding wasn't mentioned.
+    s32 Qualities[WEB_COMPRESSION_ENCODINGS_COUNT];
+    for (uz I = 0; I < WEB_COMPRESSION_ENCODINGS_COUNT; ++I) Qualities[I] = -1;
+    s32 WildcardQuality = -1;
+
+    uz Offset = 0;
+    while (Offset < AcceptEncoding.Count) {
+        uz End = Offset;
+        while (End < AcceptEncoding.Count && AcceptEncoding.Items[End] != ',') ++End;
+
+        web_string_view Element = {.Items = AcceptEncoding.Items + Offset, .Count = End - Offset};
+        Offset = End + 1;
+
+        web_string_view Token = Element;
+        s32 Quality = 1000;
+
+        u8 *Semicolon = memchr(Element.Items, ';', Element.Count);
+        if (Semicolon != NULL) {
+            Token.Count = Semicolon - Element.Items;
+
+            web_string_view Parameter = {.Items = Semicolon + 1, .Count = Element.Count - Token.Count - 1};
+            Parameter = CompressionTrim(Parameter);
+            if (Parameter.Count >= 2 && WebCharToLower(Parameter.Items[0]) == 'q' && Parameter.Items[1] == '=') {
+                Parameter.Items += 2;
+                Parameter.Count -= 2;
+                Quality = CompressionParseQuality(CompressionTrim(Parameter));
+            }
+        }
+
+        Token = CompressionTrim(Token);
+        if (Token.Count == 0) continue;
+
+        if (WebStringViewEqualCStr(Token, "*")) {
+            WildcardQuality = Quality;
+            continue;
+        }
+
+        // NOTE(oleh): Old clients still send the x- prefixed names.
+        if (WebStringViewEqualCStrIgnoreCase(Token, "x-gzip")) {
+            Qualities[WEB_COMPRESSION_GZIP] = Quality;
+            continue;
+        }
+
+        for (uz I = 0; I < WEB_COMPRESSION_ENCODINGS_COUNT; ++I) {
+            if (WebStringViewEqualCStrIgnoreCase(Token, CompressionEncodingNames[I])) {
+                Qualities[I] = Quality;
+                break;
+            }
+        }
+    }
+
+    web_compression_encoding Best = WEB_COMPRESSION_IDENTITY;
+    s32 BestQuality = 0;
+
+    for (uz I = WEB_COMPRESSION_IDENTITY + 1; I < WEB_COMPRESSION_ENCODINGS_COUNT; ++I) {
+        if (!WebCompressionIsAvailable(I)) continue;
+
+        s32 Quality = Qualities[I] >= 0 ? Qualities[I] : WildcardQuality;
+        if (Quality > BestQuality) {
+            Best = I;
+            BestQuality = Quality;
+        }
+    }
+
+    return Best;
+}
+
+// NOTE(oleh): Setting up a deflate stream costs a few hundred kilobytes of allocations, so every thread
+// keeps its encoders around and only resets them between responses.
+typedef struct {
+#ifdef WEB_USE_ZLIB
+    z_stream Gzip;
+    b32 GzipReady;
+    z_stream Deflate;
+    b32 DeflateReady;
+#endif // WEB_USE_ZLIB
+#ifdef WEB_USE_ZSTD
+    ZSTD_CCtx *Zstd;
+#endif // WEB_USE_ZSTD
+    int Unused;
+} compression_state;
+
+static pthread_key_t CompressionStateKey;
+static pthread_once_t CompressionStateOnce = PTHREAD_ONCE_INIT;
+
+static void CompressionStateDestroy(void *Arg) {
+    compression_state *State = (compression_state *) Arg;
+
+#ifdef WEB_USE_ZLIB
+    if (State->GzipReady) deflateEnd(&State->Gzip);
+    if (State->DeflateReady) deflateEnd(&State->Deflate);
+#endif // WEB_USE_ZLIB
+#ifdef WEB_USE_ZSTD
+    if (State->Zstd != NULL) ZSTD_freeCCtx(State->Zstd);
+#endif // WEB_USE_ZSTD
+
+    free(State);
+}
+
+static void CompressionStateKeyCreate(void) {
+    if (pthread_key_create(&CompressionStateKey, CompressionStateDestroy) != 0) {
+        WEB_PANIC("Failed to create the compression state key");
+    }
+}
+
+static compression_state *CompressionStateGet(void) {
+    pthread_once(&CompressionStateOnce, CompressionStateKeyCreate);
+
+    compression_state *State = pthread_getspecific(CompressionStateKey);
+    if (State == NULL) {
+        State = calloc(1, sizeof(*State));
+        pthread_setspecific(CompressionStateKey, State);
+    }
+
+    return State;
+}
+
+#ifdef WEB_USE_ZLIB
+static b32 CompressZlib(z_stream *Stream, b32 *Ready, int WindowBits, web_arena *Arena, web_string_view Input, web_string_view *Output) {
+    if (Input.Count > UINT_MAX) return 0;
+
+    if (!*Ready) {
+        WEB_STRUCT_ZERO(Stream);
+        if (deflateInit2(Stream, COMPRESSION_ZLIB_LEVEL, Z_DEFLATED, WindowBits, 8, Z_DEFAULT_STRATEGY) != Z_OK) return 0;
+        *Ready = 1;
+    }
+
+    // NOTE(oleh): The output is only worth it if it is smaller than the input, so that is all the room
+    // it gets. Running out of it means the body does not compress.
+    uz Capacity = Input.Count - 1;
+    u8 *Buffer = WebArenaPush(Arena, Capacity);
+
+    Stream->next_in = Input.Items;
+    Stream->avail_in = Input.Count;
+    Stream->next_out = Buffer;
+    Stream->avail_out = Capacity;
+
+    int Result = deflate(Stream, Z_FINISH);
+    uz Count = Capacity - Stream->avail_out;
+    deflateReset(Stream);
+
+    if (Result != Z_STREAM_END) return 0;
+
+    *Output = (web_string_view) {.Items = Buffer, .Count = Count};
+    return 1;
+}
+#endif // WEB_USE_ZLIB
+
+#ifdef WEB_USE_ZSTD
+static b32 CompressZstd(compression_state *State, web_arena *Arena, web_string_view Input, web_string_view *Output) {
+    if (State->Zstd == NULL) {
+        State->Zstd = ZSTD_createCCtx();
+        if (State->Zstd == NULL) return 0;
+    }
+
+    uz Capacity = Input.Count - 1;
+    u8 *Buffer = WebArenaPush(Arena, Capacity);
+
+    uz Count = ZSTD_compressCCtx(State->Zstd, Buffer, Capacity, Input.Items, Input.Count, COMPRESSION_ZSTD_LEVEL);
+    if (ZSTD_isError(Count)) return 0;
+
+    *Output = (web_string_view) {.Items = Buffer, .Count = Count};
+    return 1;
+}
+#endif // WEB_USE_ZSTD
+
+b32 WebCompress(web_arena *Arena, web_compression_encoding Encoding, web_string_view Input, web_string_view *Output) {
+    if (Input.Count < 2 || !WebCompressionIsAvailable(Encoding)) return 0;
+
+    compression_state *State = CompressionStateGet();
+    // NOTE(oleh): Unused when built without any encoder.
+    (void) State;
+    (void) Arena;
+    (void) Output;
+
+    switch (Encoding) {
+#ifdef WEB_USE_ZLIB
+    case WEB_COMPRESSION_GZIP: return CompressZlib(&State->Gzip, &State->GzipReady, MAX_WBITS + 16, Arena, Input, Output);
+    case WEB_COMPRESSION_DEFLATE: return CompressZlib(&State->Deflate, &State->DeflateReady, MAX_WBITS, Arena, Input, Output);
+#endif // WEB_USE_ZLIB
+#ifdef WEB_USE_ZSTD
+    case WEB_COMPRESSION_ZSTD: return CompressZstd(State, Arena, Input, Output);
+#endif // WEB_USE_ZSTD
+    default: return 0;
+    }
+}
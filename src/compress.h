@@ -0,0 +1,42 @@
+#ifndef COMPRESS_H_
+#define COMPRESS_H_
+
+#include "common.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// NOTE(oleh): In the order of preference when the client accepts several of them equally.
+#define WEB_ENUM_COMPRESSION_ENCODINGS \
+    X(ZSTD, "zstd")                    \
+    X(GZIP, "gzip")                    \
+    X(DEFLATE, "deflate")
+
+typedef enum {
+    WEB_COMPRESSION_IDENTITY,
+#define X(Name, Token) WEB_COMPRESSION_##Name,
+    WEB_ENUM_COMPRESSION_ENCODINGS
+#undef X
+    WEB_COMPRESSION_ENCODINGS_COUNT,
+} web_compression_encoding;
+
+const char *WebCompressionEncodingName(web_compression_encoding Encoding);
+
+// NOTE(oleh): Whether the library was built with the encoder, see the `-z` and `-Z` flags of build.sh.
+b32 WebCompressionIsAvailable(web_compression_encoding Encoding);
+
+// NOTE(oleh): Picks the best available encoding out of an `Accept-Encoding` value, honouring q-values
+// and `*`. Returns `WEB_COMPRESSION_IDENTITY` if none of them is acceptable.
+web_compression_encoding WebCompressionNegotiate(web_string_view AcceptEncoding);
+
+// NOTE(oleh): Compresses `Input` into the arena. The encoder state is kept per thread and reset between
+// calls, so it is only set up once for every worker. Fails if the encoding is not available or the
+// output would not be any smaller than the input.
+b32 WebCompress(web_arena *Arena, web_compression_encoding Encoding, web_string_view Input, web_string_view *Output);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // COMPRESS_H_
@@ -0,0 +1,300 @@
+#include "dns.h"
+#include "threadpool.h"
+#include "log.h"
+
+#include <arpa/inet.h>
+#include <netdb.h>
+#include <sys/socket.h>
+#include <time.h>
+
+#define DNS_DEFAULT_TTL_MS 60000
+#define DNS_DEFAULT_NEGATIVE_TTL_MS 5000
+
+// NOTE(oleh): The longest a host name can be. (https://datatracker.ietf.org/doc/html/rfc1035#section-2.3.4)
+#define DNS_MAX_HOSTNAME_SIZE 255
+
+#define DNS_SHARDS_COUNT 16
+#define DNS_BUCKETS_COUNT 64
+// NOTE(oleh): A shard that is full only makes room by dropping expired entries. New hosts simply
+// aren't cached if there are none.
+#define DNS_SHARD_MAX_ENTRIES 256
+
+typedef struct dns_entry dns_entry;
+struct dns_entry {
+    dns_entry *Next;
+    u64 Hash;
+    // NOTE(oleh): Lower case, names are compared without regard to it.
+    char Hostname[DNS_MAX_HOSTNAME_SIZE + 1];
+    uz HostnameCount;
+
+    // NOTE(oleh): Empty for a failed lookup.
+    web_dns_addresses Addresses;
+    s64 ExpiresAt;
+    // NOTE(oleh): A lookup past this point queues the entry for a refresh.
+    s64 RefreshAt;
+    b32 Refreshing;
+};
+
+typedef struct {
+    web_mutex Mu;
+    dns_entry *Buckets[DNS_BUCKETS_COUNT];
+    uz Count;
+} dns_shard;
+
+typedef struct dns_refresh dns_refresh;
+struct dns_refresh {
+    dns_refresh *Next;
+    char Hostname[DNS_MAX_HOSTNAME_SIZE + 1];
+    uz HostnameCount;
+};
+
+static dns_shard DnsShards[DNS_SHARDS_COUNT];
+static pthread_once_t DnsOnce = PTHREAD_ONCE_INIT;
+
+static u32 DnsTtlMs = DNS_DEFAULT_TTL_MS;
+static u32 DnsNegativeTtlMs = DNS_DEFAULT_NEGATIVE_TTL_MS;
+
+// NOTE(oleh): The refreshes are done one after another by a single thread, started with the first one.
+static web_mutex DnsRefreshMu;
+static pthread_cond_t DnsRefreshCondVar = PTHREAD_COND_INITIALIZER;
+static dns_refresh *DnsRefreshQueue;
+static b32 DnsRefreshStarted;
+static web_thread DnsRefreshThread;
+
+static void DnsInit(void) {
+    for (uz I = 0; I < DNS_SHARDS_COUNT; ++I) WebMutexInit(&DnsShards[I].Mu);
+    WebMutexInit(&DnsRefreshMu);
+}
+
+static s64 DnsMonotonicNs(void) {
+    struct timespec Now;
+    clock_gettime(CLOCK_MONOTONIC, &Now);
+    return (s64) Now.tv_sec * 1000000000ll + Now.tv_nsec;
+}
+
+void WebDnsConfigure(web_dns_config *Config) {
+    __atomic_store_n(&DnsTtlMs, Config->TtlMs > 0 ? Config->TtlMs : DNS_DEFAULT_TTL_MS, __ATOMIC_RELAXED);
+    __atomic_store_n(&DnsNegativeTtlMs, Config->NegativeTtlMs > 0 ? Config->NegativeTtlMs : DNS_DEFAULT_NEGATIVE_TTL_MS, __ATOMIC_RELAXED);
+}
+
+static b32 DnsLookup(const char *Hostname, web_dns_addresses *Out) {
+    struct addrinfo Hints = {0};
+    struct addrinfo *Info = NULL;
+
+    Hints.ai_family = AF_INET;
+    Hints.ai_socktype = SOCK_STREAM;
+
+    Out->Count = 0;
+
+    int Status = getaddrinfo(Hostname, NULL, &Hints, &Info);
+    if (Status != 0) {
+        WEB_LOG_FMT(WARN, DNS, "Failed to resolve '%s': %s", Hostname, gai_strerror(Status));
+        return 0;
+    }
+
+    for (struct addrinfo *It = Info; It != NULL && Out->Count < WEB_DNS_MAX_ADDRESSES; It = It->ai_next) {
+        if (It->ai_family != AF_INET || It->ai_addrlen != sizeof(struct sockaddr_in)) continue;
+        memcpy(&Out->Items[Out->Count++], It->ai_addr, sizeof(struct sockaddr_in));
+    }
+
+    freeaddrinfo(Info);
+    return Out->Count > 0;
+}
+
+static dns_entry *DnsShardFind(dns_shard *Shard, u64 Hash, const char *Hostname, uz HostnameCount) {
+    dns_entry *Entry = Shard->Buckets[Hash % DNS_BUCKETS_COUNT];
+    while (Entry != NULL) {
+        if (Entry->Hash == Hash && Entry->HostnameCount == HostnameCount && memcmp(Entry->Hostname, Hostname, HostnameCount) == 0) break;
+        Entry = Entry->Next;
+    }
+
+    return Entry;
+}
+
+static void DnsShardSweep(dns_shard *Shard, s64 Now) {
+    for (uz I = 0; I < DNS_BUCKETS_COUNT; ++I) {
+        dns_entry **Link = &Shard->Buckets[I];
+        while (*Link != NULL) {
+            dns_entry *Entry = *Link;
+            if (Entry->ExpiresAt > Now) {
+                Link = &Entry->Next;
+                continue;
+            }
+
+            *Link = Entry->Next;
+            free(Entry);
+            --Shard->Count;
+        }
+    }
+}
+
+// NOTE(oleh): The addresses of the entry are still good until it expires, the refresh is retried after
+// the negative TTL instead of on the very next lookup.
+static void DnsRefreshFailed(dns_entry *Entry, s64 Now) {
+    s64 NegativeTtlNs = (s64) __atomic_load_n(&DnsNegativeTtlMs, __ATOMIC_RELAXED) * 1000000ll;
+
+    Entry->Refreshing = 0;
+    Entry->RefreshAt = WEB_MIN(Now + NegativeTtlNs, Entry->ExpiresAt);
+}
+
+static void DnsStore(u64 Hash, const char *Hostname, uz HostnameCount, web_dns_addresses *Addresses, b32 Refresh) {
+    dns_shard *Shard = &DnsShards[Hash % DNS_SHARDS_COUNT];
+    s64 Now = DnsMonotonicNs();
+
+    WebMutexLock(&Shard->Mu);
+
+    dns_entry *Entry = DnsShardFind(Shard, Hash, Hostname, HostnameCount);
+
+    if (Entry == NULL) {
+        if (Shard->Count >= DNS_SHARD_MAX_ENTRIES) DnsShardSweep(Shard, Now);
+        if (Shard->Count >= DNS_SHARD_MAX_ENTRIES) {
+            WebMutexUnlock(&Shard->Mu);
+            return;
+        }
+
+        Entry = calloc(1, sizeof(*Entry));
+        Entry->Hash = Hash;
+        memcpy(Entry->Hostname, Hostname, HostnameCount);
+        Entry->HostnameCount = HostnameCount;
+
+        Entry->Next = Shard->Buckets[Hash % DNS_BUCKETS_COUNT];
+        Shard->Buckets[Hash % DNS_BUCKETS_COUNT] = Entry;
+        ++Shard->Count;
+    }
+
+    if (Refresh && Addresses->Count == 0) {
+        DnsRefreshFailed(Entry, Now);
+    } else {
+        s64 TtlNs = (s64) __atomic_load_n(Addresses->Count > 0 ? &DnsTtlMs : &DnsNegativeTtlMs, __ATOMIC_RELAXED) * 1000000ll;
+
+        Entry->Addresses = *Addresses;
+        Entry->ExpiresAt = Now + TtlNs;
+        // NOTE(oleh): In the last fifth of its lifetime.
+        Entry->RefreshAt = Now + TtlNs - TtlNs / 5;
+        Entry->Refreshing = 0;
+    }
+
+    WebMutexUnlock(&Shard->Mu);
+}
+
+static void *DnsRefreshProc(void *Arg) {
+    (void) Arg;
+
+    while (1) {
+        WebMutexLock(&DnsRefreshMu);
+        while (DnsRefreshQueue == NULL) pthread_cond_wait(&DnsRefreshCondVar, &DnsRefreshMu.Inner);
+
+        dns_refresh *Refresh = DnsRefreshQueue;
+        DnsRefreshQueue = Refresh->Next;
+        WebMutexUnlock(&DnsRefreshMu);
+
+        web_dns_addresses Addresses;
+        DnsLookup(Refresh->Hostname, &Addresses);
+
+        web_string_view Hostname = {.Items = (u8 *) Refresh->Hostname, .Count = Refresh->HostnameCount};
+        DnsStore(WebHashFnv1(Hostname), Refresh->Hostname, Refresh->HostnameCount, &Addresses, 1);
+
+        free(Refresh);
+    }
+
+    return NULL;
+}
+
+// NOTE(oleh): Returns 0 if the refresh thread couldn't be started.
+static b32 DnsRefreshEnqueue(const char *Hostname, uz HostnameCount) {
+    dns_refresh *Refresh = calloc(1, sizeof(*Refresh));
+    memcpy(Refresh->Hostname, Hostname, HostnameCount);
+    Refresh->HostnameCount = HostnameCount;
+
+    WebMutexLock(&DnsRefreshMu);
+
+    if (!DnsRefreshStarted) {
+        DnsRefreshStarted = WebThreadLaunch(&DnsRefreshThread, DnsRefreshProc, NULL);
+        if (!DnsRefreshStarted) {
+            WebMutexUnlock(&DnsRefreshMu);
+            WEB_LOG(ERROR, DNS, "Failed to launch the refresh thread");
+            free(Refresh);
+            return 0;
+        }
+
+        pthread_detach(DnsRefreshThread.Id);
+    }
+
+    Refresh->Next = DnsRefreshQueue;
+    DnsRefreshQueue = Refresh;
+    pthread_cond_signal(&DnsRefreshCondVar);
+
+    WebMutexUnlock(&DnsRefreshMu);
+    return 1;
+}
+
+b32 WebDnsResolve(web_string_view Hostname, web_dns_addresses *Out) {
+    Out->Count = 0;
+    if (Hostname.Count == 0 || Hostname.Count > DNS_MAX_HOSTNAME_SIZE) return 0;
+
+    char HostnameCStr[DNS_MAX_HOSTNAME_SIZE + 1];
+    for (uz I = 0; I < Hostname.Count; ++I) HostnameCStr[I] = WebCharToLower(Hostname.Items[I]);
+    HostnameCStr[Hostname.Count] = '\0';
+
+    struct sockaddr_in *Address = &Out->Items[0];
+    WEB_STRUCT_ZERO(Address);
+    if (inet_pton(AF_INET, HostnameCStr, &Address->sin_addr) == 1) {
+        Address->sin_family = AF_INET;
+        Out->Count = 1;
+        return 1;
+    }
+
+    pthread_once(&DnsOnce, DnsInit);
+
+    web_string_view Key = {.Items = (u8 *) HostnameCStr, .Count = Hostname.Count};
+    u64 Hash = WebHashFnv1(Key);
+    dns_shard *Shard = &DnsShards[Hash % DNS_SHARDS_COUNT];
+
+    WebMutexLock(&Shard->Mu);
+
+    dns_entry *Entry = DnsShardFind(Shard, Hash, HostnameCStr, Hostname.Count);
+    if (Entry != NULL) {
+        s64 Now = DnsMonotonicNs();
+
+        if (Now < Entry->ExpiresAt) {
+            *Out = Entry->Addresses;
+
+            // NOTE(oleh): Only positive answers are refreshed, failures are retried once they expire.
+            b32 Refresh = Out->Count > 0 && Now >= Entry->RefreshAt && !Entry->Refreshing;
+            if (Refresh) Entry->Refreshing = 1;
+
+            WebMutexUnlock(&Shard->Mu);
+
+            if (Refresh && !DnsRefreshEnqueue(HostnameCStr, Hostname.Count)) {
+                // NOTE(oleh): The entry may have been dropped while the lock wasn't held.
+                WebMutexLock(&Shard->Mu);
+                Entry = DnsShardFind(Shard, Hash, HostnameCStr, Hostname.Count);
+                if (Entry != NULL) DnsRefreshFailed(Entry, Now);
+                WebMutexUnlock(&Shard->Mu);
+            }
+
+            return Out->Count > 0;
+        }
+    }
+
+    WebMutexUnlock(&Shard->Mu);
+
+    // NOTE(oleh): Concurrent misses on the same host all go to the resolver, the last answer wins.
+    DnsLookup(HostnameCStr, Out);
+    DnsStore(Hash, HostnameCStr, Hostname.Count, Out, 0);
+
+    return Out->Count > 0;
+}
+
+void WebDnsFlush(void) {
+    pthread_once(&DnsOnce, DnsInit);
+
+    for (uz I = 0; I < DNS_SHARDS_COUNT; ++I) {
+        dns_shard *Shard = &DnsShards[I];
+
+        WebMutexLock(&Shard->Mu);
+        // NOTE(oleh): Everything counts as expired.
+        DnsShardSweep(Shard, INT64_MAX);
+        WebMutexUnlock(&Shard->Mu);
+    }
+}
@@ -0,0 +1,47 @@
+#ifndef DNS_H_
+#define DNS_H_
+
+#include "common.h"
+
+#include <netinet/in.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif // __cplusplus
+
+// NOTE(oleh): A process-wide cache in front of getaddrinfo. Only IPv4 addresses are looked up, which
+// is what the HTTP client connects to. getaddrinfo doesn't report the TTLs of the records, so every
+// answer is kept for the configured time instead. Hosts that keep being looked up are resolved again
+// in the background shortly before their entry expires, so they never wait for the resolver. Failed
+// lookups are cached too, for a shorter time.
+
+#define WEB_DNS_MAX_ADDRESSES 8
+
+typedef struct {
+    // NOTE(oleh): In the order getaddrinfo returned them, the ports are 0.
+    struct sockaddr_in Items[WEB_DNS_MAX_ADDRESSES];
+    u32 Count;
+} web_dns_addresses;
+
+typedef struct {
+    // NOTE(oleh): 60 seconds by default.
+    u32 TtlMs;
+    // NOTE(oleh): 5 seconds by default.
+    u32 NegativeTtlMs;
+} web_dns_config;
+
+// NOTE(oleh): Applies to the entries cached from now on.
+void WebDnsConfigure(web_dns_config *Config);
+
+// NOTE(oleh): Thread-safe. Numeric addresses are parsed without touching the cache. Returns 0 if the
+// host couldn't be resolved, either right now or recently.
+b32 WebDnsResolve(web_string_view Hostname, web_dns_addresses *Out);
+
+// NOTE(oleh): Forgets every cached answer.
+void WebDnsFlush(void);
+
+#ifdef __cplusplus
+}
+#endif // __cplusplus
+
+#endif // DNS_H_
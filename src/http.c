@@ -1,12 +1,33 @@
+#define _GNU_SOURCE
+
 #include "http.h"
 #include "threadpool.h"
 #include "log.h"
+#include "compress.h"
+#include "http2.h"
+#include "dns.h"
+
+#ifdef WEB_USE_IO_URING
+#include "uring.h"
+#endif // WEB_USE_IO_URING
 
 #include <sys/socket.h>
 #include <sys/types.h>
+#include <sys/epoll.h>
+#include <sys/uio.h>
+#include <sys/sendfile.h>
+#include <sys/stat.h>
 #include <netdb.h>
+#include <poll.h>
 
 #include <errno.h>
+#include <limits.h>
+#include <fcntl.h>
+#include <time.h>
+
+#ifdef __x86_64__
+#include <immintrin.h>
+#endif // __x86_64__
 
 static const char *HttpVersionStrings[] = {
 #define X(Version, String) [HTTP_##Version] = String,
@@ -20,11 +41,166 @@ WEB_ENUM_HTTP_METHODS
 #undef X
 };
 
-const char *WebHttpGetResponseStatusReason(web_http_response_status Status) {
-#define X(Name, Code, Reason) if (Status == HTTP_STATUS_##Name) return Reason;
+// NOTE(oleh): Indexed by the status code itself.
+#define HTTP_STATUS_CODES_COUNT 600
+
+static const char *HttpStatusReasons[HTTP_STATUS_CODES_COUNT] = {
+#define X(Name, Code, Reason) [Code] = Reason,
 WEB_ENUM_HTTP_RESPONSE_STATUSES
 #undef X
-    WEB_PANIC_FMT("Unknown response status %d", Status);
+};
+
+#define HTTP_STATUS_LINE(VersionString, Code, Reason) { \
+        .Items = (u8 *) VersionString " " #Code " " Reason "\r\n", \
+        .Count = sizeof(VersionString " " #Code " " Reason "\r\n") - 1, \
+    }
+
+// NOTE(oleh): Complete status lines for every version and status, so that a response head starts
+// with a single memcpy.
+static const web_string_view HttpStatusLines[][HTTP_STATUS_CODES_COUNT] = {
+    [HTTP_1_0] = {
+#define X(Name, Code, Reason) [Code] = HTTP_STATUS_LINE("HTTP/1.0", Code, Reason),
+        WEB_ENUM_HTTP_RESPONSE_STATUSES
+#undef X
+    },
+    [HTTP_1_1] = {
+#define X(Name, Code, Reason) [Code] = HTTP_STATUS_LINE("HTTP/1.1", Code, Reason),
+        WEB_ENUM_HTTP_RESPONSE_STATUSES
+#undef X
+    },
+};
+
+static s64 HttpMonotonicNs(void) {
+    struct timespec Now;
+    clock_gettime(CLOCK_MONOTONIC, &Now);
+    return (s64) Now.tv_sec * 1000000000ll + Now.tv_nsec;
+}
+
+const char *WebHttpGetResponseStatusReason(web_http_response_status Status) {
+    if ((uz) Status >= HTTP_STATUS_CODES_COUNT || HttpStatusReasons[Status] == NULL) {
+        WEB_PANIC_FMT("Unknown response status %d", Status);
+    }
+
+    return HttpStatusReasons[Status];
+}
+
+static web_string_view HttpStatusLine(web_http_version Version, web_http_response_status Status) {
+    if ((uz) Status >= HTTP_STATUS_CODES_COUNT || HttpStatusLines[Version][Status].Items == NULL) {
+        WEB_PANIC_FMT("Unknown response status %d", Status);
+    }
+
+    return HttpStatusLines[Version][Status];
+}
+
+static const web_string_view HttpKnownHeaderNames[] = {
+#define X(Name, String) [HTTP_HEADER_##Name] = {.Items = (u8 *) String, .Count = sizeof(String) - 1},
+    WEB_ENUM_HTTP_KNOWN_HEADERS
+#undef X
+};
+
+// NOTE(oleh): A perfect hash of the known header names, folded to lower case. It was found by
+// brute-forcing the multipliers until no two names collide, so it has to be redone whenever
+// WEB_ENUM_HTTP_KNOWN_HEADERS changes (the tests will tell).
+#define HTTP_KNOWN_HEADERS_HASH_SIZE 128
+
+static inline uz HttpKnownHeaderHash(web_string_view Name) {
+    u8 First = WebCharToLower(Name.Items[0]);
+    u8 Middle = WebCharToLower(Name.Items[Name.Count / 2]);
+    u8 Last = WebCharToLower(Name.Items[Name.Count - 1]);
+    return (Name.Count + First * 27 + Last * 6 + Middle) & (HTTP_KNOWN_HEADERS_HASH_SIZE - 1);
+}
+
+// NOTE(oleh): Header id + 1, 0 for the free slots.
+static const u8 HttpKnownHeadersTable[HTTP_KNOWN_HEADERS_HASH_SIZE] = {
+    [1] = HTTP_HEADER_TE + 1,
+    [4] = HTTP_HEADER_FORWARDED + 1,
+    [18] = HTTP_HEADER_KEEP_ALIVE + 1,
+    [20] = HTTP_HEADER_ACCEPT_LANGUAGE + 1,
+    [25] = HTTP_HEADER_ACCEPT_ENCODING + 1,
+    [28] = HTTP_HEADER_CONTENT_LENGTH + 1,
+    [29] = HTTP_HEADER_HTTP2_SETTINGS + 1,
+    [30] = HTTP_HEADER_REFERER + 1,
+    [36] = HTTP_HEADER_VIA + 1,
+    [39] = HTTP_HEADER_HOST + 1,
+    [46] = HTTP_HEADER_UPGRADE + 1,
+    [50] = HTTP_HEADER_X_REAL_IP + 1,
+    [54] = HTTP_HEADER_ORIGIN + 1,
+    [55] = HTTP_HEADER_X_FORWARDED_PROTO + 1,
+    [56] = HTTP_HEADER_LAST_MODIFIED + 1,
+    [62] = HTTP_HEADER_VARY + 1,
+    [64] = HTTP_HEADER_COOKIE + 1,
+    [69] = HTTP_HEADER_AUTHORIZATION + 1,
+    [73] = HTTP_HEADER_SERVER + 1,
+    [74] = HTTP_HEADER_EXPECT + 1,
+    [79] = HTTP_HEADER_CONTENT_TYPE + 1,
+    [80] = HTTP_HEADER_CONTENT_ENCODING + 1,
+    [85] = HTTP_HEADER_X_FORWARDED_FOR + 1,
+    [87] = HTTP_HEADER_RANGE + 1,
+    [88] = HTTP_HEADER_TRAILER + 1,
+    [90] = HTTP_HEADER_IF_RANGE + 1,
+    [93] = HTTP_HEADER_ACCESS_CONTROL_REQUEST_METHOD + 1,
+    [94] = HTTP_HEADER_ACCEPT + 1,
+    [96] = HTTP_HEADER_WWW_AUTHENTICATE + 1,
+    [98] = HTTP_HEADER_DATE + 1,
+    [100] = HTTP_HEADER_TRANSFER_ENCODING + 1,
+    [105] = HTTP_HEADER_CACHE_CONTROL + 1,
+    [106] = HTTP_HEADER_IF_UNMODIFIED_SINCE + 1,
+    [107] = HTTP_HEADER_IF_MODIFIED_SINCE + 1,
+    [108] = HTTP_HEADER_IF_MATCH + 1,
+    [113] = HTTP_HEADER_X_REQUEST_ID + 1,
+    [114] = HTTP_HEADER_CONNECTION + 1,
+    [116] = HTTP_HEADER_LOCATION + 1,
+    [117] = HTTP_HEADER_IF_NONE_MATCH + 1,
+    [118] = HTTP_HEADER_ETAG + 1,
+    [119] = HTTP_HEADER_SEC_WEBSOCKET_KEY + 1,
+    [120] = HTTP_HEADER_SET_COOKIE + 1,
+    [122] = HTTP_HEADER_USER_AGENT + 1,
+    [125] = HTTP_HEADER_ACCESS_CONTROL_REQUEST_HEADERS + 1,
+};
+
+web_http_header_id WebHttpHeaderId(web_string_view Name) {
+    if (Name.Count == 0) return HTTP_HEADER_UNKNOWN;
+
+    u8 Entry = HttpKnownHeadersTable[HttpKnownHeaderHash(Name)];
+    if (Entry == 0) return HTTP_HEADER_UNKNOWN;
+
+    web_http_header_id Id = (web_http_header_id) (Entry - 1);
+    web_string_view Known = HttpKnownHeaderNames[Id];
+    if (Known.Count != Name.Count) return HTTP_HEADER_UNKNOWN;
+
+    for (uz I = 0; I < Name.Count; ++I) {
+        if (WebCharToLower(Name.Items[I]) != WebCharToLower(Known.Items[I])) return HTTP_HEADER_UNKNOWN;
+    }
+
+    return Id;
+}
+
+b32 WebHttpRequestGetHeader(web_http_request *Request, web_string_view Name, web_string_view *OutValue) {
+    web_http_header_id Id = WebHttpHeaderId(Name);
+    if (Id != HTTP_HEADER_UNKNOWN) return WebHttpRequestGetKnownHeader(Request, Id, OutValue);
+
+    for (uz I = 0; I < Request->Headers.Count; ++I) {
+        web_http_header *Header = &Request->Headers.Items[I];
+        if (Header->Name.Count != Name.Count) continue;
+
+        uz J = 0;
+        while (J < Name.Count && WebCharToLower(Header->Name.Items[J]) == WebCharToLower(Name.Items[J])) ++J;
+
+        if (J == Name.Count) {
+            *OutValue = Header->Value;
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+// NOTE(oleh): Call right after pushing `Header` onto `Headers`.
+static web_http_header_id HttpKnownHeadersRecord(u32 *KnownHeaders, web_http_headers *Headers, web_http_header Header) {
+    web_http_header_id Id = WebHttpHeaderId(Header.Name);
+    if (Id != HTTP_HEADER_UNKNOWN && KnownHeaders[Id] == 0) KnownHeaders[Id] = Headers->Count;
+
+    return Id;
 }
 
 static void HttpHeadersFormat(web_arena *Arena, web_dynamic_string *String, web_http_headers Headers) {
@@ -47,836 +223,4724 @@ static void HttpHeadersFormat(web_arena *Arena, web_dynamic_string *String, web_
     }
 }
 
-#define WEB_HTTP_RESPONSE_MAX_SIZE (128l * 1024l * 512l)
-
-b32 WebHttpRequestSend(web_arena *ResponseArena,
-                       web_string_view Hostname,
-                       u16 Port,
-                       web_http_request Request,
-                       web_http_response *Response) {
-    web_arena *Temp = WebGetTempArena();
-    b32 Result = 1;
-
-    struct addrinfo Hints = {0};
-    struct addrinfo* ServerAddr = NULL;
+// NOTE(oleh): Parses a comma separated list of connection options (the value of a Connection header)
+// on top of the version's default. (https://datatracker.ietf.org/doc/html/rfc7230#section-6.3)
+static b32 HttpConnectionOptionsKeepAlive(web_http_version Version, web_string_view Connection) {
+    b32 KeepAlive = Version != HTTP_1_0;
 
-    Hints.ai_family = AF_INET;
-    Hints.ai_socktype = SOCK_STREAM;
-    Hints.ai_flags = AI_PASSIVE;
+    uz OptionStart = 0;
+    for (uz I = 0; I <= Connection.Count; ++I) {
+        if (I < Connection.Count && Connection.Items[I] != ',') continue;
 
-    const char *HostnameCStr = WebStringViewCloneCStr(Temp, Hostname);
+        web_string_view Option = {.Items = Connection.Items + OptionStart, .Count = I - OptionStart};
+        while (Option.Count > 0 && Option.Items[0] == ' ') {
+            ++Option.Items;
+            --Option.Count;
+        }
+        while (Option.Count > 0 && Option.Items[Option.Count - 1] == ' ') --Option.Count;
 
-    char PortCStr[6] = {0};
-    sprintf(PortCStr, "%hu", Port);
+        if (WebStringViewEqualCStrIgnoreCase(Option, "close"))      KeepAlive = 0;
+        if (WebStringViewEqualCStrIgnoreCase(Option, "keep-alive")) KeepAlive = 1;
 
-    sz Status = getaddrinfo(HostnameCStr, PortCStr, &Hints, &ServerAddr);
-    if (Status != 0) {
-        // FIXME(oleh): Report an error.
-        Result = 0;
-        goto End;
+        OptionStart = I + 1;
     }
 
-    int ServerSock = socket(ServerAddr->ai_family, ServerAddr->ai_socktype, 0);
-    if (ServerSock == -1) {
-        // FIXME(oleh): Report an error.
-        Result = 0;
-        goto End;
-    }
+    return KeepAlive;
+}
 
-    Status = connect(ServerSock, ServerAddr->ai_addr, ServerAddr->ai_addrlen);
-    if (Status != 0) {
-        Result = 0;
-        goto End;
+static b32 HttpHeadersFind(web_http_headers Headers, const char *Name, web_string_view *OutValue) {
+    for (uz I = 0; I < Headers.Count; ++I) {
+        if (WebStringViewEqualCStrIgnoreCase(Headers.Items[I].Name, Name)) {
+            *OutValue = Headers.Items[I].Value;
+            return 1;
+        }
     }
 
-    const char *VersionString = HttpVersionStrings[Request.Version];
-    web_string_view VersionSv = WEB_SV_LIT(VersionString);
-
-    const char *MethodString = HttpMethodNames[Request.Method];
-    web_string_view MethodSv = WEB_SV_LIT(MethodString);
+    return 0;
+}
 
-    web_dynamic_string RequestString;
-    WEB_ARRAY_INIT(Temp, &RequestString);
+#define WEB_HTTP_RESPONSE_MAX_SIZE (128l * 1024l * 512l)
 
-    // Request line.
-    WEB_ARRAY_EXTEND(Temp, &RequestString, &MethodSv);
-    WEB_ARRAY_PUSH(Temp, &RequestString, ' ');
-    WEB_ARRAY_EXTEND(Temp, &RequestString, &Request.Path);
-    WEB_ARRAY_PUSH(Temp, &RequestString, ' ');
-    WEB_ARRAY_EXTEND(Temp, &RequestString, &VersionSv);
-    WEB_ARRAY_PUSH(Temp, &RequestString, '\r');
-    WEB_ARRAY_PUSH(Temp, &RequestString, '\n');
+#define HTTP_CLIENT_DEFAULT_MAX_CONNECTIONS_PER_HOST 8
+#define HTTP_CLIENT_DEFAULT_IDLE_TIMEOUT_MS 30000
+#define HTTP_CLIENT_DEFAULT_TIMEOUT_MS 30000
+// NOTE(oleh): How often the idle connections of all the hosts are looked at, the ones of the host
+// being connected to are checked on every request anyway.
+#define HTTP_CLIENT_SWEEP_INTERVAL_NS 1000000000ll
 
-    // Headers.
-    HttpHeadersFormat(Temp, &RequestString, Request.Headers);
-    WEB_ARRAY_PUSH(Temp, &RequestString, '\r');
-    WEB_ARRAY_PUSH(Temp, &RequestString, '\n');
+typedef struct {
+    int Fd;
+    s64 IdleSince;
+} http_client_idle_connection;
+
+typedef struct http_client_host http_client_host;
+struct http_client_host {
+    http_client_host *Next;
+    char *Hostname;
+    u16 Port;
+
+    // NOTE(oleh): Oldest first. Requests take the newest one, which is the least likely to have been
+    // closed by the server in the meantime.
+    http_client_idle_connection *Idle;
+    u32 IdleCount;
+    // NOTE(oleh): Idle ones included, never more than the client's `MaxConnectionsPerHost`.
+    u32 OpenCount;
+};
 
-    // Body.
-    WEB_ARRAY_EXTEND(Temp, &RequestString, &Request.Body);
+struct web_http_client {
+    web_mutex Mu;
+    // NOTE(oleh): Signalled whenever a connection goes back to the pool or gets closed, for the
+    // requests that are waiting on a host at its limit.
+    pthread_cond_t Released;
+
+    // NOTE(oleh): A handful of upstreams at most, so a list is fine.
+    http_client_host *Hosts;
+    u32 MaxConnectionsPerHost;
+    s64 IdleTimeoutNs;
+    u32 TimeoutMs;
+    s64 NextSweep;
+};
 
-    Status = write(ServerSock, RequestString.Items, RequestString.Count);
-    if (Status == -1) {
-        Result = 0;
-        goto End;
+web_http_client *WebHttpClientCreate(web_http_client_config *Config) {
+    web_http_client *Client = calloc(1, sizeof(*Client));
+    WebMutexInit(&Client->Mu);
+
+    // NOTE(oleh): The slot waits have a deadline, which must not move with the wall clock.
+    pthread_condattr_t CondAttr;
+    pthread_condattr_init(&CondAttr);
+    pthread_condattr_setclock(&CondAttr, CLOCK_MONOTONIC);
+    pthread_cond_init(&Client->Released, &CondAttr);
+    pthread_condattr_destroy(&CondAttr);
+
+    Client->MaxConnectionsPerHost = HTTP_CLIENT_DEFAULT_MAX_CONNECTIONS_PER_HOST;
+    Client->TimeoutMs = HTTP_CLIENT_DEFAULT_TIMEOUT_MS;
+    u32 IdleTimeoutMs = HTTP_CLIENT_DEFAULT_IDLE_TIMEOUT_MS;
+
+    if (Config != NULL) {
+        if (Config->MaxConnectionsPerHost > 0) Client->MaxConnectionsPerHost = Config->MaxConnectionsPerHost;
+        if (Config->IdleTimeoutMs > 0) IdleTimeoutMs = Config->IdleTimeoutMs;
+        if (Config->TimeoutMs > 0) Client->TimeoutMs = Config->TimeoutMs;
     }
 
-    uz ResponseArenaAvailableMemory = ResponseArena->Capacity - ResponseArena->Offset;
-    uz ResponseBufferCount = WEB_MIN(ResponseArenaAvailableMemory / 16, WEB_HTTP_RESPONSE_MAX_SIZE);
-    u8 *ResponseBuffer = WebArenaPush(ResponseArena, ResponseBufferCount);
+    Client->IdleTimeoutNs = (s64) IdleTimeoutMs * 1000000ll;
+    return Client;
+}
 
-    Status = read(ServerSock, ResponseBuffer, ResponseBufferCount);
-    if (Status == -1) {
-        Result = 0;
-        goto End;
-    }
+void WebHttpClientDestroy(web_http_client *Client) {
+    http_client_host *Host = Client->Hosts;
+    while (Host != NULL) {
+        http_client_host *Next = Host->Next;
 
-    web_string_view ResponseSv = {
-        .Items = ResponseBuffer,
-        .Count = Status,
-    };
+        for (u32 I = 0; I < Host->IdleCount; ++I) close(Host->Idle[I].Fd);
+        free(Host->Idle);
+        free(Host->Hostname);
+        free(Host);
 
-    if (!WebHttpResponseParse(ResponseArena, ResponseSv, Response)) {
-        Result = 0;
-        goto End;
+        Host = Next;
     }
 
-End:
-    if (ServerAddr != NULL) {
-        freeaddrinfo(ServerAddr);
+    pthread_cond_destroy(&Client->Released);
+    pthread_mutex_destroy(&Client->Mu.Inner);
+    free(Client);
+}
+
+// NOTE(oleh): Call with the client's mutex held.
+static void HttpClientHostExpire(web_http_client *Client, http_client_host *Host, s64 Now) {
+    u32 Expired = 0;
+    while (Expired < Host->IdleCount && Now - Host->Idle[Expired].IdleSince >= Client->IdleTimeoutNs) {
+        close(Host->Idle[Expired].Fd);
+        ++Expired;
     }
 
-    return Result;
-}
+    if (Expired == 0) return;
 
-static sz HttpRequestParseHeader(u8 *Buffer,
-                                 uz BufferCount,
-                                 web_http_header *Header) {
-    uz I = 0;
+    Host->IdleCount -= Expired;
+    Host->OpenCount -= Expired;
+    memmove(Host->Idle, Host->Idle + Expired, Host->IdleCount * sizeof(*Host->Idle));
+    pthread_cond_broadcast(&Client->Released);
+}
 
-    for (; I < BufferCount; ++I) {
-        if (Buffer[I] == ':') break;
-    }
+// NOTE(oleh): An idle connection must not have anything to read. End of file means the server has
+// closed it, anything else is garbage that would be taken for the next response.
+static b32 HttpClientConnectionAlive(int Fd) {
+    u8 Byte;
+    sz N = recv(Fd, &Byte, 1, MSG_PEEK | MSG_DONTWAIT);
+    return N == -1 && (errno == EAGAIN || errno == EWOULDBLOCK);
+}
 
-    if (I >= BufferCount) {
-        return -1;
-    }
+// NOTE(oleh): Waits for a non-blocking connect to finish, at most `TimeoutMs`.
+static b32 HttpClientWaitConnected(int Fd, u32 TimeoutMs) {
+    s64 Deadline = HttpMonotonicNs() + (s64) TimeoutMs * 1000000ll;
 
-    Header->Name = (web_string_view) {.Items = Buffer, .Count = I};
+    while (1) {
+        s64 Left = Deadline - HttpMonotonicNs();
+        if (Left <= 0) {
+            errno = ETIMEDOUT;
+            return 0;
+        }
 
-    uz HeaderValueStart = I + 2;
+        struct pollfd Poll = {.fd = Fd, .events = POLLOUT};
+        int Ready = poll(&Poll, 1, (int) ((Left + 999999) / 1000000));
+        if (Ready == -1) {
+            if (errno == EINTR) continue;
+            return 0;
+        }
 
-    for (I = HeaderValueStart; I < BufferCount; ++I) {
-        if (Buffer[I] == '\r') break;
+        if (Ready == 1) break;
     }
 
-    if (I >= BufferCount) {
-        return -1;
-    }
+    int Error = 0;
+    socklen_t ErrorSize = sizeof(Error);
+    if (getsockopt(Fd, SOL_SOCKET, SO_ERROR, &Error, &ErrorSize) == -1) return 0;
 
-    if (BufferCount - I <= 1) {
-        return -1;
-    }
+    errno = Error;
+    return Error == 0;
+}
 
-    u8 NewlineChar = Buffer[I + 1];
-    if (NewlineChar != '\n') {
+// NOTE(oleh): Tries the addresses of the host in order. A non-blocking connect is still in progress
+// when this returns, the socket turns writable once it is done. A blocking one gives up on an address
+// after `TimeoutMs`. Either way every send and receive on the socket times out after `TimeoutMs`.
+static int HttpClientConnect(web_string_view Hostname, u16 Port, b32 NonBlocking, u32 TimeoutMs) {
+    web_dns_addresses Addresses;
+    if (!WebDnsResolve(Hostname, &Addresses)) {
+        WEB_LOG_FMT(WARN, HTTP, "Failed to resolve '" WEB_SV_FMT "'", WEB_SV_ARG(Hostname));
         return -1;
     }
 
-    Header->Value = (web_string_view) {.Items = Buffer + HeaderValueStart, .Count = I - HeaderValueStart};
+    struct timeval Timeout = {.tv_sec = TimeoutMs / 1000, .tv_usec = (TimeoutMs % 1000) * 1000};
 
-    return I + 2;
-}
+    for (u32 I = 0; I < Addresses.Count; ++I) {
+        struct sockaddr_in Address = Addresses.Items[I];
+        Address.sin_port = htons(Port);
 
-// TODO(oleh): This should be more strict, i.e. now it does not check that the ':' is before the CRLF.
-static b32 HttpHeadersParse(web_arena *Arena,
-                            web_string_view Buffer,
-                            uz *Offset,
-                            web_http_headers *Headers) {
-    b32 Result = 1;
-    uz I;
+        int ServerSock = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0);
+        if (ServerSock == -1) break;
 
-    for (I = *Offset; I < Buffer.Count; ) {
-        if (Buffer.Items[I] == '\r' && Buffer.Count - I > 1 && Buffer.Items[I + 1] == '\n') goto Success;
+        setsockopt(ServerSock, SOL_SOCKET, SO_RCVTIMEO, &Timeout, sizeof(Timeout));
+        setsockopt(ServerSock, SOL_SOCKET, SO_SNDTIMEO, &Timeout, sizeof(Timeout));
 
-        web_http_header Header = {0};
-        sz N = HttpRequestParseHeader(Buffer.Items + I, Buffer.Count - I, &Header);
-        if (N == -1) {
-            return 0;
+        b32 Connected = connect(ServerSock, (struct sockaddr *) &Address, sizeof(Address)) == 0;
+        if (!Connected && errno == EINPROGRESS) {
+            if (NonBlocking) return ServerSock;
+            Connected = HttpClientWaitConnected(ServerSock, TimeoutMs);
         }
 
-        I += N;
+        if (Connected) {
+            if (!NonBlocking) fcntl(ServerSock, F_SETFL, fcntl(ServerSock, F_GETFL) & ~O_NONBLOCK);
+            return ServerSock;
+        }
 
-        WEB_ARRAY_PUSH(Arena, Headers, Header);
+        int ConnectError = errno;
+        close(ServerSock);
+        errno = ConnectError;
     }
 
-    Result = 0;
-
-Success:
-    *Offset = I + 2;
-
-    return Result;
+    WEB_LOG_FMT(WARN, HTTP, "Failed to connect to '" WEB_SV_FMT ":%hu': %s", WEB_SV_ARG(Hostname), Port, strerror(errno));
+    return -1;
 }
 
-b32 WebHttpResponseParse(web_arena *Arena, web_string_view Buffer, web_http_response *OutResponse) {
-    // 1. Response line. (https://datatracker.ietf.org/doc/html/rfc2616#section-6.1)
-    // 1.1. Version.
-
-    uz I;
-    for (I = 0; I < Buffer.Count; ++I) {
-        if (Buffer.Items[I] == ' ') break;
+typedef enum {
+    // NOTE(oleh): `OutFd` is an idle connection out of the pool.
+    HTTP_CLIENT_ACQUIRE_IDLE,
+    // NOTE(oleh): The host had room for another connection, which the caller has to open. It counts
+    // against the host's limit until it is released, a failed connect has to be released as -1.
+    HTTP_CLIENT_ACQUIRE_NEW,
+    // NOTE(oleh): The host is at its limit, returned right away when not waiting, otherwise once the
+    // client's `TimeoutMs` ran out.
+    HTTP_CLIENT_ACQUIRE_BUSY,
+} http_client_acquire_result;
+
+static http_client_acquire_result HttpClientAcquireSlot(web_http_client *Client,
+                                                        web_string_view Hostname,
+                                                        u16 Port,
+                                                        b32 Wait,
+                                                        http_client_host **OutHost,
+                                                        int *OutFd) {
+    WebMutexLock(&Client->Mu);
+
+    http_client_host *Host = Client->Hosts;
+    while (Host != NULL && !(Host->Port == Port && WebStringViewEqualCStr(Hostname, Host->Hostname))) Host = Host->Next;
+
+    if (Host == NULL) {
+        Host = calloc(1, sizeof(*Host));
+        Host->Hostname = WebStringViewCloneCStrMalloc(Hostname);
+        Host->Port = Port;
+        Host->Idle = malloc(Client->MaxConnectionsPerHost * sizeof(*Host->Idle));
+        Host->Next = Client->Hosts;
+        Client->Hosts = Host;
     }
 
-    if (I >= Buffer.Count) return 0;
+    *OutHost = Host;
 
-    web_http_version HttpVersion;
-    web_string_view HttpVersionSv = {.Items = Buffer.Items, .Count = I};
-#define X(Version, VersionString) if (WebStringViewEqualCStr(HttpVersionSv, VersionString)) { \
-    HttpVersion = HTTP_##Version; \
-    goto ResponseVersionSuccess; \
+    struct timespec Deadline;
+    clock_gettime(CLOCK_MONOTONIC, &Deadline);
+    Deadline.tv_sec += Client->TimeoutMs / 1000;
+    Deadline.tv_nsec += (long) (Client->TimeoutMs % 1000) * 1000000l;
+    if (Deadline.tv_nsec >= 1000000000l) {
+        Deadline.tv_sec += 1;
+        Deadline.tv_nsec -= 1000000000l;
     }
-WEB_ENUM_HTTP_VERSIONS
-#undef X
 
-    // Failed to parse the version.
-    return 0;
+    while (1) {
+        s64 Now = HttpMonotonicNs();
+        if (Now >= Client->NextSweep) {
+            for (http_client_host *Other = Client->Hosts; Other != NULL; Other = Other->Next) {
+                HttpClientHostExpire(Client, Other, Now);
+            }
 
-ResponseVersionSuccess: ;
-    uz StatusCodeStart = I + 1;
+            Client->NextSweep = Now + HTTP_CLIENT_SWEEP_INTERVAL_NS;
+        } else {
+            HttpClientHostExpire(Client, Host, Now);
+        }
 
-    for (I = StatusCodeStart; I < Buffer.Count; ++I) {
-        if (Buffer.Items[I] == ' ') break;
-    }
+        while (Host->IdleCount > 0) {
+            int Fd = Host->Idle[--Host->IdleCount].Fd;
+            if (HttpClientConnectionAlive(Fd)) {
+                WebMutexUnlock(&Client->Mu);
+                *OutFd = Fd;
+                return HTTP_CLIENT_ACQUIRE_IDLE;
+            }
 
-    if (I >= Buffer.Count) return 0;
+            close(Fd);
+            --Host->OpenCount;
+        }
 
-    s64 StatusCodeNum;
-    web_string_view StatusCodeSv = {.Items = Buffer.Items + StatusCodeStart, .Count = I - StatusCodeStart};
-    if (!WebParseS64(StatusCodeSv, &StatusCodeNum)) return 0;
+        if (Host->OpenCount < Client->MaxConnectionsPerHost) break;
 
-    web_http_response_status StatusCode;
+        if (!Wait) {
+            WebMutexUnlock(&Client->Mu);
+            return HTTP_CLIENT_ACQUIRE_BUSY;
+        }
 
-    uz ReasonStart = I + 1;
-    for (I = ReasonStart; I < Buffer.Count; ++I) {
-        if (Buffer.Items[I] == '\r') break;
+        if (pthread_cond_timedwait(&Client->Released, &Client->Mu.Inner, &Deadline) == ETIMEDOUT) {
+            WebMutexUnlock(&Client->Mu);
+            WEB_LOG_FMT(WARN, HTTP, "Timed out waiting for a connection to '" WEB_SV_FMT ":%hu'", WEB_SV_ARG(Hostname), Port);
+            return HTTP_CLIENT_ACQUIRE_BUSY;
+        }
     }
 
-    web_string_view ReasonPhrase = {.Items = Buffer.Items + ReasonStart, .Count = I - ReasonStart};
+    ++Host->OpenCount;
+    WebMutexUnlock(&Client->Mu);
 
-    ++I;
-    if (I >= Buffer.Count) return 0;
+    *OutFd = -1;
+    return HTTP_CLIENT_ACQUIRE_NEW;
+}
 
-    if (Buffer.Items[I] != '\n') return 0;
+static void HttpClientRelease(web_http_client *Client, http_client_host *Host, int Fd, b32 Reuse) {
+    WebMutexLock(&Client->Mu);
 
-    // NOTE(oleh): This reason phrase is not required to be matching the status code, so maybe
-    // we should just not check if it matches?
-#define X(Name, Code, Reason) if (StatusCodeNum == Code && WebStringViewEqualCStr(ReasonPhrase, Reason)) { StatusCode = HTTP_STATUS_##Name; goto ResponseStatusSuccess; }
-WEB_ENUM_HTTP_RESPONSE_STATUSES
-#undef X
+    if (Reuse) {
+        Host->Idle[Host->IdleCount++] = (http_client_idle_connection) {.Fd = Fd, .IdleSince = HttpMonotonicNs()};
+    } else {
+        if (Fd != -1) close(Fd);
+        --Host->OpenCount;
+    }
 
-    // Failed to parse response status code.
-    return 0;
-ResponseStatusSuccess: ;
-    ++I;
+    // NOTE(oleh): The waiters of every host share the condition variable, a single wakeup could go to
+    // one waiting for another host.
+    pthread_cond_broadcast(&Client->Released);
+    WebMutexUnlock(&Client->Mu);
+}
 
-    web_http_headers Headers;
-    WEB_ARRAY_INIT(Arena, &Headers);
+// NOTE(oleh): Hands out an idle connection to the host if there is one, otherwise opens a new one,
+// waiting for another request to finish if the host is at its limit. Returns -1 if connecting failed
+// or no connection freed up in time.
+static int HttpClientAcquire(web_http_client *Client,
+                             web_string_view Hostname,
+                             u16 Port,
+                             http_client_host **OutHost,
+                             b32 *OutReused) {
+    int Fd;
+    http_client_acquire_result Result = HttpClientAcquireSlot(Client, Hostname, Port, 1, OutHost, &Fd);
+
+    *OutReused = Result == HTTP_CLIENT_ACQUIRE_IDLE;
+    if (Result == HTTP_CLIENT_ACQUIRE_IDLE) return Fd;
+    if (Result == HTTP_CLIENT_ACQUIRE_BUSY) return -1;
+
+    Fd = HttpClientConnect(WEB_SV_LIT((*OutHost)->Hostname), Port, 0, Client->TimeoutMs);
+    if (Fd == -1) HttpClientRelease(Client, *OutHost, -1, 0);
+
+    return Fd;
+}
 
-    if (!HttpHeadersParse(Arena, Buffer, &I, &Headers)) return 0;
+// NOTE(oleh): Reads a response as its bytes come in and finds where it ends. Chunked bodies are
+// decoded in place, so the buffer always holds the head followed by as much of the plain body as has
+// arrived. The buffer is malloc'ed and grows with the response, bodies with a Content-Length get
+// exactly the room they need. With a `Sink` the body is handed over piece by piece instead and only
+// the head is kept.
+typedef enum {
+    HTTP_CLIENT_READER_HEAD,
+    HTTP_CLIENT_READER_BODY,
+    HTTP_CLIENT_READER_UNTIL_CLOSE,
+    HTTP_CLIENT_READER_CHUNK_SIZE,
+    HTTP_CLIENT_READER_CHUNK_DATA,
+    HTTP_CLIENT_READER_CHUNK_DATA_END,
+    HTTP_CLIENT_READER_TRAILERS,
+    HTTP_CLIENT_READER_DONE,
+} http_client_reader_state;
 
-    web_string_view ResponseBody = {.Items = Buffer.Items + I, .Count = Buffer.Count - I};
+typedef enum {
+    HTTP_CLIENT_READ_ERROR,
+    HTTP_CLIENT_READ_INCOMPLETE,
+    HTTP_CLIENT_READ_DONE,
+} http_client_read_result;
 
-    OutResponse->Version = HttpVersion;
-    OutResponse->Body = ResponseBody;
-    OutResponse->Status = StatusCode;
-    OutResponse->Headers = Headers;
-    return 1;
+#define HTTP_CLIENT_READ_SIZE 4096
+#define HTTP_CLIENT_READER_MAX_LINE_SIZE (8 * 1024)
+#define HTTP_CLIENT_READER_MAX_HEAD_SIZE (64 * 1024)
+// NOTE(oleh): Upper bound for a single read into a streamed body.
+#define HTTP_CLIENT_READER_SINK_READ_SIZE (64 * 1024)
+
+typedef struct {
+    u8 *Items;
+    uz Count;
+    uz Capacity;
+
+    web_http_body_proc Sink;
+    void *SinkData;
+
+    http_client_reader_state State;
+    // NOTE(oleh): Everything before it has been looked at.
+    uz Offset;
+    u64 Remaining;
+    uz HeadSize;
+    // NOTE(oleh): The decoded body is in [HeadSize, BodyEnd).
+    uz BodyEnd;
+    // NOTE(oleh): The body had no framing, the connection can't be used for anything else.
+    b32 UntilClose;
+    // NOTE(oleh): Over the whole response, including what was handed to the sink.
+    u64 Received;
+} http_client_reader;
+
+static void HttpClientReaderFree(http_client_reader *Reader) {
+    free(Reader->Items);
+    WEB_STRUCT_ZERO(Reader);
 }
 
-static sz HttpRequestParseRequestLine(u8 *Buffer,
-                                      uz BufferCount,
-                                      web_http_method *Method,
-                                      web_string_view *Path,
-                                      web_http_version *Version) {
-    uz I;
-    for (I = 0; I < BufferCount; ++I) {
-        if (Buffer[I] == ' ') break;
-    }
+// NOTE(oleh): Returns the free tail of the buffer, or NULL once a buffered response would go over
+// `WEB_HTTP_RESPONSE_MAX_SIZE`. Call `HttpClientReaderAdvance` after appending to it.
+static u8 *HttpClientReaderReserve(http_client_reader *Reader, uz *OutAvailable) {
+    b32 ExactSize = Reader->State == HTTP_CLIENT_READER_BODY && Reader->Remaining > 0;
 
-    if (I >= BufferCount) {
-        return -1;
+    uz Wanted = HTTP_CLIENT_READ_SIZE;
+    if (ExactSize) {
+        Wanted = Reader->Sink != NULL ? WEB_MIN(Reader->Remaining, HTTP_CLIENT_READER_SINK_READ_SIZE) : Reader->Remaining;
     }
 
-    web_http_method RequestMethod;
-    web_string_view RequestMethodSv = {.Items = Buffer, .Count = I};
-#define X(Method) if (WebStringViewEqualCStr(RequestMethodSv, #Method)) {  \
-        RequestMethod = HTTP_##Method;                                  \
-        goto RequestMethodSuccess;                                      \
-    }
+    if (Reader->Capacity - Reader->Count < Wanted) {
+        if (Reader->Count + Wanted > WEB_HTTP_RESPONSE_MAX_SIZE) return NULL;
 
-    WEB_ENUM_HTTP_METHODS
+        uz NewCapacity = Reader->Count + Wanted;
+        if (!ExactSize) NewCapacity = WEB_MIN(WEB_MAX(NewCapacity, Reader->Capacity * 2), WEB_HTTP_RESPONSE_MAX_SIZE);
 
-#undef X
+        Reader->Items = realloc(Reader->Items, NewCapacity);
+        Reader->Capacity = NewCapacity;
+    }
 
-    // Failed to parse the HTTP method.
+    *OutAvailable = Reader->Capacity - Reader->Count;
+    return Reader->Items + Reader->Count;
+}
+
+static s32 HttpHexDigitValue(u8 Char) {
+    if (Char >= '0' && Char <= '9') return Char - '0';
+    if (Char >= 'a' && Char <= 'f') return Char - 'a' + 10;
+    if (Char >= 'A' && Char <= 'F') return Char - 'A' + 10;
     return -1;
+}
 
- RequestMethodSuccess: ;
-    // 1.2. Request URI. (https://datatracker.ietf.org/doc/html/rfc2616#section-5.1.2)
-    // FIXME(oleh): Actually parse URI's.
+// NOTE(oleh): Looks at the head for the framing of the body. (https://datatracker.ietf.org/doc/html/rfc7230#section-3.3.3)
+static http_client_read_result HttpClientReaderHead(http_client_reader *Reader, uz HeadSize) {
+    web_string_view Head = {.Items = Reader->Items, .Count = HeadSize};
 
-    uz PathStart = I + 1;
+    uz LineEnd = 0;
+    while (LineEnd < Head.Count && Head.Items[LineEnd] != '\n') ++LineEnd;
+
+    // NOTE(oleh): "HTTP/1.1 200", the reason phrase doesn't matter.
+    if (LineEnd < 12 || Head.Items[8] != ' ') return HTTP_CLIENT_READ_ERROR;
 
-    for (I = PathStart; I < BufferCount; ++I) {
-        if (Buffer[I] == ' ') break;
+    s64 Status;
+    if (!WebParseS64((web_string_view) {.Items = Head.Items + 9, .Count = 3}, &Status)) return HTTP_CLIENT_READ_ERROR;
+
+    if (Status >= 100 && Status < 200) {
+        // NOTE(oleh): An interim response, the real one follows.
+        memmove(Reader->Items, Reader->Items + HeadSize, Reader->Count - HeadSize);
+        Reader->Count -= HeadSize;
+        Reader->Offset = 0;
+        return HTTP_CLIENT_READ_INCOMPLETE;
     }
 
-    if (I >= BufferCount) {
-        return -1;
+    Reader->HeadSize = HeadSize;
+    Reader->BodyEnd = HeadSize;
+    Reader->Offset = HeadSize;
+
+    if (Status == HTTP_STATUS_NO_CONTENT || Status == HTTP_STATUS_NOT_MODIFIED) {
+        Reader->State = HTTP_CLIENT_READER_DONE;
+        return HTTP_CLIENT_READ_INCOMPLETE;
     }
 
-    web_string_view RequestPath = {.Items = Buffer + PathStart, .Count = I - PathStart};
+    b32 Chunked = 0;
+    s64 ContentLength = -1;
 
-    // 1.3. HTTP version.
+    uz LineStart = LineEnd + 1;
+    while (LineStart < Head.Count) {
+        LineEnd = LineStart;
+        while (LineEnd < Head.Count && Head.Items[LineEnd] != '\n') ++LineEnd;
 
-    uz VersionStart = I + 1;
+        web_string_view Line = {.Items = Head.Items + LineStart, .Count = LineEnd - LineStart};
+        LineStart = LineEnd + 1;
 
-    for (I = VersionStart; I < BufferCount; ++I) {
-        if (Buffer[I] == '\r') break;
-    }
+        u8 *Colon = memchr(Line.Items, ':', Line.Count);
+        if (Colon == NULL) continue;
 
-    if (I >= BufferCount) {
-        return -1;
+        web_string_view Name = {.Items = Line.Items, .Count = Colon - Line.Items};
+        web_string_view Value = {.Items = Colon + 1, .Count = Line.Count - Name.Count - 1};
+        while (Value.Count > 0 && (Value.Items[0] == ' ' || Value.Items[0] == '\t')) {
+            ++Value.Items;
+            --Value.Count;
+        }
+        while (Value.Count > 0 && (Value.Items[Value.Count - 1] == '\r' || Value.Items[Value.Count - 1] == ' ')) --Value.Count;
+
+        if (WebStringViewEqualCStrIgnoreCase(Name, "Transfer-Encoding")) {
+            // NOTE(oleh): Chunked has to be the last coding if it's there at all.
+            Chunked = Value.Count >= 7 && WebStringViewEqualCStrIgnoreCase((web_string_view) {.Items = Value.Items + Value.Count - 7, .Count = 7}, "chunked");
+        } else if (WebStringViewEqualCStrIgnoreCase(Name, "Content-Length")) {
+            if (!WebParseS64(Value, &ContentLength) || ContentLength < 0) return HTTP_CLIENT_READ_ERROR;
+        }
     }
 
-    web_http_version RequestVersion;
-    web_string_view VersionSv = {.Items = Buffer + VersionStart, .Count = I - VersionStart};
+    if (Chunked) {
+        Reader->State = HTTP_CLIENT_READER_CHUNK_SIZE;
+    } else if (ContentLength >= 0) {
+        if (Reader->Sink == NULL && (u64) ContentLength > WEB_HTTP_RESPONSE_MAX_SIZE - HeadSize) return HTTP_CLIENT_READ_ERROR;
 
-#define X(Version, String) if (WebStringViewEqualCStr(VersionSv, String)) { \
-        RequestVersion = HTTP_##Version;                                \
-        goto RequestVersionSuccess;                                     \
+        Reader->State = HTTP_CLIENT_READER_BODY;
+        Reader->Remaining = ContentLength;
+    } else {
+        Reader->State = HTTP_CLIENT_READER_UNTIL_CLOSE;
+        Reader->UntilClose = 1;
     }
 
-    WEB_ENUM_HTTP_VERSIONS
-#undef X
+    return HTTP_CLIENT_READ_INCOMPLETE;
+}
 
-    // NOTE(oleh): Failed to recognize the HTTP version.
-    return -1;
- RequestVersionSuccess:
-    // 1.4. CRLF.
+// NOTE(oleh): Moves `Count` body bytes from `Offset` down to the end of the decoded body.
+static void HttpClientReaderTakeBody(http_client_reader *Reader, uz Count) {
+    if (Reader->BodyEnd != Reader->Offset) memmove(Reader->Items + Reader->BodyEnd, Reader->Items + Reader->Offset, Count);
 
-    if (BufferCount - I <= 1) {
-        return -1;
-    }
+    Reader->BodyEnd += Count;
+    Reader->Offset += Count;
+}
 
-    u8 NewlineChar = Buffer[I + 1];
-    if (NewlineChar != '\n') {
-        return -1;
-    }
+// NOTE(oleh): Hands the decoded body over to the sink and drops it from the buffer.
+static b32 HttpClientReaderFlush(http_client_reader *Reader) {
+    if (Reader->Sink == NULL || Reader->BodyEnd == Reader->HeadSize) return 1;
 
-    *Method = RequestMethod;
-    *Path = RequestPath;
-    *Version = RequestVersion;
+    web_string_view Body = {.Items = Reader->Items + Reader->HeadSize, .Count = Reader->BodyEnd - Reader->HeadSize};
+    if (!Reader->Sink(Reader->SinkData, Body)) return 0;
 
-    return I + 2;
+    uz Pending = Reader->Count - Reader->Offset;
+    memmove(Reader->Items + Reader->HeadSize, Reader->Items + Reader->Offset, Pending);
+    Reader->Count = Reader->HeadSize + Pending;
+    Reader->Offset = Reader->HeadSize;
+    Reader->BodyEnd = Reader->HeadSize;
+    return 1;
 }
 
-b32 WebHttpRequestParse(web_arena *Arena, web_string_view Buffer, web_http_request *OutRequest, web_string_view *Error) {
-    // 1. Request line. (https://datatracker.ietf.org/doc/html/rfc2616#section-5.1)
-    // 1.1. Method. (https://datatracker.ietf.org/doc/html/rfc2616#section-5.1.1)
-    sz N = HttpRequestParseRequestLine(Buffer.Items,
-                                       0,
-                                       &OutRequest->Method,
-                                       &OutRequest->Path,
-                                       &OutRequest->Version);
+static http_client_read_result HttpClientReaderAdvance(http_client_reader *Reader) {
+    while (1) {
+        u8 *Data = Reader->Items + Reader->Offset;
+        uz Available = Reader->Count - Reader->Offset;
+
+        switch (Reader->State) {
+        case HTTP_CLIENT_READER_HEAD: {
+            // NOTE(oleh): `Offset` is where the search for the blank line left off.
+            uz Start = Reader->Offset >= 3 ? Reader->Offset - 3 : 0;
+            uz HeadSize = 0;
+            for (uz I = Start; I + 4 <= Reader->Count; ++I) {
+                if (memcmp(Reader->Items + I, "\r\n\r\n", 4) == 0) {
+                    HeadSize = I + 4;
+                    break;
+                }
+            }
 
-    if (N == -1) {
-        *Error = WEB_SV_LIT("Could not parse the request line");
-        return 0;
-    }
+            if (HeadSize == 0) {
+                Reader->Offset = Reader->Count;
+                return Reader->Count > HTTP_CLIENT_READER_MAX_HEAD_SIZE ? HTTP_CLIENT_READ_ERROR : HTTP_CLIENT_READ_INCOMPLETE;
+            }
 
-    Buffer.Items += N;
-    Buffer.Count -= N;
+            if (HttpClientReaderHead(Reader, HeadSize) == HTTP_CLIENT_READ_ERROR) return HTTP_CLIENT_READ_ERROR;
+        } break;
 
-    // 2. Headers. (https://datatracker.ietf.org/doc/html/rfc2616#section-5.3)
-    // FIXME(oleh): Actually parse the headers according to their specification.
+        case HTTP_CLIENT_READER_BODY: {
+            HttpClientReaderTakeBody(Reader, WEB_MIN(Available, Reader->Remaining));
+            Reader->Remaining -= WEB_MIN(Available, Reader->Remaining);
 
-    web_http_headers Headers;
-    WEB_ARRAY_INIT(Arena, &Headers);
+            if (Reader->Remaining > 0) return HTTP_CLIENT_READ_INCOMPLETE;
+            Reader->State = HTTP_CLIENT_READER_DONE;
+        } break;
 
-    uz I = 0;
+        case HTTP_CLIENT_READER_UNTIL_CLOSE: {
+            HttpClientReaderTakeBody(Reader, Available);
+            return HTTP_CLIENT_READ_INCOMPLETE;
+        }
 
-    N = HttpHeadersParse(Arena, Buffer, &I, &Headers);
-    if (N == -1) {
-        *Error = WebArenaFormat(Arena,
-                                "could not parse the request headers: " WEB_SV_FMT,
-                                WEB_SV_ARG(*Error));
-        return 0;
-    }
+        case HTTP_CLIENT_READER_CHUNK_SIZE:
+        case HTTP_CLIENT_READER_TRAILERS: {
+            u8 *LineEnd = memchr(Data, '\n', Available);
+            if (LineEnd == NULL) {
+                return Available > HTTP_CLIENT_READER_MAX_LINE_SIZE ? HTTP_CLIENT_READ_ERROR : HTTP_CLIENT_READ_INCOMPLETE;
+            }
 
-    I += N;
+            uz LineSize = LineEnd - Data;
+            Reader->Offset += LineSize + 1;
+            if (LineSize > 0 && Data[LineSize - 1] == '\r') --LineSize;
 
-    WEB_ASSERT(I <= Buffer.Count);
+            // NOTE(oleh): Trailer fields are dropped.
+            if (Reader->State == HTTP_CLIENT_READER_TRAILERS) {
+                if (LineSize == 0) Reader->State = HTTP_CLIENT_READER_DONE;
+                break;
+            }
 
-    // 3. Message body. (https://datatracker.ietf.org/doc/html/rfc2616#section-4.3)
-    web_string_view RequestBody = {.Items = Buffer.Items + I, .Count = Buffer.Count - I};
+            u64 Size = 0;
+            uz I = 0;
+            for (; I < LineSize && HttpHexDigitValue(Data[I]) >= 0; ++I) {
+                if (Size > (UINT64_MAX >> 4)) return HTTP_CLIENT_READ_ERROR;
+                Size = Size * 16 + HttpHexDigitValue(Data[I]);
+            }
 
-    OutRequest->Headers = Headers;
-    OutRequest->Body = RequestBody;
+            // NOTE(oleh): Chunk extensions are ignored.
+            if (I == 0 || (I < LineSize && Data[I] != ';' && Data[I] != ' ' && Data[I] != '\t')) return HTTP_CLIENT_READ_ERROR;
 
-    return 1;
+            if (Size == 0) {
+                Reader->State = HTTP_CLIENT_READER_TRAILERS;
+            } else {
+                Reader->State = HTTP_CLIENT_READER_CHUNK_DATA;
+                Reader->Remaining = Size;
+            }
+        } break;
+
+        case HTTP_CLIENT_READER_CHUNK_DATA: {
+            HttpClientReaderTakeBody(Reader, WEB_MIN(Available, Reader->Remaining));
+            Reader->Remaining -= WEB_MIN(Available, Reader->Remaining);
+
+            if (Reader->Remaining > 0) return HTTP_CLIENT_READ_INCOMPLETE;
+            Reader->State = HTTP_CLIENT_READER_CHUNK_DATA_END;
+        } break;
+
+        case HTTP_CLIENT_READER_CHUNK_DATA_END: {
+            if (Available < 2) return HTTP_CLIENT_READ_INCOMPLETE;
+            if (Data[0] != '\r' || Data[1] != '\n') return HTTP_CLIENT_READ_ERROR;
+
+            Reader->Offset += 2;
+            Reader->State = HTTP_CLIENT_READER_CHUNK_SIZE;
+        } break;
+
+        case HTTP_CLIENT_READER_DONE: {
+            // NOTE(oleh): Anything past the response would have to be a response to a request that
+            // was never sent.
+            return Reader->Offset == Reader->Count ? HTTP_CLIENT_READ_DONE : HTTP_CLIENT_READ_ERROR;
+        }
+        }
+    }
 }
 
-static const char *GetHttpResponseStatusReasonPhrase(web_http_response_status Status) {
-    switch (Status) {
-#define X(Status, _Code, Phrase) case HTTP_STATUS_##Status: return Phrase;
-        WEB_ENUM_HTTP_RESPONSE_STATUSES
-#undef X
-    default: WEB_UNREACHABLE();
+// NOTE(oleh): Only a response that runs until the connection closes can end here.
+static http_client_read_result HttpClientReaderEnd(http_client_reader *Reader) {
+    if (Reader->State != HTTP_CLIENT_READER_UNTIL_CLOSE) return HTTP_CLIENT_READ_ERROR;
+
+    Reader->State = HTTP_CLIENT_READER_DONE;
+    return HTTP_CLIENT_READ_DONE;
+}
+
+// NOTE(oleh): Appends `Count` freshly received bytes, 0 meaning that the connection was closed.
+static http_client_read_result HttpClientReaderReceived(http_client_reader *Reader, uz Count) {
+    http_client_read_result Result;
+    if (Count == 0) {
+        Result = HttpClientReaderEnd(Reader);
+    } else {
+        Reader->Count += Count;
+        Reader->Received += Count;
+        Result = HttpClientReaderAdvance(Reader);
     }
+
+    if (Result != HTTP_CLIENT_READ_ERROR && !HttpClientReaderFlush(Reader)) Result = HTTP_CLIENT_READ_ERROR;
+    return Result;
 }
 
-typedef void *(*sync_pool_new_proc)(uz *Size);
+// NOTE(oleh): Parses the finished response into `Arena`, which gets a copy of the head and the body.
+static b32 HttpClientReaderFinish(http_client_reader *Reader, web_arena *Arena, web_http_response *Response) {
+    u8 *Buffer = WebArenaPush(Arena, Reader->BodyEnd);
+    memcpy(Buffer, Reader->Items, Reader->BodyEnd);
 
-typedef struct sync_pool_node {
-    struct sync_pool_node *Next;
-    u8 Item[];
-} sync_pool_node;
+    web_string_view ResponseSv = {.Items = Buffer, .Count = Reader->BodyEnd};
+    return WebHttpResponseParse(Arena, ResponseSv, Response);
+}
 
-typedef struct {
-    sync_pool_new_proc NewProc;
-    sync_pool_node *Head;
-    web_mutex Mu;
-} sync_pool;
+static b32 HttpClientResponseKeepAlive(web_http_response *Response) {
+    web_string_view Connection;
+    if (!HttpHeadersFind(Response->Headers, "Connection", &Connection)) return Response->Version != HTTP_1_0;
 
-static void SyncPoolInit(sync_pool *Pool, sync_pool_new_proc NewProc) {
-    WEB_STRUCT_ZERO(Pool);
-    Pool->NewProc = NewProc;
-    WebMutexInit(&Pool->Mu);
+    return HttpConnectionOptionsKeepAlive(Response->Version, Connection);
 }
 
-static void *SyncPoolAlloc(sync_pool *Pool) {
-    WebMutexLock(&Pool->Mu);
+typedef enum {
+    HTTP_CLIENT_EXCHANGE_OK,
+    HTTP_CLIENT_EXCHANGE_FAILED,
+    // NOTE(oleh): The connection broke before a single byte of the response came back.
+    HTTP_CLIENT_EXCHANGE_NO_RESPONSE,
+} http_client_exchange_result;
+
+static http_client_exchange_result HttpClientExchange(int Fd,
+                                                      web_string_view RequestString,
+                                                      http_client_reader *Reader,
+                                                      web_arena *ResponseArena,
+                                                      web_http_response *Response,
+                                                      b32 *OutReusable) {
+    *OutReusable = 0;
+
+    uz Written = 0;
+    while (Written < RequestString.Count) {
+        sz N = send(Fd, RequestString.Items + Written, RequestString.Count - Written, MSG_NOSIGNAL);
+        if (N == -1) {
+            if (errno == EINTR) continue;
+            // NOTE(oleh): A server that stopped taking data is not worth another try.
+            if (errno == EAGAIN || errno == EWOULDBLOCK) return HTTP_CLIENT_EXCHANGE_FAILED;
+            return HTTP_CLIENT_EXCHANGE_NO_RESPONSE;
+        }
+
+        Written += N;
+    }
+
+    while (1) {
+        uz Available;
+        u8 *Dest = HttpClientReaderReserve(Reader, &Available);
+        if (Dest == NULL) {
+            WEB_LOG(WARN, HTTP, "A response is too large to be buffered");
+            return HTTP_CLIENT_EXCHANGE_FAILED;
+        }
 
-    sync_pool_node *Node = NULL;
+        sz N = recv(Fd, Dest, Available, 0);
+        if (N == -1) {
+            if (errno == EINTR) continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                WEB_LOG(WARN, HTTP, "Timed out waiting for a response");
+                return HTTP_CLIENT_EXCHANGE_FAILED;
+            }
+
+            return Reader->Received == 0 ? HTTP_CLIENT_EXCHANGE_NO_RESPONSE : HTTP_CLIENT_EXCHANGE_FAILED;
+        }
 
-    if (Pool->Head == NULL) {
-        uz ItemSize = 0;
-        void *ItemData = Pool->NewProc(&ItemSize);
-        Node = malloc(sizeof(sync_pool_node) + ItemSize);
-        WEB_STRUCT_ZERO(Node);
-        memcpy(Node->Item, ItemData, ItemSize);
-        goto Cleanup;
+        if (N == 0 && Reader->Received == 0) return HTTP_CLIENT_EXCHANGE_NO_RESPONSE;
+
+        http_client_read_result Result = HttpClientReaderReceived(Reader, N);
+        if (Result == HTTP_CLIENT_READ_ERROR) return HTTP_CLIENT_EXCHANGE_FAILED;
+        if (Result == HTTP_CLIENT_READ_DONE) break;
     }
 
-    Node = Pool->Head;
-    Pool->Head = Pool->Head->Next;
-Cleanup:
-    WebMutexUnlock(&Pool->Mu);
-    return Node->Item;
+    if (!HttpClientReaderFinish(Reader, ResponseArena, Response)) return HTTP_CLIENT_EXCHANGE_FAILED;
+
+    *OutReusable = !Reader->UntilClose && HttpClientResponseKeepAlive(Response);
+    return HTTP_CLIENT_EXCHANGE_OK;
 }
 
-static void SyncPoolFree(sync_pool *Pool, void *Item) {
-    WebMutexLock(&Pool->Mu);
+static web_string_view HttpClientFormatRequest(web_arena *Arena, web_http_request *Request) {
+    const char *VersionString = HttpVersionStrings[Request->Version];
+    web_string_view VersionSv = WEB_SV_LIT(VersionString);
 
-    sync_pool_node *Node = (sync_pool_node *)((u8 *)Item - sizeof(Node->Next));
-    Node->Next = Pool->Head;
-    Pool->Head = Node;
+    const char *MethodString = HttpMethodNames[Request->Method];
+    web_string_view MethodSv = WEB_SV_LIT(MethodString);
 
-    WebMutexUnlock(&Pool->Mu);
-}
+    web_dynamic_string RequestString;
+    WEB_ARRAY_INIT(Arena, &RequestString);
 
-#define TCP_BACKLOG_SIZE 256
+    // Request line.
+    WEB_ARRAY_EXTEND(Arena, &RequestString, &MethodSv);
+    WEB_ARRAY_PUSH(Arena, &RequestString, ' ');
+    WEB_ARRAY_EXTEND(Arena, &RequestString, &Request->Path);
+    WEB_ARRAY_PUSH(Arena, &RequestString, ' ');
+    WEB_ARRAY_EXTEND(Arena, &RequestString, &VersionSv);
+    WEB_ARRAY_PUSH(Arena, &RequestString, '\r');
+    WEB_ARRAY_PUSH(Arena, &RequestString, '\n');
 
-// NOTE(oleh): This is bad.
-#define DEFAULT_REQUEST_ARENA_CAPACITY (4ll * 1024ll * 1024ll * 1024ll)
+    // Headers.
+    HttpHeadersFormat(Arena, &RequestString, Request->Headers);
+    WEB_ARRAY_PUSH(Arena, &RequestString, '\r');
+    WEB_ARRAY_PUSH(Arena, &RequestString, '\n');
 
-typedef struct {
-    sync_pool *WorkerDataPool;
-    sync_pool *ContextPool;
-    web_http_server *Server;
-    int ClientSock;
-    web_https_session HttpsSession;
-} worker_data;
+    // Body.
+    WEB_ARRAY_EXTEND(Arena, &RequestString, &Request->Body);
 
-static sz HttpsRead(web_https_session *Sess, u8 *Buffer, uz BufferCapacity) {
-    return Sess->VTable.Read(Sess->Data, Buffer, BufferCapacity);
+    return (web_string_view) {.Items = RequestString.Items, .Count = RequestString.Count};
 }
 
-// TODO(oleh): Get the error string.
-static sz HttpReceive(worker_data *WorkerData, u8 *Buffer, uz BufferCapacity) {
-    sz NumRead = 0;
+b32 WebHttpRequestStream(web_http_client *Client,
+                         web_arena *ResponseArena,
+                         web_string_view Hostname,
+                         u16 Port,
+                         web_http_request Request,
+                         web_http_response *Response,
+                         web_http_body_proc OnBody,
+                         void *OnBodyData) {
+    // NOTE(oleh): Nothing that could log may run while the request is still needed, the log
+    // messages are formatted in the temporary arena too.
+    web_arena *Temp = WebGetTempArena();
+    web_string_view RequestSv = HttpClientFormatRequest(Temp, &Request);
 
-    if (WorkerData->Server->UseHttps) {
-        NumRead = HttpsRead(&WorkerData->HttpsSession,
-                            Buffer,
-                            BufferCapacity);
-    } else {
-        NumRead = read(WorkerData->ClientSock, Buffer, BufferCapacity);
+    http_client_reader Reader = {.Sink = OnBody, .SinkData = OnBodyData};
+    b32 Reusable;
+
+    if (Client == NULL) {
+        int Fd = HttpClientConnect(Hostname, Port, 0, HTTP_CLIENT_DEFAULT_TIMEOUT_MS);
+        if (Fd == -1) return 0;
+
+        http_client_exchange_result Result = HttpClientExchange(Fd, RequestSv, &Reader, ResponseArena, Response, &Reusable);
+        close(Fd);
+        HttpClientReaderFree(&Reader);
+        return Result == HTTP_CLIENT_EXCHANGE_OK;
     }
 
-    return NumRead;
+    // NOTE(oleh): A pooled connection can still be closed by the server right as the request goes out.
+    // Only requests that are safe to send twice get another try on a fresh connection then.
+    b32 Retryable = Request.Method != HTTP_POST && Request.Method != HTTP_CONNECT;
+
+    while (1) {
+        http_client_host *Host;
+        b32 Reused;
+        int Fd = HttpClientAcquire(Client, Hostname, Port, &Host, &Reused);
+        if (Fd == -1) {
+            HttpClientReaderFree(&Reader);
+            return 0;
+        }
+
+        http_client_exchange_result Result = HttpClientExchange(Fd, RequestSv, &Reader, ResponseArena, Response, &Reusable);
+        HttpClientRelease(Client, Host, Fd, Reusable);
+
+        if (Result == HTTP_CLIENT_EXCHANGE_NO_RESPONSE && Reused && Retryable) continue;
+
+        HttpClientReaderFree(&Reader);
+        return Result == HTTP_CLIENT_EXCHANGE_OK;
+    }
+}
+
+b32 WebHttpRequestSend(web_http_client *Client,
+                       web_arena *ResponseArena,
+                       web_string_view Hostname,
+                       u16 Port,
+                       web_http_request Request,
+                       web_http_response *Response) {
+    return WebHttpRequestStream(Client, ResponseArena, Hostname, Port, Request, Response, NULL, NULL);
 }
 
 typedef enum {
-    PARSE_STATE_REQUEST_LINE,
-    PARSE_STATE_HEADERS,
-    PARSE_STATE_BODY,
-} request_parse_state;
+    HTTP_BATCH_PENDING,
+    HTTP_BATCH_CONNECTING,
+    HTTP_BATCH_SENDING,
+    HTTP_BATCH_RECEIVING,
+    HTTP_BATCH_DONE,
+} http_batch_state;
 
-#define INITIAL_PARSE_BUFFER_CAPACITY 4096
+typedef struct {
+    web_http_batch_request *Request;
+    http_batch_state State;
+    s64 Deadline;
 
-static b32 HttpRequestParseStreaming(worker_data *WorkerData,
-                                     web_arena *Arena,
-                                     web_http_request *Request) {
-    sz WriteOffset = 0;
-    sz ParseOffset = 0;
-    sz N = 0;
+    http_client_host *Host;
+    int Fd;
+    b32 Reused;
+    b32 Retryable;
 
-    sz BufferSize = 0;
-    sz BufferCapacity = INITIAL_PARSE_BUFFER_CAPACITY;
-    u8 *Buffer = WebArenaPush(Arena, BufferCapacity);
+    web_string_view Out;
+    uz Written;
+    http_client_reader Reader;
+} http_batch_item;
 
-    request_parse_state ParseState = PARSE_STATE_REQUEST_LINE;
+typedef struct {
+    web_http_client *Client;
+    web_arena *Arena;
+    int Epoll;
+    uz Remaining;
+} http_batch;
+
+static void HttpBatchCloseConnection(http_batch *Batch, http_batch_item *Item, b32 Reuse) {
+    if (Item->Fd != -1) epoll_ctl(Batch->Epoll, EPOLL_CTL_DEL, Item->Fd, NULL);
+
+    if (Item->Host != NULL) {
+        // NOTE(oleh): The pool hands out blocking connections.
+        if (Reuse) fcntl(Item->Fd, F_SETFL, fcntl(Item->Fd, F_GETFL) & ~O_NONBLOCK);
+        HttpClientRelease(Batch->Client, Item->Host, Item->Fd, Reuse);
+    } else if (Item->Fd != -1) {
+        close(Item->Fd);
+    }
 
-    s64 ContentLength = -1;
-    web_http_header Header = {0};
-    web_http_headers Headers = {0};
-    WEB_ARRAY_INIT(Arena, &Headers);
+    Item->Fd = -1;
+    Item->Host = NULL;
+}
 
-ReceiveLoop:
-    if (BufferSize >= BufferCapacity) {
-        BufferCapacity <<= 1;
-        Buffer = WebArenaRealloc(Arena, Buffer, BufferSize, BufferCapacity);
+static void HttpBatchFinish(http_batch *Batch, http_batch_item *Item, web_http_client_result Result) {
+    web_http_batch_request *Request = Item->Request;
+    b32 Reuse = 0;
+
+    if (Result == WEB_HTTP_CLIENT_OK) {
+        // NOTE(oleh): Only now the response goes into the caller's arena, in one piece.
+        if (HttpClientReaderFinish(&Item->Reader, Batch->Arena, &Request->Response)) {
+            Reuse = !Item->Reader.UntilClose && HttpClientResponseKeepAlive(&Request->Response);
+        } else {
+            Result = WEB_HTTP_CLIENT_BAD_RESPONSE;
+        }
     }
 
-    N = HttpReceive(WorkerData, Buffer + WriteOffset, BufferCapacity - WriteOffset);
-    if (N == -1) {
-        WEB_LOG(ERROR, HTTP, "Failed to receive from a client socket");
-        return 0;
+    HttpBatchCloseConnection(Batch, Item, Reuse);
+    HttpClientReaderFree(&Item->Reader);
+
+    Request->Result = Result;
+    Item->State = HTTP_BATCH_DONE;
+    --Batch->Remaining;
+}
+
+// NOTE(oleh): A pooled connection that broke before any of the response came back was most likely
+// closed by the server while idle, the request is started again on a new one.
+static b32 HttpBatchRetry(http_batch *Batch, http_batch_item *Item) {
+    if (!Item->Reused || !Item->Retryable || Item->Reader.Received > 0) return 0;
+
+    HttpBatchCloseConnection(Batch, Item, 0);
+    Item->State = HTTP_BATCH_PENDING;
+    Item->Written = 0;
+    return 1;
+}
+
+static void HttpBatchStart(http_batch *Batch, http_batch_item *Item) {
+    web_http_batch_request *Request = Item->Request;
+    int Fd = -1;
+
+    if (Batch->Client != NULL) {
+        http_client_acquire_result Acquired = HttpClientAcquireSlot(Batch->Client, Request->Hostname, Request->Port, 0, &Item->Host, &Fd);
+        if (Acquired == HTTP_CLIENT_ACQUIRE_BUSY) {
+            Item->Host = NULL;
+            return;
+        }
+
+        Item->Reused = Acquired == HTTP_CLIENT_ACQUIRE_IDLE;
+        if (Acquired == HTTP_CLIENT_ACQUIRE_NEW) Fd = HttpClientConnect(Request->Hostname, Request->Port, 1, Batch->Client->TimeoutMs);
+    } else {
+        Fd = HttpClientConnect(Request->Hostname, Request->Port, 1, HTTP_CLIENT_DEFAULT_TIMEOUT_MS);
     }
 
-    WriteOffset += N;
-    BufferSize += N;
+    Item->Fd = Fd;
+    if (Fd == -1) {
+        HttpBatchFinish(Batch, Item, WEB_HTTP_CLIENT_CONNECT_FAILED);
+        return;
+    }
 
-    switch (ParseState) {
-    case PARSE_STATE_REQUEST_LINE: goto ParseRequestLine;
-    case PARSE_STATE_HEADERS:      goto ParseHeaders;
-    case PARSE_STATE_BODY:         goto ParseBody;
-    default:                       WEB_UNREACHABLE();
+    if (Item->Reused) {
+        fcntl(Fd, F_SETFL, fcntl(Fd, F_GETFL) | O_NONBLOCK);
     }
 
-ParseRequestLine:
-    N = HttpRequestParseRequestLine(Buffer + ParseOffset,
-                                    BufferSize - ParseOffset,
-                                    &Request->Method,
-                                    &Request->Path,
-                                    &Request->Version);
-    if (N == -1) {
-        WEB_LOG(ERROR, HTTP, "Failed to parse the request line");
-        return 0;
+    // NOTE(oleh): A new connection is writable once connected, a reused one right away.
+    Item->State = Item->Reused ? HTTP_BATCH_SENDING : HTTP_BATCH_CONNECTING;
+
+    struct epoll_event Event = {.events = EPOLLOUT, .data.ptr = Item};
+    if (epoll_ctl(Batch->Epoll, EPOLL_CTL_ADD, Fd, &Event) == -1) {
+        HttpBatchFinish(Batch, Item, WEB_HTTP_CLIENT_IO_ERROR);
     }
+}
 
-    ParseOffset += N;
+static void HttpBatchAdvance(http_batch *Batch, http_batch_item *Item) {
+    switch (Item->State) {
+    case HTTP_BATCH_CONNECTING: {
+        int Error = 0;
+        socklen_t ErrorSize = sizeof(Error);
+        if (getsockopt(Item->Fd, SOL_SOCKET, SO_ERROR, &Error, &ErrorSize) == -1 || Error != 0) {
+            HttpBatchFinish(Batch, Item, WEB_HTTP_CLIENT_CONNECT_FAILED);
+            return;
+        }
 
-    ParseState = PARSE_STATE_HEADERS;
+        Item->State = HTTP_BATCH_SENDING;
+    } // fallthrough
+
+    case HTTP_BATCH_SENDING: {
+        while (Item->Written < Item->Out.Count) {
+            sz N = send(Item->Fd, Item->Out.Items + Item->Written, Item->Out.Count - Item->Written, MSG_NOSIGNAL);
+            if (N == -1) {
+                if (errno == EINTR) continue;
+                if (errno == EAGAIN || errno == EWOULDBLOCK) return;
+                if (!HttpBatchRetry(Batch, Item)) HttpBatchFinish(Batch, Item, WEB_HTTP_CLIENT_IO_ERROR);
+                return;
+            }
 
-ParseHeaders:
-    while (ParseOffset < BufferSize) {
-        if (ParseOffset < BufferSize - 1 &&
-            Buffer[ParseOffset] == '\r' && Buffer[ParseOffset + 1] == '\n') {
-            ParseOffset += 2;
-            ParseState = PARSE_STATE_BODY;
-            break;
+            Item->Written += N;
         }
 
-        N = HttpRequestParseHeader(Buffer + ParseOffset, BufferSize - ParseOffset, &Header);
-        if (N == -1) {
-            WEB_LOG(ERROR, HTTP, "Failed to parse a request's header");
-            return 0;
+        Item->State = HTTP_BATCH_RECEIVING;
+        struct epoll_event Event = {.events = EPOLLIN, .data.ptr = Item};
+        epoll_ctl(Batch->Epoll, EPOLL_CTL_MOD, Item->Fd, &Event);
+    } break;
+
+    case HTTP_BATCH_RECEIVING: {
+        while (1) {
+            uz Available;
+            u8 *Dest = HttpClientReaderReserve(&Item->Reader, &Available);
+            if (Dest == NULL) {
+                HttpBatchFinish(Batch, Item, WEB_HTTP_CLIENT_BAD_RESPONSE);
+                return;
+            }
+
+            sz N = recv(Item->Fd, Dest, Available, 0);
+            if (N == -1) {
+                if (errno == EINTR) continue;
+                if (errno == EAGAIN || errno == EWOULDBLOCK) return;
+                if (!HttpBatchRetry(Batch, Item)) HttpBatchFinish(Batch, Item, WEB_HTTP_CLIENT_IO_ERROR);
+                return;
+            }
+
+            if (N == 0 && HttpBatchRetry(Batch, Item)) return;
+
+            http_client_read_result Result = HttpClientReaderReceived(&Item->Reader, N);
+
+            if (Result == HTTP_CLIENT_READ_INCOMPLETE) continue;
+
+            HttpBatchFinish(Batch, Item, Result == HTTP_CLIENT_READ_DONE ? WEB_HTTP_CLIENT_OK : WEB_HTTP_CLIENT_BAD_RESPONSE);
+            return;
         }
+    }
 
-        ParseOffset += N;
+    default: break;
+    }
+}
 
-        WEB_ARRAY_PUSH(Arena, &Headers, Header);
+#define HTTP_BATCH_EVENTS_COUNT 64
+// NOTE(oleh): How often requests waiting for a host at its connection limit look again, in case the
+// connections are held by someone outside of the batch.
+#define HTTP_BATCH_BUSY_POLL_MS 5
 
-        if (WebStringViewEqualCStr(Header.Name, "Content-Length")) {
-            if (!WebParseS64(Header.Value, &ContentLength)) {
-                WEB_LOG_FMT(WARN,
-                            HTTP,
-                            "Failed to parse received Content-Length header value as an integer; value=" WEB_SV_FMT,
-                            WEB_SV_ARG(Header.Value));
-                ContentLength = -1;
+uz WebHttpRequestSendMany(web_http_client *Client, web_arena *Arena, web_http_batch_request *Requests, uz Count) {
+    if (Count == 0) return 0;
+
+    http_batch Batch = {.Client = Client, .Arena = Arena, .Remaining = Count};
+
+    Batch.Epoll = epoll_create1(EPOLL_CLOEXEC);
+    if (Batch.Epoll == -1) {
+        for (uz I = 0; I < Count; ++I) Requests[I].Result = WEB_HTTP_CLIENT_IO_ERROR;
+        return 0;
+    }
+
+    http_batch_item *Items = calloc(Count, sizeof(*Items));
+    s64 Start = HttpMonotonicNs();
+
+    for (uz I = 0; I < Count; ++I) {
+        web_http_batch_request *Request = &Requests[I];
+        http_batch_item *Item = &Items[I];
+
+        Item->Request = Request;
+        Item->Fd = -1;
+        Item->Deadline = Request->TimeoutMs > 0 ? Start + (s64) Request->TimeoutMs * 1000000ll : INT64_MAX;
+        Item->Retryable = Request->Request.Method != HTTP_POST && Request->Request.Method != HTTP_CONNECT;
+        Item->Out = HttpClientFormatRequest(Arena, &Request->Request);
+    }
+
+    struct epoll_event Events[HTTP_BATCH_EVENTS_COUNT];
+
+    while (Batch.Remaining > 0) {
+        // NOTE(oleh): The batches are small enough (tens of requests) to just look at all of them.
+        s64 Now = HttpMonotonicNs();
+        s64 NextDeadline = INT64_MAX;
+        b32 Waiting = 0;
+
+        for (uz I = 0; I < Count; ++I) {
+            http_batch_item *Item = &Items[I];
+            if (Item->State == HTTP_BATCH_DONE) continue;
+
+            if (Now >= Item->Deadline) {
+                HttpBatchFinish(&Batch, Item, WEB_HTTP_CLIENT_TIMED_OUT);
+                continue;
             }
+
+            if (Item->State == HTTP_BATCH_PENDING) HttpBatchStart(&Batch, Item);
+            if (Item->State == HTTP_BATCH_PENDING) Waiting = 1;
+            if (Item->State != HTTP_BATCH_DONE) NextDeadline = WEB_MIN(NextDeadline, Item->Deadline);
         }
-    }
 
-    if (ParseState == PARSE_STATE_HEADERS && ParseOffset >= BufferSize) goto ReceiveLoop;
+        if (Batch.Remaining == 0) break;
 
-ParseBody:
-    if (ContentLength >= 0) {
-        if (BufferSize - ParseOffset >= ContentLength) {
-            Request->Body.Items = Buffer + ParseOffset;
-            Request->Body.Count = ContentLength;
-            return 1;
+        int TimeoutMs = -1;
+        if (NextDeadline != INT64_MAX) TimeoutMs = (int) WEB_MIN((NextDeadline - Now + 999999) / 1000000, INT_MAX);
+        if (Waiting && (TimeoutMs == -1 || TimeoutMs > HTTP_BATCH_BUSY_POLL_MS)) TimeoutMs = HTTP_BATCH_BUSY_POLL_MS;
+
+        int EventsCount = epoll_wait(Batch.Epoll, Events, HTTP_BATCH_EVENTS_COUNT, TimeoutMs);
+        if (EventsCount == -1 && errno != EINTR) {
+            WEB_LOG_FMT(ERROR, HTTP, "epoll_wait failed: %s", strerror(errno));
+            for (uz I = 0; I < Count; ++I) {
+                if (Items[I].State != HTTP_BATCH_DONE) HttpBatchFinish(&Batch, &Items[I], WEB_HTTP_CLIENT_IO_ERROR);
+            }
+            break;
         }
 
-        goto ReceiveLoop;
-    } else {
-        // TODO(oleh): Maybe this should go back to the receive loop with some timeout checks.
-        Request->Body.Items = Buffer + ParseOffset;
-        Request->Body.Count = BufferSize - ParseOffset;
-        return 1;
+        for (int I = 0; I < EventsCount; ++I) {
+            http_batch_item *Item = Events[I].data.ptr;
+            // NOTE(oleh): Errors and hangups show up as a failing send or recv.
+            if (Item->State != HTTP_BATCH_DONE) HttpBatchAdvance(&Batch, Item);
+        }
     }
-}
 
-static sz HttpsWrite(web_https_session *Sess, web_string_view ResponseString) {
-    return Sess->VTable.Write(Sess->Data, ResponseString.Items, ResponseString.Count);
+    uz Succeeded = 0;
+    for (uz I = 0; I < Count; ++I) {
+        if (Requests[I].Result == WEB_HTTP_CLIENT_OK) ++Succeeded;
+    }
+
+    free(Items);
+    close(Batch.Epoll);
+    return Succeeded;
 }
 
-// TODO(oleh): Get the error string.
-static sz HttpResponseSend(worker_data *WorkerData, web_string_view ResponseString) {
-    if (WorkerData->Server->UseHttps) {
-        return HttpsWrite(&WorkerData->HttpsSession, ResponseString);
-    } else {
-        return write(WorkerData->ClientSock, ResponseString.Items, ResponseString.Count);
+// NOTE(oleh): Delimiter search for the request parser. Returns the index of the first `A` or `B` in
+// `Buffer`, or `Count` if there is none. On x86-64 it looks at 16 (SSE2) or 32 (AVX2, if the CPU has
+// it) bytes at a time, the scalar loop handles the tails and every other architecture.
+static uz HttpFindDelimiterScalar(const u8 *Buffer, uz Count, u8 A, u8 B) {
+    uz I = 0;
+    for (; I < Count; ++I) {
+        if (Buffer[I] == A || Buffer[I] == B) break;
     }
-}
 
-static sz HttpsCloseConnection(web_https_session *Sess) {
-    return Sess->VTable.Close(Sess->Data);
+    return I;
 }
 
-static void ServerWorker(void *Arg) {
-    worker_data *Data = (worker_data *)Arg;
-
-    web_http_response_context *Ctx = SyncPoolAlloc(Data->ContextPool);
+#ifdef __x86_64__
+static uz HttpFindDelimiterSse2(const u8 *Buffer, uz Count, u8 A, u8 B) {
+    __m128i MatchA = _mm_set1_epi8((char) A);
+    __m128i MatchB = _mm_set1_epi8((char) B);
 
-    WebArenaReset(&Ctx->Arena);
-    Ctx->ResponseHeaders.Count = 0;
-    WEB_ARRAY_INIT(&Ctx->Arena, &Ctx->ResponseHeaders);
-    Ctx->Content = (web_string_view) {0};
+    uz I = 0;
+    for (; I + 16 <= Count; I += 16) {
+        __m128i Chunk = _mm_loadu_si128((const __m128i *) (Buffer + I));
+        __m128i Matches = _mm_or_si128(_mm_cmpeq_epi8(Chunk, MatchA), _mm_cmpeq_epi8(Chunk, MatchB));
 
-    web_http_request HttpRequest;
-    b32 Success = HttpRequestParseStreaming(Data, &Ctx->Arena, &HttpRequest);
-    if (!Success) {
-        WEB_LOG(INFO, HTTP, "Could not streaming parse HTTP request");
-        goto Cleanup;
+        int Mask = _mm_movemask_epi8(Matches);
+        if (Mask != 0) return I + __builtin_ctz(Mask);
     }
 
-    Ctx->Request = HttpRequest;
+    return I + HttpFindDelimiterScalar(Buffer + I, Count - I, A, B);
+}
+
+__attribute__((target("avx2")))
+static uz HttpFindDelimiterAvx2(const u8 *Buffer, uz Count, u8 A, u8 B) {
+    __m256i MatchA = _mm256_set1_epi8((char) A);
+    __m256i MatchB = _mm256_set1_epi8((char) B);
 
-    for (uz HandlerIndex = 0; HandlerIndex < Data->Server->HandlersCount; ++HandlerIndex) {
-        web_string_view HandlerPath = Data->Server->HandlersPaths[HandlerIndex];
-        if (!WebStringViewEqual(HandlerPath, HttpRequest.Path)) continue;
+    uz I = 0;
+    for (; I + 32 <= Count; I += 32) {
+        __m256i Chunk = _mm256_loadu_si256((const __m256i *) (Buffer + I));
+        __m256i Matches = _mm256_or_si256(_mm256_cmpeq_epi8(Chunk, MatchA), _mm256_cmpeq_epi8(Chunk, MatchB));
+
+        u32 Mask = (u32) _mm256_movemask_epi8(Matches);
+        if (Mask != 0) return I + __builtin_ctz(Mask);
+    }
 
-        web_http_request_handler Handler = Data->Server->Handlers[HandlerIndex];
+    return I + HttpFindDelimiterSse2(Buffer + I, Count - I, A, B);
+}
 
-        web_http_response_status ResponseStatus = Handler(Ctx);
+typedef uz (*http_find_delimiter_proc)(const u8 *Buffer, uz Count, u8 A, u8 B);
 
-        // 1. Status line. (https://datatracker.ietf.org/doc/html/rfc2616#section-6.1)
-        const char *ReasonPhrase = GetHttpResponseStatusReasonPhrase(ResponseStatus);
-        const char *VersionString = HttpVersionStrings[HttpRequest.Version];
+static uz HttpFindDelimiterResolve(const u8 *Buffer, uz Count, u8 A, u8 B);
 
-        web_dynamic_string ResponseHeadersString;
-        WEB_ARRAY_INIT(&Ctx->Arena, &ResponseHeadersString);
+// NOTE(oleh): Resolved on the first call. Threads racing on it all store the same value.
+static http_find_delimiter_proc HttpFindDelimiterImpl = HttpFindDelimiterResolve;
 
-        HttpHeadersFormat(&Ctx->Arena, &ResponseHeadersString, Ctx->ResponseHeaders);
+static uz HttpFindDelimiterResolve(const u8 *Buffer, uz Count, u8 A, u8 B) {
+    __builtin_cpu_init();
+    HttpFindDelimiterImpl = __builtin_cpu_supports("avx2") ? HttpFindDelimiterAvx2 : HttpFindDelimiterSse2;
+    return HttpFindDelimiterImpl(Buffer, Count, A, B);
+}
 
-        web_string_view ResponseString = WebArenaFormat(&Ctx->Arena,
-                                                        "%s %u %s\r\nAccess-Control-Allow-Origin: *\r\n" WEB_SV_FMT "\r\n" WEB_SV_FMT,
-                                                        VersionString,
-                                                        ResponseStatus,
-                                                        ReasonPhrase,
-                                                        WEB_SV_ARG(ResponseHeadersString),
-                                                        WEB_SV_ARG(Ctx->Content));
+static inline uz HttpFindDelimiter(const u8 *Buffer, uz Count, u8 A, u8 B) {
+    return HttpFindDelimiterImpl(Buffer, Count, A, B);
+}
+#else
+static inline uz HttpFindDelimiter(const u8 *Buffer, uz Count, u8 A, u8 B) {
+    return HttpFindDelimiterScalar(Buffer, Count, A, B);
+}
+#endif // __x86_64__
+
+// NOTE(oleh): Loads up to 8 bytes into a zero-padded word, so that methods and versions are matched
+// with a single compare. For the literals on the other side it all folds into a constant.
+static inline u64 HttpLoadWord(const void *Bytes, uz Count) {
+    u64 Word = 0;
+    memcpy(&Word, Bytes, Count);
+    return Word;
+}
 
-        sz NumSent = HttpResponseSend(Data, ResponseString);
-        WEB_VERIFY(NumSent > 0);
+#define HTTP_WORD_LITERAL(String) HttpLoadWord((String), sizeof(String) - 1)
+
+static sz HttpRequestParseHeader(u8 *Buffer,
+                                 uz BufferCount,
+                                 web_http_header *Header) {
+    uz I = HttpFindDelimiter(Buffer, BufferCount, ':', '\r');
+
+    // NOTE(oleh): A CR before the colon means the line has no colon at all.
+    if (I >= BufferCount || Buffer[I] != ':') {
+        return -1;
+    }
+
+    Header->Name = (web_string_view) {.Items = Buffer, .Count = I};
+
+    uz HeaderValueStart = I + 1;
+    while (HeaderValueStart < BufferCount && (Buffer[HeaderValueStart] == ' ' || Buffer[HeaderValueStart] == '\t')) {
+        ++HeaderValueStart;
+    }
+
+    I = HeaderValueStart + HttpFindDelimiter(Buffer + HeaderValueStart, BufferCount - HeaderValueStart, '\r', '\r');
+
+    if (I >= BufferCount) {
+        return -1;
+    }
+
+    if (BufferCount - I <= 1) {
+        return -1;
+    }
+
+    u8 NewlineChar = Buffer[I + 1];
+    if (NewlineChar != '\n') {
+        return -1;
+    }
+
+    Header->Value = (web_string_view) {.Items = Buffer + HeaderValueStart, .Count = I - HeaderValueStart};
+
+    return I + 2;
+}
+
+static b32 HttpHeadersParse(web_arena *Arena,
+                            web_string_view Buffer,
+                            uz *Offset,
+                            web_http_headers *Headers) {
+    b32 Result = 1;
+    uz I;
+
+    for (I = *Offset; I < Buffer.Count; ) {
+        if (Buffer.Items[I] == '\r' && Buffer.Count - I > 1 && Buffer.Items[I + 1] == '\n') goto Success;
+
+        web_http_header Header = {0};
+        sz N = HttpRequestParseHeader(Buffer.Items + I, Buffer.Count - I, &Header);
+        if (N == -1) {
+            return 0;
+        }
+
+        I += N;
+
+        WEB_ARRAY_PUSH(Arena, Headers, Header);
+    }
+
+    Result = 0;
+
+Success:
+    *Offset = I + 2;
+
+    return Result;
+}
+
+b32 WebHttpResponseParse(web_arena *Arena, web_string_view Buffer, web_http_response *OutResponse) {
+    // 1. Response line. (https://datatracker.ietf.org/doc/html/rfc2616#section-6.1)
+    // 1.1. Version.
+
+    uz I;
+    for (I = 0; I < Buffer.Count; ++I) {
+        if (Buffer.Items[I] == ' ') break;
+    }
+
+    if (I >= Buffer.Count) return 0;
+
+    web_http_version HttpVersion;
+    web_string_view HttpVersionSv = {.Items = Buffer.Items, .Count = I};
+#define X(Version, VersionString) if (WebStringViewEqualCStr(HttpVersionSv, VersionString)) { \
+    HttpVersion = HTTP_##Version; \
+    goto ResponseVersionSuccess; \
+    }
+WEB_ENUM_HTTP_VERSIONS
+#undef X
+
+    // Failed to parse the version.
+    return 0;
+
+ResponseVersionSuccess: ;
+    // 1.2. Status code, always three digits. The reason phrase is optional and doesn't have to be the
+    // usual one for the code, so it is kept as it is. (https://datatracker.ietf.org/doc/html/rfc9112#section-4)
+    uz StatusCodeStart = I + 1;
+    if (Buffer.Count - StatusCodeStart < 4) return 0;
+
+    s64 StatusCodeNum = 0;
+    for (I = StatusCodeStart; I < StatusCodeStart + 3; ++I) {
+        if (Buffer.Items[I] < '0' || Buffer.Items[I] > '9') return 0;
+        StatusCodeNum = StatusCodeNum * 10 + (Buffer.Items[I] - '0');
+    }
+
+    if (StatusCodeNum < 100) return 0;
+
+    // NOTE(oleh): Some servers leave out the space when there is no reason phrase.
+    if (Buffer.Items[I] != ' ' && Buffer.Items[I] != '\r') return 0;
+
+    uz ReasonStart = Buffer.Items[I] == ' ' ? I + 1 : I;
+    for (I = ReasonStart; I < Buffer.Count; ++I) {
+        if (Buffer.Items[I] == '\r') break;
+    }
+
+    web_string_view ReasonPhrase = {.Items = Buffer.Items + ReasonStart, .Count = I - ReasonStart};
+
+    ++I;
+    if (I >= Buffer.Count) return 0;
+
+    if (Buffer.Items[I] != '\n') return 0;
+
+    ++I;
+
+    web_http_headers Headers;
+    WEB_ARRAY_INIT(Arena, &Headers);
+
+    if (!HttpHeadersParse(Arena, Buffer, &I, &Headers)) return 0;
+
+    web_string_view ResponseBody = {.Items = Buffer.Items + I, .Count = Buffer.Count - I};
+
+    OutResponse->Version = HttpVersion;
+    OutResponse->Body = ResponseBody;
+    OutResponse->Status = (web_http_response_status) StatusCodeNum;
+    OutResponse->Reason = ReasonPhrase;
+    OutResponse->Headers = Headers;
+    return 1;
+}
+
+static sz HttpRequestParseRequestLine(u8 *Buffer,
+                                      uz BufferCount,
+                                      web_http_method *Method,
+                                      web_string_view *Path,
+                                      web_http_version *Version) {
+    uz I = HttpFindDelimiter(Buffer, BufferCount, ' ', ' ');
+
+    // NOTE(oleh): No method is longer than a word.
+    if (I >= BufferCount || I > sizeof(u64)) {
+        return -1;
+    }
+
+    web_http_method RequestMethod;
+    u64 MethodWord = HttpLoadWord(Buffer, I);
+#define X(Method) if (I == sizeof(#Method) - 1 && MethodWord == HTTP_WORD_LITERAL(#Method)) {  \
+        RequestMethod = HTTP_##Method;                                  \
+        goto RequestMethodSuccess;                                      \
+    }
+
+    WEB_ENUM_HTTP_METHODS
+
+#undef X
+
+    // Failed to parse the HTTP method.
+    return -1;
+
+ RequestMethodSuccess: ;
+    // 1.2. Request URI. (https://datatracker.ietf.org/doc/html/rfc2616#section-5.1.2)
+    // FIXME(oleh): Actually parse URI's.
+
+    uz PathStart = I + 1;
+
+    I = PathStart + HttpFindDelimiter(Buffer + PathStart, BufferCount - PathStart, ' ', '\r');
+
+    if (I >= BufferCount || Buffer[I] != ' ') {
+        return -1;
+    }
+
+    web_string_view RequestPath = {.Items = Buffer + PathStart, .Count = I - PathStart};
+
+    // 1.3. HTTP version.
+
+    uz VersionStart = I + 1;
+
+    I = VersionStart + HttpFindDelimiter(Buffer + VersionStart, BufferCount - VersionStart, '\r', '\r');
+
+    if (I >= BufferCount || I - VersionStart > sizeof(u64)) {
+        return -1;
+    }
+
+    web_http_version RequestVersion;
+    uz VersionCount = I - VersionStart;
+    u64 VersionWord = HttpLoadWord(Buffer + VersionStart, VersionCount);
+
+#define X(Version, String) if (VersionCount == sizeof(String) - 1 && VersionWord == HTTP_WORD_LITERAL(String)) { \
+        RequestVersion = HTTP_##Version;                                \
+        goto RequestVersionSuccess;                                     \
+    }
+
+    WEB_ENUM_HTTP_VERSIONS
+#undef X
+
+    // NOTE(oleh): Failed to recognize the HTTP version.
+    return -1;
+ RequestVersionSuccess:
+    // 1.4. CRLF.
+
+    if (BufferCount - I <= 1) {
+        return -1;
+    }
+
+    u8 NewlineChar = Buffer[I + 1];
+    if (NewlineChar != '\n') {
+        return -1;
+    }
+
+    *Method = RequestMethod;
+    *Path = RequestPath;
+    *Version = RequestVersion;
+
+    return I + 2;
+}
+
+b32 WebHttpRequestParse(web_arena *Arena, web_string_view Buffer, web_http_request *OutRequest, web_string_view *Error) {
+    // 1. Request line. (https://datatracker.ietf.org/doc/html/rfc2616#section-5.1)
+    // 1.1. Method. (https://datatracker.ietf.org/doc/html/rfc2616#section-5.1.1)
+    sz N = HttpRequestParseRequestLine(Buffer.Items,
+                                       Buffer.Count,
+                                       &OutRequest->Method,
+                                       &OutRequest->Path,
+                                       &OutRequest->Version);
+
+    if (N == -1) {
+        *Error = WEB_SV_LIT("Could not parse the request line");
+        return 0;
+    }
+
+    Buffer.Items += N;
+    Buffer.Count -= N;
+
+    // 2. Headers. (https://datatracker.ietf.org/doc/html/rfc2616#section-5.3)
+    // FIXME(oleh): Actually parse the headers according to their specification.
+
+    web_http_headers Headers;
+    WEB_ARRAY_INIT(Arena, &Headers);
+
+    uz I = 0;
+
+    if (!HttpHeadersParse(Arena, Buffer, &I, &Headers)) {
+        *Error = WEB_SV_LIT("Could not parse the request headers");
+        return 0;
+    }
+
+    WEB_ASSERT(I <= Buffer.Count);
+
+    // 3. Message body. (https://datatracker.ietf.org/doc/html/rfc2616#section-4.3)
+    web_string_view RequestBody = {.Items = Buffer.Items + I, .Count = Buffer.Count - I};
+
+    OutRequest->Headers = Headers;
+    OutRequest->Body = RequestBody;
+
+    memset(OutRequest->KnownHeaders, 0, sizeof(OutRequest->KnownHeaders));
+    for (uz HeaderIndex = 0; HeaderIndex < Headers.Count; ++HeaderIndex) {
+        web_http_header_id Id = WebHttpHeaderId(Headers.Items[HeaderIndex].Name);
+        if (Id != HTTP_HEADER_UNKNOWN && OutRequest->KnownHeaders[Id] == 0) OutRequest->KnownHeaders[Id] = HeaderIndex + 1;
+    }
+
+    return 1;
+}
+
+// NOTE(oleh): Route slots are indexed by the method, with one extra slot for handlers attached to
+// every method.
+enum {
+#define X(Method) HTTP_ROUTE_SLOT_##Method,
+    WEB_ENUM_HTTP_METHODS
+#undef X
+    HTTP_ROUTE_SLOT_ANY,
+    HTTP_ROUTE_SLOTS_COUNT,
+};
+
+typedef struct {
+    web_http_request_handler Handler;
+    void *Data;
+    b32 StreamBody;
+
+    u32 CacheTtlMs;
+    const char *const *CacheVary;
+    uz CacheVaryCount;
+
+    u32 SchedulingClass;
+} http_route;
+
+// NOTE(oleh): A node of the compressed radix tree. `Prefix` is the static part of the path matched by
+// the node itself, static children are keyed by the first byte of their prefix. A parameter child
+// matches a single non-empty segment, a wildcard child the whole rest of the path.
+struct web_http_route_node {
+    web_string_view Prefix;
+
+    web_http_route_node **Children;
+    uz ChildrenCount;
+
+    web_http_route_node *ParamChild;
+    web_string_view ParamName;
+
+    web_http_route_node *WildcardChild;
+    web_string_view WildcardName;
+
+    http_route Routes[HTTP_ROUTE_SLOTS_COUNT];
+};
+
+static web_http_route_node *RouteNodeNew(web_arena *Arena, web_string_view Prefix) {
+    web_http_route_node *Node = WEB_ARENA_PUSH_ZERO(Arena, sizeof(*Node));
+    Node->Prefix = Prefix;
+    return Node;
+}
+
+static web_http_route_node **RouteNodeFindChild(web_http_route_node *Node, u8 FirstChar) {
+    for (uz I = 0; I < Node->ChildrenCount; ++I) {
+        if (Node->Children[I]->Prefix.Items[0] == FirstChar) return &Node->Children[I];
+    }
+
+    return NULL;
+}
+
+static void RouteNodeAddChild(web_arena *Arena, web_http_route_node *Node, web_http_route_node *Child) {
+    if (Node->ChildrenCount == 0) {
+        Node->Children = WebArenaPush(Arena, sizeof(*Node->Children));
+    } else {
+        Node->Children = WebArenaRealloc(Arena,
+                                         Node->Children,
+                                         sizeof(*Node->Children) * Node->ChildrenCount,
+                                         sizeof(*Node->Children) * (Node->ChildrenCount + 1));
+    }
+    Node->Children[Node->ChildrenCount] = Child;
+    ++Node->ChildrenCount;
+}
+
+static web_string_view RouteTakeName(web_string_view *Pattern) {
+    uz Count = 0;
+    while (Count < Pattern->Count && Pattern->Items[Count] != '/') ++Count;
+
+    web_string_view Name = {.Items = Pattern->Items, .Count = Count};
+    Pattern->Items += Count;
+    Pattern->Count -= Count;
+    return Name;
+}
+
+// NOTE(oleh): Walks down the tree along `Pattern`, splitting and creating nodes as needed, and returns
+// the node the route ends at.
+static web_http_route_node *RouteInsert(web_arena *Arena, web_http_route_node *Node, web_string_view Pattern) {
+    web_string_view FullPattern = Pattern;
+
+    while (Pattern.Count > 0) {
+        b32 SegmentStart = Pattern.Items == FullPattern.Items || Pattern.Items[-1] == '/';
+
+        if (SegmentStart && Pattern.Items[0] == ':') {
+            ++Pattern.Items;
+            --Pattern.Count;
+            web_string_view Name = RouteTakeName(&Pattern);
+
+            if (Node->ParamChild == NULL) {
+                Node->ParamChild = RouteNodeNew(Arena, (web_string_view) {0});
+                Node->ParamName = Name;
+            } else if (!WebStringViewEqual(Node->ParamName, Name)) {
+                WEB_PANIC_FMT("Route '" WEB_SV_FMT "' names a parameter '" WEB_SV_FMT "' where another route has '" WEB_SV_FMT "'",
+                              WEB_SV_ARG(FullPattern), WEB_SV_ARG(Name), WEB_SV_ARG(Node->ParamName));
+            }
+
+            Node = Node->ParamChild;
+            continue;
+        }
+
+        if (Pattern.Items[0] == '*') {
+            web_string_view Name = {.Items = Pattern.Items + 1, .Count = Pattern.Count - 1};
+            if (memchr(Name.Items, '/', Name.Count) != NULL)
+                WEB_PANIC_FMT("Wildcard has to be at the end of the route '" WEB_SV_FMT "'", WEB_SV_ARG(FullPattern));
+
+            if (Node->WildcardChild == NULL) {
+                Node->WildcardChild = RouteNodeNew(Arena, (web_string_view) {0});
+                Node->WildcardName = Name;
+            }
+
+            return Node->WildcardChild;
+        }
+
+        uz StaticCount = 1;
+        while (StaticCount < Pattern.Count) {
+            u8 Char = Pattern.Items[StaticCount];
+            if (Char == '*' || (Char == ':' && Pattern.Items[StaticCount - 1] == '/')) break;
+            ++StaticCount;
+        }
+
+        web_string_view Static = {.Items = Pattern.Items, .Count = StaticCount};
+
+        web_http_route_node **ChildPtr = RouteNodeFindChild(Node, Static.Items[0]);
+        if (ChildPtr == NULL) {
+            web_http_route_node *Child = RouteNodeNew(Arena, Static);
+            RouteNodeAddChild(Arena, Node, Child);
+
+            Node = Child;
+            Pattern.Items += StaticCount;
+            Pattern.Count -= StaticCount;
+            continue;
+        }
+
+        web_http_route_node *Child = *ChildPtr;
+
+        uz CommonCount = 0;
+        while (CommonCount < Static.Count && CommonCount < Child->Prefix.Count &&
+               Static.Items[CommonCount] == Child->Prefix.Items[CommonCount]) {
+            ++CommonCount;
+        }
+
+        if (CommonCount < Child->Prefix.Count) {
+            web_string_view SplitPrefix = {.Items = Child->Prefix.Items, .Count = CommonCount};
+            web_http_route_node *Split = RouteNodeNew(Arena, SplitPrefix);
+
+            Child->Prefix.Items += CommonCount;
+            Child->Prefix.Count -= CommonCount;
+            RouteNodeAddChild(Arena, Split, Child);
+
+            *ChildPtr = Split;
+            Child = Split;
+        }
+
+        Node = Child;
+        Pattern.Items += CommonCount;
+        Pattern.Count -= CommonCount;
+    }
+
+    return Node;
+}
+
+static b32 RouteNodeHasRoutes(web_http_route_node *Node) {
+    for (uz I = 0; I < HTTP_ROUTE_SLOTS_COUNT; ++I) {
+        if (Node->Routes[I].Handler != NULL) return 1;
+    }
+
+    return 0;
+}
+
+// NOTE(oleh): `Path` is what's left after the prefix of `Node`. Static children win over parameters,
+// which win over wildcards; we only backtrack when the more specific branch dead-ends.
+static web_http_route_node *RouteMatch(web_arena *Arena,
+                                       web_http_route_node *Node,
+                                       web_string_view Path,
+                                       web_http_path_params *Params) {
+    if (Path.Count == 0 && RouteNodeHasRoutes(Node)) return Node;
+
+    if (Path.Count > 0) {
+        web_http_route_node **ChildPtr = RouteNodeFindChild(Node, Path.Items[0]);
+        if (ChildPtr != NULL) {
+            web_http_route_node *Child = *ChildPtr;
+            if (Path.Count >= Child->Prefix.Count && memcmp(Path.Items, Child->Prefix.Items, Child->Prefix.Count) == 0) {
+                web_string_view Rest = {.Items = Path.Items + Child->Prefix.Count, .Count = Path.Count - Child->Prefix.Count};
+                web_http_route_node *Match = RouteMatch(Arena, Child, Rest, Params);
+                if (Match != NULL) return Match;
+            }
+        }
+    }
+
+    if (Node->ParamChild != NULL && Path.Count > 0 && Path.Items[0] != '/') {
+        web_string_view Rest = Path;
+        web_string_view Value = RouteTakeName(&Rest);
+
+        uz ParamsCount = Params->Count;
+        web_http_path_param Param = {.Name = Node->ParamName, .Value = Value};
+        WEB_ARRAY_PUSH(Arena, Params, Param);
+
+        web_http_route_node *Match = RouteMatch(Arena, Node->ParamChild, Rest, Params);
+        if (Match != NULL) return Match;
+
+        Params->Count = ParamsCount;
+    }
+
+    if (Node->WildcardChild != NULL) {
+        web_http_path_param Param = {.Name = Node->WildcardName, .Value = Path};
+        WEB_ARRAY_PUSH(Arena, Params, Param);
+        return Node->WildcardChild;
+    }
+
+    return NULL;
+}
+
+typedef enum {
+    PARSE_STATE_REQUEST_LINE,
+    PARSE_STATE_HEADERS,
+    PARSE_STATE_BODY,
+} request_parse_state;
+
+// NOTE(oleh): Where a chunked body is at, on top of `PARSE_STATE_BODY`.
+typedef enum {
+    PARSE_CHUNK_SIZE,
+    PARSE_CHUNK_DATA,
+    PARSE_CHUNK_DATA_END,
+    PARSE_CHUNK_TRAILERS,
+    PARSE_CHUNK_DONE,
+} request_chunk_state;
+
+typedef enum {
+    PARSE_RESULT_ERROR,
+    PARSE_RESULT_INCOMPLETE,
+    PARSE_RESULT_DONE,
+    // NOTE(oleh): The client sent the HTTP/2 connection preface, which has been consumed.
+    PARSE_RESULT_HTTP2,
+} request_parse_result;
+
+#define INITIAL_PARSE_BUFFER_CAPACITY 4096
+// NOTE(oleh): The request line and the headers have to fit in this, the parse buffer would otherwise
+// grow for as long as the client keeps sending.
+#define MAX_REQUEST_HEAD_SIZE (64 * 1024)
+#define MAX_REQUEST_CHUNK_LINE_SIZE (8 * 1024)
+
+// NOTE(oleh): Incremental request parser. The receive side appends bytes to `Buffer` and calls
+// `RequestParserAdvance`, which picks up from `State` and reports whether a full request has been
+// seen yet. This lets the blocking workers and the event loops share the same parsing code.
+typedef struct {
+    request_parse_state State;
+    u8 *Buffer;
+    uz BufferSize;
+    uz BufferCapacity;
+    uz ParseOffset;
+    s64 ContentLength;
+    web_http_headers Headers;
+    // NOTE(oleh): The request being parsed, it has to survive between the calls.
+    web_http_request Request;
+
+    // NOTE(oleh): The route is looked up as soon as the headers are in, since it decides whether the
+    // body gets buffered at all. `Node` is NULL when nothing matched the path.
+    web_http_route_node *Routes;
+    web_http_route_node *Node;
+    web_http_path_params Params;
+    b32 AllowStreamBody;
+    b32 StreamBody;
+    uz BodyConsumed;
+    // NOTE(oleh): Only limits the bodies that get buffered.
+    uz MaxBodySize;
+
+    // NOTE(oleh): A buffered chunked body is decoded in place, the decoded part is in
+    // [BodyStart, BodyEnd) and the raw chunks that still have to be decoded start at `ParseOffset`.
+    b32 Chunked;
+    request_chunk_state ChunkState;
+    u64 ChunkRemaining;
+    uz TrailersSize;
+    uz BodyStart;
+    uz BodyEnd;
+
+    // NOTE(oleh): What the client gets told before the connection is closed, when parsing fails
+    // because of the request itself. Zero means the connection is just closed.
+    web_http_response_status ErrorStatus;
+} request_parser;
+
+// NOTE(oleh): `Pending` holds the bytes a client has already sent past the end of the previous
+// request on the same connection (pipelining). They may live anywhere in the freshly reset arena,
+// so they are moved to the very front of it before anything else gets pushed.
+static void RequestParserInit(request_parser *Parser,
+                              web_arena *Arena,
+                              web_string_view Pending,
+                              web_http_route_node *Routes,
+                              b32 AllowStreamBody,
+                              uz MaxBodySize) {
+    uz Capacity = INITIAL_PARSE_BUFFER_CAPACITY;
+    while (Capacity <= Pending.Count) Capacity <<= 1;
+
+    Parser->State = PARSE_STATE_REQUEST_LINE;
+    Parser->BufferSize = Pending.Count;
+    Parser->BufferCapacity = Capacity;
+    Parser->Buffer = WebArenaPush(Arena, Parser->BufferCapacity);
+    Parser->ParseOffset = 0;
+    Parser->ContentLength = -1;
+    Parser->Request = (web_http_request) {0};
+    Parser->Routes = Routes;
+    Parser->Node = NULL;
+    Parser->AllowStreamBody = AllowStreamBody;
+    Parser->StreamBody = 0;
+    Parser->BodyConsumed = 0;
+    Parser->MaxBodySize = MaxBodySize;
+    Parser->Chunked = 0;
+    Parser->ChunkState = PARSE_CHUNK_SIZE;
+    Parser->ChunkRemaining = 0;
+    Parser->TrailersSize = 0;
+    Parser->BodyStart = 0;
+    Parser->BodyEnd = 0;
+    Parser->ErrorStatus = 0;
+
+    if (Pending.Count > 0) memmove(Parser->Buffer, Pending.Items, Pending.Count);
+
+    WEB_ARRAY_INIT(Arena, &Parser->Headers);
+    WEB_ARRAY_INIT(Arena, &Parser->Params);
+}
+
+static http_route *RouteNodeRoute(web_http_route_node *Node, web_http_method Method) {
+    if (Node == NULL) return NULL;
+
+    http_route *Route = &Node->Routes[Method];
+    if (Route->Handler == NULL) Route = &Node->Routes[HTTP_ROUTE_SLOT_ANY];
+    if (Route->Handler == NULL) return NULL;
+
+    return Route;
+}
+
+static http_route *RequestParserRoute(request_parser *Parser, web_http_method Method) {
+    return RouteNodeRoute(Parser->Node, Method);
+}
+
+// NOTE(oleh): Returns the free tail of the parse buffer, growing the buffer if it is full.
+static u8 *RequestParserReserve(request_parser *Parser, web_arena *Arena, uz *OutAvailable) {
+    if (Parser->BufferSize >= Parser->BufferCapacity) {
+        uz NewCapacity = Parser->BufferCapacity << 1;
+        Parser->Buffer = WebArenaRealloc(Arena, Parser->Buffer, Parser->BufferSize, NewCapacity);
+        Parser->BufferCapacity = NewCapacity;
+    }
+
+    *OutAvailable = Parser->BufferCapacity - Parser->BufferSize;
+    return Parser->Buffer + Parser->BufferSize;
+}
+
+// NOTE(oleh): Only plain digits, few enough of them that the value can't overflow.
+static b32 HttpParseContentLength(web_string_view Value, s64 *Out) {
+    if (Value.Count == 0 || Value.Count > 18) return 0;
+
+    for (uz I = 0; I < Value.Count; ++I) {
+        if (Value.Items[I] < '0' || Value.Items[I] > '9') return 0;
+    }
+
+    return WebParseS64(Value, Out);
+}
+
+// NOTE(oleh): Steps over the chunk framing in [ParseOffset, BufferSize) until it gets to chunk data,
+// the end of the body or the end of what's buffered. Returns 0 if the framing is malformed.
+// (https://datatracker.ietf.org/doc/html/rfc9112#section-7.1)
+static b32 RequestParserSkipChunkFraming(request_parser *Parser) {
+    while (1) {
+        u8 *Data = Parser->Buffer + Parser->ParseOffset;
+        uz Available = Parser->BufferSize - Parser->ParseOffset;
+
+        switch (Parser->ChunkState) {
+        case PARSE_CHUNK_SIZE:
+        case PARSE_CHUNK_TRAILERS: {
+            u8 *LineEnd = memchr(Data, '\n', Available);
+            if (LineEnd == NULL) {
+                if (Available <= MAX_REQUEST_CHUNK_LINE_SIZE) return 1;
+
+                Parser->ErrorStatus = HTTP_STATUS_BAD_REQUEST;
+                return 0;
+            }
+
+            uz LineSize = LineEnd - Data;
+            Parser->ParseOffset += LineSize + 1;
+            if (LineSize > 0 && Data[LineSize - 1] == '\r') --LineSize;
+
+            // NOTE(oleh): Trailer fields are dropped, but they still count against the head size.
+            if (Parser->ChunkState == PARSE_CHUNK_TRAILERS) {
+                Parser->TrailersSize += LineSize + 2;
+                if (Parser->TrailersSize > MAX_REQUEST_HEAD_SIZE) {
+                    Parser->ErrorStatus = HTTP_STATUS_REQUEST_HEADER_FIELDS_TOO_LARGE;
+                    return 0;
+                }
+
+                if (LineSize == 0) Parser->ChunkState = PARSE_CHUNK_DONE;
+                break;
+            }
+
+            u64 Size = 0;
+            uz I = 0;
+            for (; I < LineSize && HttpHexDigitValue(Data[I]) >= 0; ++I) {
+                if (Size > (UINT64_MAX >> 4)) break;
+                Size = Size * 16 + HttpHexDigitValue(Data[I]);
+            }
+
+            // NOTE(oleh): Chunk extensions are ignored.
+            if (I == 0 || (I < LineSize && Data[I] != ';' && Data[I] != ' ' && Data[I] != '\t')) {
+                Parser->ErrorStatus = HTTP_STATUS_BAD_REQUEST;
+                return 0;
+            }
+
+            if (Size == 0) {
+                Parser->ChunkState = PARSE_CHUNK_TRAILERS;
+            } else {
+                Parser->ChunkState = PARSE_CHUNK_DATA;
+                Parser->ChunkRemaining = Size;
+            }
+        } break;
+
+        case PARSE_CHUNK_DATA: {
+            if (Parser->ChunkRemaining > 0) return 1;
+            Parser->ChunkState = PARSE_CHUNK_DATA_END;
+        } break;
+
+        case PARSE_CHUNK_DATA_END: {
+            if (Available < 2) return 1;
+            if (Data[0] != '\r' || Data[1] != '\n') {
+                Parser->ErrorStatus = HTTP_STATUS_BAD_REQUEST;
+                return 0;
+            }
+
+            Parser->ParseOffset += 2;
+            Parser->ChunkState = PARSE_CHUNK_SIZE;
+        } break;
+
+        case PARSE_CHUNK_DONE: return 1;
+        }
+    }
+}
+
+static request_parse_result RequestParserAdvance(request_parser *Parser,
+                                                 web_arena *Arena,
+                                                 web_http_request *OutRequest) {
+    web_http_request *Request = &Parser->Request;
+    u8 *Buffer = Parser->Buffer;
+    uz BufferSize = Parser->BufferSize;
+    web_http_header Header = {0};
+    sz N = 0;
+
+    switch (Parser->State) {
+    case PARSE_STATE_REQUEST_LINE: goto ParseRequestLine;
+    case PARSE_STATE_HEADERS:      goto ParseHeaders;
+    case PARSE_STATE_BODY:         goto ParseBody;
+    default:                       WEB_UNREACHABLE();
+    }
+
+ParseRequestLine:
+    // NOTE(oleh): The HTTP/2 preface looks like a request line with an unknown method, so it has to be
+    // caught before the line parser sees it.
+    {
+        uz Remaining = BufferSize - Parser->ParseOffset;
+        if (memcmp(Buffer + Parser->ParseOffset, HTTP2_PREFACE, WEB_MIN(Remaining, HTTP2_PREFACE_SIZE)) == 0) {
+            if (Remaining < HTTP2_PREFACE_SIZE) return PARSE_RESULT_INCOMPLETE;
+
+            Parser->ParseOffset += HTTP2_PREFACE_SIZE;
+            return PARSE_RESULT_HTTP2;
+        }
+    }
+
+    // NOTE(oleh): The line parsers cannot tell a malformed line from a partial one, so wait until
+    // the whole line is buffered before handing it to them.
+    u8 *LineEnd = memchr(Buffer + Parser->ParseOffset, '\n', BufferSize - Parser->ParseOffset);
+    if (LineEnd == NULL || LineEnd - Buffer >= MAX_REQUEST_HEAD_SIZE) {
+        if (LineEnd == NULL && BufferSize <= MAX_REQUEST_HEAD_SIZE) return PARSE_RESULT_INCOMPLETE;
+
+        WEB_LOG(WARN, HTTP, "Refusing a request line that is too long");
+        Parser->ErrorStatus = HTTP_STATUS_URI_TOO_LONG;
+        return PARSE_RESULT_ERROR;
+    }
+
+    N = HttpRequestParseRequestLine(Buffer + Parser->ParseOffset,
+                                    BufferSize - Parser->ParseOffset,
+                                    &Request->Method,
+                                    &Request->Path,
+                                    &Request->Version);
+    if (N == -1) {
+        WEB_LOG(ERROR, HTTP, "Failed to parse the request line");
+        Parser->ErrorStatus = HTTP_STATUS_BAD_REQUEST;
+        return PARSE_RESULT_ERROR;
+    }
+
+    Parser->ParseOffset += N;
+
+    Parser->State = PARSE_STATE_HEADERS;
+
+ParseHeaders:
+    while (Parser->ParseOffset < BufferSize) {
+        u8 *Line = Buffer + Parser->ParseOffset;
+        uz Remaining = BufferSize - Parser->ParseOffset;
+
+        if (Remaining > 1 && Line[0] == '\r' && Line[1] == '\n') {
+            Parser->ParseOffset += 2;
+            Parser->State = PARSE_STATE_BODY;
+            break;
+        }
+
+        if (memchr(Line, '\n', Remaining) == NULL) break;
+
+        N = HttpRequestParseHeader(Line, Remaining, &Header);
+        if (N == -1) {
+            WEB_LOG(ERROR, HTTP, "Failed to parse a request's header");
+            Parser->ErrorStatus = HTTP_STATUS_BAD_REQUEST;
+            return PARSE_RESULT_ERROR;
+        }
+
+        Parser->ParseOffset += N;
+
+        WEB_ARRAY_PUSH(Arena, &Parser->Headers, Header);
+        web_http_header_id Id = HttpKnownHeadersRecord(Request->KnownHeaders, &Parser->Headers, Header);
+
+        // NOTE(oleh): Whoever sits in front of us has to agree with us on where the request ends, or
+        // the body of one request could be taken for the next one. So anything that we don't frame
+        // exactly the same way every time gets refused and the connection closed (RFC 9112, section 6.3).
+        // Only a lone chunked coding is decoded, anything stacked on it would be ours to undo as well.
+        if (Id == HTTP_HEADER_TRANSFER_ENCODING) {
+            web_string_view Value = Header.Value;
+            while (Value.Count > 0 && (Value.Items[Value.Count - 1] == ' ' || Value.Items[Value.Count - 1] == '\t')) --Value.Count;
+
+            b32 ChunkedLast = Value.Count >= 7 &&
+                              WebStringViewEqualCStrIgnoreCase((web_string_view) {.Items = Value.Items + Value.Count - 7, .Count = 7}, "chunked");
+
+            if (!ChunkedLast || Parser->Chunked || Request->Version == HTTP_1_0) {
+                WEB_LOG_FMT(WARN, HTTP, "Refusing a request with Transfer-Encoding: " WEB_SV_FMT, WEB_SV_ARG(Value));
+                Parser->ErrorStatus = HTTP_STATUS_BAD_REQUEST;
+                return PARSE_RESULT_ERROR;
+            }
+
+            if (!WebStringViewEqualCStrIgnoreCase(Value, "chunked")) {
+                WEB_LOG_FMT(WARN, HTTP, "Refusing a request with Transfer-Encoding: " WEB_SV_FMT, WEB_SV_ARG(Value));
+                Parser->ErrorStatus = HTTP_STATUS_NOT_IMPLEMENTED;
+                return PARSE_RESULT_ERROR;
+            }
+
+            Parser->Chunked = 1;
+        }
+
+        if (Id == HTTP_HEADER_CONTENT_LENGTH) {
+            s64 ContentLength = -1;
+            if (!HttpParseContentLength(Header.Value, &ContentLength)) {
+                WEB_LOG_FMT(WARN,
+                            HTTP,
+                            "Failed to parse received Content-Length header value as an integer; value=" WEB_SV_FMT,
+                            WEB_SV_ARG(Header.Value));
+                Parser->ErrorStatus = HTTP_STATUS_BAD_REQUEST;
+                return PARSE_RESULT_ERROR;
+            }
+
+            if (Parser->ContentLength >= 0 && Parser->ContentLength != ContentLength) {
+                WEB_LOG(WARN, HTTP, "Received conflicting Content-Length headers");
+                Parser->ErrorStatus = HTTP_STATUS_BAD_REQUEST;
+                return PARSE_RESULT_ERROR;
+            }
+
+            Parser->ContentLength = ContentLength;
+        }
+    }
+
+    if (Parser->State == PARSE_STATE_HEADERS || Parser->ParseOffset > MAX_REQUEST_HEAD_SIZE) {
+        if (BufferSize > MAX_REQUEST_HEAD_SIZE) {
+            WEB_LOG(WARN, HTTP, "Refusing a request whose headers are too large");
+            Parser->ErrorStatus = HTTP_STATUS_REQUEST_HEADER_FIELDS_TOO_LARGE;
+            return PARSE_RESULT_ERROR;
+        }
+
+        return PARSE_RESULT_INCOMPLETE;
+    }
+
+    if (Parser->Chunked && Parser->ContentLength >= 0) {
+        WEB_LOG(WARN, HTTP, "Refusing a request with both Transfer-Encoding and Content-Length");
+        Parser->ErrorStatus = HTTP_STATUS_BAD_REQUEST;
+        return PARSE_RESULT_ERROR;
+    }
+
+    Parser->BodyStart = Parser->ParseOffset;
+    Parser->BodyEnd = Parser->ParseOffset;
+
+    {
+        web_string_view RoutePath = Request->Path;
+        u8 *Query = memchr(RoutePath.Items, '?', RoutePath.Count);
+        if (Query != NULL) RoutePath.Count = Query - RoutePath.Items;
+
+        Parser->Node = RouteMatch(Arena, Parser->Routes, RoutePath, &Parser->Params);
+
+        http_route *Route = RequestParserRoute(Parser, Request->Method);
+        Parser->StreamBody = Parser->AllowStreamBody && Route != NULL && Route->StreamBody;
+
+        if (!Parser->StreamBody && Parser->ContentLength > (s64) Parser->MaxBodySize) {
+            WEB_LOG_FMT(WARN, HTTP, "Refusing a request body of %lld bytes", (long long) Parser->ContentLength);
+            Parser->ErrorStatus = HTTP_STATUS_PAYLOAD_TOO_LARGE;
+            return PARSE_RESULT_ERROR;
+        }
+    }
+
+ParseBody:
+    Request->Headers = Parser->Headers;
+
+    if (Parser->StreamBody) {
+        // NOTE(oleh): The handler pulls the body itself, whatever part of it is already buffered
+        // stays where it is.
+        Request->Body.Items = Buffer + Parser->ParseOffset;
+        Request->Body.Count = 0;
+    } else if (Parser->Chunked) {
+        while (1) {
+            if (!RequestParserSkipChunkFraming(Parser)) {
+                WEB_LOG(WARN, HTTP, "Failed to parse a chunked request body");
+                return PARSE_RESULT_ERROR;
+            }
+
+            if (Parser->ChunkState == PARSE_CHUNK_DONE) break;
+
+            if (Parser->ChunkState != PARSE_CHUNK_DATA) return PARSE_RESULT_INCOMPLETE;
+
+            if (Parser->ChunkRemaining > Parser->MaxBodySize - (Parser->BodyEnd - Parser->BodyStart)) {
+                WEB_LOG(WARN, HTTP, "Refusing a chunked request body that is too large");
+                Parser->ErrorStatus = HTTP_STATUS_PAYLOAD_TOO_LARGE;
+                return PARSE_RESULT_ERROR;
+            }
+
+            uz N = WEB_MIN(BufferSize - Parser->ParseOffset, Parser->ChunkRemaining);
+            if (N == 0) return PARSE_RESULT_INCOMPLETE;
+
+            memmove(Buffer + Parser->BodyEnd, Buffer + Parser->ParseOffset, N);
+            Parser->BodyEnd += N;
+            Parser->ParseOffset += N;
+            Parser->ChunkRemaining -= N;
+        }
+
+        Request->Body.Items = Buffer + Parser->BodyStart;
+        Request->Body.Count = Parser->BodyEnd - Parser->BodyStart;
+    } else if (Parser->ContentLength >= 0) {
+        if (BufferSize - Parser->ParseOffset < (uz) Parser->ContentLength) return PARSE_RESULT_INCOMPLETE;
+
+        Request->Body.Items = Buffer + Parser->ParseOffset;
+        Request->Body.Count = Parser->ContentLength;
+        Parser->ParseOffset += Parser->ContentLength;
+    } else {
+        // NOTE(oleh): Without a Content-Length the request has no body (RFC 9112, section 6.3),
+        // whatever follows the headers is the next pipelined request.
+        Request->Body.Items = Buffer + Parser->ParseOffset;
+        Request->Body.Count = 0;
+    }
+
+    *OutRequest = *Request;
+    return PARSE_RESULT_DONE;
+}
+
+// NOTE(oleh): Sets up a freshly allocated (zeroed) item, returns 0 if it can't.
+typedef b32 (*sync_pool_init_proc)(void *Item);
+
+typedef struct sync_pool_node {
+    struct sync_pool_node *Next;
+    u8 Item[];
+} sync_pool_node;
+
+typedef struct {
+    uz ItemSize;
+    sync_pool_init_proc InitProc;
+    sync_pool_node *Head;
+    web_mutex Mu;
+} sync_pool;
+
+static void SyncPoolInit(sync_pool *Pool, uz ItemSize, sync_pool_init_proc InitProc) {
+    WEB_STRUCT_ZERO(Pool);
+    Pool->ItemSize = ItemSize;
+    Pool->InitProc = InitProc;
+    WebMutexInit(&Pool->Mu);
+}
+
+// NOTE(oleh): Returns NULL when out of memory.
+static void *SyncPoolAlloc(sync_pool *Pool) {
+    WebMutexLock(&Pool->Mu);
+
+    sync_pool_node *Node = Pool->Head;
+    if (Node != NULL) Pool->Head = Node->Next;
+
+    WebMutexUnlock(&Pool->Mu);
+    if (Node != NULL) return Node->Item;
+
+    Node = calloc(1, sizeof(sync_pool_node) + Pool->ItemSize);
+    if (Node == NULL) return NULL;
+
+    if (Pool->InitProc != NULL && !Pool->InitProc(Node->Item)) {
+        free(Node);
+        return NULL;
+    }
+
+    return Node->Item;
+}
+
+static void SyncPoolFree(sync_pool *Pool, void *Item) {
+    WebMutexLock(&Pool->Mu);
+
+    sync_pool_node *Node = (sync_pool_node *)((u8 *)Item - sizeof(Node->Next));
+    Node->Next = Pool->Head;
+    Pool->Head = Node;
+
+    WebMutexUnlock(&Pool->Mu);
+}
+
+#define TCP_BACKLOG_SIZE 256
+
+// NOTE(oleh): This is bad.
+#define DEFAULT_REQUEST_ARENA_CAPACITY (4ll * 1024ll * 1024ll * 1024ll)
+
+typedef struct http_event_loop http_event_loop;
+typedef struct http_uring_loop http_uring_loop;
+typedef struct worker_data worker_data;
+
+// NOTE(oleh): Connections of an event loop in the order they were last heard from, so the ones that
+// stalled for the longest are always at the front.
+typedef struct {
+    worker_data *Head;
+    worker_data *Tail;
+    s64 TimeoutNs;
+} http_timeout_list;
+
+struct worker_data {
+    sync_pool *WorkerDataPool;
+    sync_pool *ContextPool;
+    web_http_server *Server;
+    int ClientSock;
+    web_https_session HttpsSession;
+
+    // NOTE(oleh): Only used by the event loops, where a connection outlives a single readiness
+    // notification and has to carry its partially parsed request around.
+    http_event_loop *Loop;
+    web_http_response_context *Ctx;
+    request_parser Parser;
+
+    // NOTE(oleh): What the socket of an event loop connection didn't take right away. The loop sends it
+    // once the socket is writable again and reads nothing from the connection until then. The bytes
+    // are copies, the buffers they came from may be long gone by the time they go out.
+    u8 *Unsent;
+    uz UnsentSize;
+    uz UnsentOffset;
+    uz UnsentCapacity;
+    web_http_response_file UnsentFile;
+    b32 CloseWhenSent;
+
+    http_timeout_list *TimeoutList;
+    worker_data *TimeoutPrev;
+    worker_data *TimeoutNext;
+    s64 ActiveAt;
+
+    // NOTE(oleh): Set once the client switched to HTTP/2 (thread pool only), `Ctx` and `Parser` are
+    // unused from then on. The streams are served one at a time, `Http2Stream` is the one whose handler
+    // is running.
+    http2_connection *Http2;
+    http2_stream *Http2Stream;
+
+    // NOTE(oleh): The thread pool lane the connection's task is in at the moment.
+    u32 Lane;
+
+#ifdef WEB_USE_IO_URING
+    // NOTE(oleh): Set for connections owned by an io_uring loop. A connection can only be freed
+    // once no submitted operation refers to it anymore.
+    http_uring_loop *Uring;
+    struct io_uring_sqe *UringLastSqe;
+    u64 UringLastSqeGeneration;
+    u32 UringRefs;
+    u32 UringPendingSends;
+    b32 UringClosing;
+#endif // WEB_USE_IO_URING
+};
+
+static void HttpTimeoutListRemove(worker_data *Conn) {
+    http_timeout_list *List = Conn->TimeoutList;
+    if (List == NULL) return;
+
+    if (Conn->TimeoutPrev != NULL) Conn->TimeoutPrev->TimeoutNext = Conn->TimeoutNext;
+    else List->Head = Conn->TimeoutNext;
+
+    if (Conn->TimeoutNext != NULL) Conn->TimeoutNext->TimeoutPrev = Conn->TimeoutPrev;
+    else List->Tail = Conn->TimeoutPrev;
+
+    Conn->TimeoutList = NULL;
+    Conn->TimeoutPrev = NULL;
+    Conn->TimeoutNext = NULL;
+}
+
+// NOTE(oleh): Moves the connection to the back of `List`, restarting its timeout.
+static void HttpTimeoutListTouch(http_timeout_list *List, worker_data *Conn, s64 Now) {
+    HttpTimeoutListRemove(Conn);
+
+    Conn->TimeoutList = List;
+    Conn->ActiveAt = Now;
+    Conn->TimeoutPrev = List->Tail;
+
+    if (List->Tail != NULL) List->Tail->TimeoutNext = Conn;
+    else List->Head = Conn;
+    List->Tail = Conn;
+}
+
+static sz HttpsRead(web_https_session *Sess, u8 *Buffer, uz BufferCapacity) {
+    return Sess->VTable.Read(Sess->Data, Buffer, BufferCapacity);
+}
+
+// TODO(oleh): Get the error string.
+static sz HttpReceive(worker_data *WorkerData, u8 *Buffer, uz BufferCapacity) {
+    sz NumRead = 0;
+
+    if (WorkerData->Server->UseHttps) {
+        NumRead = HttpsRead(&WorkerData->HttpsSession,
+                            Buffer,
+                            BufferCapacity);
+    } else {
+        NumRead = read(WorkerData->ClientSock, Buffer, BufferCapacity);
+    }
+
+    return NumRead;
+}
+
+static request_parse_result HttpRequestParseStreaming(worker_data *WorkerData,
+                                                      web_arena *Arena,
+                                                      web_http_request *Request) {
+    request_parser *Parser = &WorkerData->Parser;
+
+    while (1) {
+        // NOTE(oleh): A pipelined request may already be sitting in the buffer in full.
+        request_parse_result Result = RequestParserAdvance(Parser, Arena, Request);
+        if (Result != PARSE_RESULT_INCOMPLETE) return Result;
+
+        uz Available = 0;
+        u8 *Dest = RequestParserReserve(Parser, Arena, &Available);
+
+        sz N = HttpReceive(WorkerData, Dest, Available);
+        if (N == -1) {
+            // NOTE(oleh): Most likely the keep-alive timeout ran out.
+            WEB_LOG(INFO, HTTP, "Failed to receive from a client socket");
+            return PARSE_RESULT_ERROR;
+        }
+
+        if (N == 0) {
+            if (Parser->BufferSize > 0) {
+                WEB_LOG(INFO, HTTP, "Client closed the connection before sending a full request");
+            }
+            return PARSE_RESULT_ERROR;
+        }
+
+        Parser->BufferSize += N;
+    }
+}
+
+static sz HttpsWriteV(web_https_session *Sess, struct iovec *Iov, int IovCount) {
+    if (Sess->VTable.WriteV != NULL) return Sess->VTable.WriteV(Sess->Data, Iov, IovCount);
+
+    sz Total = 0;
+    for (int I = 0; I < IovCount; ++I) {
+        sz N = Sess->VTable.Write(Sess->Data, Iov[I].iov_base, Iov[I].iov_len);
+        if (N <= 0) return -1;
+        Total += N;
+    }
+
+    return Total;
+}
+
+#define SOCKET_WRITE_TIMEOUT_MS (30 * 1000)
+
+// NOTE(oleh): Drops the first `N` bytes from the buffers.
+static void HttpIovAdvance(struct iovec **Iov, int *IovCount, uz N) {
+    while (*IovCount > 0 && N >= (*Iov)->iov_len) {
+        N -= (*Iov)->iov_len;
+        ++*Iov;
+        --*IovCount;
+    }
+
+    if (*IovCount > 0) {
+        (*Iov)->iov_base = (u8 *) (*Iov)->iov_base + N;
+        (*Iov)->iov_len -= N;
+    }
+}
+
+// NOTE(oleh): Writes all of the buffers to a blocking socket, which gives up after
+// `SOCKET_WRITE_TIMEOUT_MS`. Consumes `Iov`.
+static sz HttpSocketWriteVAll(int Sock, struct iovec *Iov, int IovCount, int Flags) {
+    uz Written = 0;
+
+    while (IovCount > 0) {
+        struct msghdr Message = {.msg_iov = Iov, .msg_iovlen = IovCount};
+
+        sz N = sendmsg(Sock, &Message, MSG_NOSIGNAL | Flags);
+        if (N == -1) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+
+        Written += N;
+        HttpIovAdvance(&Iov, &IovCount, N);
+    }
+
+    return Written;
+}
+
+static b32 HttpConnectionHasUnsent(worker_data *Conn) {
+    return Conn->UnsentOffset < Conn->UnsentSize || Conn->UnsentFile.Present;
+}
+
+static void HttpUnsentAppend(worker_data *Conn, struct iovec *Iov, int IovCount) {
+    uz Count = 0;
+    for (int I = 0; I < IovCount; ++I) Count += Iov[I].iov_len;
+
+    if (Conn->UnsentSize + Count > Conn->UnsentCapacity && Conn->UnsentOffset > 0) {
+        // NOTE(oleh): Whatever went out already makes room first.
+        memmove(Conn->Unsent, Conn->Unsent + Conn->UnsentOffset, Conn->UnsentSize - Conn->UnsentOffset);
+        Conn->UnsentSize -= Conn->UnsentOffset;
+        Conn->UnsentOffset = 0;
+    }
+
+    if (Conn->UnsentSize + Count > Conn->UnsentCapacity) {
+        uz NewCapacity = WEB_MAX(Conn->UnsentCapacity * 2, 4096);
+        while (NewCapacity < Conn->UnsentSize + Count) NewCapacity *= 2;
+
+        u8 *Unsent = realloc(Conn->Unsent, NewCapacity);
+        if (Unsent == NULL) WEB_PANIC("Failed to grow the unsent response buffer of a connection");
+
+        Conn->Unsent = Unsent;
+        Conn->UnsentCapacity = NewCapacity;
+    }
+
+    for (int I = 0; I < IovCount; ++I) {
+        memcpy(Conn->Unsent + Conn->UnsentSize, Iov[I].iov_base, Iov[I].iov_len);
+        Conn->UnsentSize += Iov[I].iov_len;
+    }
+}
+
+// NOTE(oleh): The event loops never wait for a socket. What it doesn't take right away is queued on
+// the connection, and so is everything sent after that, so the order stays intact.
+static sz HttpEventLoopSendV(worker_data *Conn, struct iovec *Iov, int IovCount, int Flags) {
+    uz Count = 0;
+    for (int I = 0; I < IovCount; ++I) Count += Iov[I].iov_len;
+
+    // NOTE(oleh): A file always comes last in a response.
+    WEB_ASSERT(!Conn->UnsentFile.Present);
+
+    while (IovCount > 0 && !HttpConnectionHasUnsent(Conn)) {
+        struct msghdr Message = {.msg_iov = Iov, .msg_iovlen = IovCount};
+
+        sz N = sendmsg(Conn->ClientSock, &Message, MSG_NOSIGNAL | Flags);
+        if (N == -1) {
+            if (errno == EINTR) continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK) break;
+            return -1;
+        }
+
+        HttpIovAdvance(&Iov, &IovCount, N);
+    }
+
+    if (IovCount > 0) HttpUnsentAppend(Conn, Iov, IovCount);
+    return Count;
+}
+
+#ifdef WEB_USE_IO_URING
+static sz HttpUringSendV(worker_data *Conn, struct iovec *Iov, int IovCount);
+#endif // WEB_USE_IO_URING
+
+// NOTE(oleh): Sends the buffers as one gathered write, so the body never has to be copied next to the
+// headers. The buffers have to stay alive until the next request on the connection begins.
+// TODO(oleh): Get the error string.
+static sz HttpResponseSendV(worker_data *WorkerData, struct iovec *Iov, int IovCount) {
+#ifdef WEB_USE_IO_URING
+    if (WorkerData->Uring != NULL) {
+        return HttpUringSendV(WorkerData, Iov, IovCount);
+    }
+#endif // WEB_USE_IO_URING
+
+    if (WorkerData->Loop != NULL) return HttpEventLoopSendV(WorkerData, Iov, IovCount, 0);
+
+    if (WorkerData->Server->UseHttps) {
+        return HttpsWriteV(&WorkerData->HttpsSession, Iov, IovCount);
+    } else {
+        return HttpSocketWriteVAll(WorkerData->ClientSock, Iov, IovCount, 0);
+    }
+}
+
+static sz HttpSocketSendFile(int Sock, int Fd, s64 Offset, uz Count) {
+    off_t FileOffset = Offset;
+    uz Sent = 0;
+
+    while (Sent < Count) {
+        sz N = sendfile(Sock, Fd, &FileOffset, Count - Sent);
+        if (N == -1) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+
+        // NOTE(oleh): The file got truncated under us.
+        if (N == 0) return -1;
+
+        Sent += N;
+    }
+
+    return Sent;
+}
+
+// NOTE(oleh): Like `HttpEventLoopSendV`. The connection takes the file over if it can't be sent right
+// away, and releases it once it has been.
+static sz HttpEventLoopSendFile(worker_data *Conn, web_http_response_file *File) {
+    web_http_response_file Rest = *File;
+
+    while (Rest.Count > 0 && !HttpConnectionHasUnsent(Conn)) {
+        off_t FileOffset = Rest.Offset;
+        sz N = sendfile(Conn->ClientSock, Rest.Fd, &FileOffset, Rest.Count);
+        if (N == -1) {
+            if (errno == EINTR) continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK) break;
+            return -1;
+        }
+
+        // NOTE(oleh): The file got truncated under us.
+        if (N == 0) return -1;
+
+        Rest.Offset += N;
+        Rest.Count -= N;
+    }
+
+    if (Rest.Count > 0) {
+        Conn->UnsentFile = Rest;
+        File->Release = NULL;
+    }
+
+    return File->Count;
+}
+
+// NOTE(oleh): Sends as much of what is queued on the connection as the socket takes. Returns 0 on errors.
+static b32 HttpEventLoopSendUnsent(worker_data *Conn) {
+    web_http_response_file *File = &Conn->UnsentFile;
+
+    while (Conn->UnsentOffset < Conn->UnsentSize) {
+        int Flags = MSG_NOSIGNAL | (File->Present ? MSG_MORE : 0);
+        sz N = send(Conn->ClientSock, Conn->Unsent + Conn->UnsentOffset, Conn->UnsentSize - Conn->UnsentOffset, Flags);
+        if (N == -1) {
+            if (errno == EINTR) continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK) return 1;
+            return 0;
+        }
+
+        Conn->UnsentOffset += N;
+    }
+
+    // NOTE(oleh): The buffer is only needed by slow clients, so it doesn't stay around.
+    free(Conn->Unsent);
+    Conn->Unsent = NULL;
+    Conn->UnsentSize = 0;
+    Conn->UnsentOffset = 0;
+    Conn->UnsentCapacity = 0;
+
+    while (File->Present && File->Count > 0) {
+        off_t FileOffset = File->Offset;
+        sz N = sendfile(Conn->ClientSock, File->Fd, &FileOffset, File->Count);
+        if (N == -1) {
+            if (errno == EINTR) continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK) return 1;
+            return 0;
+        }
+
+        if (N == 0) return 0;
+
+        File->Offset += N;
+        File->Count -= N;
+    }
+
+    if (File->Present) {
+        if (File->Release != NULL) File->Release(File->ReleaseData);
+        *File = (web_http_response_file) {0};
+    }
+
+    return 1;
+}
+
+#define FILE_CHUNK_SIZE (64 * 1024)
+
+// NOTE(oleh): Sends the response head followed by a file body. Plain sockets get the file through
+// sendfile, so its contents never enter user space. TLS sessions and io_uring connections have to
+// read it into the arena first.
+static sz HttpResponseSendFile(worker_data *WorkerData,
+                               web_arena *Arena,
+                               struct iovec *Head,
+                               int HeadCount,
+                               web_http_response_file *File) {
+    b32 Plain = !WorkerData->Server->UseHttps;
+#ifdef WEB_USE_IO_URING
+    if (WorkerData->Uring != NULL) Plain = 0;
+#endif // WEB_USE_IO_URING
+
+    if (Plain && WorkerData->Loop != NULL) {
+        if (HttpEventLoopSendV(WorkerData, Head, HeadCount, MSG_MORE) == -1) return -1;
+        return HttpEventLoopSendFile(WorkerData, File);
+    }
+
+    if (Plain) {
+        if (HttpSocketWriteVAll(WorkerData->ClientSock, Head, HeadCount, MSG_MORE) == -1) return -1;
+        return HttpSocketSendFile(WorkerData->ClientSock, File->Fd, File->Offset, File->Count);
+    }
+
+    if (HttpResponseSendV(WorkerData, Head, HeadCount) == -1) return -1;
+
+    // NOTE(oleh): io_uring sends complete later, so every chunk needs its own buffer there.
+    b32 ReuseChunk = 1;
+#ifdef WEB_USE_IO_URING
+    if (WorkerData->Uring != NULL) ReuseChunk = 0;
+#endif // WEB_USE_IO_URING
+
+    uz ChunkSize = ReuseChunk ? WEB_MIN(File->Count, FILE_CHUNK_SIZE) : File->Count;
+    u8 *Chunk = WebArenaPush(Arena, WEB_MAX(ChunkSize, 1));
+
+    uz Sent = 0;
+    while (Sent < File->Count) {
+        uz ToRead = WEB_MIN(ChunkSize, File->Count - Sent);
+        sz N = pread(File->Fd, Chunk, ToRead, File->Offset + Sent);
+        if (N <= 0) return -1;
+
+        struct iovec Iov = {.iov_base = Chunk, .iov_len = N};
+        if (HttpResponseSendV(WorkerData, &Iov, 1) == -1) return -1;
+
+        Sent += N;
+        if (!ReuseChunk) Chunk += N;
+    }
+
+    return Sent;
+}
+
+static sz HttpsCloseConnection(web_https_session *Sess) {
+    return Sess->VTable.Close(Sess->Data);
+}
+
+// NOTE(oleh): Clears what the previous response left in the context. The arena has to be reset by the
+// caller, before anything else got pushed onto it.
+static void HttpContextReset(web_http_response_context *Ctx) {
+    Ctx->ResponseHeaders.Count = 0;
+    WEB_ARRAY_INIT(&Ctx->Arena, &Ctx->ResponseHeaders);
+    Ctx->Content = (web_string_view) {0};
+    Ctx->File = (web_http_response_file) {0};
+    Ctx->HandlerData = NULL;
+    Ctx->BodyReader = (web_http_body_reader) {0};
+    Ctx->Stream = (web_http_response_stream) {0};
+    Ctx->ResponseTrailers.Count = 0;
+    WEB_ARRAY_INIT(&Ctx->Arena, &Ctx->ResponseTrailers);
+}
+
+// NOTE(oleh): Prepares the connection for its next request. The context (and its arena) is kept
+// for the whole lifetime of a keep-alive connection and only reset between the requests. Returns 0
+// if there is no memory for the context, which can only happen before the first request.
+static b32 HttpConnectionBeginRequest(worker_data *Conn) {
+    web_string_view Pending = {0};
+
+    if (Conn->Ctx == NULL) {
+        Conn->Ctx = SyncPoolAlloc(Conn->ContextPool);
+        if (Conn->Ctx == NULL) {
+            WEB_LOG(ERROR, HTTP, "Out of memory for a request context");
+            return 0;
+        }
+    } else {
+        request_parser *Parser = &Conn->Parser;
+        Pending.Items = Parser->Buffer + Parser->ParseOffset;
+        Pending.Count = Parser->BufferSize - Parser->ParseOffset;
+    }
+
+    web_http_response_context *Ctx = Conn->Ctx;
+
+    // NOTE(oleh): io_uring connections can't receive outside of their multishot receive, and the event
+    // loops can't wait for the rest of a body in the middle of a handler, so their bodies are always
+    // buffered.
+    b32 AllowStreamBody = Conn->Loop == NULL;
+#ifdef WEB_USE_IO_URING
+    if (Conn->Uring != NULL) AllowStreamBody = 0;
+#endif // WEB_USE_IO_URING
+
+    WebArenaReset(&Ctx->Arena);
+    RequestParserInit(&Conn->Parser, &Ctx->Arena, Pending, Conn->Server->Routes, AllowStreamBody, Conn->Server->MaxRequestBodySize);
+
+    HttpContextReset(Ctx);
+    return 1;
+}
+
+static void HttpConnectionReleaseContext(worker_data *Conn) {
+    if (Conn->Ctx == NULL) return;
+
+    SyncPoolFree(Conn->ContextPool, Conn->Ctx);
+    Conn->Ctx = NULL;
+}
+
+static void HttpConnectionClose(worker_data *Data) {
+    // NOTE(oleh): There's no session when the handshake didn't get far enough to set one up.
+    if (Data->Server->UseHttps && Data->HttpsSession.VTable.Close != NULL) {
+        HttpsCloseConnection(&Data->HttpsSession);
+    }
+
+    close(Data->ClientSock);
+
+    // NOTE(oleh): Gives the contexts of the streams back to the pool.
+    if (Data->Http2 != NULL) {
+        Http2ConnectionDestroy(Data->Http2);
+        Data->Http2 = NULL;
+    }
+
+    HttpConnectionReleaseContext(Data);
+
+    // NOTE(oleh): An event loop connection may still have a part of its response queued.
+    HttpTimeoutListRemove(Data);
+    free(Data->Unsent);
+    if (Data->UnsentFile.Release != NULL) Data->UnsentFile.Release(Data->UnsentFile.ReleaseData);
+
+    SyncPoolFree(Data->WorkerDataPool, Data);
+}
+
+// NOTE(oleh): HTTP/1.1 connections are persistent unless the client says otherwise, HTTP/1.0 ones
+// have to ask for it. (https://datatracker.ietf.org/doc/html/rfc7230#section-6.3)
+static b32 HttpRequestKeepAlive(web_http_request *Request) {
+    web_string_view Connection;
+    if (!WebHttpRequestGetKnownHeader(Request, HTTP_HEADER_CONNECTION, &Connection)) return Request->Version != HTTP_1_0;
+
+    return HttpConnectionOptionsKeepAlive(Request->Version, Connection);
+}
+
+static const char *HttpConnectionHeader(web_http_version Version, b32 KeepAlive) {
+    if (!KeepAlive) return "Connection: close\r\n";
+    if (Version == HTTP_1_0) return "Connection: keep-alive\r\n";
+    return "";
+}
+
+#define HTTP_DATE_HEADER_SIZE (sizeof("Date: Sun, 06 Nov 1994 08:49:37 GMT\r\n") - 1)
+
+// NOTE(oleh): The Date header is regenerated once a second by its own thread. It writes the buffer
+// that's not in use and then flips `HttpDateCurrent`, readers just copy the current one.
+static char HttpDateHeaders[2][HTTP_DATE_HEADER_SIZE + 1];
+static u32 HttpDateCurrent;
+static pthread_once_t HttpDateOnce = PTHREAD_ONCE_INIT;
+static web_thread HttpDateThread;
+
+static void HttpDateFormat(char *Out, time_t Now) {
+    static const char *Days[] = {"Sun", "Mon", "Tue", "Wed", "Thu", "Fri", "Sat"};
+    static const char *Months[] = {"Jan", "Feb", "Mar", "Apr", "May", "Jun", "Jul", "Aug", "Sep", "Oct", "Nov", "Dec"};
+
+    struct tm Tm;
+    gmtime_r(&Now, &Tm);
+
+    // NOTE(oleh): IMF-fixdate. (https://datatracker.ietf.org/doc/html/rfc7231#section-7.1.1.1)
+    char Header[64];
+    snprintf(Header,
+             sizeof(Header),
+             "Date: %s, %02d %s %04d %02d:%02d:%02d GMT\r\n",
+             Days[Tm.tm_wday],
+             Tm.tm_mday,
+             Months[Tm.tm_mon],
+             Tm.tm_year + 1900,
+             Tm.tm_hour,
+             Tm.tm_min,
+             Tm.tm_sec);
+
+    memcpy(Out, Header, HTTP_DATE_HEADER_SIZE);
+}
+
+static void HttpDateUpdate(void) {
+    struct timespec Now;
+    clock_gettime(CLOCK_REALTIME, &Now);
+
+    u32 Next = __atomic_load_n(&HttpDateCurrent, __ATOMIC_RELAXED) ^ 1;
+    HttpDateFormat(HttpDateHeaders[Next], Now.tv_sec);
+    __atomic_store_n(&HttpDateCurrent, Next, __ATOMIC_RELEASE);
+}
+
+static void *HttpDateProc(void *Arg) {
+    (void) Arg;
+
+    while (1) {
+        // NOTE(oleh): Wake up right after the second changes.
+        struct timespec Now;
+        clock_gettime(CLOCK_REALTIME, &Now);
+        // Exactly on the boundary the remainder is a full second, which tv_nsec cannot hold.
+        struct timespec Sleep = {.tv_sec = 0, .tv_nsec = 1000000000l - Now.tv_nsec};
+        if (Sleep.tv_nsec >= 1000000000l) {
+            Sleep.tv_sec += 1;
+            Sleep.tv_nsec -= 1000000000l;
+        }
+        nanosleep(&Sleep, NULL);
+
+        HttpDateUpdate();
+    }
+
+    return NULL;
+}
+
+static void HttpDateStartOnce(void) {
+    HttpDateUpdate();
+
+    if (!WebThreadLaunch(&HttpDateThread, HttpDateProc, NULL)) {
+        WEB_PANIC("Could not launch the Date header thread");
+    }
+}
+
+static void HttpDateStart(void) {
+    pthread_once(&HttpDateOnce, HttpDateStartOnce);
+}
+
+static const char *HttpDateHeader(void) {
+    return HttpDateHeaders[__atomic_load_n(&HttpDateCurrent, __ATOMIC_ACQUIRE)];
+}
+
+static uz HttpFormatUz(char *Out, uz Value) {
+    char Digits[24];
+    uz Count = 0;
+
+    do {
+        Digits[Count++] = '0' + Value % 10;
+        Value /= 10;
+    } while (Value > 0);
+
+    for (uz I = 0; I < Count; ++I) Out[I] = Digits[Count - I - 1];
+    return Count;
+}
+
+#define HTTP_STATIC_HEADERS "Access-Control-Allow-Origin: *\r\n"
+
+static inline u8 *HttpAppend(u8 *Cursor, const void *Bytes, uz Count) {
+    memcpy(Cursor, Bytes, Count);
+    return Cursor + Count;
+}
+
+// NOTE(oleh): Assembles the status line and all of the headers with plain copies. The Content-Length
+// is left out when `ContentLength` is negative, `ExtraHeaders` is for the ones only the server adds
+// (Transfer-Encoding, Allow).
+static web_string_view HttpResponseHeadFormat(web_http_response_context *Ctx,
+                                              web_http_version Version,
+                                              web_http_response_status Status,
+                                              s64 ContentLength,
+                                              const char *ExtraHeaders,
+                                              const char *ConnectionHeader) {
+    // 1. Status line. (https://datatracker.ietf.org/doc/html/rfc2616#section-6.1)
+    web_string_view StatusLine = HttpStatusLine(Version, Status);
+
+    char ContentLengthHeader[64];
+    uz ContentLengthCount = 0;
+    if (ContentLength >= 0) {
+        memcpy(ContentLengthHeader, "Content-Length: ", 16);
+        ContentLengthCount = 16 + HttpFormatUz(ContentLengthHeader + 16, ContentLength);
+        ContentLengthHeader[ContentLengthCount++] = '\r';
+        ContentLengthHeader[ContentLengthCount++] = '\n';
+    }
+
+    uz ExtraCount = strlen(ExtraHeaders);
+    uz ConnectionCount = strlen(ConnectionHeader);
+
+    // 2. Headers.
+    uz Size = StatusLine.Count + sizeof(HTTP_STATIC_HEADERS) - 1 + HTTP_DATE_HEADER_SIZE +
+        ContentLengthCount + ExtraCount + ConnectionCount + 2;
+
+    web_http_headers Headers = Ctx->ResponseHeaders;
+    for (uz I = 0; I < Headers.Count; ++I) Size += Headers.Items[I].Name.Count + Headers.Items[I].Value.Count + 4;
+
+    u8 *Head = WebArenaPush(&Ctx->Arena, Size);
+    u8 *Cursor = Head;
+
+    Cursor = HttpAppend(Cursor, StatusLine.Items, StatusLine.Count);
+    Cursor = HttpAppend(Cursor, HTTP_STATIC_HEADERS, sizeof(HTTP_STATIC_HEADERS) - 1);
+    Cursor = HttpAppend(Cursor, HttpDateHeader(), HTTP_DATE_HEADER_SIZE);
+    Cursor = HttpAppend(Cursor, ContentLengthHeader, ContentLengthCount);
+    Cursor = HttpAppend(Cursor, ExtraHeaders, ExtraCount);
+    Cursor = HttpAppend(Cursor, ConnectionHeader, ConnectionCount);
+
+    for (uz I = 0; I < Headers.Count; ++I) {
+        web_http_header Header = Headers.Items[I];
+        Cursor = HttpAppend(Cursor, Header.Name.Items, Header.Name.Count);
+        Cursor = HttpAppend(Cursor, ": ", 2);
+        Cursor = HttpAppend(Cursor, Header.Value.Items, Header.Value.Count);
+        Cursor = HttpAppend(Cursor, "\r\n", 2);
+    }
+
+    Cursor = HttpAppend(Cursor, "\r\n", 2);
+    WEB_ASSERT((uz) (Cursor - Head) == Size);
+
+    return (web_string_view) {.Items = Head, .Count = Size};
+}
+
+// NOTE(oleh): The same headers `HttpResponseHeadFormat` puts in an HTTP/1 head, without the status line and
+// the Connection header. `ExtraHeaders` are formatted the HTTP/1 way, "Name: Value\r\n" each.
+static web_http_headers HttpHttp2ResponseHeaders(web_http_response_context *Ctx,
+                                                 s64 ContentLength,
+                                                 web_string_view ExtraHeaders) {
+    web_http_headers Headers;
+    WEB_ARRAY_INIT(&Ctx->Arena, &Headers);
+
+    u8 *Date = WebArenaPush(&Ctx->Arena, HTTP_DATE_HEADER_SIZE);
+    memcpy(Date, HttpDateHeader(), HTTP_DATE_HEADER_SIZE);
+    web_http_header DateHeader = {
+        .Name = WEB_SV_LIT("date"),
+        .Value = {.Items = Date + 6, .Count = HTTP_DATE_HEADER_SIZE - 8},
+    };
+    WEB_ARRAY_PUSH(&Ctx->Arena, &Headers, DateHeader);
+
+    web_http_header AllowOriginHeader = {.Name = WEB_SV_LIT("access-control-allow-origin"), .Value = WEB_SV_LIT("*")};
+    WEB_ARRAY_PUSH(&Ctx->Arena, &Headers, AllowOriginHeader);
+
+    if (ContentLength >= 0) {
+        u8 *Digits = WebArenaPush(&Ctx->Arena, 24);
+        web_http_header ContentLengthHeader = {
+            .Name = WEB_SV_LIT("content-length"),
+            .Value = {.Items = Digits, .Count = HttpFormatUz((char *) Digits, ContentLength)},
+        };
+        WEB_ARRAY_PUSH(&Ctx->Arena, &Headers, ContentLengthHeader);
+    }
+
+    // NOTE(oleh): There is no blank line after them, so the parser reports failure once it runs out.
+    uz Offset = 0;
+    if (ExtraHeaders.Count > 0) HttpHeadersParse(&Ctx->Arena, ExtraHeaders, &Offset, &Headers);
+
+    for (uz I = 0; I < Ctx->ResponseHeaders.Count; ++I) {
+        WEB_ARRAY_PUSH(&Ctx->Arena, &Headers, Ctx->ResponseHeaders.Items[I]);
+    }
+
+    return Headers;
+}
+
+// NOTE(oleh): Whatever the flow control doesn't let through right away waits on the stream, `Copy` says
+// whether the body has to be copied for that or already lives in the context's arena.
+static b32 HttpHttp2Send(worker_data *Data,
+                         web_http_response_status Status,
+                         web_http_headers Headers,
+                         web_string_view Body,
+                         b32 Copy) {
+    b32 EndStream = Body.Count == 0;
+    if (!Http2StreamSendHeaders(Data->Http2, Data->Http2Stream, Status, Headers, EndStream)) return 0;
+    if (EndStream) return 1;
+
+    return Http2StreamSendData(Data->Http2, Data->Http2Stream, Body, 1, Copy);
+}
+
+static b32 HttpSendEmptyResponse(worker_data *Data,
+                                 web_http_response_context *Ctx,
+                                 web_http_version Version,
+                                 web_http_response_status ResponseStatus,
+                                 const char *ExtraHeaders,
+                                 const char *ConnectionHeader) {
+    if (Version == HTTP_2) {
+        web_http_headers Headers = HttpHttp2ResponseHeaders(Ctx, 0, WEB_SV_LIT(ExtraHeaders));
+        return HttpHttp2Send(Data, ResponseStatus, Headers, (web_string_view) {0}, 0);
+    }
+
+    web_string_view Head = HttpResponseHeadFormat(Ctx, Version, ResponseStatus, 0, ExtraHeaders, ConnectionHeader);
+
+    struct iovec Iov = {.iov_base = Head.Items, .iov_len = Head.Count};
+    sz NumSent = HttpResponseSendV(Data, &Iov, 1);
+    return NumSent > 0;
+}
+
+// NOTE(oleh): Tells the client why the parser refused its request, if it was the request's fault. The
+// caller closes the connection right after, nothing past the refused request gets looked at.
+static void HttpRejectRequest(worker_data *Conn) {
+    web_http_response_status Status = Conn->Parser.ErrorStatus;
+    if (Status == 0 || Conn->Ctx == NULL) return;
+
+    HttpSendEmptyResponse(Conn, Conn->Ctx, HTTP_1_1, Status, "", HttpConnectionHeader(HTTP_1_1, 0));
+}
+
+#define RESPONSE_CACHE_SHARDS_COUNT 16
+#define RESPONSE_CACHE_BUCKETS_COUNT 1024
+#define RESPONSE_CACHE_DEFAULT_CAPACITY (64 * 1024 * 1024)
+#define RESPONSE_CACHE_DEFAULT_MAX_ENTRY_SIZE (1024 * 1024)
+
+// NOTE(oleh): A cached response is everything after the Connection header: the Content-Length, the
+// handler's headers and the body. The status line, Date and Connection depend on the request and the
+// time, so they are put in front on every hit.
+typedef struct http_cache_entry http_cache_entry;
+struct http_cache_entry {
+    http_cache_entry *BucketNext;
+    http_cache_entry *LruPrev;
+    http_cache_entry *LruNext;
+
+    u64 Hash;
+    web_string_view Key;
+    // NOTE(oleh): The path without the query, what invalidation goes by.
+    web_string_view Path;
+
+    web_http_response_status Status;
+    web_string_view Data;
+    s64 ExpiresAt;
+    uz Size;
+
+    // NOTE(oleh): Responses being sent from the entry. A dead entry is out of the shard already and gets
+    // freed by the last of them.
+    s32 Refs;
+    b32 Dead;
+};
+
+typedef struct {
+    web_mutex Mu;
+    http_cache_entry *Buckets[RESPONSE_CACHE_BUCKETS_COUNT];
+    // NOTE(oleh): Most recently used first.
+    http_cache_entry *LruHead;
+    http_cache_entry *LruTail;
+    uz Size;
+    uz Capacity;
+} http_cache_shard;
+
+struct web_http_response_cache {
+    http_cache_shard Shards[RESPONSE_CACHE_SHARDS_COUNT];
+    uz MaxEntrySize;
+};
+
+static void HttpCacheInit(web_http_response_cache *Cache, uz Capacity, uz MaxEntrySize) {
+    for (uz I = 0; I < RESPONSE_CACHE_SHARDS_COUNT; ++I) {
+        http_cache_shard *Shard = &Cache->Shards[I];
+        WEB_STRUCT_ZERO(Shard);
+        WebMutexInit(&Shard->Mu);
+        Shard->Capacity = Capacity / RESPONSE_CACHE_SHARDS_COUNT;
+    }
+
+    Cache->MaxEntrySize = WEB_MIN(MaxEntrySize, Capacity / RESPONSE_CACHE_SHARDS_COUNT);
+}
+
+// NOTE(oleh): All the variants of a path live in the same shard, so that invalidating it only has to
+// look at one of them.
+static http_cache_shard *HttpCacheShard(web_http_response_cache *Cache, web_string_view Path) {
+    return &Cache->Shards[WebHashFnv1(Path) % RESPONSE_CACHE_SHARDS_COUNT];
+}
+
+static web_string_view HttpCachePath(web_string_view RequestPath) {
+    u8 *Query = memchr(RequestPath.Items, '?', RequestPath.Count);
+    if (Query != NULL) RequestPath.Count = Query - RequestPath.Items;
+    return RequestPath;
+}
+
+// NOTE(oleh): The full request path, then the value of every header the route varies on and the
+// response encoding. Values are NUL-separated, a missing header is a lone \1.
+static web_string_view HttpCacheKey(web_arena *Arena,
+                                    web_http_request *Request,
+                                    http_route *Route,
+                                    web_compression_encoding Encoding) {
+    web_dynamic_string Key;
+    WEB_ARRAY_INIT(Arena, &Key);
+
+    for (uz I = 0; I < Request->Path.Count; ++I) WEB_ARRAY_PUSH(Arena, &Key, Request->Path.Items[I]);
+
+    for (uz VaryIndex = 0; VaryIndex < Route->CacheVaryCount; ++VaryIndex) {
+        WEB_ARRAY_PUSH(Arena, &Key, '\0');
+
+        web_string_view Value;
+        if (!WebHttpRequestGetHeader(Request, WEB_SV_LIT(Route->CacheVary[VaryIndex]), &Value)) {
+            WEB_ARRAY_PUSH(Arena, &Key, '\1');
+            continue;
+        }
+
+        for (uz I = 0; I < Value.Count; ++I) WEB_ARRAY_PUSH(Arena, &Key, Value.Items[I]);
+    }
+
+    // NOTE(oleh): Responses are cached after compression, so the encoding is a part of the key too.
+    WEB_ARRAY_PUSH(Arena, &Key, '\0');
+    WEB_ARRAY_PUSH(Arena, &Key, (u8) Encoding);
+
+    return (web_string_view) {.Items = Key.Items, .Count = Key.Count};
+}
+
+static void HttpCacheLruUnlink(http_cache_shard *Shard, http_cache_entry *Entry) {
+    if (Entry->LruPrev != NULL) Entry->LruPrev->LruNext = Entry->LruNext;
+    else Shard->LruHead = Entry->LruNext;
+
+    if (Entry->LruNext != NULL) Entry->LruNext->LruPrev = Entry->LruPrev;
+    else Shard->LruTail = Entry->LruPrev;
+
+    Entry->LruPrev = NULL;
+    Entry->LruNext = NULL;
+}
+
+static void HttpCacheLruPushFront(http_cache_shard *Shard, http_cache_entry *Entry) {
+    Entry->LruPrev = NULL;
+    Entry->LruNext = Shard->LruHead;
+    if (Shard->LruHead != NULL) Shard->LruHead->LruPrev = Entry;
+    Shard->LruHead = Entry;
+    if (Shard->LruTail == NULL) Shard->LruTail = Entry;
+}
+
+// NOTE(oleh): Must be called with the shard mutex held.
+static void HttpCacheRemove(http_cache_shard *Shard, http_cache_entry *Entry) {
+    http_cache_entry **Link = &Shard->Buckets[Entry->Hash % RESPONSE_CACHE_BUCKETS_COUNT];
+    while (*Link != Entry) Link = &(*Link)->BucketNext;
+    *Link = Entry->BucketNext;
+
+    HttpCacheLruUnlink(Shard, Entry);
+    Shard->Size -= Entry->Size;
+
+    Entry->Dead = 1;
+    if (Entry->Refs == 0) free(Entry);
+}
+
+static http_cache_entry *HttpCacheAcquire(web_http_response_cache *Cache, web_string_view Path, web_string_view Key) {
+    http_cache_shard *Shard = HttpCacheShard(Cache, Path);
+    u64 Hash = WebHashFnv1(Key);
+    s64 Now = HttpMonotonicNs();
+
+    WebMutexLock(&Shard->Mu);
+
+    http_cache_entry *Entry = Shard->Buckets[Hash % RESPONSE_CACHE_BUCKETS_COUNT];
+    while (Entry != NULL && !(Entry->Hash == Hash && WebStringViewEqual(Entry->Key, Key))) Entry = Entry->BucketNext;
+
+    if (Entry != NULL && Entry->ExpiresAt <= Now) {
+        HttpCacheRemove(Shard, Entry);
+        Entry = NULL;
+    }
+
+    if (Entry != NULL) {
+        ++Entry->Refs;
+        HttpCacheLruUnlink(Shard, Entry);
+        HttpCacheLruPushFront(Shard, Entry);
+    }
+
+    WebMutexUnlock(&Shard->Mu);
+    return Entry;
+}
+
+static void HttpCacheRelease(web_http_response_cache *Cache, http_cache_entry *Entry) {
+    http_cache_shard *Shard = HttpCacheShard(Cache, Entry->Path);
+
+    WebMutexLock(&Shard->Mu);
+    --Entry->Refs;
+    b32 Free = Entry->Refs == 0 && Entry->Dead;
+    WebMutexUnlock(&Shard->Mu);
+
+    if (Free) free(Entry);
+}
+
+static void HttpCacheStore(web_http_response_cache *Cache,
+                           web_http_response_context *Ctx,
+                           web_string_view Key,
+                           web_http_response_status Status,
+                           u32 TtlMs) {
+    web_string_view Path = HttpCachePath(Ctx->Request.Path);
+
+    char ContentLengthHeader[64];
+    uz ContentLengthCount = 0;
+    memcpy(ContentLengthHeader, "Content-Length: ", 16);
+    ContentLengthCount = 16 + HttpFormatUz(ContentLengthHeader + 16, Ctx->Content.Count);
+    ContentLengthHeader[ContentLengthCount++] = '\r';
+    ContentLengthHeader[ContentLengthCount++] = '\n';
+
+    web_http_headers Headers = Ctx->ResponseHeaders;
+    uz DataSize = ContentLengthCount + 2 + Ctx->Content.Count;
+    for (uz I = 0; I < Headers.Count; ++I) DataSize += Headers.Items[I].Name.Count + Headers.Items[I].Value.Count + 4;
+
+    uz Size = sizeof(http_cache_entry) + Key.Count + DataSize;
+    if (Size > Cache->MaxEntrySize) return;
+
+    // NOTE(oleh): One allocation for the entry, its key and the response.
+    http_cache_entry *Entry = malloc(Size);
+    WEB_STRUCT_ZERO(Entry);
+
+    u8 *Cursor = (u8 *) (Entry + 1);
+    Entry->Key = (web_string_view) {.Items = Cursor, .Count = Key.Count};
+    Cursor = HttpAppend(Cursor, Key.Items, Key.Count);
+    // NOTE(oleh): The key starts with the path.
+    Entry->Path = (web_string_view) {.Items = Entry->Key.Items, .Count = Path.Count};
+
+    Entry->Data = (web_string_view) {.Items = Cursor, .Count = DataSize};
+    Cursor = HttpAppend(Cursor, ContentLengthHeader, ContentLengthCount);
+    for (uz I = 0; I < Headers.Count; ++I) {
+        web_http_header Header = Headers.Items[I];
+        Cursor = HttpAppend(Cursor, Header.Name.Items, Header.Name.Count);
+        Cursor = HttpAppend(Cursor, ": ", 2);
+        Cursor = HttpAppend(Cursor, Header.Value.Items, Header.Value.Count);
+        Cursor = HttpAppend(Cursor, "\r\n", 2);
+    }
+    Cursor = HttpAppend(Cursor, "\r\n", 2);
+    Cursor = HttpAppend(Cursor, Ctx->Content.Items, Ctx->Content.Count);
+
+    Entry->Hash = WebHashFnv1(Key);
+    Entry->Status = Status;
+    Entry->ExpiresAt = HttpMonotonicNs() + (s64) TtlMs * 1000000ll;
+    Entry->Size = Size;
+
+    http_cache_shard *Shard = HttpCacheShard(Cache, Path);
+    WebMutexLock(&Shard->Mu);
+
+    // NOTE(oleh): Somebody else might have filled it in the meantime, the newer response wins.
+    http_cache_entry *Existing = Shard->Buckets[Entry->Hash % RESPONSE_CACHE_BUCKETS_COUNT];
+    while (Existing != NULL && !(Existing->Hash == Entry->Hash && WebStringViewEqual(Existing->Key, Key))) {
+        Existing = Existing->BucketNext;
+    }
+    if (Existing != NULL) HttpCacheRemove(Shard, Existing);
+
+    while (Shard->Size + Size > Shard->Capacity && Shard->LruTail != NULL) HttpCacheRemove(Shard, Shard->LruTail);
+
+    http_cache_entry **Bucket = &Shard->Buckets[Entry->Hash % RESPONSE_CACHE_BUCKETS_COUNT];
+    Entry->BucketNext = *Bucket;
+    *Bucket = Entry;
+    HttpCacheLruPushFront(Shard, Entry);
+    Shard->Size += Size;
+
+    WebMutexUnlock(&Shard->Mu);
+}
+
+static b32 HttpCacheServe(worker_data *Data,
+                          web_http_response_context *Ctx,
+                          http_cache_entry *Entry,
+                          const char *ConnectionHeader) {
+    if (Ctx->Request.Version == HTTP_2) {
+        // NOTE(oleh): The cached head is parsed back into fields, the body is copied only if it can't
+        // go out right away, since the entry may be gone by then.
+        web_http_headers Headers = HttpHttp2ResponseHeaders(Ctx, -1, (web_string_view) {0});
+        uz Offset = 0;
+        HttpHeadersParse(&Ctx->Arena, Entry->Data, &Offset, &Headers);
+
+        web_string_view Body = {.Items = Entry->Data.Items + Offset, .Count = Entry->Data.Count - Offset};
+        return HttpHttp2Send(Data, Entry->Status, Headers, Body, 1);
+    }
+
+    // NOTE(oleh): Everything up to the Connection header, without the blank line that ends the head.
+    web_string_view Head = HttpResponseHeadFormat(Ctx, Ctx->Request.Version, Entry->Status, -1, "", ConnectionHeader);
+    Head.Count -= 2;
+
+    web_string_view Body = Entry->Data;
+
+#ifdef WEB_USE_IO_URING
+    // NOTE(oleh): The send outlives this call, and the entry may be gone by then.
+    if (Data->Uring != NULL) {
+        u8 *Copy = WebArenaPush(&Ctx->Arena, Body.Count);
+        memcpy(Copy, Body.Items, Body.Count);
+        Body.Items = Copy;
+    }
+#endif // WEB_USE_IO_URING
+
+    struct iovec Iov[] = {
+        {.iov_base = Head.Items, .iov_len = Head.Count},
+        {.iov_base = Body.Items, .iov_len = Body.Count},
+    };
+
+    return HttpResponseSendV(Data, Iov, WEB_ARRAY_COUNT(Iov)) >= 0;
+}
+
+void WebHttpServerInvalidateCache(web_http_server *Server, web_string_view Path) {
+    web_http_response_cache *Cache = Server->Cache;
+    Path = HttpCachePath(Path);
+
+    http_cache_shard *Shard = HttpCacheShard(Cache, Path);
+    WebMutexLock(&Shard->Mu);
+
+    http_cache_entry *Entry = Shard->LruHead;
+    while (Entry != NULL) {
+        http_cache_entry *Next = Entry->LruNext;
+        if (WebStringViewEqual(Entry->Path, Path)) HttpCacheRemove(Shard, Entry);
+        Entry = Next;
+    }
+
+    WebMutexUnlock(&Shard->Mu);
+}
+
+void WebHttpServerClearCache(web_http_server *Server) {
+    web_http_response_cache *Cache = Server->Cache;
+
+    for (uz I = 0; I < RESPONSE_CACHE_SHARDS_COUNT; ++I) {
+        http_cache_shard *Shard = &Cache->Shards[I];
+
+        WebMutexLock(&Shard->Mu);
+        while (Shard->LruHead != NULL) HttpCacheRemove(Shard, Shard->LruHead);
+        WebMutexUnlock(&Shard->Mu);
+    }
+}
+
+#define COMPRESSION_DEFAULT_MIN_SIZE 1024
+#define REQUEST_BODY_DEFAULT_MAX_SIZE (64 * 1024 * 1024)
+
+static web_compression_encoding HttpResponseEncoding(web_http_server *Server, web_http_request *Request) {
+    if (!Server->Compression) return WEB_COMPRESSION_IDENTITY;
+
+    web_string_view AcceptEncoding;
+    if (!WebHttpRequestGetKnownHeader(Request, HTTP_HEADER_ACCEPT_ENCODING, &AcceptEncoding)) {
+        return WEB_COMPRESSION_IDENTITY;
+    }
+
+    return WebCompressionNegotiate(AcceptEncoding);
+}
+
+// NOTE(oleh): Compressing these again only burns CPU.
+static const char *HttpCompressedContentTypes[] = {
+    "image/",
+    "video/",
+    "audio/",
+    "font/woff",
+    "application/zip",
+    "application/gzip",
+    "application/x-gzip",
+    "application/zstd",
+    "application/x-bzip2",
+    "application/x-xz",
+    "application/x-7z-compressed",
+    "application/x-rar-compressed",
+    "application/pdf",
+};
+
+static b32 HttpStartsWithIgnoreCase(web_string_view Sv, const char *Prefix) {
+    uz PrefixLength = strlen(Prefix);
+    if (Sv.Count < PrefixLength) return 0;
+
+    Sv.Count = PrefixLength;
+    return WebStringViewEqualCStrIgnoreCase(Sv, Prefix);
+}
+
+static b32 HttpContentTypeIsCompressed(web_string_view ContentType) {
+    // NOTE(oleh): SVG is text.
+    if (HttpStartsWithIgnoreCase(ContentType, "image/svg")) return 0;
+
+    for (uz I = 0; I < WEB_ARRAY_COUNT(HttpCompressedContentTypes); ++I) {
+        if (HttpStartsWithIgnoreCase(ContentType, HttpCompressedContentTypes[I])) return 1;
+    }
+
+    return 0;
+}
+
+static void HttpResponseCompress(web_http_server *Server,
+                                 web_http_response_context *Ctx,
+                                 web_compression_encoding Encoding) {
+    if (!Server->Compression || Ctx->Content.Count < Server->CompressionMinSize) return;
+
+    web_http_headers *Headers = &Ctx->ResponseHeaders;
+    for (uz I = 0; I < Headers->Count; ++I) {
+        web_http_header Header = Headers->Items[I];
+        if (WebStringViewEqualCStrIgnoreCase(Header.Name, "Content-Encoding")) return;
+        if (WebStringViewEqualCStrIgnoreCase(Header.Name, "Content-Type") && HttpContentTypeIsCompressed(Header.Value)) return;
+    }
+
+    // NOTE(oleh): Whether it ends up compressed or not, the response depends on the header.
+    WebHttpContextAddHeader(Ctx, WEB_SV_LIT("Vary"), WEB_SV_LIT("Accept-Encoding"));
+
+    if (Encoding == WEB_COMPRESSION_IDENTITY) return;
+
+    web_string_view Compressed;
+    if (!WebCompress(&Ctx->Arena, Encoding, Ctx->Content, &Compressed)) return;
+
+    Ctx->Content = Compressed;
+    WebHttpContextAddHeader(Ctx, WEB_SV_LIT("Content-Encoding"), WEB_SV_LIT(WebCompressionEncodingName(Encoding)));
+}
+
+static const char *HttpAllowHeader(web_arena *Arena, web_http_route_node *Node) {
+    web_dynamic_string Allow;
+    WEB_ARRAY_INIT(Arena, &Allow);
+
+    const char *Header = "Allow: ";
+    for (const char *C = Header; *C != '\0'; ++C) WEB_ARRAY_PUSH(Arena, &Allow, *C);
+
+    for (uz I = 0; I < HTTP_ROUTE_SLOT_ANY; ++I) {
+        if (Node->Routes[I].Handler == NULL) continue;
+
+        if (Allow.Count > strlen(Header)) {
+            WEB_ARRAY_PUSH(Arena, &Allow, ',');
+            WEB_ARRAY_PUSH(Arena, &Allow, ' ');
+        }
+
+        for (const char *C = HttpMethodNames[I]; *C != '\0'; ++C) WEB_ARRAY_PUSH(Arena, &Allow, *C);
+    }
+
+    WEB_ARRAY_PUSH(Arena, &Allow, '\r');
+    WEB_ARRAY_PUSH(Arena, &Allow, '\n');
+    WEB_ARRAY_PUSH(Arena, &Allow, '\0');
+    return (const char *) Allow.Items;
+}
+
+static sz HttpStreamBodyReceive(worker_data *Conn, u8 *Buffer, uz Capacity) {
+    while (1) {
+        sz N = HttpReceive(Conn, Buffer, Capacity);
+        if (N > 0) return N;
+
+        if (N == 0) {
+            WEB_LOG(INFO, HTTP, "Client closed the connection before sending the full body");
+            return -1;
+        }
+
+        if (errno == EINTR) continue;
+
+        WEB_LOG(INFO, HTTP, "Failed to receive a request body from a client socket");
+        return -1;
+    }
+}
+
+// NOTE(oleh): The chunk data goes to the handler the same way a body with a Content-Length does, only
+// the framing in between is received into the parse buffer. Whatever comes after the body stays there
+// for the next request.
+static sz HttpStreamChunkedBodyRead(worker_data *Conn, u8 *Buffer, uz Capacity) {
+    request_parser *Parser = &Conn->Parser;
+
+    while (1) {
+        if (!RequestParserSkipChunkFraming(Parser)) {
+            WEB_LOG(WARN, HTTP, "Failed to parse a chunked request body");
+            return -1;
+        }
+
+        if (Parser->ChunkState == PARSE_CHUNK_DONE) return 0;
+
+        uz Buffered = Parser->BufferSize - Parser->ParseOffset;
+
+        if (Parser->ChunkState == PARSE_CHUNK_DATA) {
+            uz Want = WEB_MIN(Capacity, Parser->ChunkRemaining);
+
+            sz N;
+            if (Buffered > 0) {
+                N = WEB_MIN(Want, Buffered);
+                memcpy(Buffer, Parser->Buffer + Parser->ParseOffset, N);
+                Parser->ParseOffset += N;
+            } else {
+                N = HttpStreamBodyReceive(Conn, Buffer, Want);
+                if (N < 0) return -1;
+            }
+
+            Parser->ChunkRemaining -= N;
+            Parser->BodyConsumed += N;
+            return N;
+        }
+
+        // NOTE(oleh): Everything buffered has been looked at, so the buffer can start over right after
+        // the headers instead of growing with the body.
+        if (Buffered == 0) {
+            Parser->BufferSize = Parser->BodyStart;
+            Parser->ParseOffset = Parser->BodyStart;
+        }
+
+        uz Available = 0;
+        u8 *Dest = RequestParserReserve(Parser, &Conn->Ctx->Arena, &Available);
+        sz N = HttpStreamBodyReceive(Conn, Dest, Available);
+        if (N < 0) return -1;
+
+        Parser->BufferSize += N;
+    }
+}
+
+static sz HttpStreamBodyRead(void *Arg, u8 *Buffer, uz Capacity) {
+    worker_data *Conn = (worker_data *) Arg;
+    request_parser *Parser = &Conn->Parser;
+
+    if (Parser->Chunked) return HttpStreamChunkedBodyRead(Conn, Buffer, Capacity);
+
+    uz ContentLength = Parser->ContentLength > 0 ? (uz) Parser->ContentLength : 0;
+    uz Want = WEB_MIN(Capacity, ContentLength - Parser->BodyConsumed);
+    if (Want == 0) return 0;
+
+    // NOTE(oleh): First hand out whatever came in together with the headers.
+    uz Buffered = Parser->BufferSize - Parser->ParseOffset;
+    if (Buffered > 0) {
+        uz N = WEB_MIN(Want, Buffered);
+        memcpy(Buffer, Parser->Buffer + Parser->ParseOffset, N);
+        Parser->ParseOffset += N;
+        Parser->BodyConsumed += N;
+        return N;
+    }
+
+    // NOTE(oleh): Then receive straight into the handler's buffer, never past the end of the body, so
+    // the next pipelined request stays in the socket.
+    sz N = HttpStreamBodyReceive(Conn, Buffer, Want);
+    if (N > 0) Parser->BodyConsumed += N;
+    return N;
+}
+
+#define STREAM_BODY_DRAIN_MAX (64 * 1024)
+
+// NOTE(oleh): Skips what the handler left of the body so the next request can be parsed. Large leftovers
+// aren't worth receiving, the connection gets closed instead.
+static b32 HttpStreamBodyFinish(worker_data *Conn) {
+    request_parser *Parser = &Conn->Parser;
+
+    // NOTE(oleh): There's no telling how much of a chunked body is left, so it is drained until it
+    // ends or goes over the limit.
+    if (Parser->Chunked) {
+        u8 Scratch[4096];
+        uz Drained = 0;
+        while (Drained <= STREAM_BODY_DRAIN_MAX) {
+            sz N = HttpStreamBodyRead(Conn, Scratch, sizeof(Scratch));
+            if (N <= 0) return N == 0;
+            Drained += N;
+        }
+
+        return 0;
+    }
+
+    uz ContentLength = Parser->ContentLength > 0 ? (uz) Parser->ContentLength : 0;
+    uz Buffered = Parser->BufferSize - Parser->ParseOffset;
+    uz Unread = ContentLength - Parser->BodyConsumed;
+
+    if (Unread > Buffered && Unread - Buffered > STREAM_BODY_DRAIN_MAX) return 0;
+
+    u8 Scratch[4096];
+    while (Parser->BodyConsumed < ContentLength) {
+        if (HttpStreamBodyRead(Conn, Scratch, sizeof(Scratch)) <= 0) return 0;
+    }
+
+    return 1;
+}
+
+static sz HttpResponseStreamSendV(void *Arg, struct iovec *Iov, int IovCount) {
+    worker_data *Conn = (worker_data *) Arg;
+
+#ifdef WEB_USE_IO_URING
+    // NOTE(oleh): The send only runs after the handler returns, by which point the handler's buffers
+    // are gone. So for io_uring the chunks are copied into the arena and the response ends up
+    // buffered after all.
+    if (Conn->Uring != NULL) {
+        for (int I = 0; I < IovCount; ++I) {
+            u8 *Copy = WebArenaPush(&Conn->Ctx->Arena, WEB_MAX(Iov[I].iov_len, 1));
+            memcpy(Copy, Iov[I].iov_base, Iov[I].iov_len);
+            Iov[I].iov_base = Copy;
+        }
+    }
+#endif // WEB_USE_IO_URING
+
+    return HttpResponseSendV(Conn, Iov, IovCount);
+}
+
+// NOTE(oleh): Runs the handler for an already parsed request and sends the response back. `Node` is the
+// matched route node, NULL if nothing matched the path.
+static b32 HttpServeRequest(worker_data *Data,
+                            web_http_response_context *Ctx,
+                            web_http_request HttpRequest,
+                            web_http_route_node *Node,
+                            web_http_path_params Params,
+                            b32 StreamBody,
+                            b32 *KeepAlive) {
+    Ctx->Request = HttpRequest;
+
+    const char *ConnectionHeader = HttpConnectionHeader(HttpRequest.Version, *KeepAlive);
+
+    if (Node == NULL) {
+        return HttpSendEmptyResponse(Data, Ctx, HttpRequest.Version, HTTP_STATUS_NOT_FOUND, "", ConnectionHeader);
+    }
+
+    http_route *Route = RouteNodeRoute(Node, HttpRequest.Method);
+    if (Route == NULL) {
+        const char *AllowHeader = HttpAllowHeader(&Ctx->Arena, Node);
+        return HttpSendEmptyResponse(Data, Ctx, HttpRequest.Version, HTTP_STATUS_METHOD_NOT_ALLOWED, AllowHeader, ConnectionHeader);
+    }
+
+    Ctx->Params = Params;
+    Ctx->HandlerData = Route->Data;
+    Ctx->Server = Data->Server;
+
+    // NOTE(oleh): Hits are sent without ever calling the handler.
+    web_http_response_cache *Cache = Data->Server->Cache;
+    b32 Cacheable = Route->CacheTtlMs > 0 && HttpRequest.Method == HTTP_GET && !StreamBody;
+    web_string_view CacheKey = {0};
+    web_compression_encoding Encoding = HttpResponseEncoding(Data->Server, &Ctx->Request);
+
+    if (Cacheable) {
+        CacheKey = HttpCacheKey(&Ctx->Arena, &Ctx->Request, Route, Encoding);
+
+        http_cache_entry *Entry = HttpCacheAcquire(Cache, HttpCachePath(HttpRequest.Path), CacheKey);
+        if (Entry != NULL) {
+            b32 Sent = HttpCacheServe(Data, Ctx, Entry, ConnectionHeader);
+            HttpCacheRelease(Cache, Entry);
+            return Sent;
+        }
+    }
+
+    if (StreamBody) {
+        Ctx->BodyReader.Read = HttpStreamBodyRead;
+        Ctx->BodyReader.Data = Data;
+    }
+
+    Ctx->Stream.WriteV = HttpResponseStreamSendV;
+    Ctx->Stream.Data = Data;
+    Ctx->Stream.KeepAlive = *KeepAlive;
+
+    web_http_response_status ResponseStatus = Route->Handler(Ctx);
+
+    if (StreamBody && !HttpStreamBodyFinish(Data)) {
+        // NOTE(oleh): The rest of the body is still on its way, so the connection can't be reused.
+        *KeepAlive = 0;
+        ConnectionHeader = HttpConnectionHeader(HttpRequest.Version, 0);
+    }
+
+    web_http_response_stream *Stream = &Ctx->Stream;
+    if (Stream->Started) {
+        if (!Stream->Finished) WebHttpResponseEnd(Ctx);
+
+        if (!Stream->KeepAlive) *KeepAlive = 0;
+        return !Stream->Failed;
+    }
+
+    web_http_response_file *File = &Ctx->File;
+    if (!File->Present) HttpResponseCompress(Data->Server, Ctx, Encoding);
+
+    uz ContentLength = File->Present ? File->Count : Ctx->Content.Count;
+
+    if (Cacheable && ResponseStatus == HTTP_STATUS_OK && !File->Present) {
+        HttpCacheStore(Cache, Ctx, CacheKey, ResponseStatus, Route->CacheTtlMs);
+    }
+
+    if (HttpRequest.Version == HTTP_2) {
+        web_http_headers Headers = HttpHttp2ResponseHeaders(Ctx, ContentLength, (web_string_view) {0});
+        if (!File->Present) return HttpHttp2Send(Data, ResponseStatus, Headers, Ctx->Content, 1);
+
+        // NOTE(oleh): The frames are cut out of memory, so the file is read into the arena whole.
+        u8 *Body = WebArenaPush(&Ctx->Arena, WEB_MAX(File->Count, 1));
+        uz Read = 0;
+        while (Read < File->Count) {
+            sz N = pread(File->Fd, Body + Read, File->Count - Read, File->Offset + Read);
+            if (N <= 0) break;
+            Read += N;
+        }
+
+        if (File->Release != NULL) File->Release(File->ReleaseData);
+
+        if (Read < File->Count) {
+            Http2StreamCancel(Data->Http2, Data->Http2Stream);
+            return 1;
+        }
+
+        web_string_view BodySv = {.Items = Body, .Count = File->Count};
+        return HttpHttp2Send(Data, ResponseStatus, Headers, BodySv, 0);
+    }
+
+    web_string_view Head = HttpResponseHeadFormat(Ctx, HttpRequest.Version, ResponseStatus, ContentLength, "", ConnectionHeader);
+
+    // NOTE(oleh): The body is sent straight from wherever the handler put it.
+    struct iovec Iov[] = {
+        {.iov_base = Head.Items,         .iov_len = Head.Count},
+        {.iov_base = Ctx->Content.Items, .iov_len = Ctx->Content.Count},
+    };
+    int IovCount = Ctx->Content.Count > 0 ? 2 : 1;
+
+    sz NumSent = 0;
+    if (File->Present) {
+        NumSent = HttpResponseSendFile(Data, &Ctx->Arena, Iov, 1, File);
+        if (File->Release != NULL) File->Release(File->ReleaseData);
+    } else {
+        NumSent = HttpResponseSendV(Data, Iov, IovCount);
+    }
+
+    return NumSent >= 0;
+}
+
+static sz HttpHttp2SendV(void *Arg, struct iovec *Iov, int IovCount) {
+    return HttpResponseSendV((worker_data *) Arg, Iov, IovCount);
+}
+
+// NOTE(oleh): Every stream gets a context of its own, so the responses waiting for the flow control
+// windows keep their memory around.
+static web_arena *HttpHttp2OpenStream(void *Arg, void **OutStreamData) {
+    worker_data *Conn = (worker_data *) Arg;
+
+    web_http_response_context *Ctx = SyncPoolAlloc(Conn->ContextPool);
+    if (Ctx == NULL) return NULL;
+
+    WebArenaReset(&Ctx->Arena);
+    HttpContextReset(Ctx);
+
+    *OutStreamData = Ctx;
+    return &Ctx->Arena;
+}
+
+static void HttpHttp2CloseStream(void *Arg, void *StreamData) {
+    worker_data *Conn = (worker_data *) Arg;
+    SyncPoolFree(Conn->ContextPool, StreamData);
+}
+
+// NOTE(oleh): The handler runs right here, inside `Http2ConnectionReceive`. Only the thread pool speaks
+// HTTP/2, so a slow one holds up the other streams of its connection, but no other connection.
+static void HttpHttp2Dispatch(void *Arg, http2_stream *Stream, void *StreamData, http2_request *Request) {
+    worker_data *Conn = (worker_data *) Arg;
+    web_http_response_context *Ctx = (web_http_response_context *) StreamData;
+    web_arena *Arena = &Ctx->Arena;
+
+    web_http_request HttpRequest = {0};
+    HttpRequest.Version = HTTP_2;
+    HttpRequest.Path = Request->Path;
+    HttpRequest.Body = Request->Body;
+
+    b32 KnownMethod = 0;
+    for (uz I = 0; I < WEB_ARRAY_COUNT(HttpMethodNames); ++I) {
+        if (WebStringViewEqualCStr(Request->Method, HttpMethodNames[I])) {
+            HttpRequest.Method = I;
+            KnownMethod = 1;
+            break;
+        }
+    }
+
+    WEB_ARRAY_INIT(Arena, &HttpRequest.Headers);
+
+    // NOTE(oleh): :authority takes the place of Host. (https://datatracker.ietf.org/doc/html/rfc9113#section-8.3.1)
+    if (Request->Authority.Count > 0) {
+        web_http_header Host = {.Name = WEB_SV_LIT("host"), .Value = Request->Authority};
+        WEB_ARRAY_PUSH(Arena, &HttpRequest.Headers, Host);
+        HttpKnownHeadersRecord(HttpRequest.KnownHeaders, &HttpRequest.Headers, Host);
+    }
+
+    for (uz I = 0; I < Request->Headers.Count; ++I) {
+        web_http_header Header = Request->Headers.Items[I];
+        if (Request->Authority.Count > 0 && WebStringViewEqualCStr(Header.Name, "host")) continue;
+
+        WEB_ARRAY_PUSH(Arena, &HttpRequest.Headers, Header);
+        HttpKnownHeadersRecord(HttpRequest.KnownHeaders, &HttpRequest.Headers, Header);
+    }
+
+    Conn->Http2Stream = Stream;
+    Ctx->Request = HttpRequest;
+
+    if (!KnownMethod) {
+        HttpSendEmptyResponse(Conn, Ctx, HTTP_2, HTTP_STATUS_NOT_IMPLEMENTED, "", "");
+    } else {
+        web_string_view RoutePath = HttpRequest.Path;
+        u8 *Query = memchr(RoutePath.Items, '?', RoutePath.Count);
+        if (Query != NULL) RoutePath.Count = Query - RoutePath.Items;
+
+        web_http_path_params Params;
+        WEB_ARRAY_INIT(Arena, &Params);
+        web_http_route_node *Node = RouteMatch(Arena, Conn->Server->Routes, RoutePath, &Params);
+
+        // NOTE(oleh): The body is already buffered and the connection outlives the request either way.
+        b32 KeepAlive = 1;
+        HttpServeRequest(Conn, Ctx, HttpRequest, Node, Params, 0, &KeepAlive);
+    }
+
+    Conn->Http2Stream = NULL;
+}
+
+// NOTE(oleh): Switches a connection over to HTTP/2 once the parser saw the preface. The frames that came
+// in right behind it are still in the parse buffer.
+static b32 HttpHttp2Begin(worker_data *Conn) {
+    if (!Conn->Server->Http2) {
+        WEB_LOG(INFO, HTTP, "Client sent the HTTP/2 preface, but HTTP/2 is disabled");
+        return 0;
+    }
+
+    http2_callbacks Callbacks = {
+        .Data = Conn,
+        .SendV = HttpHttp2SendV,
+        .OpenStream = HttpHttp2OpenStream,
+        .Dispatch = HttpHttp2Dispatch,
+        .CloseStream = HttpHttp2CloseStream,
+    };
+
+    Conn->Http2 = Http2ConnectionCreate(Callbacks, Conn->Server->MaxRequestBodySize);
+    if (!Http2ConnectionStart(Conn->Http2)) return 0;
+
+    request_parser *Parser = &Conn->Parser;
+    b32 Ok = Http2ConnectionReceive(Conn->Http2,
+                                    Parser->Buffer + Parser->ParseOffset,
+                                    Parser->BufferSize - Parser->ParseOffset);
+
+    HttpConnectionReleaseContext(Conn);
+    return Ok;
+}
+
+#define HTTP2_RECEIVE_BUFFER_SIZE (16 * 1024)
+
+static void HttpServeHttp2(worker_data *Data) {
+    if (!HttpHttp2Begin(Data)) return;
+
+    u8 Buffer[HTTP2_RECEIVE_BUFFER_SIZE];
+
+    while (1) {
+        sz N = HttpReceive(Data, Buffer, sizeof(Buffer));
+        if (N <= 0) {
+            // NOTE(oleh): The keep-alive timeout ran out, let the client know it shouldn't send anything
+            // else on this connection.
+            if (N == -1 && (errno == EAGAIN || errno == EWOULDBLOCK)) Http2ConnectionGoAway(Data->Http2);
+            return;
+        }
+
+        if (!Http2ConnectionReceive(Data->Http2, Buffer, N)) return;
+    }
+}
+
+#define KEEP_ALIVE_TIMEOUT_S 5
+
+static int HttpsAcceptConnection(web_https_provider *Provider, int ClientSock, web_https_session *Sess) {
+    switch (Provider->Type) {
+#ifdef WEB_USE_HTTPS_OPENSSL
+    case WEB_HTTPS_PROVIDER_OPENSSL: {
+        static web_https_session_vtable OpenSSLSessionVTable = {
+            .Read = OpenSSLSessionRead,
+            .Write = OpenSSLSessionWrite,
+            .WriteV = OpenSSLSessionWriteV,
+            .Close = OpenSSLSessionClose,
+        };
+
+        SSL_CTX *SslCtx = (SSL_CTX *) Provider->Data;
+        SSL *Ssl = SSL_new(SslCtx);
+        SSL_set_fd(Ssl, ClientSock);
+        Sess->Data = Ssl;
+        Sess->VTable = OpenSSLSessionVTable;
+
+        return SSL_accept(Ssl);
+    }
+#endif // WEB_USE_HTTPS_OPENSSL
+    case WEB_HTTPS_PROVIDER_CUSTOM: {
+        web_https_custom_provider *Custom = (web_https_custom_provider *) Provider->Data;
+        return Custom->VTable.AcceptConnection(Custom->Data, ClientSock, Sess);
+    }
+    }
+
+    WEB_UNREACHABLE();
+}
+
+static const char *HttpsGetErrorString(web_https_provider *Provider, int Error) {
+    switch (Provider->Type) {
+#ifdef WEB_USE_HTTPS_OPENSSL
+    case WEB_HTTPS_PROVIDER_OPENSSL: {
+        // NOTE(oleh): Handshakes fail on the workers, so the static buffer of `ERR_error_string` is
+        // not an option.
+        static _Thread_local char ErrorString[256];
+        uz SslError = ERR_get_error();
+        ERR_error_string_n(SslError, ErrorString, sizeof(ErrorString));
+        return ErrorString;
+    }
+#endif // WEB_USE_HTTPS_OPENSSL
+    case WEB_HTTPS_PROVIDER_CUSTOM: {
+        web_https_custom_provider *Custom = (web_https_custom_provider *) Provider->Data;
+        return Custom->VTable.GetErrorString(Custom->Data, Error);
+    }
+    }
+
+    WEB_UNREACHABLE();
+}
+
+// NOTE(oleh): Runs on the worker, the receive timeout set on the socket bounds how long a client can
+// stall it.
+static b32 HttpsHandshake(worker_data *Data) {
+    int Status = HttpsAcceptConnection(Data->Server->HttpsProvider, Data->ClientSock, &Data->HttpsSession);
+
+    if (Status < 0) {
+        const char *ErrorString = HttpsGetErrorString(Data->Server->HttpsProvider, Status);
+        WEB_LOG_FMT(ERROR, TLS, "TLS handshake failed: %s", ErrorString);
+        return 0;
+    }
+
+    if (Status == 0) {
+        WEB_LOG(INFO, TLS, "Client reset TLS connection");
+        return 0;
+    }
+
+    return 1;
+}
+
+static void ServerWorkerResume(void *Arg);
+
+// NOTE(oleh): Serves the requests of a connection until it is done. A request whose route belongs to
+// another scheduling class than the one the connection is running in is handed over to that lane of
+// the thread pool, and `Resume` tells that it has already been parsed into `Data->Ctx->Request`.
+static void ServerWorkerServe(worker_data *Data, b32 Resume) {
+    while (1) {
+        request_parser *Parser = &Data->Parser;
+
+        if (!Resume) {
+            if (!HttpConnectionBeginRequest(Data)) break;
+
+            web_http_request HttpRequest;
+            request_parse_result Result = HttpRequestParseStreaming(Data, &Data->Ctx->Arena, &HttpRequest);
+            if (Result == PARSE_RESULT_HTTP2) {
+                HttpServeHttp2(Data);
+                break;
+            }
+
+            if (Result != PARSE_RESULT_DONE) {
+                HttpRejectRequest(Data);
+                break;
+            }
+
+            Data->Ctx->Request = HttpRequest;
+
+            http_route *Route = RequestParserRoute(Parser, HttpRequest.Method);
+            web_thread_pool *ThreadPool = &Data->Server->ThreadPool;
+            u32 Lane = Route != NULL ? (u32) WEB_MIN(Route->SchedulingClass, ThreadPool->LanesCount - 1) : 0;
+
+            if (Lane != Data->Lane) {
+                Data->Lane = Lane;
+
+                web_thread_pool_task Task = {.Proc = ServerWorkerResume, .Arg = Data, .Lane = Lane};
+                WebThreadPoolScheduleTask(ThreadPool, Task);
+                return;
+            }
+        }
+
+        Resume = 0;
+
+        web_http_request HttpRequest = Data->Ctx->Request;
+        b32 KeepAlive = HttpRequestKeepAlive(&HttpRequest);
+
+        if (!HttpServeRequest(Data, Data->Ctx, HttpRequest, Parser->Node, Parser->Params, Parser->StreamBody, &KeepAlive)) {
+            WEB_LOG(WARN, HTTP, "Failed to send the response to a client");
+            break;
+        }
+
+        if (!KeepAlive) break;
+    }
+
+    HttpConnectionClose(Data);
+}
+
+static void ServerWorkerResume(void *Arg) {
+    ServerWorkerServe((worker_data *)Arg, 1);
+}
+
+static void ServerWorker(void *Arg) {
+    worker_data *Data = (worker_data *)Arg;
+
+    // NOTE(oleh): The contexts, and the arenas in them, are first touched by the worker they belong to
+    // and never change hands, so they stay on the worker's NUMA node once it is pinned. A connection
+    // that moves to another lane may end up on another worker, but keeps its context.
+    sz WorkerIndex = WebThreadPoolWorkerIndex(&Data->Server->ThreadPool);
+    WEB_ASSERT(WorkerIndex >= 0);
+    Data->ContextPool += WorkerIndex;
+
+    // NOTE(oleh): An idle keep-alive connection pins a worker thread here, so don't let it do that
+    // forever.
+    struct timeval Timeout = {.tv_sec = KEEP_ALIVE_TIMEOUT_S};
+    setsockopt(Data->ClientSock, SOL_SOCKET, SO_RCVTIMEO, &Timeout, sizeof(Timeout));
+
+    struct timeval WriteTimeout = {.tv_sec = SOCKET_WRITE_TIMEOUT_MS / 1000};
+    setsockopt(Data->ClientSock, SOL_SOCKET, SO_SNDTIMEO, &WriteTimeout, sizeof(WriteTimeout));
+
+    if (Data->Server->UseHttps && !HttpsHandshake(Data)) {
+        HttpConnectionClose(Data);
+        return;
+    }
+
+    ServerWorkerServe(Data, 0);
+}
+
+static b32 InitContextPoolProc(void *Item) {
+    web_http_response_context *ResponseContext = (web_http_response_context *) Item;
+    WebArenaInit(&ResponseContext->Arena, DEFAULT_REQUEST_ARENA_CAPACITY);
+    return ResponseContext->Arena.Items != NULL;
+}
+
+static int HttpListen(u16 Port, b32 NonBlocking, b32 ReusePort) {
+    struct addrinfo Hints = {0};
+    struct addrinfo* ServerAddr;
+
+    Hints.ai_family = AF_INET;
+    Hints.ai_socktype = SOCK_STREAM;
+    Hints.ai_flags = AI_PASSIVE;
+
+    char PortString[6];
+    sprintf(PortString, "%d", Port);
+
+    int Status = getaddrinfo(NULL, PortString, &Hints, &ServerAddr);
+    if (Status != 0) {
+        WEB_PANIC_FMT("Call to getaddrinfo failed: %s\n", gai_strerror(Status));
+    }
+
+    int SocketType = ServerAddr->ai_socktype;
+    if (NonBlocking) SocketType |= SOCK_NONBLOCK;
+
+    int ServerSock = socket(ServerAddr->ai_family, SocketType, 0);
+    if (ServerSock == -1) {
+        WEB_PANIC("call to `socket` failed");
+    }
+
+    int OptValue = 1;
+    if (setsockopt(ServerSock, SOL_SOCKET, SO_REUSEADDR, &OptValue, sizeof(OptValue)) == -1) {
+        WEB_PANIC("Failed to set socket options");
+    }
+
+    // NOTE(oleh): Lets several sockets bind the same port, the kernel then spreads the incoming
+    // connections between them.
+    if (ReusePort && setsockopt(ServerSock, SOL_SOCKET, SO_REUSEPORT, &OptValue, sizeof(OptValue)) == -1) {
+        WEB_PANIC("Failed to set socket options");
+    }
+
+    if (bind(ServerSock, ServerAddr->ai_addr, ServerAddr->ai_addrlen) == -1) {
+        WEB_PANIC("Call to `bind` failed");
+    }
+
+    if (listen(ServerSock, TCP_BACKLOG_SIZE) == -1) {
+        WEB_PANIC("Call to `listen` failed");
+    }
+
+    freeaddrinfo(ServerAddr);
+
+    return ServerSock;
+}
+
+static void HttpServerStartThreadPool(web_http_server *Server, u16 Port) {
+    int ServerSock = HttpListen(Port, 0, 0);
+
+    struct sockaddr_storage ClientAddr;
+    socklen_t ClientAddrSize = sizeof(ClientAddr);
+
+    sync_pool WorkerDataPool;
+    SyncPoolInit(&WorkerDataPool, sizeof(worker_data), NULL);
+
+    // NOTE(oleh): One per worker, see `ServerWorker`.
+    sync_pool *ContextPools = WEB_ARENA_PUSH_ZERO(&Server->Arena, sizeof(*ContextPools) * Server->ThreadsCount);
+    for (uz I = 0; I < Server->ThreadsCount; ++I) SyncPoolInit(&ContextPools[I], sizeof(web_http_response_context), InitContextPoolProc);
+
+    while (1) {
+        int ClientSock = accept(ServerSock, (struct sockaddr*)&ClientAddr, &ClientAddrSize);
+
+        if (ClientSock == -1) {
+            int AcceptError = errno;
+            close(ServerSock);
+            WEB_PANIC_FMT("Could not accept a new connection: %s", strerror(AcceptError));
+        }
+
+        // NOTE(oleh): The TLS handshake happens on the worker, so that accepting never waits on crypto.
+        worker_data *WorkerData = SyncPoolAlloc(&WorkerDataPool);
+        if (WorkerData == NULL) {
+            WEB_LOG(ERROR, HTTP, "Out of memory for a new connection");
+            close(ClientSock);
+            continue;
+        }
+
+        WEB_STRUCT_ZERO(WorkerData);
+        WorkerData->WorkerDataPool = &WorkerDataPool;
+        WorkerData->Server = Server;
+        WorkerData->ContextPool = ContextPools;
+        WorkerData->ClientSock = ClientSock;
+
+        web_thread_pool_task Task = {.Proc = ServerWorker, .Arg = WorkerData};
+        WebThreadPoolScheduleTask(&Server->ThreadPool, Task);
+    }
+}
+
+#define EVENT_LOOP_MAX_EVENTS 256
+// NOTE(oleh): How long a client has to send a whole request, counting from the end of the previous
+// one, so an idle keep-alive connection and a trickling request run out of time alike.
+#define EVENT_LOOP_REQUEST_TIMEOUT_MS (30 * 1000)
+#define EVENT_LOOP_SWEEP_INTERVAL_MS 1000
+
+struct http_event_loop {
+    web_http_server *Server;
+    int ListenSock;
+    int EpollFd;
+    web_thread Thread;
+
+    // NOTE(oleh): -1 if the loop is not pinned to a CPU.
+    sz Cpu;
+
+    // NOTE(oleh): Every connection stays on the loop that accepted it, so the pools are only ever
+    // touched by a single thread.
+    sync_pool WorkerDataPool;
+    sync_pool ContextPool;
+
+    // NOTE(oleh): Every connection is in one of them, `Writing` while its socket doesn't take the
+    // response. `Now` is the time of the last wakeup, good enough for the timeouts.
+    http_timeout_list Reading;
+    http_timeout_list Writing;
+    s64 Now;
+    s64 NextSweep;
+};
+
+static void HttpEventLoopWatch(worker_data *Conn, u32 Events) {
+    struct epoll_event Event = {.events = Events, .data.ptr = Conn};
+    if (epoll_ctl(Conn->Loop->EpollFd, EPOLL_CTL_MOD, Conn->ClientSock, &Event) == -1) {
+        WEB_LOG_FMT(ERROR, HTTP, "Could not update a connection's epoll registration: %s", strerror(errno));
+    }
+}
+
+// NOTE(oleh): Returns 1 if the connection has to wait for its socket to take the rest of the response
+// before anything else is read from it.
+static b32 HttpEventLoopWaitWritable(worker_data *Conn) {
+    if (!HttpConnectionHasUnsent(Conn)) return 0;
+
+    if (Conn->TimeoutList != &Conn->Loop->Writing) {
+        HttpEventLoopWatch(Conn, EPOLLOUT | EPOLLET);
+        HttpTimeoutListTouch(&Conn->Loop->Writing, Conn, Conn->Loop->Now);
+    }
+
+    return 1;
+}
+
+// NOTE(oleh): Closes the connection once its response has gone out.
+static void HttpEventLoopCloseWhenSent(worker_data *Conn) {
+    if (HttpEventLoopWaitWritable(Conn)) {
+        Conn->CloseWhenSent = 1;
+        return;
+    }
+
+    HttpConnectionClose(Conn);
+}
+
+static void HttpEventLoopAccept(http_event_loop *Loop) {
+    while (1) {
+        int ClientSock = accept4(Loop->ListenSock, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (ClientSock == -1) {
+            if (errno == EINTR) continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK) return;
+
+            WEB_LOG_FMT(ERROR, HTTP, "Could not accept a new connection: %s", strerror(errno));
+            return;
+        }
+
+        worker_data *Conn = SyncPoolAlloc(&Loop->WorkerDataPool);
+        if (Conn == NULL) {
+            WEB_LOG(ERROR, HTTP, "Out of memory for a new connection");
+            close(ClientSock);
+            continue;
+        }
+
+        WEB_STRUCT_ZERO(Conn);
+        Conn->WorkerDataPool = &Loop->WorkerDataPool;
+        Conn->ContextPool = &Loop->ContextPool;
+        Conn->Server = Loop->Server;
+        Conn->ClientSock = ClientSock;
+        Conn->Loop = Loop;
+
+        struct epoll_event Event = {
+            .events = EPOLLIN | EPOLLRDHUP | EPOLLET,
+            .data.ptr = Conn,
+        };
+
+        if (epoll_ctl(Loop->EpollFd, EPOLL_CTL_ADD, ClientSock, &Event) == -1) {
+            WEB_LOG_FMT(ERROR, HTTP, "Could not register a connection with epoll: %s", strerror(errno));
+            HttpConnectionClose(Conn);
+            continue;
+        }
+
+        HttpTimeoutListTouch(&Loop->Reading, Conn, Loop->Now);
+    }
+}
+
+// NOTE(oleh): Serves every request that is fully buffered on the connection. Returns 0 if the
+// connection got closed in the process, or has to wait until its socket takes the last response.
+static b32 HttpEventLoopServeBuffered(worker_data *Conn) {
+    while (1) {
+        web_http_request HttpRequest;
+        switch (RequestParserAdvance(&Conn->Parser, &Conn->Ctx->Arena, &HttpRequest)) {
+        case PARSE_RESULT_ERROR: {
+            HttpRejectRequest(Conn);
+            HttpEventLoopCloseWhenSent(Conn);
+            return 0;
+        }
+        case PARSE_RESULT_INCOMPLETE: return 1;
+        case PARSE_RESULT_DONE: break;
+        case PARSE_RESULT_HTTP2: {
+            // NOTE(oleh): The handlers of the streams would run on the loop, one slow stream would hold up
+            // every other connection of it.
+            WEB_LOG(WARN, HTTP, "HTTP/2 is not supported in the event loop modes");
+            HttpConnectionClose(Conn);
+            return 0;
+        }
+        }
+
+        b32 KeepAlive = HttpRequestKeepAlive(&HttpRequest);
+        request_parser *Parser = &Conn->Parser;
+
+        if (!HttpServeRequest(Conn, Conn->Ctx, HttpRequest, Parser->Node, Parser->Params, Parser->StreamBody, &KeepAlive)) {
+            WEB_LOG(WARN, HTTP, "Failed to send the response to a client");
+            HttpConnectionClose(Conn);
+            return 0;
+        }
+
+        if (!KeepAlive) {
+            HttpEventLoopCloseWhenSent(Conn);
+            return 0;
+        }
+
+        // NOTE(oleh): The queued part of the response is a copy, so the arena can go already.
+        HttpConnectionBeginRequest(Conn);
+        HttpTimeoutListTouch(&Conn->Loop->Reading, Conn, Conn->Loop->Now);
+
+        if (HttpEventLoopWaitWritable(Conn)) return 0;
+    }
+}
+
+// NOTE(oleh): The sockets are edge-triggered, so we have to drain them until `EAGAIN` every time.
+static void HttpEventLoopOnReadable(worker_data *Conn) {
+    while (1) {
+        if (Conn->Ctx == NULL && !HttpConnectionBeginRequest(Conn)) {
+            HttpConnectionClose(Conn);
+            return;
+        }
+
+        request_parser *Parser = &Conn->Parser;
+
+        uz Available = 0;
+        u8 *Dest = RequestParserReserve(Parser, &Conn->Ctx->Arena, &Available);
+
+        sz N = read(Conn->ClientSock, Dest, Available);
+        if (N == -1) {
+            if (errno == EINTR) continue;
+
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                // NOTE(oleh): Idle keep-alive connections don't hold on to a context.
+                if (Parser->BufferSize == 0) HttpConnectionReleaseContext(Conn);
+                return;
+            }
+
+            WEB_LOG_FMT(ERROR, HTTP, "Failed to receive from a client socket: %s", strerror(errno));
+            HttpConnectionClose(Conn);
+            return;
+        }
+
+        if (N == 0) {
+            HttpConnectionClose(Conn);
+            return;
+        }
+
+        Parser->BufferSize += N;
+
+        if (!HttpEventLoopServeBuffered(Conn)) return;
+    }
+}
+
+static void HttpEventLoopOnWritable(worker_data *Conn) {
+    if (!HttpEventLoopSendUnsent(Conn)) {
+        WEB_LOG(WARN, HTTP, "Failed to send the response to a client");
+        HttpConnectionClose(Conn);
+        return;
+    }
+
+    http_event_loop *Loop = Conn->Loop;
+
+    if (HttpConnectionHasUnsent(Conn)) {
+        HttpTimeoutListTouch(&Loop->Writing, Conn, Loop->Now);
+        return;
+    }
+
+    if (Conn->CloseWhenSent) {
+        HttpConnectionClose(Conn);
+        return;
+    }
+
+    HttpEventLoopWatch(Conn, EPOLLIN | EPOLLRDHUP | EPOLLET);
+    HttpTimeoutListTouch(&Loop->Reading, Conn, Loop->Now);
+
+    // NOTE(oleh): Pipelined requests may be waiting in the buffer already, and whatever arrived in the
+    // meantime didn't make it edge-trigger, so the socket is drained right away.
+    if (Conn->Ctx != NULL && !HttpEventLoopServeBuffered(Conn)) return;
+    HttpEventLoopOnReadable(Conn);
+}
+
+static void HttpEventLoopCloseExpired(http_timeout_list *List, s64 Now) {
+    while (List->Head != NULL && Now - List->Head->ActiveAt >= List->TimeoutNs) {
+        HttpConnectionClose(List->Head);
+    }
+}
+
+static void *HttpEventLoopProc(void *Arg) {
+    http_event_loop *Loop = (http_event_loop *)Arg;
+
+    if (Loop->Cpu >= 0 && !WebThreadPinToCpu((uz) Loop->Cpu)) {
+        WEB_LOG_FMT(WARN, HTTP, "Failed to pin an event loop to CPU %zd", Loop->Cpu);
+    }
+
+    struct epoll_event Events[EVENT_LOOP_MAX_EVENTS];
+
+    while (1) {
+        int NumEvents = epoll_wait(Loop->EpollFd, Events, EVENT_LOOP_MAX_EVENTS, EVENT_LOOP_SWEEP_INTERVAL_MS);
+        if (NumEvents == -1) {
+            if (errno == EINTR) continue;
+            WEB_PANIC_FMT("Call to `epoll_wait` failed: %s", strerror(errno));
+        }
+
+        Loop->Now = HttpMonotonicNs();
+
+        for (int I = 0; I < NumEvents; ++I) {
+            // NOTE(oleh): The listening socket is registered with a NULL pointer.
+            if (Events[I].data.ptr == NULL) {
+                HttpEventLoopAccept(Loop);
+                continue;
+            }
+
+            worker_data *Conn = (worker_data *)Events[I].data.ptr;
+
+            if (Events[I].events & EPOLLOUT) {
+                HttpEventLoopOnWritable(Conn);
+            } else if (Events[I].events & EPOLLIN) {
+                HttpEventLoopOnReadable(Conn);
+            } else if (Events[I].events & (EPOLLERR | EPOLLHUP | EPOLLRDHUP)) {
+                HttpConnectionClose(Conn);
+            }
+        }
+
+        if (Loop->Now >= Loop->NextSweep) {
+            HttpEventLoopCloseExpired(&Loop->Reading, Loop->Now);
+            HttpEventLoopCloseExpired(&Loop->Writing, Loop->Now);
+            Loop->NextSweep = Loop->Now + EVENT_LOOP_SWEEP_INTERVAL_MS * 1000000ll;
+        }
+    }
+
+    return NULL;
+}
+
+static void HttpEventLoopInit(http_event_loop *Loop, web_http_server *Server, int ListenSock, b32 Exclusive) {
+    Loop->Server = Server;
+    Loop->ListenSock = ListenSock;
+    Loop->Cpu = -1;
+    Loop->Reading.TimeoutNs = EVENT_LOOP_REQUEST_TIMEOUT_MS * 1000000ll;
+    Loop->Writing.TimeoutNs = SOCKET_WRITE_TIMEOUT_MS * 1000000ll;
+    Loop->Now = HttpMonotonicNs();
+
+    Loop->EpollFd = epoll_create1(EPOLL_CLOEXEC);
+    if (Loop->EpollFd == -1) {
+        WEB_PANIC_FMT("Call to `epoll_create1` failed: %s", strerror(errno));
+    }
+
+    // NOTE(oleh): When the loops share the listening socket, `EPOLLEXCLUSIVE` makes the kernel wake
+    // up only one of them per incoming connection.
+    struct epoll_event Event = {
+        .events = Exclusive ? EPOLLIN | EPOLLEXCLUSIVE : EPOLLIN,
+        .data.ptr = NULL,
+    };
+
+    if (epoll_ctl(Loop->EpollFd, EPOLL_CTL_ADD, ListenSock, &Event) == -1) {
+        WEB_PANIC_FMT("Could not register the listening socket with epoll: %s", strerror(errno));
+    }
+
+    SyncPoolInit(&Loop->WorkerDataPool, sizeof(worker_data), NULL);
+    SyncPoolInit(&Loop->ContextPool, sizeof(web_http_response_context), InitContextPoolProc);
+}
+
+// NOTE(oleh): Matches CPU_SETSIZE, the most the affinity mask can hold.
+#define HTTP_MAX_CPUS 1024
+
+static void HttpServerStartEventLoops(web_http_server *Server, u16 Port) {
+    b32 ReusePort = Server->Mode == WEB_HTTP_SERVER_MODE_REUSEPORT;
+
+    uz LoopsCount = Server->EventLoopsCount;
+    http_event_loop *Loops = WEB_ARENA_PUSH_ZERO(&Server->Arena, sizeof(*Loops) * LoopsCount);
+
+    if (ReusePort) {
+        // NOTE(oleh): Shared-nothing: every loop gets its own listener and its own core, so a
+        // connection is accepted, parsed and answered by the same thread.
+        // Only the CPUs of our affinity mask count, pinning outside of it would fail anyway.
+        u32 *Cpus = WebArenaPush(&Server->Arena, sizeof(*Cpus) * HTTP_MAX_CPUS);
+        uz CpusCount = WebThreadAllowedCpus(Cpus, HTTP_MAX_CPUS);
+
+        for (uz I = 0; I < LoopsCount; ++I) {
+            HttpEventLoopInit(&Loops[I], Server, HttpListen(Port, 1, 1), 0);
+            Loops[I].Cpu = CpusCount > 0 ? (sz) Cpus[I % CpusCount] : -1;
+        }
+    } else {
+        int ListenSock = HttpListen(Port, 1, 0);
+
+        for (uz I = 0; I < LoopsCount; ++I) {
+            HttpEventLoopInit(&Loops[I], Server, ListenSock, 1);
+        }
+    }
+
+    // NOTE(oleh): The calling thread becomes the first loop.
+    for (uz I = 1; I < LoopsCount; ++I) {
+        if (!WebThreadLaunch(&Loops[I].Thread, HttpEventLoopProc, &Loops[I])) {
+            WEB_PANIC("Failed to launch an event loop thread");
+        }
+    }
+
+    HttpEventLoopProc(&Loops[0]);
+}
+
+#ifdef WEB_USE_IO_URING
+#define URING_ENTRIES 4096
+#define URING_BUFFERS_COUNT 1024
+#define URING_BUFFER_SIZE 4096
+#define URING_BUFFER_GROUP 0
+
+// NOTE(oleh): The operation is stored in the low bits of the user data, the rest is the connection.
+#define URING_OP_MASK 7ull
+
+typedef enum {
+    URING_OP_ACCEPT = 1,
+    URING_OP_RECV,
+    URING_OP_SEND,
+    URING_OP_SHUTDOWN,
+    URING_OP_CLOSE,
+    URING_OP_TIMEOUT,
+} uring_op;
+
+struct http_uring_loop {
+    web_http_server *Server;
+    int ListenSock;
+    web_thread Thread;
+    sz Cpu;
+
+    web_uring Ring;
+    web_uring_buf_ring BufRing;
+
+    sync_pool WorkerDataPool;
+    sync_pool ContextPool;
+
+    // NOTE(oleh): The same timeouts as in the event loops. A timeout operation wakes the loop up for
+    // the sweep even when nothing else completes.
+    http_timeout_list Reading;
+    http_timeout_list Writing;
+    s64 Now;
+    s64 NextSweep;
+    struct __kernel_timespec SweepInterval;
+};
+
+static u64 UringUserData(worker_data *Conn, uring_op Op) {
+    return (u64) (uintptr_t) Conn | Op;
+}
+
+static struct io_uring_sqe *UringGetSqe(http_uring_loop *Loop) {
+    struct io_uring_sqe *Sqe = WebUringGetSqe(&Loop->Ring);
+    if (Sqe == NULL) WEB_PANIC("io_uring submission queue overflow");
+    return Sqe;
+}
+
+static void UringArmAccept(http_uring_loop *Loop) {
+    struct io_uring_sqe *Sqe = UringGetSqe(Loop);
+    Sqe->opcode = IORING_OP_ACCEPT;
+    Sqe->fd = Loop->ListenSock;
+    Sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+    Sqe->user_data = URING_OP_ACCEPT;
+}
+
+static void UringArmSweep(http_uring_loop *Loop) {
+    struct io_uring_sqe *Sqe = UringGetSqe(Loop);
+    Sqe->opcode = IORING_OP_TIMEOUT;
+    Sqe->addr = (u64) (uintptr_t) &Loop->SweepInterval;
+    Sqe->len = 1;
+    Sqe->user_data = URING_OP_TIMEOUT;
+}
+
+static void UringArmRecv(worker_data *Conn) {
+    struct io_uring_sqe *Sqe = UringGetSqe(Conn->Uring);
+    Sqe->opcode = IORING_OP_RECV;
+    Sqe->fd = Conn->ClientSock;
+    Sqe->flags = IOSQE_BUFFER_SELECT;
+    Sqe->buf_group = URING_BUFFER_GROUP;
+    Sqe->ioprio = IORING_RECV_MULTISHOT;
+    Sqe->user_data = UringUserData(Conn, URING_OP_RECV);
+
+    ++Conn->UringRefs;
+}
+
+// NOTE(oleh): Consecutive sends of a connection are linked, so they hit the socket in order.
+static void UringLinkToLastSqe(worker_data *Conn, struct io_uring_sqe *Sqe) {
+    if (Conn->UringLastSqe != NULL && Conn->UringLastSqeGeneration == Conn->Uring->Ring.SubmitGeneration) {
+        Conn->UringLastSqe->flags |= IOSQE_IO_LINK;
+    }
+
+    Conn->UringLastSqe = Sqe;
+    Conn->UringLastSqeGeneration = Conn->Uring->Ring.SubmitGeneration;
+}
+
+static sz HttpUringSendV(worker_data *Conn, struct iovec *Iov, int IovCount) {
+    // NOTE(oleh): The kernel reads the message header when the send actually runs, so it has to live
+    // in the request arena together with the buffers.
+    web_arena *Arena = &Conn->Ctx->Arena;
+    struct iovec *IovCopy = WebArenaPush(Arena, sizeof(*IovCopy) * IovCount);
+    memcpy(IovCopy, Iov, sizeof(*IovCopy) * IovCount);
+
+    struct msghdr *Message = WEB_ARENA_NEW(Arena, struct msghdr);
+    Message->msg_iov = IovCopy;
+    Message->msg_iovlen = IovCount;
+
+    uz Count = 0;
+    for (int I = 0; I < IovCount; ++I) Count += Iov[I].iov_len;
+
+    struct io_uring_sqe *Sqe = UringGetSqe(Conn->Uring);
+    Sqe->opcode = IORING_OP_SENDMSG;
+    Sqe->fd = Conn->ClientSock;
+    Sqe->addr = (u64) (uintptr_t) Message;
+    Sqe->len = 1;
+    // NOTE(oleh): Makes the kernel retry short sends instead of completing early.
+    Sqe->msg_flags = MSG_WAITALL | MSG_NOSIGNAL;
+    Sqe->user_data = UringUserData(Conn, URING_OP_SEND);
+
+    UringLinkToLastSqe(Conn, Sqe);
+
+    ++Conn->UringRefs;
+    ++Conn->UringPendingSends;
+
+    return Count;
+}
+
+// NOTE(oleh): The shutdown makes the multishot receive complete, the close is linked after the
+// queued sends, so the response goes out first.
+static void HttpUringClose(worker_data *Conn) {
+    if (Conn->UringClosing) return;
+    Conn->UringClosing = 1;
+    HttpTimeoutListRemove(Conn);
+
+    struct io_uring_sqe *Sqe = UringGetSqe(Conn->Uring);
+    Sqe->opcode = IORING_OP_SHUTDOWN;
+    Sqe->fd = Conn->ClientSock;
+    Sqe->len = SHUT_RDWR;
+    Sqe->user_data = UringUserData(Conn, URING_OP_SHUTDOWN);
+    UringLinkToLastSqe(Conn, Sqe);
+    ++Conn->UringRefs;
+
+    Sqe = UringGetSqe(Conn->Uring);
+    Sqe->opcode = IORING_OP_CLOSE;
+    Sqe->fd = Conn->ClientSock;
+    Sqe->user_data = UringUserData(Conn, URING_OP_CLOSE);
+    UringLinkToLastSqe(Conn, Sqe);
+    ++Conn->UringRefs;
+}
+
+static void HttpUringUnref(worker_data *Conn) {
+    WEB_ASSERT(Conn->UringRefs > 0);
+    --Conn->UringRefs;
+
+    if (Conn->UringRefs == 0 && Conn->UringClosing) {
+        HttpConnectionReleaseContext(Conn);
+        SyncPoolFree(Conn->WorkerDataPool, Conn);
+    }
+}
+
+// NOTE(oleh): Serves the fully buffered requests. The arena must not be reset while its response
+// is still being sent, so the next request waits for the send completions.
+static void HttpUringServeBuffered(worker_data *Conn) {
+    while (!Conn->UringClosing && Conn->UringPendingSends == 0) {
+        if (Conn->Ctx == NULL) return;
+
+        web_http_request HttpRequest;
+        switch (RequestParserAdvance(&Conn->Parser, &Conn->Ctx->Arena, &HttpRequest)) {
+        case PARSE_RESULT_ERROR: {
+            Conn->UringLastSqe = NULL;
+            HttpRejectRequest(Conn);
+            HttpUringClose(Conn);
+            return;
+        }
+        case PARSE_RESULT_INCOMPLETE: {
+            if (Conn->Parser.BufferSize == 0) HttpConnectionReleaseContext(Conn);
+            return;
+        }
+        case PARSE_RESULT_DONE: break;
+        case PARSE_RESULT_HTTP2: {
+            // TODO(oleh): The stream responses would have to survive the send completions.
+            WEB_LOG(WARN, HTTP, "HTTP/2 is not supported in the io_uring mode");
+            HttpUringClose(Conn);
+            return;
+        }
+        }
+
+        Conn->UringLastSqe = NULL;
+
+        b32 KeepAlive = HttpRequestKeepAlive(&HttpRequest);
+        request_parser *Parser = &Conn->Parser;
+        if (!HttpServeRequest(Conn, Conn->Ctx, HttpRequest, Parser->Node, Parser->Params, Parser->StreamBody, &KeepAlive)) {
+            WEB_LOG(WARN, HTTP, "Failed to send the response to a client");
+            HttpUringClose(Conn);
+            return;
+        }
+
+        if (!KeepAlive) {
+            HttpUringClose(Conn);
+            return;
+        }
+
+        if (Conn->UringPendingSends > 0) {
+            HttpTimeoutListTouch(&Conn->Uring->Writing, Conn, Conn->Uring->Now);
+            return;
+        }
 
-        goto Cleanup;
+        HttpConnectionBeginRequest(Conn);
+        HttpTimeoutListTouch(&Conn->Uring->Reading, Conn, Conn->Uring->Now);
     }
+}
 
-    web_http_response_status ResponseStatus = HTTP_STATUS_NOT_FOUND;
-    const char *ReasonPhrase = GetHttpResponseStatusReasonPhrase(ResponseStatus);
-    const char *VersionString = HttpVersionStrings[HttpRequest.Version];
-
-    // TODO(oleh): No handler found, just give em 404!
-    web_string_view ResponseString = WebArenaFormat(&Ctx->Arena,
-                                                    "%s %u %s\r\nAccess-Control-Allow-Origin: *\r\n\r\n",
-                                                    VersionString,
-                                                    ResponseStatus,
-                                                    ReasonPhrase);
+static void HttpUringOnAccept(http_uring_loop *Loop, struct io_uring_cqe *Cqe) {
+    if (!(Cqe->flags & IORING_CQE_F_MORE)) UringArmAccept(Loop);
 
-    int SendStatus = send(Data->ClientSock, ResponseString.Items, ResponseString.Count, 0);
-    WEB_ASSERT(SendStatus != -1);
+    if (Cqe->res < 0) {
+        WEB_LOG_FMT(ERROR, HTTP, "Could not accept a new connection: %s", strerror(-Cqe->res));
+        return;
+    }
 
-Cleanup:
-    if (Data->Server->UseHttps) {
-        HttpsCloseConnection(&Data->HttpsSession);
+    worker_data *Conn = SyncPoolAlloc(&Loop->WorkerDataPool);
+    if (Conn == NULL) {
+        WEB_LOG(ERROR, HTTP, "Out of memory for a new connection");
+        close(Cqe->res);
+        return;
     }
 
-    close(Data->ClientSock);
+    WEB_STRUCT_ZERO(Conn);
+    Conn->WorkerDataPool = &Loop->WorkerDataPool;
+    Conn->ContextPool = &Loop->ContextPool;
+    Conn->Server = Loop->Server;
+    Conn->ClientSock = Cqe->res;
+    Conn->Uring = Loop;
 
-    SyncPoolFree(Data->ContextPool, Ctx);
-    SyncPoolFree(Data->WorkerDataPool, Data);
+    HttpTimeoutListTouch(&Loop->Reading, Conn, Loop->Now);
+    UringArmRecv(Conn);
 }
 
-static void *NewWorkerDataPoolProc(uz *Size) {
-    *Size = sizeof(worker_data);
-    return malloc(*Size);
-}
+static void HttpUringOnRecv(worker_data *Conn, struct io_uring_cqe *Cqe) {
+    http_uring_loop *Loop = Conn->Uring;
+    b32 Rearm = !(Cqe->flags & IORING_CQE_F_MORE);
+    b32 OutOfMemory = 0;
 
-static void *NewContextPoolProc(uz *Size) {
-    *Size = sizeof(web_http_response_context);
-    web_http_response_context *ResponseContext = malloc(*Size);
-    WEB_STRUCT_ZERO(ResponseContext);
-    WebArenaInit(&ResponseContext->Arena, DEFAULT_REQUEST_ARENA_CAPACITY);
-    return ResponseContext;
-}
+    if (Cqe->flags & IORING_CQE_F_BUFFER) {
+        u16 BufferId = Cqe->flags >> IORING_CQE_BUFFER_SHIFT;
 
-static int HttpsAcceptConnection(web_https_provider *Provider, int ClientSock, web_https_session *Sess) {
-    switch (Provider->Type) {
-#ifdef WEB_USE_HTTPS_OPENSSL
-    case WEB_HTTPS_PROVIDER_OPENSSL: {
-        static web_https_session_vtable OpenSSLSessionVTable = {
-            .Read = OpenSSLSessionRead,
-            .Write = OpenSSLSessionWrite,
-            .Close = OpenSSLSessionClose,
-        };
+        if (Cqe->res > 0 && !Conn->UringClosing && Conn->Ctx == NULL) {
+            OutOfMemory = !HttpConnectionBeginRequest(Conn);
+        }
 
-        SSL_CTX *SslCtx = (SSL_CTX *) Provider->Data;
-        SSL *Ssl = SSL_new(SslCtx);
-        SSL_set_fd(Ssl, ClientSock);
-        Sess->Data = Ssl;
-        Sess->VTable = OpenSSLSessionVTable;
+        if (Cqe->res > 0 && !Conn->UringClosing && !OutOfMemory) {
+            // NOTE(oleh): The provided buffer goes back to the kernel right away, so the data has to
+            // be copied into the parse buffer.
+            u8 *Data = WebUringBufRingGet(&Loop->BufRing, BufferId);
+            uz Remaining = Cqe->res;
+            while (Remaining > 0) {
+                uz Available = 0;
+                u8 *Dest = RequestParserReserve(&Conn->Parser, &Conn->Ctx->Arena, &Available);
+                uz N = WEB_MIN(Available, Remaining);
+                memcpy(Dest, Data, N);
+                Conn->Parser.BufferSize += N;
+                Data += N;
+                Remaining -= N;
+            }
+        }
 
-        return SSL_accept(Ssl);
-    }
-#endif // WEB_USE_HTTPS_OPENSSL
-    case WEB_HTTPS_PROVIDER_CUSTOM: {
-        web_https_custom_provider *Custom = (web_https_custom_provider *) Provider->Data;
-        return Custom->VTable.AcceptConnection(Custom->Data, ClientSock, Sess);
+        WebUringBufRingRecycle(&Loop->BufRing, BufferId);
     }
+
+    if (Cqe->res == 0 || (Cqe->res < 0 && Cqe->res != -ENOBUFS) || OutOfMemory) {
+        HttpUringClose(Conn);
+    } else if (Cqe->res > 0) {
+        HttpUringServeBuffered(Conn);
     }
 
-    WEB_UNREACHABLE();
+    if (Rearm) {
+        // NOTE(oleh): -ENOBUFS means we ran out of provided buffers, just try again.
+        if (!Conn->UringClosing) UringArmRecv(Conn);
+        HttpUringUnref(Conn);
+    }
 }
 
-static const char *HttpsGetErrorString(web_https_provider *Provider, int Error) {
-    switch (Provider->Type) {
-#ifdef WEB_USE_HTTPS_OPENSSL
-    case WEB_HTTPS_PROVIDER_OPENSSL: {
-        uz SslError = ERR_get_error();
-        return ERR_error_string(SslError, NULL);
-    }
-#endif // WEB_USE_HTTPS_OPENSSL
-    case WEB_HTTPS_PROVIDER_CUSTOM: {
-        web_https_custom_provider *Custom = (web_https_custom_provider *) Provider->Data;
-        return Custom->VTable.GetErrorString(Custom->Data, Error);
-    }
+static void HttpUringOnSend(worker_data *Conn, struct io_uring_cqe *Cqe) {
+    --Conn->UringPendingSends;
+
+    if (Cqe->res < 0) {
+        if (Cqe->res != -ECANCELED) {
+            WEB_LOG_FMT(WARN, HTTP, "Failed to send the response to a client: %s", strerror(-Cqe->res));
+        }
+        HttpUringClose(Conn);
+    } else if (Conn->UringPendingSends > 0 && !Conn->UringClosing) {
+        HttpTimeoutListTouch(&Conn->Uring->Writing, Conn, Conn->Uring->Now);
+    } else if (!Conn->UringClosing) {
+        HttpConnectionBeginRequest(Conn);
+        HttpTimeoutListTouch(&Conn->Uring->Reading, Conn, Conn->Uring->Now);
+        HttpUringServeBuffered(Conn);
     }
 
-    WEB_UNREACHABLE();
+    HttpUringUnref(Conn);
 }
 
-void WebHttpServerStart(web_http_server *Server, u16 Port) {
-    struct addrinfo Hints = {0};
-    struct addrinfo* ServerAddr;
-
-    Hints.ai_family = AF_INET;
-    Hints.ai_socktype = SOCK_STREAM;
-    Hints.ai_flags = AI_PASSIVE;
+static void HttpUringOnClose(worker_data *Conn, struct io_uring_cqe *Cqe, uring_op Op) {
+    // NOTE(oleh): A failed send cancels the rest of the chain, so close the socket ourselves.
+    if (Op == URING_OP_CLOSE && Cqe->res == -ECANCELED) {
+        shutdown(Conn->ClientSock, SHUT_RDWR);
+        close(Conn->ClientSock);
+    }
 
-    char PortString[6];
-    sprintf(PortString, "%d", Port);
+    HttpUringUnref(Conn);
+}
 
-    int Status = getaddrinfo(NULL, PortString, &Hints, &ServerAddr);
-    if (Status != 0) {
-        WEB_PANIC_FMT("Call to getaddrinfo failed: %s\n", gai_strerror(Status));
+// NOTE(oleh): The shutdown fails a send the client doesn't take, otherwise the close queued after it
+// would never run.
+static void HttpUringCloseExpired(http_timeout_list *List, s64 Now) {
+    while (List->Head != NULL && Now - List->Head->ActiveAt >= List->TimeoutNs) {
+        worker_data *Conn = List->Head;
+        shutdown(Conn->ClientSock, SHUT_RDWR);
+        HttpUringClose(Conn);
     }
+}
 
-    int ServerSock = socket(ServerAddr->ai_family, ServerAddr->ai_socktype, 0);
-    if (ServerSock == -1) {
-        WEB_PANIC("call to `socket` failed");
-    }
+static void *HttpUringLoopProc(void *Arg) {
+    http_uring_loop *Loop = (http_uring_loop *)Arg;
 
-    int OptValue = 1;
-    if (setsockopt(ServerSock, SOL_SOCKET, SO_REUSEADDR, &OptValue, sizeof(OptValue)) == -1) {
-        WEB_PANIC("Failed to set socket options");
+    if (Loop->Cpu >= 0 && !WebThreadPinToCpu((uz) Loop->Cpu)) {
+        WEB_LOG_FMT(WARN, HTTP, "Failed to pin an io_uring loop to CPU %zd", Loop->Cpu);
     }
 
-    if (bind(ServerSock, ServerAddr->ai_addr, ServerAddr->ai_addrlen) == -1) {
-        WEB_PANIC("Call to `bind` failed");
-    }
+    UringArmAccept(Loop);
+    UringArmSweep(Loop);
 
-    if (listen(ServerSock, TCP_BACKLOG_SIZE) == -1) {
-        WEB_PANIC("Call to `listen` failed");
-    }
+    while (1) {
+        if (WebUringSubmitAndWait(&Loop->Ring, 1) < 0 && errno != EBUSY) {
+            WEB_PANIC_FMT("Call to `io_uring_enter` failed: %s", strerror(errno));
+        }
 
-    struct sockaddr_storage ClientAddr;
-    socklen_t ClientAddrSize = sizeof(ClientAddr);
+        Loop->Now = HttpMonotonicNs();
 
-    sync_pool WorkerDataPool;
-    SyncPoolInit(&WorkerDataPool, NewWorkerDataPoolProc);
+        struct io_uring_cqe *Cqe;
+        while ((Cqe = WebUringPeekCqe(&Loop->Ring)) != NULL) {
+            struct io_uring_cqe Completion = *Cqe;
+            WebUringCqeSeen(&Loop->Ring);
 
-    sync_pool ContextPool;
-    SyncPoolInit(&ContextPool, NewContextPoolProc);
+            uring_op Op = Completion.user_data & URING_OP_MASK;
+            worker_data *Conn = (worker_data *) (uintptr_t) (Completion.user_data & ~URING_OP_MASK);
 
-    while (1) {
-        int ClientSock = accept(ServerSock, (struct sockaddr*)&ClientAddr, &ClientAddrSize);
+            switch (Op) {
+            case URING_OP_ACCEPT:   HttpUringOnAccept(Loop, &Completion); break;
+            case URING_OP_RECV:     HttpUringOnRecv(Conn, &Completion); break;
+            case URING_OP_SEND:     HttpUringOnSend(Conn, &Completion); break;
+            case URING_OP_SHUTDOWN:
+            case URING_OP_CLOSE:    HttpUringOnClose(Conn, &Completion, Op); break;
+            case URING_OP_TIMEOUT:  UringArmSweep(Loop); break;
+            default:                WEB_UNREACHABLE();
+            }
+        }
 
-        if (ClientSock == -1) {
-            int AcceptError = errno;
-            close(ServerSock);
-            WEB_PANIC_FMT("Could not accept a new connection: %s", strerror(AcceptError));
+        if (Loop->Now >= Loop->NextSweep) {
+            HttpUringCloseExpired(&Loop->Reading, Loop->Now);
+            HttpUringCloseExpired(&Loop->Writing, Loop->Now);
+            Loop->NextSweep = Loop->Now + EVENT_LOOP_SWEEP_INTERVAL_MS * 1000000ll;
         }
+    }
 
-        web_https_session HttpsSession = {0};
+    return NULL;
+}
 
-        if (Server->UseHttps) {
-            int Status = HttpsAcceptConnection(Server->HttpsProvider, ClientSock, &HttpsSession);
+static void HttpServerStartUring(web_http_server *Server, u16 Port) {
+    uz LoopsCount = Server->EventLoopsCount;
+    http_uring_loop *Loops = WEB_ARENA_PUSH_ZERO(&Server->Arena, sizeof(*Loops) * LoopsCount);
+
+    u32 *Cpus = WebArenaPush(&Server->Arena, sizeof(*Cpus) * HTTP_MAX_CPUS);
+    uz CpusCount = WebThreadAllowedCpus(Cpus, HTTP_MAX_CPUS);
+
+    for (uz I = 0; I < LoopsCount; ++I) {
+        http_uring_loop *Loop = &Loops[I];
+        Loop->Server = Server;
+        Loop->ListenSock = HttpListen(Port, 0, 1);
+        Loop->Cpu = CpusCount > 0 ? (sz) Cpus[I % CpusCount] : -1;
+        Loop->Reading.TimeoutNs = EVENT_LOOP_REQUEST_TIMEOUT_MS * 1000000ll;
+        Loop->Writing.TimeoutNs = SOCKET_WRITE_TIMEOUT_MS * 1000000ll;
+        Loop->SweepInterval.tv_sec = EVENT_LOOP_SWEEP_INTERVAL_MS / 1000;
+        Loop->SweepInterval.tv_nsec = (EVENT_LOOP_SWEEP_INTERVAL_MS % 1000) * 1000000ll;
+        Loop->Now = HttpMonotonicNs();
+
+        if (!WebUringInit(&Loop->Ring, URING_ENTRIES)) {
+            WEB_PANIC_FMT("Failed to set up an io_uring instance: %s", strerror(errno));
+        }
 
-            if (Status < 0) {
-                const char *ErrorString = HttpsGetErrorString(Server->HttpsProvider, Status);
-                (void) ErrorString;
-                WEB_LOG_FATAL_FMT("Sum SSL bullshit: %s", ErrorString);
-            } else if (Status == 0) {
-                WEB_LOG(INFO, TLS, "Client reset TLS connection");
-                close(ClientSock);
-                continue;
-            }
+        if (!WebUringBufRingInit(&Loop->Ring, &Loop->BufRing, URING_BUFFER_GROUP, URING_BUFFERS_COUNT, URING_BUFFER_SIZE)) {
+            WEB_PANIC_FMT("Failed to register the io_uring provided buffers: %s", strerror(errno));
         }
 
-        worker_data *WorkerData = SyncPoolAlloc(&WorkerDataPool);
-        WorkerData->WorkerDataPool = &WorkerDataPool;
-        WorkerData->Server = Server;
-        WorkerData->ContextPool = &ContextPool;
-        WorkerData->ClientSock = ClientSock;
-        WorkerData->HttpsSession = HttpsSession;
+        SyncPoolInit(&Loop->WorkerDataPool, sizeof(worker_data), NULL);
+        SyncPoolInit(&Loop->ContextPool, sizeof(web_http_response_context), InitContextPoolProc);
+    }
 
-        web_thread_pool_task Task = {.Proc = ServerWorker, .Arg = WorkerData};
-        WebThreadPoolScheduleTask(&Server->ThreadPool, Task);
+    for (uz I = 1; I < LoopsCount; ++I) {
+        if (!WebThreadLaunch(&Loops[I].Thread, HttpUringLoopProc, &Loops[I])) {
+            WEB_PANIC("Failed to launch an io_uring loop thread");
+        }
+    }
+
+    HttpUringLoopProc(&Loops[0]);
+}
+#endif // WEB_USE_IO_URING
+
+void WebHttpServerStart(web_http_server *Server, u16 Port) {
+    HttpDateStart();
+
+    switch (Server->Mode) {
+    case WEB_HTTP_SERVER_MODE_THREAD_POOL: HttpServerStartThreadPool(Server, Port); return;
+    case WEB_HTTP_SERVER_MODE_EVENT_LOOP:  HttpServerStartEventLoops(Server, Port); return;
+    case WEB_HTTP_SERVER_MODE_REUSEPORT:   HttpServerStartEventLoops(Server, Port); return;
+#ifdef WEB_USE_IO_URING
+    case WEB_HTTP_SERVER_MODE_IO_URING:    HttpServerStartUring(Server, Port); return;
+#endif // WEB_USE_IO_URING
     }
+
+    WEB_UNREACHABLE();
 }
 
 // NOTE(oleh): Need to make sure that we are running on a system with virtual memory.
 #define HTTP_SERVER_ARENA_CAPACITY (4ll * 1024ll * 1024ll * 1024ll)
 
-// If you need more, seek help.
-#define HTTP_SERVER_MAX_HANDLERS (100)
+void WebHttpServerAttachRoute(web_http_server *Server,
+                              const char *Path,
+                              web_http_request_handler Handler,
+                              const web_http_route_options *Options) {
+    web_http_route_node *Node = RouteInsert(&Server->Arena, Server->Routes, WEB_SV_LIT(Path));
+
+    uz Slot = Options->HasMethod ? (uz) Options->Method : HTTP_ROUTE_SLOT_ANY;
+    if (Node->Routes[Slot].Handler != NULL) WEB_PANIC_FMT("Route '%s' is already attached", Path);
+
+    Node->Routes[Slot] = (http_route) {
+        .Handler = Handler,
+        .Data = Options->Data,
+        .StreamBody = Options->StreamBody,
+        .CacheTtlMs = Options->CacheTtlMs,
+        .CacheVary = Options->CacheVary,
+        .CacheVaryCount = Options->CacheVaryCount,
+        .SchedulingClass = Options->SchedulingClass,
+    };
+}
+
+void WebHttpServerAttachHandlerWithData(web_http_server *Server,
+                                        const char *Path,
+                                        web_http_request_handler Handler,
+                                        void *Data) {
+    web_http_route_options Options = {.Data = Data};
+    WebHttpServerAttachRoute(Server, Path, Handler, &Options);
+}
 
 void WebHttpServerAttachHandler(web_http_server *Server, const char *Path, web_http_request_handler Handler) {
-    if (Server->HandlersCount >= HTTP_SERVER_MAX_HANDLERS)
-        WEB_PANIC_FMT("Maximum amount of handlers (%d) reached!", HTTP_SERVER_MAX_HANDLERS);
+    WebHttpServerAttachHandlerWithData(Server, Path, Handler, NULL);
+}
+
+void WebHttpServerAttachMethodHandler(web_http_server *Server,
+                                      web_http_method Method,
+                                      const char *Path,
+                                      web_http_request_handler Handler,
+                                      void *Data) {
+    web_http_route_options Options = {.HasMethod = 1, .Method = Method, .Data = Data};
+    WebHttpServerAttachRoute(Server, Path, Handler, &Options);
+}
+
+b32 WebHttpContextGetParam(web_http_response_context *Ctx, const char *Name, web_string_view *OutValue) {
+    for (uz I = 0; I < Ctx->Params.Count; ++I) {
+        if (WebStringViewEqualCStr(Ctx->Params.Items[I].Name, Name)) {
+            *OutValue = Ctx->Params.Items[I].Value;
+            return 1;
+        }
+    }
 
-    uz HandlersCount = Server->HandlersCount;
-    Server->HandlersPaths[HandlersCount] = WEB_SV_LIT(Path);
-    Server->Handlers[HandlersCount] = Handler;
-    ++Server->HandlersCount;
+    return 0;
 }
 
-static void HttpsInit(web_https_provider *Provider) {
+static void HttpsInit(web_https_provider *Provider, b32 Http2) {
     switch (Provider->Type) {
 #if WEB_USE_HTTPS_OPENSSL
     case WEB_HTTPS_PROVIDER_OPENSSL: {
@@ -899,12 +4963,18 @@ static void HttpsInit(web_https_provider *Provider) {
         Ret = SSL_CTX_use_PrivateKey_file(SslCtx, Conf->PrivateKeyFileName, SSL_FILETYPE_PEM);
         WEB_VERIFY(Ret > 0);
 
+        if (Http2) SSL_CTX_set_alpn_select_cb(SslCtx, OpenSSLAlpnSelect, NULL);
+
         Provider->Data = SslCtx;
 
         return;
     }
 #endif // WEB_USE_HTTPS_OPENSSL
     case WEB_HTTPS_PROVIDER_CUSTOM: {
+        // NOTE(oleh): Custom providers do their own ALPN, clients that got "h2" still start with the
+        // preface.
+        (void) Http2;
+
         web_https_custom_provider *Custom = (web_https_custom_provider *) Provider->Data;
         Custom->VTable.Init(Custom->Data);
 
@@ -918,24 +4988,63 @@ static void HttpsInit(web_https_provider *Provider) {
 b32 WebHttpServerInit(web_http_server *Server, web_http_server_config *Config) {
     Server->UseHttps = Config->UseHttps;
     Server->HttpsProvider = Config->HttpsProvider;
+    Server->Http2 = !Config->DisableHttp2;
 
     if (Config->UseHttps) {
         WEB_VERIFY(Config->HttpsProvider != NULL);
 
-        HttpsInit(Config->HttpsProvider);
+        HttpsInit(Config->HttpsProvider, Server->Http2);
     }
 
     WebArenaInit(&Server->Arena, HTTP_SERVER_ARENA_CAPACITY);
 
-    Server->Handlers = WebArenaPush(&Server->Arena, sizeof(*Server->Handlers) * HTTP_SERVER_MAX_HANDLERS);
-    Server->HandlersPaths = WebArenaPush(&Server->Arena, sizeof(*Server->HandlersPaths) * HTTP_SERVER_MAX_HANDLERS);
+    Server->Routes = RouteNodeNew(&Server->Arena, (web_string_view) {0});
+
+    uz CacheCapacity = Config->ResponseCacheCapacity > 0 ? Config->ResponseCacheCapacity : RESPONSE_CACHE_DEFAULT_CAPACITY;
+    uz CacheMaxEntrySize = Config->ResponseCacheMaxEntrySize > 0 ? Config->ResponseCacheMaxEntrySize : RESPONSE_CACHE_DEFAULT_MAX_ENTRY_SIZE;
+    Server->Cache = WebArenaPush(&Server->Arena, sizeof(*Server->Cache));
+    HttpCacheInit(Server->Cache, CacheCapacity, CacheMaxEntrySize);
+
+    Server->Compression = !Config->DisableCompression;
+    Server->CompressionMinSize = Config->CompressionMinSize > 0 ? Config->CompressionMinSize : COMPRESSION_DEFAULT_MIN_SIZE;
+    Server->MaxRequestBodySize = Config->MaxRequestBodySize > 0 ? Config->MaxRequestBodySize : REQUEST_BODY_DEFAULT_MAX_SIZE;
 
-    Server->HandlersCount = 0;
+    Server->Mode = Config->Mode;
 
-    Server->ThreadsCount = Config->NumThreads || 1;
+    if (Server->Mode != WEB_HTTP_SERVER_MODE_THREAD_POOL) {
+        if (Config->UseHttps) {
+            WEB_LOG(ERROR, HTTP, "HTTPS is not supported by the event loop server modes yet");
+            return 0;
+        }
+
+        sz OnlineCpus = sysconf(_SC_NPROCESSORS_ONLN);
+        Server->EventLoopsCount = Config->NumEventLoops > 0 ? (uz) Config->NumEventLoops : (uz) WEB_MAX(OnlineCpus, 1);
+
+        // NOTE(oleh): The handlers run on the loops, so there is no need for the thread pool.
+        return 1;
+    }
+
+    sz OnlineCpus = sysconf(_SC_NPROCESSORS_ONLN);
+    uz NumThreads = Config->NumThreads > 0 ? (uz) Config->NumThreads : (uz) WEB_MAX(OnlineCpus, 1);
+
+    web_thread_pool_config ThreadPoolConfig = {
+        .NumThreads = NumThreads,
+        .MaxThreads = Config->MaxThreads > 0 ? (uz) Config->MaxThreads : 0,
+        .QueueWaitTargetUs = Config->ThreadsQueueWaitTargetUs,
+        .IdleTimeoutMs = Config->ThreadsIdleTimeoutMs,
+        .LanesCount = Config->SchedulingClassesCount,
+        .LanePolicy = Config->SchedulingPolicy,
+        .Affinity = Config->Affinity,
+        .Cpus = Config->AffinityCpus,
+        .CpusCount = Config->AffinityCpusCount,
+    };
+    memcpy(ThreadPoolConfig.LaneWeights, Config->SchedulingWeights, sizeof(ThreadPoolConfig.LaneWeights));
 
-    web_thread_pool_config ThreadPoolConfig = {.NumThreads = Server->ThreadsCount};
-    return WebThreadPoolInit(&Server->ThreadPool, &Server->Arena, &ThreadPoolConfig);
+    if (!WebThreadPoolInit(&Server->ThreadPool, &Server->Arena, &ThreadPoolConfig)) return 0;
+
+    // NOTE(oleh): Every slot the pool may grow to, not just the workers that are running now.
+    Server->ThreadsCount = Server->ThreadPool.ThreadsCount;
+    return 1;
 }
 
 void WebHttpContextAddHeader(web_http_response_context *Ctx, web_string_view Name, web_string_view Value) {
@@ -946,6 +5055,389 @@ void WebHttpContextAddHeader(web_http_response_context *Ctx, web_string_view Nam
     WEB_ARRAY_PUSH(&Ctx->Arena, &Ctx->ResponseHeaders, Header);
 }
 
+void WebHttpContextAddTrailer(web_http_response_context *Ctx, web_string_view Name, web_string_view Value) {
+    web_http_header Trailer = {
+        .Name = Name,
+        .Value = Value,
+    };
+    WEB_ARRAY_PUSH(&Ctx->Arena, &Ctx->ResponseTrailers, Trailer);
+}
+
+static b32 HttpResponseStreamSend(web_http_response_stream *Stream, struct iovec *Iov, int IovCount) {
+    if (Stream->Failed) return 0;
+
+    if (Stream->WriteV(Stream->Data, Iov, IovCount) == -1) Stream->Failed = 1;
+    return !Stream->Failed;
+}
+
+b32 WebHttpResponseBegin(web_http_response_context *Ctx, web_http_response_status Status) {
+    web_http_response_stream *Stream = &Ctx->Stream;
+    WEB_ASSERT(!Stream->Started);
+    Stream->Started = 1;
+
+    web_http_version Version = Ctx->Request.Version;
+
+    // NOTE(oleh): HTTP/2 frames the body itself, every chunk becomes DATA and the trailers a final HEADERS.
+    if (Version == HTTP_2) {
+        worker_data *Data = (worker_data *) Stream->Data;
+        web_http_headers Headers = HttpHttp2ResponseHeaders(Ctx, -1, (web_string_view) {0});
+        if (!Http2StreamSendHeaders(Data->Http2, Data->Http2Stream, Status, Headers, 0)) Stream->Failed = 1;
+        return !Stream->Failed;
+    }
+
+    // NOTE(oleh): HTTP/1.0 has no chunked encoding, the end of the body is the end of the connection.
+    const char *FramingHeader = "Transfer-Encoding: chunked\r\n";
+    Stream->Chunked = Version != HTTP_1_0;
+    if (!Stream->Chunked) {
+        FramingHeader = "";
+        Stream->KeepAlive = 0;
+    }
+
+    const char *ConnectionHeader = HttpConnectionHeader(Version, Stream->KeepAlive);
+    web_string_view Head = HttpResponseHeadFormat(Ctx, Version, Status, -1, FramingHeader, ConnectionHeader);
+
+    struct iovec Iov = {.iov_base = Head.Items, .iov_len = Head.Count};
+    return HttpResponseStreamSend(Stream, &Iov, 1);
+}
+
+b32 WebHttpResponseWriteChunk(web_http_response_context *Ctx, web_string_view Chunk) {
+    web_http_response_stream *Stream = &Ctx->Stream;
+    WEB_ASSERT(Stream->Started && !Stream->Finished);
+
+    // NOTE(oleh): An empty chunk would end the body.
+    if (Chunk.Count == 0) return !Stream->Failed;
+
+    if (Ctx->Request.Version == HTTP_2) {
+        worker_data *Data = (worker_data *) Stream->Data;
+        if (!Stream->Failed && !Http2StreamSendData(Data->Http2, Data->Http2Stream, Chunk, 0, 1)) Stream->Failed = 1;
+        return !Stream->Failed;
+    }
+
+    if (!Stream->Chunked) {
+        struct iovec Iov = {.iov_base = Chunk.Items, .iov_len = Chunk.Count};
+        return HttpResponseStreamSend(Stream, &Iov, 1);
+    }
+
+    char Size[24];
+    int SizeCount = snprintf(Size, sizeof(Size), "%zx\r\n", Chunk.Count);
+
+    struct iovec Iov[] = {
+        {.iov_base = Size,        .iov_len = SizeCount},
+        {.iov_base = Chunk.Items, .iov_len = Chunk.Count},
+        {.iov_base = "\r\n",      .iov_len = 2},
+    };
+
+    return HttpResponseStreamSend(Stream, Iov, WEB_ARRAY_COUNT(Iov));
+}
+
+b32 WebHttpResponseEnd(web_http_response_context *Ctx) {
+    web_http_response_stream *Stream = &Ctx->Stream;
+    WEB_ASSERT(Stream->Started && !Stream->Finished);
+    Stream->Finished = 1;
+
+    if (Ctx->Request.Version == HTTP_2) {
+        worker_data *Data = (worker_data *) Stream->Data;
+        if (!Stream->Failed && !Http2StreamSendTrailers(Data->Http2, Data->Http2Stream, Ctx->ResponseTrailers)) Stream->Failed = 1;
+        return !Stream->Failed;
+    }
+
+    if (!Stream->Chunked) return !Stream->Failed;
+
+    // NOTE(oleh): The last chunk, then the trailer section. (https://datatracker.ietf.org/doc/html/rfc7230#section-4.1.2)
+    web_dynamic_string Trailers;
+    WEB_ARRAY_INIT(&Ctx->Arena, &Trailers);
+
+    WEB_ARRAY_PUSH(&Ctx->Arena, &Trailers, '0');
+    WEB_ARRAY_PUSH(&Ctx->Arena, &Trailers, '\r');
+    WEB_ARRAY_PUSH(&Ctx->Arena, &Trailers, '\n');
+    HttpHeadersFormat(&Ctx->Arena, &Trailers, Ctx->ResponseTrailers);
+    WEB_ARRAY_PUSH(&Ctx->Arena, &Trailers, '\r');
+    WEB_ARRAY_PUSH(&Ctx->Arena, &Trailers, '\n');
+
+    struct iovec Iov = {.iov_base = Trailers.Items, .iov_len = Trailers.Count};
+    return HttpResponseStreamSend(Stream, &Iov, 1);
+}
+
 void WebHttpResponseWrite(web_http_response_context *Ctx, web_string_view Response) {
     Ctx->Content = Response;
 }
+
+sz WebHttpContextReadBody(web_http_response_context *Ctx, u8 *Buffer, uz Capacity) {
+    web_http_body_reader *Reader = &Ctx->BodyReader;
+    if (Reader->Read != NULL) return Reader->Read(Reader->Data, Buffer, Capacity);
+
+    web_string_view Body = Ctx->Request.Body;
+    uz N = WEB_MIN(Capacity, Body.Count - Reader->Offset);
+    memcpy(Buffer, Body.Items + Reader->Offset, N);
+    Reader->Offset += N;
+    return N;
+}
+
+void WebHttpResponseSendFile(web_http_response_context *Ctx, int Fd, s64 Offset, uz Count) {
+    Ctx->File = (web_http_response_file) {
+        .Present = 1,
+        .Fd = Fd,
+        .Offset = Offset,
+        .Count = Count,
+    };
+}
+
+#define WEB_ENUM_STATIC_CONTENT_TYPES                   \
+    X("html",  "text/html; charset=utf-8")              \
+    X("htm",   "text/html; charset=utf-8")              \
+    X("css",   "text/css; charset=utf-8")               \
+    X("js",    "text/javascript; charset=utf-8")        \
+    X("mjs",   "text/javascript; charset=utf-8")        \
+    X("json",  "application/json")                      \
+    X("map",   "application/json")                      \
+    X("txt",   "text/plain; charset=utf-8")             \
+    X("xml",   "application/xml")                       \
+    X("svg",   "image/svg+xml")                         \
+    X("png",   "image/png")                             \
+    X("jpg",   "image/jpeg")                            \
+    X("jpeg",  "image/jpeg")                            \
+    X("gif",   "image/gif")                             \
+    X("webp",  "image/webp")                            \
+    X("avif",  "image/avif")                            \
+    X("ico",   "image/x-icon")                          \
+    X("woff",  "font/woff")                             \
+    X("woff2", "font/woff2")                            \
+    X("ttf",   "font/ttf")                              \
+    X("otf",   "font/otf")                              \
+    X("wasm",  "application/wasm")                      \
+    X("pdf",   "application/pdf")                       \
+    X("zip",   "application/zip")                       \
+    X("gz",    "application/gzip")                      \
+    X("mp4",   "video/mp4")                             \
+    X("webm",  "video/webm")                            \
+    X("mp3",   "audio/mpeg")
+
+static const char *StaticFileContentType(web_string_view Path) {
+    sz I = Path.Count - 1;
+    for (; I >= 0; --I) {
+        if (Path.Items[I] == '.') break;
+        if (Path.Items[I] == '/') return "application/octet-stream";
+    }
+
+    if (I < 0) return "application/octet-stream";
+
+    web_string_view Extension = {.Items = Path.Items + I + 1, .Count = Path.Count - I - 1};
+
+#define X(Ext, Type) if (WebStringViewEqualCStrIgnoreCase(Extension, Ext)) return Type;
+    WEB_ENUM_STATIC_CONTENT_TYPES
+#undef X
+
+    return "application/octet-stream";
+}
+
+#define STATIC_DIRECTORY_BUCKETS_COUNT 256
+#define STATIC_DIRECTORY_MAX_FILES 1024
+#define STATIC_FILE_REVALIDATE_NS (1000ll * 1000ll * 1000ll)
+
+struct web_http_static_file {
+    web_http_static_file *Next;
+    web_http_static_directory *Directory;
+
+    char *Path;
+    u64 Hash;
+
+    int Fd;
+    struct stat Stat;
+    s64 CheckedAt;
+
+    // NOTE(oleh): Requests currently sending from `Fd`. A stale entry is out of the table already and
+    // gets closed when the last of them is done.
+    s32 Refs;
+    b32 Stale;
+};
+
+static void StaticFileDestroy(web_http_static_file *File) {
+    close(File->Fd);
+    free(File->Path);
+    free(File);
+}
+
+// NOTE(oleh): Must be called with the directory mutex held.
+static void StaticFileRetire(web_http_static_file *File) {
+    File->Stale = 1;
+    --File->Directory->FilesCount;
+    if (File->Refs == 0) StaticFileDestroy(File);
+}
+
+static void StaticFileRelease(void *Data) {
+    web_http_static_file *File = (web_http_static_file *) Data;
+    web_http_static_directory *Directory = File->Directory;
+
+    WebMutexLock(&Directory->Mu);
+    --File->Refs;
+    if (File->Refs == 0 && File->Stale) StaticFileDestroy(File);
+    WebMutexUnlock(&Directory->Mu);
+}
+
+// NOTE(oleh): Drops unused entries until there is room for a new one.
+static void StaticDirectoryEvict(web_http_static_directory *Directory) {
+    for (uz BucketIndex = 0; BucketIndex < Directory->BucketsCount; ++BucketIndex) {
+        web_http_static_file **Link = &Directory->Buckets[BucketIndex];
+
+        while (*Link != NULL) {
+            if (Directory->FilesCount < STATIC_DIRECTORY_MAX_FILES) return;
+
+            web_http_static_file *File = *Link;
+            if (File->Refs > 0) {
+                Link = &File->Next;
+                continue;
+            }
+
+            *Link = File->Next;
+            StaticFileRetire(File);
+        }
+    }
+}
+
+static b32 StaticStatEqual(struct stat *Lhs, struct stat *Rhs) {
+    return Lhs->st_ino == Rhs->st_ino &&
+        Lhs->st_dev == Rhs->st_dev &&
+        Lhs->st_size == Rhs->st_size &&
+        Lhs->st_mtim.tv_sec == Rhs->st_mtim.tv_sec &&
+        Lhs->st_mtim.tv_nsec == Rhs->st_mtim.tv_nsec;
+}
+
+// NOTE(oleh): Returns a referenced entry for the file, opening it if it isn't cached or changed on disk.
+static web_http_static_file *StaticDirectoryAcquire(web_http_static_directory *Directory, const char *Path) {
+    web_string_view PathSv = WEB_SV_LIT(Path);
+    u64 Hash = WebHashFnv1(PathSv);
+    s64 Now = HttpMonotonicNs();
+
+    WebMutexLock(&Directory->Mu);
+
+    web_http_static_file **Link = &Directory->Buckets[Hash % Directory->BucketsCount];
+    web_http_static_file *File = NULL;
+
+    for (; *Link != NULL; Link = &(*Link)->Next) {
+        if ((*Link)->Hash == Hash && strcmp((*Link)->Path, Path) == 0) {
+            File = *Link;
+            break;
+        }
+    }
+
+    if (File != NULL && Now - File->CheckedAt < STATIC_FILE_REVALIDATE_NS) {
+        ++File->Refs;
+        WebMutexUnlock(&Directory->Mu);
+        return File;
+    }
+
+    struct stat Stat;
+    if (stat(Path, &Stat) == -1 || !S_ISREG(Stat.st_mode)) {
+        if (File != NULL) {
+            *Link = File->Next;
+            StaticFileRetire(File);
+        }
+
+        WebMutexUnlock(&Directory->Mu);
+        return NULL;
+    }
+
+    if (File != NULL) {
+        if (StaticStatEqual(&File->Stat, &Stat)) {
+            File->CheckedAt = Now;
+            ++File->Refs;
+            WebMutexUnlock(&Directory->Mu);
+            return File;
+        }
+
+        *Link = File->Next;
+        StaticFileRetire(File);
+    }
+
+    int Fd = open(Path, O_RDONLY | O_CLOEXEC);
+    if (Fd == -1 || fstat(Fd, &Stat) == -1) {
+        if (Fd != -1) close(Fd);
+        WebMutexUnlock(&Directory->Mu);
+        return NULL;
+    }
+
+    if (Directory->FilesCount >= STATIC_DIRECTORY_MAX_FILES) StaticDirectoryEvict(Directory);
+
+    File = malloc(sizeof(*File));
+    WEB_STRUCT_ZERO(File);
+    File->Directory = Directory;
+    File->Path = strdup(Path);
+    File->Hash = Hash;
+    File->Fd = Fd;
+    File->Stat = Stat;
+    File->CheckedAt = Now;
+    File->Refs = 1;
+
+    web_http_static_file **Bucket = &Directory->Buckets[Hash % Directory->BucketsCount];
+    File->Next = *Bucket;
+    *Bucket = File;
+    ++Directory->FilesCount;
+
+    WebMutexUnlock(&Directory->Mu);
+    return File;
+}
+
+void WebHttpStaticDirectoryInit(web_http_static_directory *Directory, const char *UrlPrefix, const char *Root) {
+    WEB_STRUCT_ZERO(Directory);
+    Directory->Root = Root;
+    Directory->UrlPrefix = WEB_SV_LIT(UrlPrefix);
+
+    WebMutexInit(&Directory->Mu);
+    Directory->BucketsCount = STATIC_DIRECTORY_BUCKETS_COUNT;
+    Directory->Buckets = calloc(Directory->BucketsCount, sizeof(*Directory->Buckets));
+}
+
+web_http_response_status WebHttpStaticDirectoryHandler(web_http_response_context *Ctx) {
+    web_http_static_directory *Directory = (web_http_static_directory *) Ctx->HandlerData;
+    WEB_ASSERT(Directory != NULL);
+
+    if (Ctx->Request.Method != HTTP_GET) return HTTP_STATUS_METHOD_NOT_ALLOWED;
+
+    web_string_view Path = Ctx->Request.Path;
+
+    if (Path.Count < Directory->UrlPrefix.Count ||
+        memcmp(Path.Items, Directory->UrlPrefix.Items, Directory->UrlPrefix.Count) != 0) {
+        return HTTP_STATUS_NOT_FOUND;
+    }
+
+    Path.Items += Directory->UrlPrefix.Count;
+    Path.Count -= Directory->UrlPrefix.Count;
+
+    for (uz I = 0; I < Path.Count; ++I) {
+        if (Path.Items[I] == '?' || Path.Items[I] == '#') {
+            Path.Count = I;
+            break;
+        }
+    }
+
+    // NOTE(oleh): Don't let anyone walk out of the root.
+    // TODO(oleh): Percent-decode the path.
+    for (uz I = 0; I + 1 < Path.Count; ++I) {
+        if (Path.Items[I] == '.' && Path.Items[I + 1] == '.' &&
+            (I == 0 || Path.Items[I - 1] == '/') &&
+            (I + 2 == Path.Count || Path.Items[I + 2] == '/')) {
+            return HTTP_STATUS_FORBIDDEN;
+        }
+    }
+
+    b32 IsDirectory = Path.Count == 0 || Path.Items[Path.Count - 1] == '/';
+    const char *Separator = (Path.Count > 0 && Path.Items[0] == '/') ? "" : "/";
+
+    web_string_view FullPath = WebArenaFormat(&Ctx->Arena,
+                                              "%s%s" WEB_SV_FMT "%s",
+                                              Directory->Root,
+                                              Separator,
+                                              WEB_SV_ARG(Path),
+                                              IsDirectory ? "index.html" : "");
+
+    web_http_static_file *File = StaticDirectoryAcquire(Directory, (const char *) FullPath.Items);
+    if (File == NULL) return HTTP_STATUS_NOT_FOUND;
+
+    WebHttpContextAddHeader(Ctx, WEB_SV_LIT("Content-Type"), WEB_SV_LIT(StaticFileContentType(FullPath)));
+
+    WebHttpResponseSendFile(Ctx, File->Fd, 0, File->Stat.st_size);
+    Ctx->File.Release = StaticFileRelease;
+    Ctx->File.ReleaseData = File;
+
+    return HTTP_STATUS_OK;
+}
@@ -37,6 +37,65 @@ typedef struct {
     uz Capacity;
 } web_http_headers;
 
+// NOTE(oleh): Headers the parser recognizes by name. Their positions are recorded in the request's
+// `KnownHeaders` table, so looking one of them up doesn't have to go through all the headers.
+#define WEB_ENUM_HTTP_KNOWN_HEADERS\
+    X(ACCEPT, "Accept")                                                    \
+    X(ACCEPT_ENCODING, "Accept-Encoding")                                  \
+    X(ACCEPT_LANGUAGE, "Accept-Language")                                  \
+    X(ACCESS_CONTROL_REQUEST_HEADERS, "Access-Control-Request-Headers")    \
+    X(ACCESS_CONTROL_REQUEST_METHOD, "Access-Control-Request-Method")      \
+    X(AUTHORIZATION, "Authorization")                                      \
+    X(CACHE_CONTROL, "Cache-Control")                                      \
+    X(CONNECTION, "Connection")                                            \
+    X(CONTENT_ENCODING, "Content-Encoding")                                \
+    X(CONTENT_LENGTH, "Content-Length")                                    \
+    X(CONTENT_TYPE, "Content-Type")                                        \
+    X(COOKIE, "Cookie")                                                    \
+    X(DATE, "Date")                                                        \
+    X(ETAG, "ETag")                                                        \
+    X(EXPECT, "Expect")                                                    \
+    X(FORWARDED, "Forwarded")                                              \
+    X(HOST, "Host")                                                        \
+    X(HTTP2_SETTINGS, "HTTP2-Settings")                                    \
+    X(IF_MATCH, "If-Match")                                                \
+    X(IF_MODIFIED_SINCE, "If-Modified-Since")                              \
+    X(IF_NONE_MATCH, "If-None-Match")                                      \
+    X(IF_RANGE, "If-Range")                                                \
+    X(IF_UNMODIFIED_SINCE, "If-Unmodified-Since")                          \
+    X(KEEP_ALIVE, "Keep-Alive")                                            \
+    X(LAST_MODIFIED, "Last-Modified")                                      \
+    X(LOCATION, "Location")                                                \
+    X(ORIGIN, "Origin")                                                    \
+    X(RANGE, "Range")                                                      \
+    X(REFERER, "Referer")                                                  \
+    X(SET_COOKIE, "Set-Cookie")                                            \
+    X(TE, "TE")                                                            \
+    X(TRAILER, "Trailer")                                                  \
+    X(TRANSFER_ENCODING, "Transfer-Encoding")                              \
+    X(UPGRADE, "Upgrade")                                                  \
+    X(USER_AGENT, "User-Agent")                                            \
+    X(VARY, "Vary")                                                        \
+    X(VIA, "Via")                                                          \
+    X(WWW_AUTHENTICATE, "WWW-Authenticate")                                \
+    X(X_FORWARDED_FOR, "X-Forwarded-For")                                  \
+    X(X_FORWARDED_PROTO, "X-Forwarded-Proto")                              \
+    X(X_REQUEST_ID, "X-Request-Id")                                        \
+    X(X_REAL_IP, "X-Real-IP")                                              \
+    X(SEC_WEBSOCKET_KEY, "Sec-WebSocket-Key")                              \
+    X(SERVER, "Server")
+
+typedef enum {
+#define X(Name, String) HTTP_HEADER_##Name,
+    WEB_ENUM_HTTP_KNOWN_HEADERS
+#undef X
+    HTTP_KNOWN_HEADERS_COUNT,
+    HTTP_HEADER_UNKNOWN = HTTP_KNOWN_HEADERS_COUNT,
+} web_http_header_id;
+
+// NOTE(oleh): Case-insensitive, returns `HTTP_HEADER_UNKNOWN` for every other name.
+web_http_header_id WebHttpHeaderId(web_string_view Name);
+
 #define WEB_ENUM_HTTP_VERSIONS \
     X(1_0, "HTTP/1.0") \
     X(1_1, "HTTP/1.1")
@@ -45,6 +104,8 @@ typedef enum {
 #define X(Version, String) HTTP_##Version,
 WEB_ENUM_HTTP_VERSIONS
 #undef X
+    // NOTE(oleh): Only set on the requests that came in over HTTP/2, the HTTP/1 parsers never produce it.
+    HTTP_2,
 } web_http_version;
 
 #define WEB_ENUM_HTTP_RESPONSE_STATUSES                             \
@@ -122,60 +183,339 @@ typedef struct {
     web_string_view Path;
     web_http_version Version;
     web_http_headers Headers;
+    // NOTE(oleh): Index + 1 into `Headers` of the first occurrence of every known header, 0 if the
+    // request doesn't have it.
+    u32 KnownHeaders[HTTP_KNOWN_HEADERS_COUNT];
     web_string_view Body;
 } web_http_request;
 
 typedef struct {
     web_http_version Version;
+    // NOTE(oleh): Any code from 100 to 999, not only the ones in `WEB_ENUM_HTTP_RESPONSE_STATUSES`.
     web_http_response_status Status;
+    // NOTE(oleh): Whatever the server sent, may be empty.
+    web_string_view Reason;
     web_http_headers Headers;
     web_string_view Body;
 } web_http_response;
 
 b32 WebHttpRequestParse(web_arena *Arena, web_string_view Buffer, web_http_request *Out, web_string_view *Error);
-b32 WebHttpRequestSend(web_arena *Arena,
+// NOTE(oleh): Keeps the connections of `WebHttpRequestSend` open between requests, per host and port.
+// Safe to share between threads. A request to a host that is at `MaxConnectionsPerHost` waits for
+// one of its connections to be released. Connections idle for longer than `IdleTimeoutMs` are closed.
+typedef struct {
+    // NOTE(oleh): 8 by default.
+    u32 MaxConnectionsPerHost;
+    // NOTE(oleh): 30 seconds by default.
+    u32 IdleTimeoutMs;
+    // NOTE(oleh): How long connecting, every single send and receive, and waiting for a connection to a
+    // host at its limit may take before the request fails. 30 seconds by default, which is also what
+    // the requests without a client get.
+    u32 TimeoutMs;
+} web_http_client_config;
+
+typedef struct web_http_client web_http_client;
+
+// NOTE(oleh): `Config` can be NULL for the defaults.
+web_http_client *WebHttpClientCreate(web_http_client_config *Config);
+// NOTE(oleh): No request may be in flight on the client anymore.
+void WebHttpClientDestroy(web_http_client *Client);
+
+// NOTE(oleh): Without a `Client` the request gets a connection of its own, which is closed afterwards.
+// The response is read up to where its framing (Content-Length or chunked) says it ends, chunked
+// bodies come out decoded. `Arena` only gets the response itself.
+b32 WebHttpRequestSend(web_http_client *Client,
+                       web_arena *Arena,
                        web_string_view Hostname,
                        u16 Port,
                        web_http_request Request,
                        web_http_response *Response);
 
+// NOTE(oleh): Gets the body of a streamed response piece by piece, as it arrives. Returning 0 aborts
+// the request.
+typedef b32 (*web_http_body_proc)(void *Data, web_string_view Chunk);
+
+// NOTE(oleh): Like `WebHttpRequestSend`, but the body goes to `OnBody` instead of the arena, so it can
+// be of any size. `Response->Body` stays empty.
+b32 WebHttpRequestStream(web_http_client *Client,
+                         web_arena *Arena,
+                         web_string_view Hostname,
+                         u16 Port,
+                         web_http_request Request,
+                         web_http_response *Response,
+                         web_http_body_proc OnBody,
+                         void *OnBodyData);
+
+typedef enum {
+    WEB_HTTP_CLIENT_OK,
+    // NOTE(oleh): Resolving the host or connecting to it failed.
+    WEB_HTTP_CLIENT_CONNECT_FAILED,
+    WEB_HTTP_CLIENT_IO_ERROR,
+    WEB_HTTP_CLIENT_BAD_RESPONSE,
+    WEB_HTTP_CLIENT_TIMED_OUT,
+} web_http_client_result;
+
+typedef struct {
+    web_string_view Hostname;
+    u16 Port;
+    web_http_request Request;
+    // NOTE(oleh): Counted from the start of the batch, 0 for no deadline.
+    u32 TimeoutMs;
+
+    web_http_client_result Result;
+    web_http_response Response;
+} web_http_batch_request;
+
+// NOTE(oleh): Sends all of the requests at once and waits for their responses on an epoll loop in the
+// calling thread, so the whole batch takes about as long as its slowest request. The responses are
+// put into `Arena` as they complete. With a `Client` requests to a host at its connection limit are
+// started as soon as one of its connections frees up. Returns how many requests succeeded.
+uz WebHttpRequestSendMany(web_http_client *Client, web_arena *Arena, web_http_batch_request *Requests, uz Count);
+
 b32 WebHttpResponseParse(web_arena *Arena, web_string_view Buffer, web_http_response *OutResponse);
 
+static inline b32 WebHttpRequestGetKnownHeader(web_http_request *Request, web_http_header_id Id, web_string_view *OutValue) {
+    u32 Slot = Request->KnownHeaders[Id];
+    if (Slot == 0) return 0;
+
+    *OutValue = Request->Headers.Items[Slot - 1].Value;
+    return 1;
+}
+
+// NOTE(oleh): Case-insensitive. Known headers are a single table read, the rest a linear search.
+b32 WebHttpRequestGetHeader(web_http_request *Request, web_string_view Name, web_string_view *OutValue);
+
+// NOTE(oleh): A response body sent straight from a file descriptor (with sendfile where possible)
+// instead of `Content`. `Release` is called once the body has been sent.
+typedef struct {
+    b32 Present;
+    int Fd;
+    s64 Offset;
+    uz Count;
+
+    void (*Release)(void *ReleaseData);
+    void *ReleaseData;
+} web_http_response_file;
+
+typedef struct {
+    web_string_view Name;
+    web_string_view Value;
+} web_http_path_param;
+
+typedef struct {
+    web_http_path_param *Items;
+    uz Count;
+    uz Capacity;
+} web_http_path_params;
+
+// NOTE(oleh): Where `WebHttpContextReadBody` gets the body from. `Read` is only set for routes with a
+// streamed body, otherwise the reader walks `Request.Body` and `Offset` is how far it got.
+typedef struct {
+    sz (*Read)(void *Data, u8 *Buffer, uz Capacity);
+    void *Data;
+    uz Offset;
+} web_http_body_reader;
+
+// NOTE(oleh): State of a response sent in pieces with `WebHttpResponseBegin` and friends instead of
+// through `Content`.
+typedef struct {
+    sz (*WriteV)(void *Data, struct iovec *Iov, int IovCount);
+    void *Data;
+
+    b32 Started;
+    b32 Finished;
+    b32 Failed;
+    b32 Chunked;
+    b32 KeepAlive;
+} web_http_response_stream;
+
+typedef struct web_http_server web_http_server;
+
 typedef struct {
     web_arena Arena;
     web_http_request Request;
+    // NOTE(oleh): Values captured by the ":name" and "*name" segments of the matched route.
+    web_http_path_params Params;
     web_http_headers ResponseHeaders;
     web_string_view Content;
+    web_http_response_file File;
+
+    // NOTE(oleh): The data the matched handler was attached with.
+    void *HandlerData;
+    web_http_server *Server;
+
+    web_http_body_reader BodyReader;
+
+    web_http_response_stream Stream;
+    web_http_headers ResponseTrailers;
 } web_http_response_context;
 
 typedef web_http_response_status (*web_http_request_handler)(web_http_response_context *);
 
-typedef struct {
+typedef enum {
+    // NOTE(oleh): One thread accepts connections and hands each of them to the thread pool, where
+    // a worker blocks on it until the response is sent.
+    WEB_HTTP_SERVER_MODE_THREAD_POOL,
+    // NOTE(oleh): One edge-triggered epoll loop per core owning non-blocking sockets. Handlers run
+    // on the loop thread once a request has been fully received.
+    WEB_HTTP_SERVER_MODE_EVENT_LOOP,
+    // NOTE(oleh): Like the event loop mode, but every loop is pinned to its own core and accepts
+    // from its own SO_REUSEPORT listener, so nothing is shared between the loops.
+    WEB_HTTP_SERVER_MODE_REUSEPORT,
+#ifdef WEB_USE_IO_URING
+    // NOTE(oleh): Shared-nothing like the SO_REUSEPORT mode, but every loop is driven by an
+    // io_uring instance: multishot accepts and receives into provided buffers, and the sends of a
+    // response are linked with the close of the connection.
+    WEB_HTTP_SERVER_MODE_IO_URING,
+#endif // WEB_USE_IO_URING
+} web_http_server_mode;
+
+typedef struct web_http_route_node web_http_route_node;
+typedef struct web_http_response_cache web_http_response_cache;
+
+struct web_http_server {
     // TODO(oleh): Probably introduce a thread pool and accepting socket fd here.
     web_arena Arena;
-    web_string_view *HandlersPaths;
-    web_http_request_handler *Handlers;
-    uz HandlersCount;
+    web_http_route_node *Routes;
+    web_http_response_cache *Cache;
+    b32 Compression;
+    uz CompressionMinSize;
+    uz MaxRequestBodySize;
+    b32 Http2;
     uz ThreadsCount;
     web_thread_pool ThreadPool;
 
+    web_http_server_mode Mode;
+    uz EventLoopsCount;
+
     b32 UseHttps;
     web_https_provider *HttpsProvider;
-} web_http_server;
+};
 
 typedef struct {
+    // NOTE(oleh): Defaults to the number of online CPUs. With `MaxThreads` above it the pool grows while
+    // the requests wait for a free worker for longer than `ThreadsQueueWaitTargetUs`, as it happens with
+    // handlers that block, and shrinks back after `ThreadsIdleTimeoutMs`. See `web_thread_pool_config`.
     s16 NumThreads;
+    s16 MaxThreads;
+    u32 ThreadsQueueWaitTargetUs;
+    u32 ThreadsIdleTimeoutMs;
+
+    // NOTE(oleh): The number of priority lanes of the thread pool, up to `WEB_THREAD_POOL_MAX_LANES`,
+    // see the `SchedulingClass` of `web_http_route_options`. Weighted selection with halving weights
+    // unless told otherwise.
+    u32 SchedulingClassesCount;
+    web_thread_pool_lane_policy SchedulingPolicy;
+    u32 SchedulingWeights[WEB_THREAD_POOL_MAX_LANES];
+    // NOTE(oleh): Where the thread pool workers run, see `web_thread_affinity`. Every worker keeps its
+    // own request contexts.
+    web_thread_affinity Affinity;
+    u32 *AffinityCpus;
+    uz AffinityCpusCount;
+
+    web_http_server_mode Mode;
+    // NOTE(oleh): Defaults to the number of online CPUs.
+    s16 NumEventLoops;
 
     b32 UseHttps;
     web_https_provider *HttpsProvider;
+
+    // NOTE(oleh): Limits of the response cache, in bytes. They default to 64MB in total and 1MB per
+    // response.
+    uz ResponseCacheCapacity;
+    uz ResponseCacheMaxEntrySize;
+
+    // NOTE(oleh): Buffered responses of at least `CompressionMinSize` bytes (1KB by default) are
+    // compressed with whatever the client accepts and the library was built with. Responses that already
+    // have a Content-Encoding or an already compressed Content-Type are left alone.
+    b32 DisableCompression;
+    uz CompressionMinSize;
+
+    // NOTE(oleh): Requests with a larger body get a 413 and the connection closed, HTTP/2 streams get
+    // reset. 64MB by default. Only the buffered bodies count, the routes with `StreamBody` are read
+    // by their handlers as they go in the thread pool mode.
+    uz MaxRequestBodySize;
+
+    // NOTE(oleh): HTTP/2 is negotiated with ALPN over TLS (OpenSSL only) and spoken right away by
+    // clients that send the connection preface in clear text (prior knowledge). Only the thread pool
+    // mode speaks it, the event loop and io_uring modes close connections that start with the preface.
+    // The streams of a connection are handled one at a time on its worker.
+    b32 DisableHttp2;
 } web_http_server_config;
 
 b32 WebHttpServerInit(web_http_server *, web_http_server_config *);
 
 void WebHttpResponseWrite(web_http_response_context *, web_string_view);
 
+// NOTE(oleh): Incremental responses. `WebHttpResponseBegin` sends the status line and the headers added
+// so far with `Transfer-Encoding: chunked`, every `WebHttpResponseWriteChunk` goes out as one chunk,
+// and `WebHttpResponseEnd` sends the last chunk with the trailers. Ending is optional, the server
+// does it once the handler returns, and the status returned by the handler is ignored then.
+// HTTP/1.0 clients get the body unframed and the connection closed after it. On io_uring the chunks
+// are buffered until the handler returns. All of these return 0 once the client is gone.
+b32 WebHttpResponseBegin(web_http_response_context *Ctx, web_http_response_status Status);
+b32 WebHttpResponseWriteChunk(web_http_response_context *Ctx, web_string_view Chunk);
+b32 WebHttpResponseEnd(web_http_response_context *Ctx);
+void WebHttpContextAddTrailer(web_http_response_context *Ctx, web_string_view Name, web_string_view Value);
+
 void WebHttpServerStart(web_http_server *Server, u16 Port);
+// NOTE(oleh): Routes are matched against the request path without the query string. A segment
+// starting with ':' (e.g. "/users/:id") captures one path segment, and a '*' at the end of the route
+// (optionally followed by a name, "/static/*file") captures the rest of the path. Static segments are
+// preferred over parameters, and parameters over wildcards. Handlers attached without a method
+// serve every method that doesn't have its own handler.
 void WebHttpServerAttachHandler(web_http_server *Server, const char *Path, web_http_request_handler WebHandler);
+void WebHttpServerAttachHandlerWithData(web_http_server *Server,
+                                        const char *Path,
+                                        web_http_request_handler WebHandler,
+                                        void *Data);
+typedef struct {
+    // NOTE(oleh): Without a method the route serves every method that has no route of its own.
+    b32 HasMethod;
+    web_http_method Method;
+
+    // NOTE(oleh): Available to the handler as `Ctx->HandlerData`.
+    void *Data;
+
+    // NOTE(oleh): Call the handler as soon as the headers are in, without buffering the body. The
+    // handler pulls the body with `WebHttpContextReadBody` and whatever it leaves unread is skipped.
+    // Only takes effect in the thread pool mode, the event loop, reuseport and io_uring modes still
+    // buffer the whole body before calling the handler.
+    b32 StreamBody;
+
+    // NOTE(oleh): Keep 200 responses to GET requests for this long and send them again without calling
+    // the handler. Responses are keyed on the whole path with the query, plus the values of the
+    // `CacheVary` headers. Streamed responses and files are never cached.
+    u32 CacheTtlMs;
+    const char *const *CacheVary;
+    uz CacheVaryCount;
+
+    // NOTE(oleh): The thread pool lane the handler runs in, 0 being the most urgent one. New connections
+    // are read in lane 0, a request for a route of another class is then queued in its lane, so that
+    // expensive routes piling up don't hold up the cheap ones. Only used by the thread pool mode, and not
+    // for HTTP/2 connections.
+    u32 SchedulingClass;
+} web_http_route_options;
+
+void WebHttpServerAttachRoute(web_http_server *Server,
+                              const char *Path,
+                              web_http_request_handler WebHandler,
+                              const web_http_route_options *Options);
+void WebHttpServerAttachMethodHandler(web_http_server *Server,
+                                      web_http_method Method,
+                                      const char *Path,
+                                      web_http_request_handler WebHandler,
+                                      void *Data);
+
+// NOTE(oleh): Drops the cached responses for `Path` (the query is ignored) in all of their variants.
+void WebHttpServerInvalidateCache(web_http_server *Server, web_string_view Path);
+void WebHttpServerClearCache(web_http_server *Server);
+
+b32 WebHttpContextGetParam(web_http_response_context *Ctx, const char *Name, web_string_view *OutValue);
+
+// NOTE(oleh): Reads the next part of the request body into `Buffer`. Returns 0 once the whole body has
+// been read and -1 if the client went away.
+sz WebHttpContextReadBody(web_http_response_context *Ctx, u8 *Buffer, uz Capacity);
 
 static inline b32 WebHttpContextParseJsonBody(web_http_response_context *Ctx, web_json_value *OutValue) {
     return WebJsonParse(&Ctx->Arena, Ctx->Request.Body, OutValue);
@@ -183,6 +523,28 @@ static inline b32 WebHttpContextParseJsonBody(web_http_response_context *Ctx, we
 
 void WebHttpContextAddHeader(web_http_response_context *Ctx, web_string_view Name, web_string_view Value);
 
+// NOTE(oleh): The descriptor has to stay open until the response is sent.
+void WebHttpResponseSendFile(web_http_response_context *Ctx, int Fd, s64 Offset, uz Count);
+
+typedef struct web_http_static_file web_http_static_file;
+
+// NOTE(oleh): Serves the files under `Root`. Attach `WebHttpStaticDirectoryHandler` with the directory
+// as the handler data, e.g. `WebHttpServerAttachHandlerWithData(&Server, "/static/*",
+// WebHttpStaticDirectoryHandler, &Directory)`, where `UrlPrefix` is "/static". Open descriptors and
+// their stat results are cached and re-validated at most once a second.
+typedef struct {
+    const char *Root;
+    web_string_view UrlPrefix;
+
+    web_mutex Mu;
+    web_http_static_file **Buckets;
+    uz BucketsCount;
+    uz FilesCount;
+} web_http_static_directory;
+
+void WebHttpStaticDirectoryInit(web_http_static_directory *Directory, const char *UrlPrefix, const char *Root);
+web_http_response_status WebHttpStaticDirectoryHandler(web_http_response_context *Ctx);
+
 #ifdef __cplusplus
     }
 #endif
@@ -0,0 +1,1653 @@
+#include "http2.h"
+#include "log.h"
+
+#include <pthread.h>
+
+#define HTTP2_FRAME_HEADER_SIZE 9
+#define HTTP2_DEFAULT_FRAME_SIZE 16384
+#define HTTP2_MAX_FRAME_SIZE 16777215
+#define HTTP2_DEFAULT_WINDOW_SIZE 65535
+#define HTTP2_MAX_WINDOW_SIZE 0x7fffffff
+
+// NOTE(oleh): What we announce to the clients. Bodies are buffered whole, so the receive windows are
+// mostly about not making the client wait for a WINDOW_UPDATE on every round trip.
+#define HTTP2_MAX_CONCURRENT_STREAMS 100
+#define HTTP2_STREAM_WINDOW_SIZE (1 << 20)
+#define HTTP2_CONNECTION_WINDOW_SIZE (16 << 20)
+#define HTTP2_MAX_HEADER_BLOCK_SIZE (64 * 1024)
+// NOTE(oleh): The decoded size of a header block, announced as SETTINGS_MAX_HEADER_LIST_SIZE. A stream
+// that goes over it is reset.
+#define HTTP2_MAX_HEADER_LIST_SIZE (64 * 1024)
+// NOTE(oleh): Where the header blocks of the streams we don't keep are decoded. That is the strings
+// of a block of at most `HTTP2_MAX_HEADER_BLOCK_SIZE`, plus at most `HTTP2_MAX_HEADER_LIST_SIZE`
+// copied out of the dynamic table and the header array, with plenty of room to spare.
+#define HTTP2_DISCARD_ARENA_CAPACITY (4 << 20)
+
+// NOTE(oleh): How many buffers a flush gathers into a single write.
+#define HTTP2_FLUSH_IOV_COUNT 64
+
+typedef enum {
+    HTTP2_FRAME_DATA          = 0x0,
+    HTTP2_FRAME_HEADERS       = 0x1,
+    HTTP2_FRAME_PRIORITY      = 0x2,
+    HTTP2_FRAME_RST_STREAM    = 0x3,
+    HTTP2_FRAME_SETTINGS      = 0x4,
+    HTTP2_FRAME_PUSH_PROMISE  = 0x5,
+    HTTP2_FRAME_PING          = 0x6,
+    HTTP2_FRAME_GOAWAY        = 0x7,
+    HTTP2_FRAME_WINDOW_UPDATE = 0x8,
+    HTTP2_FRAME_CONTINUATION  = 0x9,
+} http2_frame_type;
+
+#define HTTP2_FLAG_END_STREAM  0x1
+#define HTTP2_FLAG_ACK         0x1
+#define HTTP2_FLAG_END_HEADERS 0x4
+#define HTTP2_FLAG_PADDED      0x8
+#define HTTP2_FLAG_PRIORITY    0x20
+
+typedef enum {
+    HTTP2_SETTINGS_HEADER_TABLE_SIZE      = 0x1,
+    HTTP2_SETTINGS_ENABLE_PUSH            = 0x2,
+    HTTP2_SETTINGS_MAX_CONCURRENT_STREAMS = 0x3,
+    HTTP2_SETTINGS_INITIAL_WINDOW_SIZE    = 0x4,
+    HTTP2_SETTINGS_MAX_FRAME_SIZE         = 0x5,
+    HTTP2_SETTINGS_MAX_HEADER_LIST_SIZE   = 0x6,
+} http2_settings_id;
+
+typedef enum {
+    HTTP2_NO_ERROR            = 0x0,
+    HTTP2_PROTOCOL_ERROR      = 0x1,
+    HTTP2_INTERNAL_ERROR      = 0x2,
+    HTTP2_FLOW_CONTROL_ERROR  = 0x3,
+    HTTP2_SETTINGS_TIMEOUT    = 0x4,
+    HTTP2_STREAM_CLOSED       = 0x5,
+    HTTP2_FRAME_SIZE_ERROR    = 0x6,
+    HTTP2_REFUSED_STREAM      = 0x7,
+    HTTP2_CANCEL              = 0x8,
+    HTTP2_COMPRESSION_ERROR   = 0x9,
+    HTTP2_CONNECT_ERROR       = 0xa,
+    HTTP2_ENHANCE_YOUR_CALM   = 0xb,
+    HTTP2_INADEQUATE_SECURITY = 0xc,
+    HTTP2_HTTP_1_1_REQUIRED   = 0xd,
+} http2_error;
+
+// ---------------------------------------------------------------------------------------------------
+// HPACK
+// ---------------------------------------------------------------------------------------------------
+
+// NOTE(oleh): The static table. (https://datatracker.ietf.org/doc/html/rfc7541#appendix-A)
+#define HPACK_ENUM_STATIC_TABLE \
+    X(":authority", "")                   \
+    X(":method", "GET")                   \
+    X(":method", "POST")                  \
+    X(":path", "/")                       \
+    X(":path", "/index.html")             \
+    X(":scheme", "http")                  \
+    X(":scheme", "https")                 \
+    X(":status", "200")                   \
+    X(":status", "204")                   \
+    X(":status", "206")                   \
+    X(":status", "304")                   \
+    X(":status", "400")                   \
+    X(":status", "404")                   \
+    X(":status", "500")                   \
+    X("accept-charset", "")               \
+    X("accept-encoding", "gzip, deflate") \
+    X("accept-language", "")              \
+    X("accept-ranges", "")                \
+    X("accept", "")                       \
+    X("access-control-allow-origin", "")  \
+    X("age", "")                          \
+    X("allow", "")                        \
+    X("authorization", "")                \
+    X("cache-control", "")                \
+    X("content-disposition", "")          \
+    X("content-encoding", "")             \
+    X("content-language", "")             \
+    X("content-length", "")               \
+    X("content-location", "")             \
+    X("content-range", "")                \
+    X("content-type", "")                 \
+    X("cookie", "")                       \
+    X("date", "")                         \
+    X("etag", "")                         \
+    X("expect", "")                       \
+    X("expires", "")                      \
+    X("from", "")                         \
+    X("host", "")                         \
+    X("if-match", "")                     \
+    X("if-modified-since", "")            \
+    X("if-none-match", "")                \
+    X("if-range", "")                     \
+    X("if-unmodified-since", "")          \
+    X("last-modified", "")                \
+    X("link", "")                         \
+    X("location", "")                     \
+    X("max-forwards", "")                 \
+    X("proxy-authenticate", "")           \
+    X("proxy-authorization", "")          \
+    X("range", "")                        \
+    X("referer", "")                      \
+    X("refresh", "")                      \
+    X("retry-after", "")                  \
+    X("server", "")                       \
+    X("set-cookie", "")                   \
+    X("strict-transport-security", "")    \
+    X("transfer-encoding", "")            \
+    X("user-agent", "")                   \
+    X("vary", "")                         \
+    X("via", "")                          \
+    X("www-authenticate", "")
+
+typedef struct {
+    const char *Name;
+    uz NameCount;
+    const char *Value;
+    uz ValueCount;
+} hpack_static_field;
+
+static const hpack_static_field HpackStaticTable[] = {
+#define X(Name, Value) {Name, sizeof(Name) - 1, Value, sizeof(Value) - 1},
+    HPACK_ENUM_STATIC_TABLE
+#undef X
+};
+
+#define HPACK_STATIC_TABLE_COUNT WEB_ARRAY_COUNT(HpackStaticTable)
+
+// NOTE(oleh): The codes are from the HPACK spec, the last symbol is EOS.
+// (https://datatracker.ietf.org/doc/html/rfc7541#appendix-B)
+#define HPACK_HUFFMAN_SYMBOLS_COUNT 257
+#define HPACK_HUFFMAN_EOS 256
+
+static const u32 HpackHuffmanCodes[HPACK_HUFFMAN_SYMBOLS_COUNT] = {
+    0x1ff8, 0x7fffd8, 0xfffffe2, 0xfffffe3, 0xfffffe4, 0xfffffe5, 0xfffffe6, 0xfffffe7,
+    0xfffffe8, 0xffffea, 0x3ffffffc, 0xfffffe9, 0xfffffea, 0x3ffffffd, 0xfffffeb, 0xfffffec,
+    0xfffffed, 0xfffffee, 0xfffffef, 0xffffff0, 0xffffff1, 0xffffff2, 0x3ffffffe, 0xffffff3,
+    0xffffff4, 0xffffff5, 0xffffff6, 0xffffff7, 0xffffff8, 0xffffff9, 0xffffffa, 0xffffffb,
+    0x14, 0x3f8, 0x3f9, 0xffa, 0x1ff9, 0x15, 0xf8, 0x7fa,
+    0x3fa, 0x3fb, 0xf9, 0x7fb, 0xfa, 0x16, 0x17, 0x18,
+    0x0, 0x1, 0x2, 0x19, 0x1a, 0x1b, 0x1c, 0x1d,
+    0x1e, 0x1f, 0x5c, 0xfb, 0x7ffc, 0x20, 0xffb, 0x3fc,
+    0x1ffa, 0x21, 0x5d, 0x5e, 0x5f, 0x60, 0x61, 0x62,
+    0x63, 0x64, 0x65, 0x66, 0x67, 0x68, 0x69, 0x6a,
+    0x6b, 0x6c, 0x6d, 0x6e, 0x6f, 0x70, 0x71, 0x72,
+    0xfc, 0x73, 0xfd, 0x1ffb, 0x7fff0, 0x1ffc, 0x3ffc, 0x22,
+    0x7ffd, 0x3, 0x23, 0x4, 0x24, 0x5, 0x25, 0x26,
+    0x27, 0x6, 0x74, 0x75, 0x28, 0x29, 0x2a, 0x7,
+    0x2b, 0x76, 0x2c, 0x8, 0x9, 0x2d, 0x77, 0x78,
+    0x79, 0x7a, 0x7b, 0x7ffe, 0x7fc, 0x3ffd, 0x1ffd, 0xffffffc,
+    0xfffe6, 0x3fffd2, 0xfffe7, 0xfffe8, 0x3fffd3, 0x3fffd4, 0x3fffd5, 0x7fffd9,
+    0x3fffd6, 0x7fffda, 0x7fffdb, 0x7fffdc, 0x7fffdd, 0x7fffde, 0xffffeb, 0x7fffdf,
+    0xffffec, 0xffffed, 0x3fffd7, 0x7fffe0, 0xffffee, 0x7fffe1, 0x7fffe2, 0x7fffe3,
+    0x7fffe4, 0x1fffdc, 0x3fffd8, 0x7fffe5, 0x3fffd9, 0x7fffe6, 0x7fffe7, 0xffffef,
+    0x3fffda, 0x1fffdd, 0xfffe9, 0x3fffdb, 0x3fffdc, 0x7fffe8, 0x7fffe9, 0x1fffde,
+    0x7fffea, 0x3fffdd, 0x3fffde, 0xfffff0, 0x1fffdf, 0x3fffdf, 0x7fffeb, 0x7fffec,
+    0x1fffe0, 0x1fffe1, 0x3fffe0, 0x1fffe2, 0x7fffed, 0x3fffe1, 0x7fffee, 0x7fffef,
+    0xfffea, 0x3fffe2, 0x3fffe3, 0x3fffe4, 0x7ffff0, 0x3fffe5, 0x3fffe6, 0x7ffff1,
+    0x3ffffe0, 0x3ffffe1, 0xfffeb, 0x7fff1, 0x3fffe7, 0x7ffff2, 0x3fffe8, 0x1ffffec,
+    0x3ffffe2, 0x3ffffe3, 0x3ffffe4, 0x7ffffde, 0x7ffffdf, 0x3ffffe5, 0xfffff1, 0x1ffffed,
+    0x7fff2, 0x1fffe3, 0x3ffffe6, 0x7ffffe0, 0x7ffffe1, 0x3ffffe7, 0x7ffffe2, 0xfffff2,
+    0x1fffe4, 0x1fffe5, 0x3ffffe8, 0x3ffffe9, 0xffffffd, 0x7ffffe3, 0x7ffffe4, 0x7ffffe5,
+    0xfffec, 0xfffff3, 0xfffed, 0x1fffe6, 0x3fffe9, 0x1fffe7, 0x1fffe8, 0x7ffff3,
+    0x3fffea, 0x3fffeb, 0x1ffffee, 0x1ffffef, 0xfffff4, 0xfffff5, 0x3ffffea, 0x7ffff4,
+    0x3ffffeb, 0x7ffffe6, 0x3ffffec, 0x3ffffed, 0x7ffffe7, 0x7ffffe8, 0x7ffffe9, 0x7ffffea,
+    0x7ffffeb, 0xffffffe, 0x7ffffec, 0x7ffffed, 0x7ffffee, 0x7ffffef, 0x7fffff0, 0x3ffffee,
+    0x3fffffff,
+};
+
+static const u8 HpackHuffmanCodeLengths[HPACK_HUFFMAN_SYMBOLS_COUNT] = {
+    13, 23, 28, 28, 28, 28, 28, 28, 28, 24, 30, 28, 28, 30, 28, 28,
+    28, 28, 28, 28, 28, 28, 30, 28, 28, 28, 28, 28, 28, 28, 28, 28,
+    6, 10, 10, 12, 13, 6, 8, 11, 10, 10, 8, 11, 8, 6, 6, 6,
+    5, 5, 5, 6, 6, 6, 6, 6, 6, 6, 7, 8, 15, 6, 12, 10,
+    13, 6, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7,
+    7, 7, 7, 7, 7, 7, 7, 7, 8, 7, 8, 13, 19, 13, 14, 6,
+    15, 5, 6, 5, 6, 5, 6, 6, 6, 5, 7, 7, 6, 6, 6, 5,
+    6, 7, 6, 5, 5, 6, 7, 7, 7, 7, 7, 15, 11, 14, 13, 28,
+    20, 22, 20, 20, 22, 22, 22, 23, 22, 23, 23, 23, 23, 23, 24, 23,
+    24, 24, 22, 23, 24, 23, 23, 23, 23, 21, 22, 23, 22, 23, 23, 24,
+    22, 21, 20, 22, 22, 23, 23, 21, 23, 22, 22, 24, 21, 22, 23, 23,
+    21, 21, 22, 21, 23, 22, 23, 23, 20, 22, 22, 22, 23, 22, 22, 23,
+    26, 26, 20, 19, 22, 23, 22, 25, 26, 26, 26, 27, 27, 26, 24, 25,
+    19, 21, 26, 27, 27, 26, 27, 24, 21, 21, 26, 26, 28, 27, 27, 27,
+    20, 24, 20, 21, 22, 21, 21, 23, 22, 22, 25, 25, 24, 24, 26, 23,
+    26, 27, 26, 26, 27, 27, 27, 27, 27, 28, 27, 27, 27, 27, 27, 26,
+    30,
+};
+
+// NOTE(oleh): A binary tree over the codes, built on first use. Leaves are tagged with
+// `HPACK_HUFFMAN_LEAF`, a zero child can't happen since the code is complete.
+#define HPACK_HUFFMAN_LEAF 0x8000
+
+static u16 HpackHuffmanTree[HPACK_HUFFMAN_SYMBOLS_COUNT][2];
+static pthread_once_t HpackHuffmanTreeOnce = PTHREAD_ONCE_INIT;
+
+static void HpackHuffmanTreeBuild(void) {
+    u16 NodesCount = 1;
+
+    for (u16 Symbol = 0; Symbol < HPACK_HUFFMAN_SYMBOLS_COUNT; ++Symbol) {
+        u32 Code = HpackHuffmanCodes[Symbol];
+        u32 Length = HpackHuffmanCodeLengths[Symbol];
+
+        u16 Node = 0;
+        for (u32 Bit = Length - 1; Bit > 0; --Bit) {
+            u32 Branch = (Code >> Bit) & 1;
+            if (HpackHuffmanTree[Node][Branch] == 0) HpackHuffmanTree[Node][Branch] = NodesCount++;
+            Node = HpackHuffmanTree[Node][Branch];
+        }
+
+        HpackHuffmanTree[Node][Code & 1] = HPACK_HUFFMAN_LEAF | Symbol;
+    }
+}
+
+// NOTE(oleh): `Output` needs room for `Count * 8 / 5` bytes, the shortest code is 5 bits long.
+static b32 HpackHuffmanDecode(u8 *Input, uz Count, u8 *Output, uz *OutCount) {
+    pthread_once(&HpackHuffmanTreeOnce, HpackHuffmanTreeBuild);
+
+    u16 Node = 0;
+    uz N = 0;
+    // NOTE(oleh): The bits after the last symbol have to be a prefix of EOS, so all ones and less
+    // than a byte of them.
+    u32 PaddingBits = 0;
+    b32 PaddingOnes = 1;
+
+    for (uz I = 0; I < Count; ++I) {
+        for (s32 Bit = 7; Bit >= 0; --Bit) {
+            u32 Branch = (Input[I] >> Bit) & 1;
+            u16 Next = HpackHuffmanTree[Node][Branch];
+            if (Next == 0) return 0;
+
+            ++PaddingBits;
+            PaddingOnes &= Branch;
+
+            if (Next & HPACK_HUFFMAN_LEAF) {
+                u16 Symbol = Next & ~HPACK_HUFFMAN_LEAF;
+                if (Symbol == HPACK_HUFFMAN_EOS) return 0;
+
+                Output[N++] = (u8) Symbol;
+                Node = 0;
+                PaddingBits = 0;
+                PaddingOnes = 1;
+            } else {
+                Node = Next;
+            }
+        }
+    }
+
+    if (PaddingBits > 7 || !PaddingOnes) return 0;
+
+    *OutCount = N;
+    return 1;
+}
+
+static uz HpackHuffmanEncodedCount(web_string_view String) {
+    uz Bits = 0;
+    for (uz I = 0; I < String.Count; ++I) Bits += HpackHuffmanCodeLengths[String.Items[I]];
+    return (Bits + 7) / 8;
+}
+
+static u8 *HpackHuffmanEncode(u8 *Out, web_string_view String) {
+    u64 Bits = 0;
+    u32 BitsCount = 0;
+
+    for (uz I = 0; I < String.Count; ++I) {
+        u32 Length = HpackHuffmanCodeLengths[String.Items[I]];
+        Bits = (Bits << Length) | HpackHuffmanCodes[String.Items[I]];
+        BitsCount += Length;
+
+        while (BitsCount >= 8) {
+            BitsCount -= 8;
+            *Out++ = (u8) (Bits >> BitsCount);
+        }
+
+        Bits &= (1ull << BitsCount) - 1;
+    }
+
+    // NOTE(oleh): Padded with the most significant bits of EOS.
+    if (BitsCount > 0) *Out++ = (u8) ((Bits << (8 - BitsCount)) | (0xff >> BitsCount));
+
+    return Out;
+}
+
+#define HPACK_ENTRY_OVERHEAD 32
+#define HPACK_DEFAULT_TABLE_SIZE 4096
+#define HPACK_TABLE_SLOTS (HPACK_DEFAULT_TABLE_SIZE / HPACK_ENTRY_OVERHEAD + 1)
+
+// NOTE(oleh): The dynamic table as a ring, `Newest` is the slot of index 0. Neither side ever goes
+// above the default size, so the slots are enough for the smallest possible entries. Every entry is
+// a single allocation, the value follows the name.
+typedef struct {
+    web_string_view Names[HPACK_TABLE_SLOTS];
+    web_string_view Values[HPACK_TABLE_SLOTS];
+    uz Newest;
+    uz Count;
+    uz Size;
+    uz MaxSize;
+} hpack_table;
+
+static uz HpackTableSlot(hpack_table *Table, uz Index) {
+    return (Table->Newest + HPACK_TABLE_SLOTS - Index) % HPACK_TABLE_SLOTS;
+}
+
+static void HpackTableEvict(hpack_table *Table) {
+    uz Slot = HpackTableSlot(Table, Table->Count - 1);
+    Table->Size -= Table->Names[Slot].Count + Table->Values[Slot].Count + HPACK_ENTRY_OVERHEAD;
+    free(Table->Names[Slot].Items);
+    --Table->Count;
+}
+
+static void HpackTableResize(hpack_table *Table, uz MaxSize) {
+    Table->MaxSize = MaxSize;
+    while (Table->Size > Table->MaxSize) HpackTableEvict(Table);
+}
+
+static void HpackTableInsert(hpack_table *Table, web_string_view Name, web_string_view Value) {
+    uz Size = Name.Count + Value.Count + HPACK_ENTRY_OVERHEAD;
+    while (Table->Count > 0 && Table->Size + Size > Table->MaxSize) HpackTableEvict(Table);
+
+    // NOTE(oleh): An entry larger than the whole table just empties it.
+    if (Size > Table->MaxSize) return;
+
+    u8 *Memory = malloc(Name.Count + Value.Count + 1);
+    memcpy(Memory, Name.Items, Name.Count);
+    memcpy(Memory + Name.Count, Value.Items, Value.Count);
+
+    Table->Newest = (Table->Newest + 1) % HPACK_TABLE_SLOTS;
+    Table->Names[Table->Newest] = (web_string_view) {.Items = Memory, .Count = Name.Count};
+    Table->Values[Table->Newest] = (web_string_view) {.Items = Memory + Name.Count, .Count = Value.Count};
+    ++Table->Count;
+    Table->Size += Size;
+}
+
+static void HpackTableFree(hpack_table *Table) {
+    while (Table->Count > 0) HpackTableEvict(Table);
+}
+
+// NOTE(oleh): Indices start at 1 with the static table, the dynamic one follows it.
+static b32 HpackLookup(hpack_table *Table, u64 Index, web_string_view *Name, web_string_view *Value) {
+    if (Index == 0) return 0;
+
+    if (Index <= HPACK_STATIC_TABLE_COUNT) {
+        const hpack_static_field *Field = &HpackStaticTable[Index - 1];
+        *Name = (web_string_view) {.Items = (u8 *) Field->Name, .Count = Field->NameCount};
+        *Value = (web_string_view) {.Items = (u8 *) Field->Value, .Count = Field->ValueCount};
+        return 1;
+    }
+
+    Index -= HPACK_STATIC_TABLE_COUNT + 1;
+    if (Index >= Table->Count) return 0;
+
+    uz Slot = HpackTableSlot(Table, Index);
+    *Name = Table->Names[Slot];
+    *Value = Table->Values[Slot];
+    return 1;
+}
+
+static b32 HpackDecodeInteger(u8 **Cursor, u8 *End, u32 PrefixBits, u64 *Out) {
+    if (*Cursor >= End) return 0;
+
+    u64 Max = (1u << PrefixBits) - 1;
+    u64 Value = *(*Cursor)++ & Max;
+
+    if (Value == Max) {
+        u32 Shift = 0;
+        while (1) {
+            // NOTE(oleh): Nothing we deal with comes anywhere close to 2^32.
+            if (*Cursor >= End || Shift > 28) return 0;
+
+            u8 Byte = *(*Cursor)++;
+            Value += (u64) (Byte & 0x7f) << Shift;
+            Shift += 7;
+
+            if (!(Byte & 0x80)) break;
+        }
+    }
+
+    *Out = Value;
+    return 1;
+}
+
+// NOTE(oleh): Strings are always copied into `Arena`, the block they come from is reused.
+static b32 HpackDecodeString(web_arena *Arena, u8 **Cursor, u8 *End, web_string_view *Out) {
+    if (*Cursor >= End) return 0;
+
+    b32 Huffman = **Cursor & 0x80;
+    u64 Count;
+    if (!HpackDecodeInteger(Cursor, End, 7, &Count)) return 0;
+    if (Count > (uz) (End - *Cursor)) return 0;
+
+    u8 *Input = *Cursor;
+    *Cursor += Count;
+
+    if (Huffman) {
+        u8 *Output = WebArenaPush(Arena, Count * 8 / 5 + 1);
+        uz OutputCount = 0;
+        if (!HpackHuffmanDecode(Input, Count, Output, &OutputCount)) return 0;
+
+        *Out = (web_string_view) {.Items = Output, .Count = OutputCount};
+    } else {
+        u8 *Output = WebArenaPush(Arena, Count + 1);
+        memcpy(Output, Input, Count);
+
+        *Out = (web_string_view) {.Items = Output, .Count = Count};
+    }
+
+    return 1;
+}
+
+static web_string_view HpackCopy(web_arena *Arena, web_string_view String) {
+    u8 *Items = WebArenaPush(Arena, String.Count + 1);
+    memcpy(Items, String.Items, String.Count);
+    return (web_string_view) {.Items = Items, .Count = String.Count};
+}
+
+// NOTE(oleh): Once the fields add up to more than `MaxListSize` (counted like SETTINGS_MAX_HEADER_LIST_SIZE)
+// the rest of the block is still decoded to keep the table in sync, but nothing is copied out of the
+// table anymore and `*OutTooLarge` is set. Otherwise a block of one byte references to a large dynamic
+// entry would blow up to thousands of times its size.
+static b32 HpackDecodeBlock(hpack_table *Table, web_arena *Arena, u8 *Block, uz Count, uz MaxListSize,
+                            web_http_headers *Out, b32 *OutTooLarge) {
+    u8 *Cursor = Block;
+    u8 *End = Block + Count;
+    uz FieldsCount = 0;
+    uz ListSize = 0;
+
+    WEB_ARRAY_INIT(Arena, Out);
+    *OutTooLarge = 0;
+
+    while (Cursor < End) {
+        u8 Byte = *Cursor;
+        web_http_header Header;
+
+        if (Byte & 0x80) {
+            // NOTE(oleh): Indexed field.
+            u64 Index;
+            if (!HpackDecodeInteger(&Cursor, End, 7, &Index)) return 0;
+            if (!HpackLookup(Table, Index, &Header.Name, &Header.Value)) return 0;
+
+            ListSize += Header.Name.Count + Header.Value.Count + HPACK_ENTRY_OVERHEAD;
+            if (ListSize > MaxListSize) *OutTooLarge = 1;
+
+            // NOTE(oleh): Dynamic entries may be evicted by the very next field.
+            if (Index > HPACK_STATIC_TABLE_COUNT && !*OutTooLarge) {
+                Header.Name = HpackCopy(Arena, Header.Name);
+                Header.Value = HpackCopy(Arena, Header.Value);
+            }
+        } else if ((Byte & 0xe0) == 0x20) {
+            // NOTE(oleh): Dynamic table size update, only allowed at the start of a block.
+            u64 MaxSize;
+            if (FieldsCount > 0) return 0;
+            if (!HpackDecodeInteger(&Cursor, End, 5, &MaxSize)) return 0;
+            if (MaxSize > HPACK_DEFAULT_TABLE_SIZE) return 0;
+
+            HpackTableResize(Table, MaxSize);
+            continue;
+        } else {
+            // NOTE(oleh): A literal, with incremental indexing (01), without indexing (0000) or never
+            // indexed (0001).
+            b32 Indexing = (Byte & 0xc0) == 0x40;
+
+            u64 Index;
+            if (!HpackDecodeInteger(&Cursor, End, Indexing ? 6 : 4, &Index)) return 0;
+
+            if (Index > 0) {
+                web_string_view Unused;
+                if (!HpackLookup(Table, Index, &Header.Name, &Unused)) return 0;
+                if (Index > HPACK_STATIC_TABLE_COUNT && !*OutTooLarge) Header.Name = HpackCopy(Arena, Header.Name);
+            } else if (!HpackDecodeString(Arena, &Cursor, End, &Header.Name)) {
+                return 0;
+            }
+
+            if (!HpackDecodeString(Arena, &Cursor, End, &Header.Value)) return 0;
+
+            if (Indexing) HpackTableInsert(Table, Header.Name, Header.Value);
+
+            ListSize += Header.Name.Count + Header.Value.Count + HPACK_ENTRY_OVERHEAD;
+            if (ListSize > MaxListSize) *OutTooLarge = 1;
+        }
+
+        ++FieldsCount;
+        if (!*OutTooLarge) WEB_ARRAY_PUSH(Arena, Out, Header);
+    }
+
+    return 1;
+}
+
+static u8 *HpackEncodeInteger(u8 *Out, u8 Flags, u32 PrefixBits, u64 Value) {
+    u64 Max = (1u << PrefixBits) - 1;
+
+    if (Value < Max) {
+        *Out++ = Flags | (u8) Value;
+        return Out;
+    }
+
+    *Out++ = Flags | (u8) Max;
+    Value -= Max;
+
+    while (Value >= 0x80) {
+        *Out++ = (u8) (Value & 0x7f) | 0x80;
+        Value >>= 7;
+    }
+
+    *Out++ = (u8) Value;
+    return Out;
+}
+
+// NOTE(oleh): Huffman-coded only when that actually makes the string shorter.
+static u8 *HpackEncodeString(u8 *Out, web_string_view String) {
+    uz HuffmanCount = HpackHuffmanEncodedCount(String);
+
+    if (HuffmanCount < String.Count) {
+        Out = HpackEncodeInteger(Out, 0x80, 7, HuffmanCount);
+        return HpackHuffmanEncode(Out, String);
+    }
+
+    Out = HpackEncodeInteger(Out, 0x00, 7, String.Count);
+    memcpy(Out, String.Items, String.Count);
+    return Out + String.Count;
+}
+
+// NOTE(oleh): Returns the index of a field with the same name and value if there is one, otherwise
+// the index of one with the same name in `NameIndex`, 0 if there is none.
+static u64 HpackFind(hpack_table *Table, web_string_view Name, web_string_view Value, u64 *NameIndex) {
+    *NameIndex = 0;
+
+    for (uz I = 0; I < HPACK_STATIC_TABLE_COUNT; ++I) {
+        const hpack_static_field *Field = &HpackStaticTable[I];
+        if (Field->NameCount != Name.Count || memcmp(Field->Name, Name.Items, Name.Count) != 0) continue;
+
+        if (*NameIndex == 0) *NameIndex = I + 1;
+        if (Field->ValueCount == Value.Count && memcmp(Field->Value, Value.Items, Value.Count) == 0) return I + 1;
+    }
+
+    for (uz I = 0; I < Table->Count; ++I) {
+        uz Slot = HpackTableSlot(Table, I);
+        if (!WebStringViewEqual(Table->Names[Slot], Name)) continue;
+
+        if (*NameIndex == 0) *NameIndex = HPACK_STATIC_TABLE_COUNT + 1 + I;
+        if (WebStringViewEqual(Table->Values[Slot], Value)) return HPACK_STATIC_TABLE_COUNT + 1 + I;
+    }
+
+    return 0;
+}
+
+// NOTE(oleh): Fields that are different in pretty much every response, indexing them would only churn
+// the table.
+static const char *HpackUnindexedNames[] = {
+    "content-length",
+    "content-range",
+    "etag",
+    "last-modified",
+    "location",
+    "set-cookie",
+};
+
+static b32 HpackShouldIndex(web_string_view Name, web_string_view Value) {
+    if (Name.Count + Value.Count + HPACK_ENTRY_OVERHEAD > HPACK_DEFAULT_TABLE_SIZE / 4) return 0;
+
+    for (uz I = 0; I < WEB_ARRAY_COUNT(HpackUnindexedNames); ++I) {
+        if (WebStringViewEqualCStr(Name, HpackUnindexedNames[I])) return 0;
+    }
+
+    return 1;
+}
+
+// NOTE(oleh): These are meaningless in HTTP/2 and make the response malformed.
+// (https://datatracker.ietf.org/doc/html/rfc9113#section-8.2.2)
+static const char *Http2ConnectionSpecificNames[] = {
+    "connection",
+    "keep-alive",
+    "proxy-connection",
+    "transfer-encoding",
+    "upgrade",
+};
+
+static b32 Http2IsConnectionSpecific(web_string_view LowerName) {
+    for (uz I = 0; I < WEB_ARRAY_COUNT(Http2ConnectionSpecificNames); ++I) {
+        if (WebStringViewEqualCStr(LowerName, Http2ConnectionSpecificNames[I])) return 1;
+    }
+
+    return 0;
+}
+
+// ---------------------------------------------------------------------------------------------------
+// Connections and streams
+// ---------------------------------------------------------------------------------------------------
+
+struct http2_stream {
+    http2_stream *Prev;
+    http2_stream *Next;
+
+    u32 Id;
+    void *Data;
+    web_arena *Arena;
+
+    http2_request Request;
+    web_dynamic_string Body;
+    b32 HeadersReceived;
+
+    b32 RemoteClosed;
+    b32 LocalClosed;
+    // NOTE(oleh): Done or reset, it is freed at the end of the current `Http2ConnectionReceive`.
+    b32 Closed;
+
+    s64 SendWindow;
+    s64 RecvWindow;
+
+    // NOTE(oleh): The response data that didn't fit the windows yet. `PendingOffset` is how much of
+    // the first buffer is already sent.
+    web_string_view *Pending;
+    uz PendingFirst;
+    uz PendingCount;
+    uz PendingCapacity;
+    uz PendingOffset;
+    b32 PendingEndStream;
+    b32 HasTrailers;
+    web_http_headers Trailers;
+};
+
+struct http2_connection {
+    http2_callbacks Callbacks;
+    // NOTE(oleh): The whole body is held in memory, a stream that sends more than this gets reset.
+    uz MaxRequestBodySize;
+
+    // NOTE(oleh): The frame being received.
+    u8 Input[HTTP2_FRAME_HEADER_SIZE + HTTP2_DEFAULT_FRAME_SIZE];
+    uz InputCount;
+    b32 SettingsReceived;
+
+    // NOTE(oleh): A header block split into HEADERS and CONTINUATION frames is collected here,
+    // `HeaderBlockStreamId` is non-zero while it is incomplete.
+    u8 *HeaderBlock;
+    uz HeaderBlockCount;
+    uz HeaderBlockCapacity;
+    u32 HeaderBlockStreamId;
+    b32 HeaderBlockEndStream;
+    // NOTE(oleh): The block belongs to a stream that isn't kept, it is decoded into `DiscardArena`
+    // only to keep the HPACK state in sync. A refused stream is reset once its block is decoded.
+    b32 HeaderBlockDiscard;
+    b32 HeaderBlockRefused;
+    web_arena DiscardArena;
+
+    hpack_table Decoder;
+    hpack_table Encoder;
+    // NOTE(oleh): The client changed SETTINGS_HEADER_TABLE_SIZE, the next block we send has to start
+    // with a size update.
+    b32 EncoderResize;
+    uz EncoderMaxSize;
+
+    http2_stream *Streams;
+    uz StreamsCount;
+    u32 LastStreamId;
+
+    s64 SendWindow;
+    s64 RecvWindow;
+    u32 PeerInitialWindowSize;
+    u32 PeerMaxFrameSize;
+
+    b32 GoingAway;
+    b32 Failed;
+};
+
+static u32 Http2ReadU24(u8 *Bytes) {
+    return ((u32) Bytes[0] << 16) | ((u32) Bytes[1] << 8) | (u32) Bytes[2];
+}
+
+static u32 Http2ReadU32(u8 *Bytes) {
+    return ((u32) Bytes[0] << 24) | ((u32) Bytes[1] << 16) | ((u32) Bytes[2] << 8) | (u32) Bytes[3];
+}
+
+static void Http2WriteU32(u8 *Bytes, u32 Value) {
+    Bytes[0] = (u8) (Value >> 24);
+    Bytes[1] = (u8) (Value >> 16);
+    Bytes[2] = (u8) (Value >> 8);
+    Bytes[3] = (u8) Value;
+}
+
+static void Http2FrameHeader(u8 *Out, uz Length, http2_frame_type Type, u8 Flags, u32 StreamId) {
+    Out[0] = (u8) (Length >> 16);
+    Out[1] = (u8) (Length >> 8);
+    Out[2] = (u8) Length;
+    Out[3] = (u8) Type;
+    Out[4] = Flags;
+    Http2WriteU32(Out + 5, StreamId & 0x7fffffff);
+}
+
+static b32 Http2SendV(http2_connection *Conn, struct iovec *Iov, int IovCount) {
+    if (Conn->Failed) return 0;
+
+    if (Conn->Callbacks.SendV(Conn->Callbacks.Data, Iov, IovCount) < 0) Conn->Failed = 1;
+    return !Conn->Failed;
+}
+
+static b32 Http2SendFrame(http2_connection *Conn, http2_frame_type Type, u8 Flags, u32 StreamId, u8 *Payload, uz Length) {
+    u8 Header[HTTP2_FRAME_HEADER_SIZE];
+    Http2FrameHeader(Header, Length, Type, Flags, StreamId);
+
+    struct iovec Iov[] = {
+        {.iov_base = Header,  .iov_len = HTTP2_FRAME_HEADER_SIZE},
+        {.iov_base = Payload, .iov_len = Length},
+    };
+
+    return Http2SendV(Conn, Iov, Length > 0 ? 2 : 1);
+}
+
+static void Http2SendWindowUpdate(http2_connection *Conn, u32 StreamId, u32 Increment) {
+    u8 Payload[4];
+    Http2WriteU32(Payload, Increment);
+    Http2SendFrame(Conn, HTTP2_FRAME_WINDOW_UPDATE, 0, StreamId, Payload, sizeof(Payload));
+}
+
+static void Http2ConnectionError(http2_connection *Conn, http2_error Error) {
+    if (Conn->Failed) return;
+
+    WEB_LOG_FMT(WARN, HTTP, "Closing an HTTP/2 connection with error code %d", Error);
+
+    u8 Payload[8];
+    Http2WriteU32(Payload, Conn->LastStreamId);
+    Http2WriteU32(Payload + 4, Error);
+    Http2SendFrame(Conn, HTTP2_FRAME_GOAWAY, 0, 0, Payload, sizeof(Payload));
+
+    Conn->Failed = 1;
+}
+
+static void Http2StreamReset(http2_connection *Conn, http2_stream *Stream, u32 StreamId, http2_error Error) {
+    u8 Payload[4];
+    Http2WriteU32(Payload, Error);
+    Http2SendFrame(Conn, HTTP2_FRAME_RST_STREAM, 0, StreamId, Payload, sizeof(Payload));
+
+    if (Stream != NULL) Stream->Closed = 1;
+}
+
+static http2_stream *Http2FindStream(http2_connection *Conn, u32 StreamId) {
+    // NOTE(oleh): There are never more than `HTTP2_MAX_CONCURRENT_STREAMS` of them.
+    for (http2_stream *Stream = Conn->Streams; Stream != NULL; Stream = Stream->Next) {
+        if (Stream->Id == StreamId) return Stream;
+    }
+
+    return NULL;
+}
+
+// NOTE(oleh): Returns NULL if there is no memory for the stream, the caller refuses it then.
+static http2_stream *Http2OpenStream(http2_connection *Conn, u32 StreamId) {
+    http2_stream *Stream = malloc(sizeof(*Stream));
+    if (Stream == NULL) return NULL;
+    WEB_STRUCT_ZERO(Stream);
+
+    Stream->Arena = Conn->Callbacks.OpenStream(Conn->Callbacks.Data, &Stream->Data);
+    if (Stream->Arena == NULL) {
+        free(Stream);
+        return NULL;
+    }
+
+    Stream->Id = StreamId;
+    Stream->SendWindow = Conn->PeerInitialWindowSize;
+    Stream->RecvWindow = HTTP2_STREAM_WINDOW_SIZE;
+
+    Stream->Next = Conn->Streams;
+    if (Conn->Streams != NULL) Conn->Streams->Prev = Stream;
+    Conn->Streams = Stream;
+    ++Conn->StreamsCount;
+
+    return Stream;
+}
+
+static void Http2FreeStream(http2_connection *Conn, http2_stream *Stream) {
+    if (Stream->Prev != NULL) Stream->Prev->Next = Stream->Next;
+    else Conn->Streams = Stream->Next;
+    if (Stream->Next != NULL) Stream->Next->Prev = Stream->Prev;
+    --Conn->StreamsCount;
+
+    Conn->Callbacks.CloseStream(Conn->Callbacks.Data, Stream->Data);
+    free(Stream);
+}
+
+static void Http2ReapStreams(http2_connection *Conn) {
+    http2_stream *Stream = Conn->Streams;
+    while (Stream != NULL) {
+        http2_stream *Next = Stream->Next;
+        if (Stream->Closed) Http2FreeStream(Conn, Stream);
+        Stream = Next;
+    }
+}
+
+static void Http2StreamLocalClose(http2_stream *Stream) {
+    Stream->LocalClosed = 1;
+    if (Stream->RemoteClosed) Stream->Closed = 1;
+}
+
+static b32 Http2StreamHasPending(http2_stream *Stream) {
+    return Stream->PendingFirst < Stream->PendingCount;
+}
+
+static void Http2StreamQueue(http2_stream *Stream, web_string_view Data) {
+    if (Stream->PendingCount >= Stream->PendingCapacity) {
+        uz NewCapacity = WEB_MAX(Stream->PendingCapacity * 2, 8);
+        web_string_view *Pending = WebArenaPush(Stream->Arena, NewCapacity * sizeof(*Pending));
+        if (Stream->PendingCount > 0) memcpy(Pending, Stream->Pending, Stream->PendingCount * sizeof(*Pending));
+
+        Stream->Pending = Pending;
+        Stream->PendingCapacity = NewCapacity;
+    }
+
+    Stream->Pending[Stream->PendingCount++] = Data;
+}
+
+static b32 Http2SendHeaderBlock(http2_connection *Conn, http2_stream *Stream, u8 *Block, uz Count, b32 EndStream) {
+    // NOTE(oleh): A block larger than a frame continues in CONTINUATION frames, which can't be
+    // interleaved with anything else.
+    uz FramesCount = Count == 0 ? 1 : (Count + Conn->PeerMaxFrameSize - 1) / Conn->PeerMaxFrameSize;
+    u8 *Headers = WebArenaPush(Stream->Arena, FramesCount * HTTP2_FRAME_HEADER_SIZE);
+    struct iovec *Iov = WebArenaPush(Stream->Arena, FramesCount * 2 * sizeof(*Iov));
+
+    uz Offset = 0;
+    for (uz I = 0; I < FramesCount; ++I) {
+        uz Length = WEB_MIN(Count - Offset, Conn->PeerMaxFrameSize);
+        u8 Flags = I + 1 == FramesCount ? HTTP2_FLAG_END_HEADERS : 0;
+        if (I == 0 && EndStream) Flags |= HTTP2_FLAG_END_STREAM;
+
+        u8 *Header = Headers + I * HTTP2_FRAME_HEADER_SIZE;
+        Http2FrameHeader(Header, Length, I == 0 ? HTTP2_FRAME_HEADERS : HTTP2_FRAME_CONTINUATION, Flags, Stream->Id);
+
+        Iov[I * 2] = (struct iovec) {.iov_base = Header, .iov_len = HTTP2_FRAME_HEADER_SIZE};
+        Iov[I * 2 + 1] = (struct iovec) {.iov_base = Block + Offset, .iov_len = Length};
+        Offset += Length;
+    }
+
+    return Http2SendV(Conn, Iov, FramesCount * 2);
+}
+
+// NOTE(oleh): The encoder state changes as the block is built, so a block has to go out before the
+// next one is encoded.
+static web_string_view Http2EncodeHeaders(http2_connection *Conn, web_arena *Arena, u32 Status, web_http_headers Headers) {
+    uz Capacity = 16;
+    for (uz I = 0; I < Headers.Count; ++I) Capacity += Headers.Items[I].Name.Count + Headers.Items[I].Value.Count + 24;
+
+    u8 *Block = WebArenaPush(Arena, Capacity);
+    u8 *Out = Block;
+
+    hpack_table *Table = &Conn->Encoder;
+
+    if (Conn->EncoderResize) {
+        Out = HpackEncodeInteger(Out, 0x20, 5, Conn->EncoderMaxSize);
+        HpackTableResize(Table, Conn->EncoderMaxSize);
+        Conn->EncoderResize = 0;
+    }
+
+    if (Status > 0) {
+        u8 Digits[3] = {'0' + Status / 100 % 10, '0' + Status / 10 % 10, '0' + Status % 10};
+        web_string_view Value = {.Items = Digits, .Count = 3};
+
+        u64 NameIndex;
+        u64 Index = HpackFind(Table, WEB_SV_LIT(":status"), Value, &NameIndex);
+        if (Index > 0) {
+            Out = HpackEncodeInteger(Out, 0x80, 7, Index);
+        } else {
+            Out = HpackEncodeInteger(Out, 0x00, 4, NameIndex);
+            Out = HpackEncodeString(Out, Value);
+        }
+    }
+
+    for (uz I = 0; I < Headers.Count; ++I) {
+        web_http_header Header = Headers.Items[I];
+
+        u8 *Lower = WebArenaPush(Arena, Header.Name.Count + 1);
+        for (uz J = 0; J < Header.Name.Count; ++J) Lower[J] = WebCharToLower(Header.Name.Items[J]);
+        web_string_view Name = {.Items = Lower, .Count = Header.Name.Count};
+
+        if (Http2IsConnectionSpecific(Name)) continue;
+
+        u64 NameIndex;
+        u64 Index = HpackFind(Table, Name, Header.Value, &NameIndex);
+        if (Index > 0) {
+            Out = HpackEncodeInteger(Out, 0x80, 7, Index);
+            continue;
+        }
+
+        b32 Indexing = HpackShouldIndex(Name, Header.Value);
+        Out = Indexing ? HpackEncodeInteger(Out, 0x40, 6, NameIndex) : HpackEncodeInteger(Out, 0x00, 4, NameIndex);
+        if (NameIndex == 0) Out = HpackEncodeString(Out, Name);
+        Out = HpackEncodeString(Out, Header.Value);
+
+        if (Indexing) HpackTableInsert(Table, Name, Header.Value);
+    }
+
+    WEB_ASSERT((uz) (Out - Block) <= Capacity);
+    return (web_string_view) {.Items = Block, .Count = Out - Block};
+}
+
+// NOTE(oleh): Sends whatever the windows allow, one frame per stream at a time, so that one large
+// response doesn't hold up the others.
+static void Http2Flush(http2_connection *Conn) {
+    struct iovec Iov[HTTP2_FLUSH_IOV_COUNT];
+    u8 Headers[HTTP2_FLUSH_IOV_COUNT / 2][HTTP2_FRAME_HEADER_SIZE];
+    int IovCount = 0;
+
+    b32 Progress = 1;
+    while (Progress && !Conn->Failed) {
+        Progress = 0;
+
+        for (http2_stream *Stream = Conn->Streams; Stream != NULL && !Conn->Failed; Stream = Stream->Next) {
+            if (Stream->Closed || Stream->LocalClosed) continue;
+
+            if (IovCount + 2 > HTTP2_FLUSH_IOV_COUNT) {
+                Http2SendV(Conn, Iov, IovCount);
+                IovCount = 0;
+            }
+
+            if (Http2StreamHasPending(Stream)) {
+                s64 Window = WEB_MIN(Conn->SendWindow, Stream->SendWindow);
+                if (Window <= 0) continue;
+
+                web_string_view Data = Stream->Pending[Stream->PendingFirst];
+                uz Remaining = Data.Count - Stream->PendingOffset;
+                uz Length = WEB_MIN(WEB_MIN((uz) Window, Remaining), Conn->PeerMaxFrameSize);
+
+                b32 LastBuffer = Length == Remaining && Stream->PendingFirst + 1 == Stream->PendingCount;
+                b32 EndStream = LastBuffer && Stream->PendingEndStream && !Stream->HasTrailers;
+
+                u8 *Header = Headers[IovCount / 2];
+                Http2FrameHeader(Header, Length, HTTP2_FRAME_DATA, EndStream ? HTTP2_FLAG_END_STREAM : 0, Stream->Id);
+                Iov[IovCount++] = (struct iovec) {.iov_base = Header, .iov_len = HTTP2_FRAME_HEADER_SIZE};
+                Iov[IovCount++] = (struct iovec) {.iov_base = Data.Items + Stream->PendingOffset, .iov_len = Length};
+
+                Conn->SendWindow -= Length;
+                Stream->SendWindow -= Length;
+
+                Stream->PendingOffset += Length;
+                if (Stream->PendingOffset == Data.Count) {
+                    ++Stream->PendingFirst;
+                    Stream->PendingOffset = 0;
+                }
+
+                if (EndStream) Http2StreamLocalClose(Stream);
+                Progress = 1;
+            } else if (Stream->PendingEndStream) {
+                if (Stream->HasTrailers) {
+                    if (IovCount > 0 && !Http2SendV(Conn, Iov, IovCount)) return;
+                    IovCount = 0;
+
+                    web_string_view Block = Http2EncodeHeaders(Conn, Stream->Arena, 0, Stream->Trailers);
+                    Http2SendHeaderBlock(Conn, Stream, Block.Items, Block.Count, 1);
+                } else {
+                    u8 *Header = Headers[IovCount / 2];
+                    Http2FrameHeader(Header, 0, HTTP2_FRAME_DATA, HTTP2_FLAG_END_STREAM, Stream->Id);
+                    Iov[IovCount++] = (struct iovec) {.iov_base = Header, .iov_len = HTTP2_FRAME_HEADER_SIZE};
+                    // NOTE(oleh): Keeps the header slots in step with the iovecs.
+                    Iov[IovCount++] = (struct iovec) {.iov_base = Header, .iov_len = 0};
+                }
+
+                Http2StreamLocalClose(Stream);
+                Progress = 1;
+            }
+        }
+    }
+
+    if (IovCount > 0) Http2SendV(Conn, Iov, IovCount);
+}
+
+b32 Http2StreamSendHeaders(http2_connection *Conn, http2_stream *Stream, u32 Status, web_http_headers Headers, b32 EndStream) {
+    if (Conn->Failed) return 0;
+    if (Stream->Closed) return 1;
+
+    web_string_view Block = Http2EncodeHeaders(Conn, Stream->Arena, Status, Headers);
+    if (!Http2SendHeaderBlock(Conn, Stream, Block.Items, Block.Count, EndStream)) return 0;
+
+    if (EndStream) Http2StreamLocalClose(Stream);
+    return 1;
+}
+
+b32 Http2StreamSendData(http2_connection *Conn, http2_stream *Stream, web_string_view Data, b32 EndStream, b32 Copy) {
+    if (Conn->Failed) return 0;
+    if (Stream->Closed) return 1;
+
+    WEB_ASSERT(!Stream->PendingEndStream);
+
+    uz Index = Stream->PendingCount;
+    if (Data.Count > 0) Http2StreamQueue(Stream, Data);
+    if (EndStream) Stream->PendingEndStream = 1;
+
+    Http2Flush(Conn);
+
+    // NOTE(oleh): Only copy what is still waiting.
+    if (Copy && Data.Count > 0 && !Stream->Closed && Stream->PendingFirst <= Index && Index < Stream->PendingCount) {
+        uz Offset = Stream->PendingFirst == Index ? Stream->PendingOffset : 0;
+        web_string_view Rest = {.Items = Data.Items + Offset, .Count = Data.Count - Offset};
+
+        Stream->Pending[Index] = HpackCopy(Stream->Arena, Rest);
+        if (Stream->PendingFirst == Index) Stream->PendingOffset = 0;
+    }
+
+    return !Conn->Failed;
+}
+
+b32 Http2StreamSendTrailers(http2_connection *Conn, http2_stream *Stream, web_http_headers Trailers) {
+    if (Conn->Failed) return 0;
+    if (Stream->Closed) return 1;
+
+    WEB_ASSERT(!Stream->PendingEndStream);
+
+    Stream->HasTrailers = Trailers.Count > 0;
+    Stream->Trailers = Trailers;
+    Stream->PendingEndStream = 1;
+
+    Http2Flush(Conn);
+    return !Conn->Failed;
+}
+
+void Http2StreamCancel(http2_connection *Conn, http2_stream *Stream) {
+    if (Stream->Closed) return;
+    Http2StreamReset(Conn, Stream, Stream->Id, HTTP2_INTERNAL_ERROR);
+}
+
+static void Http2JoinCookies(web_arena *Arena, web_http_headers *Headers) {
+    uz First = Headers->Count;
+    web_dynamic_string Cookie = {0};
+    uz Count = 0;
+
+    for (uz I = 0; I < Headers->Count; ++I) {
+        if (!WebStringViewEqualCStr(Headers->Items[I].Name, "cookie")) continue;
+
+        if (Count++ == 0) {
+            First = I;
+            continue;
+        }
+
+        if (Count == 2) {
+            WEB_ARRAY_INIT(Arena, &Cookie);
+            web_string_view Value = Headers->Items[First].Value;
+            for (uz J = 0; J < Value.Count; ++J) WEB_ARRAY_PUSH(Arena, &Cookie, Value.Items[J]);
+        }
+
+        WEB_ARRAY_PUSH(Arena, &Cookie, ';');
+        WEB_ARRAY_PUSH(Arena, &Cookie, ' ');
+        web_string_view Value = Headers->Items[I].Value;
+        for (uz J = 0; J < Value.Count; ++J) WEB_ARRAY_PUSH(Arena, &Cookie, Value.Items[J]);
+    }
+
+    if (Count < 2) return;
+
+    // NOTE(oleh): HTTP/2 lets the client split the cookies into several fields, the rest of the
+    // server expects a single header. (https://datatracker.ietf.org/doc/html/rfc9113#section-8.2.3)
+    Headers->Items[First].Value = (web_string_view) {.Items = Cookie.Items, .Count = Cookie.Count};
+
+    uz Out = 0;
+    for (uz I = 0; I < Headers->Count; ++I) {
+        if (I != First && WebStringViewEqualCStr(Headers->Items[I].Name, "cookie")) continue;
+        Headers->Items[Out++] = Headers->Items[I];
+    }
+    Headers->Count = Out;
+}
+
+// NOTE(oleh): Splits the pseudo-headers off and checks the rules of
+// https://datatracker.ietf.org/doc/html/rfc9113#section-8.3.
+static b32 Http2ParseRequestHead(web_arena *Arena, web_http_headers Fields, http2_request *Request) {
+    web_http_headers Headers;
+    WEB_ARRAY_INIT(Arena, &Headers);
+
+    for (uz I = 0; I < Fields.Count; ++I) {
+        web_http_header Field = Fields.Items[I];
+
+        if (Field.Name.Count > 0 && Field.Name.Items[0] == ':') {
+            if (Headers.Count > 0) return 0;
+
+            web_string_view *Target = NULL;
+            if (WebStringViewEqualCStr(Field.Name, ":method"))    Target = &Request->Method;
+            if (WebStringViewEqualCStr(Field.Name, ":scheme"))    Target = &Request->Scheme;
+            if (WebStringViewEqualCStr(Field.Name, ":authority")) Target = &Request->Authority;
+            if (WebStringViewEqualCStr(Field.Name, ":path"))      Target = &Request->Path;
+
+            if (Target == NULL || Target->Items != NULL) return 0;
+
+            *Target = Field.Value;
+            continue;
+        }
+
+        for (uz J = 0; J < Field.Name.Count; ++J) {
+            if (Field.Name.Items[J] >= 'A' && Field.Name.Items[J] <= 'Z') return 0;
+        }
+
+        if (Http2IsConnectionSpecific(Field.Name)) return 0;
+        if (WebStringViewEqualCStr(Field.Name, "te") && !WebStringViewEqualCStr(Field.Value, "trailers")) return 0;
+
+        WEB_ARRAY_PUSH(Arena, &Headers, Field);
+    }
+
+    if (Request->Method.Items == NULL || Request->Scheme.Items == NULL || Request->Path.Count == 0) return 0;
+
+    Http2JoinCookies(Arena, &Headers);
+    Request->Headers = Headers;
+    return 1;
+}
+
+static void Http2StreamRemoteClose(http2_connection *Conn, http2_stream *Stream) {
+    Stream->RemoteClosed = 1;
+    if (Stream->Closed) return;
+
+    http2_request *Request = &Stream->Request;
+    Request->Body = (web_string_view) {.Items = Stream->Body.Items, .Count = Stream->Body.Count};
+
+    for (uz I = 0; I < Request->Headers.Count; ++I) {
+        web_http_header Header = Request->Headers.Items[I];
+        if (!WebStringViewEqualCStr(Header.Name, "content-length")) continue;
+
+        s64 ContentLength;
+        if (!WebParseS64(Header.Value, &ContentLength) || (uz) ContentLength != Request->Body.Count) {
+            Http2StreamReset(Conn, Stream, Stream->Id, HTTP2_PROTOCOL_ERROR);
+            return;
+        }
+    }
+
+    Conn->Callbacks.Dispatch(Conn->Callbacks.Data, Stream, Stream->Data, Request);
+}
+
+static void Http2HeaderBlockDiscard(http2_connection *Conn) {
+    u32 StreamId = Conn->HeaderBlockStreamId;
+    Conn->HeaderBlockStreamId = 0;
+    Conn->HeaderBlockDiscard = 0;
+
+    if (Conn->DiscardArena.Items == NULL) {
+        WebArenaInit(&Conn->DiscardArena, HTTP2_DISCARD_ARENA_CAPACITY);
+        if (Conn->DiscardArena.Items == NULL) {
+            Http2ConnectionError(Conn, HTTP2_INTERNAL_ERROR);
+            return;
+        }
+    }
+
+    web_http_headers Fields;
+    b32 TooLarge;
+    b32 Decoded = HpackDecodeBlock(&Conn->Decoder, &Conn->DiscardArena, Conn->HeaderBlock, Conn->HeaderBlockCount,
+                                   HTTP2_MAX_HEADER_LIST_SIZE, &Fields, &TooLarge);
+    WebArenaReset(&Conn->DiscardArena);
+
+    if (!Decoded) {
+        Http2ConnectionError(Conn, HTTP2_COMPRESSION_ERROR);
+        return;
+    }
+
+    if (Conn->HeaderBlockRefused) Http2StreamReset(Conn, NULL, StreamId, HTTP2_REFUSED_STREAM);
+}
+
+static void Http2HeaderBlockDone(http2_connection *Conn) {
+    if (Conn->HeaderBlockDiscard) {
+        Http2HeaderBlockDiscard(Conn);
+        return;
+    }
+
+    http2_stream *Stream = Http2FindStream(Conn, Conn->HeaderBlockStreamId);
+    WEB_ASSERT(Stream != NULL);
+    Conn->HeaderBlockStreamId = 0;
+
+    web_http_headers Fields;
+    b32 TooLarge;
+    if (!HpackDecodeBlock(&Conn->Decoder, Stream->Arena, Conn->HeaderBlock, Conn->HeaderBlockCount,
+                          HTTP2_MAX_HEADER_LIST_SIZE, &Fields, &TooLarge)) {
+        Http2ConnectionError(Conn, HTTP2_COMPRESSION_ERROR);
+        return;
+    }
+
+    if (TooLarge) {
+        Http2StreamReset(Conn, Stream, Stream->Id, HTTP2_ENHANCE_YOUR_CALM);
+        return;
+    }
+
+    if (!Stream->HeadersReceived) {
+        Stream->HeadersReceived = 1;
+
+        if (!Http2ParseRequestHead(Stream->Arena, Fields, &Stream->Request)) {
+            Http2StreamReset(Conn, Stream, Stream->Id, HTTP2_PROTOCOL_ERROR);
+            return;
+        }
+
+        // NOTE(oleh): Don't wait for a body that is going to be too large anyway.
+        for (uz I = 0; I < Stream->Request.Headers.Count; ++I) {
+            web_http_header Header = Stream->Request.Headers.Items[I];
+            if (!WebStringViewEqualCStr(Header.Name, "content-length")) continue;
+
+            s64 ContentLength;
+            if (WebParseS64(Header.Value, &ContentLength) && ContentLength > (s64) Conn->MaxRequestBodySize) {
+                Http2StreamReset(Conn, Stream, Stream->Id, HTTP2_ENHANCE_YOUR_CALM);
+                return;
+            }
+        }
+    }
+
+    // NOTE(oleh): Request trailers are read and dropped, the handlers have no way to get at them.
+    if (Conn->HeaderBlockEndStream) Http2StreamRemoteClose(Conn, Stream);
+}
+
+static void Http2HeaderBlockAppend(http2_connection *Conn, u8 *Fragment, uz Count) {
+    if (Conn->HeaderBlockCount + Count > HTTP2_MAX_HEADER_BLOCK_SIZE) {
+        Http2ConnectionError(Conn, HTTP2_ENHANCE_YOUR_CALM);
+        return;
+    }
+
+    if (Conn->HeaderBlockCount + Count > Conn->HeaderBlockCapacity) {
+        uz NewCapacity = WEB_MAX(Conn->HeaderBlockCapacity * 2, Conn->HeaderBlockCount + Count);
+        Conn->HeaderBlock = realloc(Conn->HeaderBlock, NewCapacity);
+        Conn->HeaderBlockCapacity = NewCapacity;
+    }
+
+    memcpy(Conn->HeaderBlock + Conn->HeaderBlockCount, Fragment, Count);
+    Conn->HeaderBlockCount += Count;
+}
+
+// NOTE(oleh): Strips the padding off a DATA or HEADERS payload.
+static b32 Http2Unpad(u8 Flags, u8 **Payload, uz *Length) {
+    if (!(Flags & HTTP2_FLAG_PADDED)) return 1;
+    if (*Length < 1) return 0;
+
+    u8 PadLength = (*Payload)[0];
+    if (PadLength >= *Length) return 0;
+
+    *Payload += 1;
+    *Length -= 1 + PadLength;
+    return 1;
+}
+
+static void Http2OnData(http2_connection *Conn, u8 Flags, u32 StreamId, u8 *Payload, uz Length) {
+    if (StreamId == 0) {
+        Http2ConnectionError(Conn, HTTP2_PROTOCOL_ERROR);
+        return;
+    }
+
+    // NOTE(oleh): The padding counts against the windows too.
+    uz FlowLength = Length;
+    if (FlowLength > (uz) Conn->RecvWindow) {
+        Http2ConnectionError(Conn, HTTP2_FLOW_CONTROL_ERROR);
+        return;
+    }
+
+    Conn->RecvWindow -= FlowLength;
+    if (Conn->RecvWindow < HTTP2_CONNECTION_WINDOW_SIZE / 2) {
+        Http2SendWindowUpdate(Conn, 0, HTTP2_CONNECTION_WINDOW_SIZE - Conn->RecvWindow);
+        Conn->RecvWindow = HTTP2_CONNECTION_WINDOW_SIZE;
+    }
+
+    if (!Http2Unpad(Flags, &Payload, &Length)) {
+        Http2ConnectionError(Conn, HTTP2_PROTOCOL_ERROR);
+        return;
+    }
+
+    http2_stream *Stream = Http2FindStream(Conn, StreamId);
+    if (Stream == NULL || Stream->RemoteClosed || Stream->Closed) {
+        if (StreamId > Conn->LastStreamId) Http2ConnectionError(Conn, HTTP2_PROTOCOL_ERROR);
+        else Http2StreamReset(Conn, Stream, StreamId, HTTP2_STREAM_CLOSED);
+        return;
+    }
+
+    if (FlowLength > (uz) Stream->RecvWindow) {
+        Http2StreamReset(Conn, Stream, StreamId, HTTP2_FLOW_CONTROL_ERROR);
+        return;
+    }
+
+    Stream->RecvWindow -= FlowLength;
+
+    if (Stream->Body.Count + Length > Conn->MaxRequestBodySize) {
+        Http2StreamReset(Conn, Stream, StreamId, HTTP2_ENHANCE_YOUR_CALM);
+        return;
+    }
+
+    if (Length > 0) {
+        web_dynamic_string *Body = &Stream->Body;
+        if (Body->Count + Length > Body->Capacity) {
+            uz NewCapacity = WEB_MAX(Body->Capacity * 2, Body->Count + Length);
+            u8 *Items = WebArenaPush(Stream->Arena, NewCapacity);
+            if (Body->Count > 0) memcpy(Items, Body->Items, Body->Count);
+
+            Body->Items = Items;
+            Body->Capacity = NewCapacity;
+        }
+
+        memcpy(Body->Items + Body->Count, Payload, Length);
+        Body->Count += Length;
+    }
+
+    if (Flags & HTTP2_FLAG_END_STREAM) {
+        Http2StreamRemoteClose(Conn, Stream);
+    } else if (Stream->RecvWindow < HTTP2_STREAM_WINDOW_SIZE / 2) {
+        Http2SendWindowUpdate(Conn, StreamId, HTTP2_STREAM_WINDOW_SIZE - Stream->RecvWindow);
+        Stream->RecvWindow = HTTP2_STREAM_WINDOW_SIZE;
+    }
+}
+
+static void Http2OnHeaders(http2_connection *Conn, u8 Flags, u32 StreamId, u8 *Payload, uz Length) {
+    if (StreamId == 0 || (StreamId & 1) == 0) {
+        Http2ConnectionError(Conn, HTTP2_PROTOCOL_ERROR);
+        return;
+    }
+
+    if (!Http2Unpad(Flags, &Payload, &Length)) {
+        Http2ConnectionError(Conn, HTTP2_PROTOCOL_ERROR);
+        return;
+    }
+
+    // NOTE(oleh): Priorities are deprecated, the stream dependency and weight are skipped.
+    if (Flags & HTTP2_FLAG_PRIORITY) {
+        if (Length < 5) {
+            Http2ConnectionError(Conn, HTTP2_PROTOCOL_ERROR);
+            return;
+        }
+
+        Payload += 5;
+        Length -= 5;
+    }
+
+    http2_stream *Stream = Http2FindStream(Conn, StreamId);
+    Conn->HeaderBlockDiscard = 0;
+    Conn->HeaderBlockRefused = 0;
+
+    if (Stream == NULL) {
+        if (StreamId <= Conn->LastStreamId) {
+            // NOTE(oleh): The trailers of a stream we have already reset or refused, the client may
+            // have sent them before it got our RST_STREAM.
+            if (!(Flags & HTTP2_FLAG_END_STREAM)) {
+                Http2ConnectionError(Conn, HTTP2_STREAM_CLOSED);
+                return;
+            }
+
+            Conn->HeaderBlockDiscard = 1;
+        } else {
+            Conn->LastStreamId = StreamId;
+
+            // NOTE(oleh): A refused stream gets nothing allocated for it, its block is only decoded.
+            if (!Conn->GoingAway && Conn->StreamsCount < HTTP2_MAX_CONCURRENT_STREAMS) {
+                Stream = Http2OpenStream(Conn, StreamId);
+            }
+
+            if (Stream == NULL) {
+                Conn->HeaderBlockDiscard = 1;
+                Conn->HeaderBlockRefused = 1;
+            }
+        }
+    } else if (Stream->RemoteClosed || !(Flags & HTTP2_FLAG_END_STREAM)) {
+        // NOTE(oleh): A second header block can only be the trailers, and those end the stream.
+        Http2ConnectionError(Conn, HTTP2_PROTOCOL_ERROR);
+        return;
+    }
+
+    Conn->HeaderBlockStreamId = StreamId;
+    Conn->HeaderBlockEndStream = Flags & HTTP2_FLAG_END_STREAM;
+    Conn->HeaderBlockCount = 0;
+
+    Http2HeaderBlockAppend(Conn, Payload, Length);
+    if (!Conn->Failed && (Flags & HTTP2_FLAG_END_HEADERS)) Http2HeaderBlockDone(Conn);
+}
+
+static void Http2OnContinuation(http2_connection *Conn, u8 Flags, u32 StreamId, u8 *Payload, uz Length) {
+    if (Conn->HeaderBlockStreamId == 0 || StreamId != Conn->HeaderBlockStreamId) {
+        Http2ConnectionError(Conn, HTTP2_PROTOCOL_ERROR);
+        return;
+    }
+
+    Http2HeaderBlockAppend(Conn, Payload, Length);
+    if (!Conn->Failed && (Flags & HTTP2_FLAG_END_HEADERS)) Http2HeaderBlockDone(Conn);
+}
+
+static void Http2OnSettings(http2_connection *Conn, u8 Flags, u32 StreamId, u8 *Payload, uz Length) {
+    if (StreamId != 0) {
+        Http2ConnectionError(Conn, HTTP2_PROTOCOL_ERROR);
+        return;
+    }
+
+    if (Flags & HTTP2_FLAG_ACK) {
+        if (Length != 0) Http2ConnectionError(Conn, HTTP2_FRAME_SIZE_ERROR);
+        return;
+    }
+
+    if (Length % 6 != 0) {
+        Http2ConnectionError(Conn, HTTP2_FRAME_SIZE_ERROR);
+        return;
+    }
+
+    for (uz Offset = 0; Offset < Length; Offset += 6) {
+        u32 Id = ((u32) Payload[Offset] << 8) | Payload[Offset + 1];
+        u32 Value = Http2ReadU32(Payload + Offset + 2);
+
+        switch (Id) {
+        case HTTP2_SETTINGS_HEADER_TABLE_SIZE: {
+            // NOTE(oleh): That's just the most the client can take, we stick to the default at most.
+            Conn->EncoderMaxSize = WEB_MIN(Value, HPACK_DEFAULT_TABLE_SIZE);
+            Conn->EncoderResize = 1;
+            break;
+        }
+        case HTTP2_SETTINGS_ENABLE_PUSH: {
+            if (Value > 1) {
+                Http2ConnectionError(Conn, HTTP2_PROTOCOL_ERROR);
+                return;
+            }
+            break;
+        }
+        case HTTP2_SETTINGS_INITIAL_WINDOW_SIZE: {
+            if (Value > HTTP2_MAX_WINDOW_SIZE) {
+                Http2ConnectionError(Conn, HTTP2_FLOW_CONTROL_ERROR);
+                return;
+            }
+
+            // NOTE(oleh): Applies to the windows of the open streams retroactively, so they can go
+            // negative. (https://datatracker.ietf.org/doc/html/rfc9113#section-6.9.2)
+            s64 Delta = (s64) Value - (s64) Conn->PeerInitialWindowSize;
+            for (http2_stream *Stream = Conn->Streams; Stream != NULL; Stream = Stream->Next) {
+                Stream->SendWindow += Delta;
+                if (Stream->SendWindow > HTTP2_MAX_WINDOW_SIZE) {
+                    Http2ConnectionError(Conn, HTTP2_FLOW_CONTROL_ERROR);
+                    return;
+                }
+            }
+
+            Conn->PeerInitialWindowSize = Value;
+            break;
+        }
+        case HTTP2_SETTINGS_MAX_FRAME_SIZE: {
+            if (Value < HTTP2_DEFAULT_FRAME_SIZE || Value > HTTP2_MAX_FRAME_SIZE) {
+                Http2ConnectionError(Conn, HTTP2_PROTOCOL_ERROR);
+                return;
+            }
+
+            Conn->PeerMaxFrameSize = Value;
+            break;
+        }
+        default: break;
+        }
+    }
+
+    Conn->SettingsReceived = 1;
+    Http2SendFrame(Conn, HTTP2_FRAME_SETTINGS, HTTP2_FLAG_ACK, 0, NULL, 0);
+
+    Http2Flush(Conn);
+}
+
+static void Http2OnWindowUpdate(http2_connection *Conn, u32 StreamId, u8 *Payload, uz Length) {
+    if (Length != 4) {
+        Http2ConnectionError(Conn, HTTP2_FRAME_SIZE_ERROR);
+        return;
+    }
+
+    u32 Increment = Http2ReadU32(Payload) & 0x7fffffff;
+
+    if (StreamId == 0) {
+        Conn->SendWindow += Increment;
+        if (Increment == 0 || Conn->SendWindow > HTTP2_MAX_WINDOW_SIZE) {
+            Http2ConnectionError(Conn, Increment == 0 ? HTTP2_PROTOCOL_ERROR : HTTP2_FLOW_CONTROL_ERROR);
+            return;
+        }
+    } else {
+        http2_stream *Stream = Http2FindStream(Conn, StreamId);
+        if (Stream == NULL) {
+            if (StreamId > Conn->LastStreamId) Http2ConnectionError(Conn, HTTP2_PROTOCOL_ERROR);
+            return;
+        }
+
+        Stream->SendWindow += Increment;
+        if (Increment == 0 || Stream->SendWindow > HTTP2_MAX_WINDOW_SIZE) {
+            Http2StreamReset(Conn, Stream, StreamId, Increment == 0 ? HTTP2_PROTOCOL_ERROR : HTTP2_FLOW_CONTROL_ERROR);
+            return;
+        }
+    }
+
+    Http2Flush(Conn);
+}
+
+static void Http2OnFrame(http2_connection *Conn, u8 *Frame) {
+    uz Length = Http2ReadU24(Frame);
+    http2_frame_type Type = Frame[3];
+    u8 Flags = Frame[4];
+    u32 StreamId = Http2ReadU32(Frame + 5) & 0x7fffffff;
+    u8 *Payload = Frame + HTTP2_FRAME_HEADER_SIZE;
+
+    // NOTE(oleh): The client preface ends with a SETTINGS frame.
+    if (!Conn->SettingsReceived && Type != HTTP2_FRAME_SETTINGS) {
+        Http2ConnectionError(Conn, HTTP2_PROTOCOL_ERROR);
+        return;
+    }
+
+    if (Conn->HeaderBlockStreamId != 0 && Type != HTTP2_FRAME_CONTINUATION) {
+        Http2ConnectionError(Conn, HTTP2_PROTOCOL_ERROR);
+        return;
+    }
+
+    switch (Type) {
+    case HTTP2_FRAME_DATA:          Http2OnData(Conn, Flags, StreamId, Payload, Length); break;
+    case HTTP2_FRAME_HEADERS:       Http2OnHeaders(Conn, Flags, StreamId, Payload, Length); break;
+    case HTTP2_FRAME_CONTINUATION:  Http2OnContinuation(Conn, Flags, StreamId, Payload, Length); break;
+    case HTTP2_FRAME_SETTINGS:      Http2OnSettings(Conn, Flags, StreamId, Payload, Length); break;
+    case HTTP2_FRAME_WINDOW_UPDATE: Http2OnWindowUpdate(Conn, StreamId, Payload, Length); break;
+    case HTTP2_FRAME_PRIORITY: {
+        if (StreamId == 0) Http2ConnectionError(Conn, HTTP2_PROTOCOL_ERROR);
+        else if (Length != 5) Http2StreamReset(Conn, Http2FindStream(Conn, StreamId), StreamId, HTTP2_FRAME_SIZE_ERROR);
+        break;
+    }
+    case HTTP2_FRAME_RST_STREAM: {
+        if (StreamId == 0 || StreamId > Conn->LastStreamId) {
+            Http2ConnectionError(Conn, HTTP2_PROTOCOL_ERROR);
+        } else if (Length != 4) {
+            Http2ConnectionError(Conn, HTTP2_FRAME_SIZE_ERROR);
+        } else {
+            http2_stream *Stream = Http2FindStream(Conn, StreamId);
+            if (Stream != NULL) Stream->Closed = 1;
+        }
+        break;
+    }
+    case HTTP2_FRAME_PING: {
+        if (StreamId != 0) Http2ConnectionError(Conn, HTTP2_PROTOCOL_ERROR);
+        else if (Length != 8) Http2ConnectionError(Conn, HTTP2_FRAME_SIZE_ERROR);
+        else if (!(Flags & HTTP2_FLAG_ACK)) Http2SendFrame(Conn, HTTP2_FRAME_PING, HTTP2_FLAG_ACK, 0, Payload, Length);
+        break;
+    }
+    case HTTP2_FRAME_GOAWAY: {
+        if (StreamId != 0) Http2ConnectionError(Conn, HTTP2_PROTOCOL_ERROR);
+        else if (Length < 8) Http2ConnectionError(Conn, HTTP2_FRAME_SIZE_ERROR);
+        else Conn->GoingAway = 1;
+        break;
+    }
+    // NOTE(oleh): Clients can't push.
+    case HTTP2_FRAME_PUSH_PROMISE: Http2ConnectionError(Conn, HTTP2_PROTOCOL_ERROR); break;
+    // NOTE(oleh): Unknown frame types are ignored.
+    default: break;
+    }
+}
+
+http2_connection *Http2ConnectionCreate(http2_callbacks Callbacks, uz MaxRequestBodySize) {
+    http2_connection *Conn = malloc(sizeof(*Conn));
+    WEB_STRUCT_ZERO(Conn);
+
+    Conn->Callbacks = Callbacks;
+    Conn->MaxRequestBodySize = MaxRequestBodySize;
+    Conn->Decoder.MaxSize = HPACK_DEFAULT_TABLE_SIZE;
+    Conn->Encoder.MaxSize = HPACK_DEFAULT_TABLE_SIZE;
+    Conn->SendWindow = HTTP2_DEFAULT_WINDOW_SIZE;
+    Conn->RecvWindow = HTTP2_CONNECTION_WINDOW_SIZE;
+    Conn->PeerInitialWindowSize = HTTP2_DEFAULT_WINDOW_SIZE;
+    Conn->PeerMaxFrameSize = HTTP2_DEFAULT_FRAME_SIZE;
+
+    return Conn;
+}
+
+void Http2ConnectionDestroy(http2_connection *Conn) {
+    while (Conn->Streams != NULL) Http2FreeStream(Conn, Conn->Streams);
+
+    HpackTableFree(&Conn->Decoder);
+    HpackTableFree(&Conn->Encoder);
+    free(Conn->HeaderBlock);
+    free(Conn->DiscardArena.Items);
+    free(Conn);
+}
+
+b32 Http2ConnectionStart(http2_connection *Conn) {
+    u8 Settings[24];
+    u32 Values[][2] = {
+        {HTTP2_SETTINGS_MAX_CONCURRENT_STREAMS, HTTP2_MAX_CONCURRENT_STREAMS},
+        {HTTP2_SETTINGS_INITIAL_WINDOW_SIZE, HTTP2_STREAM_WINDOW_SIZE},
+        {HTTP2_SETTINGS_ENABLE_PUSH, 0},
+        {HTTP2_SETTINGS_MAX_HEADER_LIST_SIZE, HTTP2_MAX_HEADER_LIST_SIZE},
+    };
+
+    for (uz I = 0; I < WEB_ARRAY_COUNT(Values); ++I) {
+        Settings[I * 6] = (u8) (Values[I][0] >> 8);
+        Settings[I * 6 + 1] = (u8) Values[I][0];
+        Http2WriteU32(Settings + I * 6 + 2, Values[I][1]);
+    }
+
+    // NOTE(oleh): The connection window can only be grown by a WINDOW_UPDATE.
+    u8 SettingsHeader[HTTP2_FRAME_HEADER_SIZE];
+    Http2FrameHeader(SettingsHeader, sizeof(Settings), HTTP2_FRAME_SETTINGS, 0, 0);
+
+    u8 WindowUpdate[HTTP2_FRAME_HEADER_SIZE + 4];
+    Http2FrameHeader(WindowUpdate, 4, HTTP2_FRAME_WINDOW_UPDATE, 0, 0);
+    Http2WriteU32(WindowUpdate + HTTP2_FRAME_HEADER_SIZE, HTTP2_CONNECTION_WINDOW_SIZE - HTTP2_DEFAULT_WINDOW_SIZE);
+
+    struct iovec Iov[] = {
+        {.iov_base = SettingsHeader, .iov_len = sizeof(SettingsHeader)},
+        {.iov_base = Settings,       .iov_len = sizeof(Settings)},
+        {.iov_base = WindowUpdate,   .iov_len = sizeof(WindowUpdate)},
+    };
+
+    return Http2SendV(Conn, Iov, WEB_ARRAY_COUNT(Iov));
+}
+
+b32 Http2ConnectionReceive(http2_connection *Conn, u8 *Buffer, uz Count) {
+    while (!Conn->Failed) {
+        uz Needed = HTTP2_FRAME_HEADER_SIZE;
+
+        if (Conn->InputCount >= HTTP2_FRAME_HEADER_SIZE) {
+            // NOTE(oleh): We never raise SETTINGS_MAX_FRAME_SIZE.
+            uz Length = Http2ReadU24(Conn->Input);
+            if (Length > HTTP2_DEFAULT_FRAME_SIZE) {
+                Http2ConnectionError(Conn, HTTP2_FRAME_SIZE_ERROR);
+                break;
+            }
+
+            Needed += Length;
+        }
+
+        if (Conn->InputCount < Needed) {
+            if (Count == 0) break;
+
+            uz N = WEB_MIN(Needed - Conn->InputCount, Count);
+            memcpy(Conn->Input + Conn->InputCount, Buffer, N);
+            Conn->InputCount += N;
+            Buffer += N;
+            Count -= N;
+            continue;
+        }
+
+        Http2OnFrame(Conn, Conn->Input);
+        Conn->InputCount = 0;
+    }
+
+    Http2ReapStreams(Conn);
+
+    if (Conn->Failed) return 0;
+    return !(Conn->GoingAway && Conn->StreamsCount == 0);
+}
+
+void Http2ConnectionGoAway(http2_connection *Conn) {
+    if (Conn->Failed) return;
+
+    u8 Payload[8];
+    Http2WriteU32(Payload, Conn->LastStreamId);
+    Http2WriteU32(Payload + 4, HTTP2_NO_ERROR);
+    Http2SendFrame(Conn, HTTP2_FRAME_GOAWAY, 0, 0, Payload, sizeof(Payload));
+
+    Conn->GoingAway = 1;
+}
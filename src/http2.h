@@ -0,0 +1,83 @@
+#ifndef HTTP2_H_
+#define HTTP2_H_
+
+#include "http.h"
+
+#include <sys/uio.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif // __cplusplus
+
+// NOTE(oleh): HTTP/2 framing (RFC 9113) and HPACK (RFC 7541). This part doesn't know about sockets:
+// the server feeds it whatever it receives on a connection and gets the frames back through
+// `SendV`. A request is dispatched as soon as the client is done sending its stream. The response is
+// then queued on the stream and goes out as fast as the flow control windows allow, interleaved with
+// the other streams of the connection.
+//
+// `Dispatch` runs synchronously inside `Http2ConnectionReceive`, so the streams of one connection are
+// handled one at a time. While a handler runs, nothing else on the connection moves: not the other
+// streams, not the WINDOW_UPDATEs the queued responses are waiting for, and not the PING answers.
+// The server only speaks HTTP/2 in the thread pool mode, where this stalls just the one connection.
+
+#define HTTP2_PREFACE "PRI * HTTP/2.0\r\n\r\nSM\r\n\r\n"
+#define HTTP2_PREFACE_SIZE (sizeof(HTTP2_PREFACE) - 1)
+
+typedef struct http2_connection http2_connection;
+typedef struct http2_stream http2_stream;
+
+typedef struct {
+    web_string_view Method;
+    web_string_view Scheme;
+    web_string_view Authority;
+    web_string_view Path;
+    // NOTE(oleh): Without the pseudo-headers, the cookie fields are joined back into one.
+    web_http_headers Headers;
+    web_string_view Body;
+} http2_request;
+
+typedef struct {
+    void *Data;
+
+    // NOTE(oleh): Has to write all of the buffers or fail.
+    sz (*SendV)(void *Data, struct iovec *Iov, int IovCount);
+
+    // NOTE(oleh): Everything that belongs to the stream is allocated from the returned arena, which
+    // has to stay around until `CloseStream`. Returning NULL refuses the stream. It isn't called for
+    // the streams refused over the concurrency limit or after GOAWAY.
+    web_arena *(*OpenStream)(void *Data, void **OutStreamData);
+    // NOTE(oleh): Blocks the whole connection until it returns, see above.
+    void (*Dispatch)(void *Data, http2_stream *Stream, void *StreamData, http2_request *Request);
+    void (*CloseStream)(void *Data, void *StreamData);
+} http2_callbacks;
+
+// NOTE(oleh): The request bodies are buffered whole, streams with larger ones are reset.
+http2_connection *Http2ConnectionCreate(http2_callbacks Callbacks, uz MaxRequestBodySize);
+void Http2ConnectionDestroy(http2_connection *Conn);
+
+// NOTE(oleh): Sends the server's SETTINGS. Call once the client preface has been read.
+b32 Http2ConnectionStart(http2_connection *Conn);
+
+// NOTE(oleh): Returns 0 once the connection has to be closed, either because of an error or because
+// the client went away and all of its streams are done.
+b32 Http2ConnectionReceive(http2_connection *Conn, u8 *Buffer, uz Count);
+
+// NOTE(oleh): Tells the client not to open any more streams.
+void Http2ConnectionGoAway(http2_connection *Conn);
+
+// NOTE(oleh): The response side of a dispatched stream. They return 0 only if the connection is
+// broken, a stream reset by the client silently drops whatever is sent on it.
+b32 Http2StreamSendHeaders(http2_connection *Conn, http2_stream *Stream, u32 Status, web_http_headers Headers, b32 EndStream);
+// NOTE(oleh): Whatever the flow control windows don't let through right away waits on the stream.
+// It is copied into the stream's arena if `Copy` is set, otherwise `Data` has to outlive the stream.
+b32 Http2StreamSendData(http2_connection *Conn, http2_stream *Stream, web_string_view Data, b32 EndStream, b32 Copy);
+// NOTE(oleh): Ends the stream once all of its data is out.
+b32 Http2StreamSendTrailers(http2_connection *Conn, http2_stream *Stream, web_http_headers Trailers);
+// NOTE(oleh): Resets the stream with INTERNAL_ERROR, for responses that can't be finished.
+void Http2StreamCancel(http2_connection *Conn, http2_stream *Stream);
+
+#ifdef __cplusplus
+}
+#endif // __cplusplus
+
+#endif // HTTP2_H_
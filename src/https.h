@@ -3,6 +3,8 @@
 
 #include "common.h"
 
+#include <sys/uio.h>
+
 #ifdef WEB_USE_HTTPS_OPENSSL
 #include <openssl/ssl.h>
 #include <openssl/err.h>
@@ -20,14 +22,20 @@ typedef struct {
 
 sz OpenSSLSessionRead(void *, u8 *, uz);
 sz OpenSSLSessionWrite(void *, u8 *, uz);
+sz OpenSSLSessionWriteV(void *, struct iovec *, int);
 sz OpenSSLSessionClose(void *);
 
+// NOTE(oleh): ALPN callback preferring "h2" over "http/1.1", see `SSL_CTX_set_alpn_select_cb`.
+int OpenSSLAlpnSelect(SSL *, const unsigned char **, unsigned char *, const unsigned char *, unsigned int, void *);
+
 #endif // WEB_USE_HTTPS_OPENSSL
 
 typedef struct {
     sz (*Close)(void *Data);
     sz (*Read) (void *Data, u8 *Buffer, uz N);
     sz (*Write)(void *Data, u8 *Buffer, uz N);
+    // NOTE(oleh): Optional, falls back to calling `Write` for every buffer.
+    sz (*WriteV)(void *Data, struct iovec *Iov, int IovCount);
 } web_https_session_vtable;
 
 typedef struct {
@@ -29,7 +29,9 @@ typedef enum {
     X(TLS) \
     X(COMMON) \
     X(JSON) \
-    X(BASE64)
+    X(BASE64) \
+    X(DNS) \
+    X(THREAD)
 
 typedef enum {
     #define X(Scope) WEB_LOG_SCOPE_##Scope,
@@ -10,7 +10,86 @@ sz OpenSSLSessionWrite(void *Ptr, u8 *Buf, uz BufCount) {
     return SSL_write(Ssl, Buf, BufCount);
 }
 
+#define OPENSSL_RECORD_SIZE (16 * 1024)
+
+static b32 OpenSSLWriteAll(SSL *Ssl, u8 *Buf, uz BufCount) {
+    size_t Written = 0;
+    return SSL_write_ex(Ssl, Buf, BufCount, &Written) == 1 && Written == BufCount;
+}
+
+// NOTE(oleh): Every SSL_write produces at least one TLS record, so the small buffers (status line,
+// headers) are packed together with the start of the body into full records. Whatever is left of a
+// large buffer goes to SSL_write_ex directly without being copied.
+sz OpenSSLSessionWriteV(void *Ptr, struct iovec *Iov, int IovCount) {
+    SSL *Ssl = (SSL *) Ptr;
+
+    u8 Record[OPENSSL_RECORD_SIZE];
+    uz RecordCount = 0;
+    sz Total = 0;
+
+    for (int I = 0; I < IovCount; ++I) {
+        u8 *Buf = (u8 *) Iov[I].iov_base;
+        uz BufCount = Iov[I].iov_len;
+
+        while (BufCount > 0) {
+            if (RecordCount == 0 && BufCount >= OPENSSL_RECORD_SIZE) {
+                if (!OpenSSLWriteAll(Ssl, Buf, BufCount)) return -1;
+                Total += BufCount;
+                break;
+            }
+
+            uz N = WEB_MIN(BufCount, OPENSSL_RECORD_SIZE - RecordCount);
+            memcpy(Record + RecordCount, Buf, N);
+            RecordCount += N;
+            Buf += N;
+            BufCount -= N;
+
+            if (RecordCount == OPENSSL_RECORD_SIZE) {
+                if (!OpenSSLWriteAll(Ssl, Record, RecordCount)) return -1;
+                Total += RecordCount;
+                RecordCount = 0;
+            }
+        }
+    }
+
+    if (RecordCount > 0) {
+        if (!OpenSSLWriteAll(Ssl, Record, RecordCount)) return -1;
+        Total += RecordCount;
+    }
+
+    return Total;
+}
+
 sz OpenSSLSessionClose(void *Ptr) {
     SSL *Ssl = (SSL *) Ptr;
-    return SSL_shutdown(Ssl);
+    sz Result = SSL_shutdown(Ssl);
+    SSL_free(Ssl);
+    return Result;
+}
+
+// NOTE(oleh): Length-prefixed, in the order of preference.
+static const unsigned char OpenSSLAlpnProtocols[] = "\x02h2\x08http/1.1";
+
+int OpenSSLAlpnSelect(SSL *Ssl,
+                      const unsigned char **Out,
+                      unsigned char *OutCount,
+                      const unsigned char *In,
+                      unsigned int InCount,
+                      void *Arg) {
+    (void) Ssl;
+    (void) Arg;
+
+    unsigned char *Selected = NULL;
+    int Status = SSL_select_next_proto(&Selected,
+                                       OutCount,
+                                       OpenSSLAlpnProtocols,
+                                       sizeof(OpenSSLAlpnProtocols) - 1,
+                                       In,
+                                       InCount);
+
+    // NOTE(oleh): Without a common protocol the handshake goes on without ALPN, which means HTTP/1.1.
+    if (Status != OPENSSL_NPN_NEGOTIATED) return SSL_TLSEXT_ERR_NOACK;
+
+    *Out = Selected;
+    return SSL_TLSEXT_ERR_OK;
 }
@@ -1,5 +1,50 @@
+#define _GNU_SOURCE
+
+#include <dirent.h>
 #include <errno.h>
+#include <limits.h>
+#include <sched.h>
+#include <time.h>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
 #include "threadpool.h"
+#include "log.h"
+
+#ifdef __x86_64__
+#include <immintrin.h>
+#endif // __x86_64__
+
+#define THREAD_POOL_DEQUE_INITIAL_CAPACITY 256
+#define THREAD_POOL_INBOX_INITIAL_CAPACITY 128
+// NOTE(oleh): Rounds of stealing before a worker with nothing to do parks.
+#define THREAD_POOL_SPIN_ROUNDS 64
+// NOTE(oleh): How many tasks are wrapped up on the stack at a time when submitting a batch.
+#define THREAD_POOL_SUBMIT_BATCH 64
+
+#define THREAD_POOL_GROUP_WAITING 0x80000000u
+
+// NOTE(oleh): Keeps the lane credits from overflowing.
+#define THREAD_POOL_MAX_LANE_WEIGHT 0xFFFF
+
+#define THREAD_POOL_DEFAULT_QUEUE_WAIT_TARGET_US 1000
+#define THREAD_POOL_DEFAULT_IDLE_TIMEOUT_MS 10000
+// NOTE(oleh): The supervisor backs off up to this while nothing is waiting.
+#define THREAD_POOL_SUPERVISOR_MAX_INTERVAL_NS (100ull * 1000 * 1000)
+
+enum {
+    THREAD_POOL_WORKER_RUNNING,
+    THREAD_POOL_WORKER_PARKED,
+    // NOTE(oleh): The thread is launched, but the worker isn't set up yet.
+    THREAD_POOL_WORKER_STARTING,
+    // NOTE(oleh): There is no thread behind the slot.
+    THREAD_POOL_WORKER_STOPPED,
+};
+
+// NOTE(oleh): The worker the calling thread is, if it belongs to a pool.
+static __thread web_thread_pool_worker *ThreadPoolCurrentWorker;
+// NOTE(oleh): The lane of the job the calling worker is running.
+static __thread u32 ThreadPoolCurrentLane;
 
 b32 WebThreadLaunch(web_thread *Thread, web_thread_proc ThreadProc, void *ThreadProcArg) {
     pthread_attr_t Attr;
@@ -8,72 +53,894 @@ b32 WebThreadLaunch(web_thread *Thread, web_thread_proc ThreadProc, void *Thread
     return Status == 0;
 }
 
+// NOTE(oleh): Pins the calling thread.
+b32 WebThreadPinToCpu(uz Cpu) {
+    cpu_set_t CpuSet;
+    CPU_ZERO(&CpuSet);
+    CPU_SET(Cpu, &CpuSet);
+    return pthread_setaffinity_np(pthread_self(), sizeof(CpuSet), &CpuSet) == 0;
+}
+
+// NOTE(oleh): Lists the CPUs the calling thread may run on, in ascending order. Returns how many
+// there are, 0 if the mask can't be read.
+uz WebThreadAllowedCpus(u32 *Cpus, uz Capacity) {
+    cpu_set_t Allowed;
+    if (sched_getaffinity(0, sizeof(Allowed), &Allowed) != 0) return 0;
+
+    uz Count = 0;
+    for (u32 Cpu = 0; Cpu < CPU_SETSIZE && Count < Capacity; ++Cpu) {
+        if (CPU_ISSET(Cpu, &Allowed)) Cpus[Count++] = Cpu;
+    }
+
+    return Count;
+}
+
+static inline void ThreadPoolCpuRelax(void) {
+#ifdef __x86_64__
+    _mm_pause();
+#endif // __x86_64__
+}
+
+static u64 ThreadPoolMonotonicNs(void) {
+    struct timespec Now;
+    clock_gettime(CLOCK_MONOTONIC, &Now);
+    return (u64) Now.tv_sec * 1000000000ull + (u64) Now.tv_nsec;
+}
+
+// NOTE(oleh): Waits forever if `TimeoutNs` is 0.
+static void ThreadPoolFutexWait(u32 *Word, u32 Expected, u64 TimeoutNs) {
+    struct timespec Timeout = {.tv_sec = TimeoutNs / 1000000000ull, .tv_nsec = TimeoutNs % 1000000000ull};
+    syscall(SYS_futex, Word, FUTEX_WAIT_PRIVATE, Expected, TimeoutNs > 0 ? &Timeout : NULL, NULL, 0);
+}
+
+static void ThreadPoolFutexWake(u32 *Word, int Count) {
+    syscall(SYS_futex, Word, FUTEX_WAKE_PRIVATE, Count, NULL, NULL, 0);
+}
+
+static web_thread_pool_deque_array *ThreadPoolDequeArrayCreate(s64 Capacity) {
+    web_thread_pool_deque_array *Array = malloc(sizeof(*Array) + Capacity * sizeof(Array->Items[0]));
+    if (Array == NULL) WEB_PANIC("Failed to allocate a work-stealing deque");
+
+    Array->Previous = NULL;
+    Array->Capacity = Capacity;
+    return Array;
+}
+
+// NOTE(oleh): The slots are read by thieves while the owner may be writing them, a thief that reads a
+// slot being overwritten loses the race for `Top` and throws what it read away.
+static inline void ThreadPoolDequeStore(web_thread_pool_deque_array *Array, s64 Index, web_thread_pool_job Job) {
+    web_thread_pool_job *Slot = &Array->Items[Index & (Array->Capacity - 1)];
+    __atomic_store_n(&Slot->Task.Proc, Job.Task.Proc, __ATOMIC_RELAXED);
+    __atomic_store_n(&Slot->Task.Arg, Job.Task.Arg, __ATOMIC_RELAXED);
+    __atomic_store_n(&Slot->Task.Lane, Job.Task.Lane, __ATOMIC_RELAXED);
+    __atomic_store_n(&Slot->Group, Job.Group, __ATOMIC_RELAXED);
+    __atomic_store_n(&Slot->QueuedAt, Job.QueuedAt, __ATOMIC_RELAXED);
+}
+
+static inline web_thread_pool_job ThreadPoolDequeLoad(web_thread_pool_deque_array *Array, s64 Index) {
+    web_thread_pool_job *Slot = &Array->Items[Index & (Array->Capacity - 1)];
+    return (web_thread_pool_job) {
+        .Task = {
+            .Proc = __atomic_load_n(&Slot->Task.Proc, __ATOMIC_RELAXED),
+            .Arg = __atomic_load_n(&Slot->Task.Arg, __ATOMIC_RELAXED),
+            .Lane = __atomic_load_n(&Slot->Task.Lane, __ATOMIC_RELAXED),
+        },
+        .Group = __atomic_load_n(&Slot->Group, __ATOMIC_RELAXED),
+        .QueuedAt = __atomic_load_n(&Slot->QueuedAt, __ATOMIC_RELAXED),
+    };
+}
+
+// NOTE(oleh): The deque operations follow "Correct and Efficient Work-Stealing for Weak Memory Models"
+// (Lê et al., 2013).
+static void ThreadPoolDequePush(web_thread_pool_queue *Queue, web_thread_pool_job Job) {
+    s64 Bottom = __atomic_load_n(&Queue->Bottom, __ATOMIC_RELAXED);
+    s64 Top = __atomic_load_n(&Queue->Top, __ATOMIC_ACQUIRE);
+    web_thread_pool_deque_array *Array = __atomic_load_n(&Queue->Array, __ATOMIC_RELAXED);
+
+    if (Bottom - Top > Array->Capacity - 1) {
+        web_thread_pool_deque_array *Grown = ThreadPoolDequeArrayCreate(Array->Capacity * 2);
+        for (s64 I = Top; I < Bottom; ++I) ThreadPoolDequeStore(Grown, I, ThreadPoolDequeLoad(Array, I));
+
+        Grown->Previous = Array;
+        __atomic_store_n(&Queue->Array, Grown, __ATOMIC_RELEASE);
+        Array = Grown;
+    }
+
+    ThreadPoolDequeStore(Array, Bottom, Job);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    __atomic_store_n(&Queue->Bottom, Bottom + 1, __ATOMIC_RELAXED);
+}
+
+static b32 ThreadPoolDequeTake(web_thread_pool_queue *Queue, web_thread_pool_job *OutJob) {
+    s64 Bottom = __atomic_load_n(&Queue->Bottom, __ATOMIC_RELAXED) - 1;
+    web_thread_pool_deque_array *Array = __atomic_load_n(&Queue->Array, __ATOMIC_RELAXED);
+    __atomic_store_n(&Queue->Bottom, Bottom, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    s64 Top = __atomic_load_n(&Queue->Top, __ATOMIC_RELAXED);
+
+    if (Top > Bottom) {
+        __atomic_store_n(&Queue->Bottom, Bottom + 1, __ATOMIC_RELAXED);
+        return 0;
+    }
+
+    *OutJob = ThreadPoolDequeLoad(Array, Bottom);
+    if (Top < Bottom) return 1;
+
+    // NOTE(oleh): The last job, thieves are racing for it.
+    b32 Won = __atomic_compare_exchange_n(&Queue->Top, &Top, Top + 1, 0, __ATOMIC_SEQ_CST, __ATOMIC_RELAXED);
+    __atomic_store_n(&Queue->Bottom, Bottom + 1, __ATOMIC_RELAXED);
+    return Won;
+}
+
+static b32 ThreadPoolDequeSteal(web_thread_pool_queue *Victim, web_thread_pool_job *OutJob) {
+    s64 Top = __atomic_load_n(&Victim->Top, __ATOMIC_ACQUIRE);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    s64 Bottom = __atomic_load_n(&Victim->Bottom, __ATOMIC_ACQUIRE);
+
+    if (Top >= Bottom) return 0;
+
+    web_thread_pool_deque_array *Array = __atomic_load_n(&Victim->Array, __ATOMIC_ACQUIRE);
+    web_thread_pool_job Job = ThreadPoolDequeLoad(Array, Top);
+    if (!__atomic_compare_exchange_n(&Victim->Top, &Top, Top + 1, 0, __ATOMIC_SEQ_CST, __ATOMIC_RELAXED)) return 0;
+
+    *OutJob = Job;
+    return 1;
+}
+
+static b32 ThreadPoolDequeIsEmpty(web_thread_pool_queue *Queue) {
+    return __atomic_load_n(&Queue->Bottom, __ATOMIC_SEQ_CST) <= __atomic_load_n(&Queue->Top, __ATOMIC_SEQ_CST);
+}
+
+static void ThreadPoolInboxPush(web_thread_pool_queue *Queue, web_thread_pool_job *Jobs, uz Count) {
+    WebMutexLock(&Queue->InboxMu);
+
+    if (Queue->InboxCount + Count > Queue->InboxCapacity) {
+        uz NewCapacity = Queue->InboxCapacity * 2;
+        while (NewCapacity < Queue->InboxCount + Count) NewCapacity *= 2;
+
+        web_thread_pool_job *Items = malloc(NewCapacity * sizeof(*Items));
+        if (Items == NULL) WEB_PANIC("Failed to grow a thread pool inbox");
+
+        for (uz I = 0; I < Queue->InboxCount; ++I) {
+            Items[I] = Queue->InboxItems[(Queue->InboxHead + I) % Queue->InboxCapacity];
+        }
+
+        free(Queue->InboxItems);
+        Queue->InboxItems = Items;
+        Queue->InboxCapacity = NewCapacity;
+        Queue->InboxHead = 0;
+    }
+
+    for (uz I = 0; I < Count; ++I) {
+        Queue->InboxItems[(Queue->InboxHead + Queue->InboxCount + I) % Queue->InboxCapacity] = Jobs[I];
+    }
+    __atomic_store_n(&Queue->InboxCount, Queue->InboxCount + Count, __ATOMIC_SEQ_CST);
+
+    WebMutexUnlock(&Queue->InboxMu);
+}
+
+// NOTE(oleh): `OutMore` tells whether the inbox still had jobs left in it afterwards.
+static b32 ThreadPoolInboxPop(web_thread_pool_queue *Queue, web_thread_pool_job *OutJob, b32 *OutMore) {
+    if (__atomic_load_n(&Queue->InboxCount, __ATOMIC_RELAXED) == 0) return 0;
+
+    WebMutexLock(&Queue->InboxMu);
+
+    b32 Popped = Queue->InboxCount > 0;
+    if (Popped) {
+        *OutJob = Queue->InboxItems[Queue->InboxHead];
+        Queue->InboxHead = (Queue->InboxHead + 1) % Queue->InboxCapacity;
+        __atomic_store_n(&Queue->InboxCount, Queue->InboxCount - 1, __ATOMIC_RELAXED);
+        *OutMore = Queue->InboxCount > 0;
+    }
+
+    WebMutexUnlock(&Queue->InboxMu);
+    return Popped;
+}
+
+static u64 ThreadPoolRandom(web_thread_pool_worker *Worker) {
+    // NOTE(oleh): xorshift64.
+    u64 X = Worker->Random;
+    X ^= X << 13;
+    X ^= X >> 7;
+    X ^= X << 17;
+    Worker->Random = X;
+    return X;
+}
+
+static b32 ThreadPoolHasWork(web_thread_pool *ThreadPool) {
+    for (uz I = 0; I < ThreadPool->ThreadsCount; ++I) {
+        for (uz Lane = 0; Lane < ThreadPool->LanesCount; ++Lane) {
+            web_thread_pool_queue *Queue = &ThreadPool->Workers[I].Queues[Lane];
+
+            if (!ThreadPoolDequeIsEmpty(Queue)) return 1;
+            if (__atomic_load_n(&Queue->InboxCount, __ATOMIC_SEQ_CST) > 0) return 1;
+        }
+    }
+
+    return 0;
+}
+
+// NOTE(oleh): Wakes a single parked worker, `Preferred` if it is one of them. A worker parks by
+// announcing itself in `IdleCount` and then looking for work once more, while the scheduling side
+// publishes the job before it looks at `IdleCount`. One of the two always sees the other.
+static void ThreadPoolWakeOne(web_thread_pool *ThreadPool, uz Preferred) {
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&ThreadPool->IdleCount, __ATOMIC_SEQ_CST) == 0) return;
+
+    for (uz I = 0; I < ThreadPool->ThreadsCount; ++I) {
+        web_thread_pool_worker *Worker = &ThreadPool->Workers[(Preferred + I) % ThreadPool->ThreadsCount];
+
+        u32 Expected = THREAD_POOL_WORKER_PARKED;
+        if (__atomic_compare_exchange_n(&Worker->State, &Expected, THREAD_POOL_WORKER_RUNNING, 0, __ATOMIC_SEQ_CST, __ATOMIC_RELAXED)) {
+            __atomic_fetch_sub(&ThreadPool->IdleCount, 1, __ATOMIC_SEQ_CST);
+            ThreadPoolFutexWake(&Worker->State, 1);
+            return;
+        }
+    }
+}
+
+// NOTE(oleh): The order in which the worker looks at the lanes this time. The weighted policy picks the
+// first one with smooth weighted round-robin and falls back to the rest in the order of urgency, so
+// that an empty lane doesn't hold up the others.
+static void ThreadPoolLaneOrder(web_thread_pool_worker *Worker, uz *Order) {
+    web_thread_pool *ThreadPool = Worker->Pool;
+
+    uz First = 0;
+
+    if (!ThreadPool->StrictLanes && ThreadPool->LanesCount > 1) {
+        for (uz Lane = 0; Lane < ThreadPool->LanesCount; ++Lane) {
+            Worker->LaneCredits[Lane] += ThreadPool->LaneWeights[Lane];
+            if (Worker->LaneCredits[Lane] > Worker->LaneCredits[First]) First = Lane;
+        }
+
+        Worker->LaneCredits[First] -= ThreadPool->LaneWeightsTotal;
+    }
+
+    uz Count = 0;
+    Order[Count++] = First;
+    for (uz Lane = 0; Lane < ThreadPool->LanesCount; ++Lane) {
+        if (Lane != First) Order[Count++] = Lane;
+    }
+}
+
+// NOTE(oleh): Whoever picks up a job from somebody else's queue, or from its own inbox, and sees that
+// there is more wakes up another worker. That way a batch only costs a single wakeup up front and the
+// rest of the pool joins in as the batch is being taken apart.
+static b32 ThreadPoolFindJobInLane(web_thread_pool_worker *Worker, uz Lane, web_thread_pool_job *OutJob) {
+    web_thread_pool *ThreadPool = Worker->Pool;
+    web_thread_pool_queue *Own = &Worker->Queues[Lane];
+    b32 More = 0;
+
+    if (ThreadPoolDequeTake(Own, OutJob)) return 1;
+
+    if (ThreadPoolInboxPop(Own, OutJob, &More)) {
+        if (More) ThreadPoolWakeOne(ThreadPool, Worker->Index + 1);
+        return 1;
+    }
+
+    uz Start = ThreadPoolRandom(Worker) % ThreadPool->ThreadsCount;
+
+    for (uz I = 0; I < ThreadPool->ThreadsCount; ++I) {
+        web_thread_pool_worker *Victim = &ThreadPool->Workers[(Start + I) % ThreadPool->ThreadsCount];
+        if (Victim == Worker) continue;
+
+        web_thread_pool_queue *Queue = &Victim->Queues[Lane];
+
+        if (ThreadPoolDequeSteal(Queue, OutJob)) {
+            More = !ThreadPoolDequeIsEmpty(Queue);
+        } else if (!ThreadPoolInboxPop(Queue, OutJob, &More)) {
+            continue;
+        }
+
+        if (More) ThreadPoolWakeOne(ThreadPool, Worker->Index + 1);
+        return 1;
+    }
+
+    return 0;
+}
+
+static b32 ThreadPoolFindJob(web_thread_pool_worker *Worker, web_thread_pool_job *OutJob) {
+    uz Order[WEB_THREAD_POOL_MAX_LANES];
+    ThreadPoolLaneOrder(Worker, Order);
+
+    for (uz I = 0; I < Worker->Pool->LanesCount; ++I) {
+        if (ThreadPoolFindJobInLane(Worker, Order[I], OutJob)) return 1;
+    }
+
+    return 0;
+}
+
+// NOTE(oleh): Only a parked worker retires, and only while there are more than the minimum of them.
+static b32 ThreadPoolTryRetire(web_thread_pool_worker *Worker) {
+    web_thread_pool *ThreadPool = Worker->Pool;
+
+    uz Active = __atomic_load_n(&ThreadPool->ActiveCount, __ATOMIC_SEQ_CST);
+    do {
+        if (Active <= ThreadPool->MinThreadsCount) return 0;
+    } while (!__atomic_compare_exchange_n(&ThreadPool->ActiveCount, &Active, Active - 1, 0, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST));
+
+    u32 Expected = THREAD_POOL_WORKER_PARKED;
+    if (!__atomic_compare_exchange_n(&Worker->State, &Expected, THREAD_POOL_WORKER_STOPPED, 0, __ATOMIC_SEQ_CST, __ATOMIC_RELAXED)) {
+        // NOTE(oleh): Woken up in the meantime.
+        __atomic_fetch_add(&ThreadPool->ActiveCount, 1, __ATOMIC_SEQ_CST);
+        return 0;
+    }
+
+    __atomic_fetch_sub(&ThreadPool->IdleCount, 1, __ATOMIC_SEQ_CST);
+    return 1;
+}
+
+// NOTE(oleh): Returns 1 if the worker has retired instead of being woken up.
+static b32 ThreadPoolPark(web_thread_pool_worker *Worker) {
+    web_thread_pool *ThreadPool = Worker->Pool;
+
+    __atomic_store_n(&Worker->State, THREAD_POOL_WORKER_PARKED, __ATOMIC_SEQ_CST);
+    __atomic_fetch_add(&ThreadPool->IdleCount, 1, __ATOMIC_SEQ_CST);
+
+    if (ThreadPoolHasWork(ThreadPool)) {
+        u32 Expected = THREAD_POOL_WORKER_PARKED;
+        if (__atomic_compare_exchange_n(&Worker->State, &Expected, THREAD_POOL_WORKER_RUNNING, 0, __ATOMIC_SEQ_CST, __ATOMIC_RELAXED)) {
+            __atomic_fetch_sub(&ThreadPool->IdleCount, 1, __ATOMIC_SEQ_CST);
+        }
+
+        // NOTE(oleh): Otherwise someone has woken us up already and took care of the count.
+        return 0;
+    }
+
+    b32 CanRetire = ThreadPool->ThreadsCount > ThreadPool->MinThreadsCount;
+    u64 Deadline = ThreadPoolMonotonicNs() + ThreadPool->IdleTimeoutNs;
+
+    while (__atomic_load_n(&Worker->State, __ATOMIC_SEQ_CST) == THREAD_POOL_WORKER_PARKED) {
+        if (!CanRetire) {
+            ThreadPoolFutexWait(&Worker->State, THREAD_POOL_WORKER_PARKED, 0);
+            continue;
+        }
+
+        u64 Now = ThreadPoolMonotonicNs();
+        if (Now >= Deadline) {
+            if (ThreadPoolTryRetire(Worker)) return 1;
+
+            Deadline = Now + ThreadPool->IdleTimeoutNs;
+            continue;
+        }
+
+        ThreadPoolFutexWait(&Worker->State, THREAD_POOL_WORKER_PARKED, Deadline - Now);
+    }
+
+    return 0;
+}
+
+static void ThreadPoolGroupDone(web_thread_pool_group *Group) {
+    u32 Pending = __atomic_fetch_sub(&Group->Pending, 1, __ATOMIC_SEQ_CST);
+
+    // NOTE(oleh): The waiter may return and free the group as soon as the count hits zero, so nothing
+    // but the wakeup itself touches it after that.
+    if (Pending == (THREAD_POOL_GROUP_WAITING | 1)) ThreadPoolFutexWake(&Group->Pending, INT_MAX);
+}
+
+static inline void ThreadPoolRunJob(web_thread_pool_job Job) {
+    // NOTE(oleh): Jobs run inside of another one, by `WebThreadPoolGroupWait`, restore the lane after.
+    u32 OuterLane = ThreadPoolCurrentLane;
+    ThreadPoolCurrentLane = Job.Task.Lane;
+
+    Job.Task.Proc(Job.Task.Arg);
+    if (Job.Group != NULL) ThreadPoolGroupDone(Job.Group);
+
+    ThreadPoolCurrentLane = OuterLane;
+}
+
+static void ThreadPoolWaitReady(web_thread_pool *ThreadPool) {
+    while (1) {
+        u32 Ready = __atomic_load_n(&ThreadPool->ReadyCount, __ATOMIC_SEQ_CST);
+        if (Ready >= ThreadPool->MinThreadsCount) break;
+
+        ThreadPoolFutexWait(&ThreadPool->ReadyCount, Ready, 0);
+    }
+}
+
+static void ThreadPoolWorkerSetUp(web_thread_pool_worker *Worker) {
+    web_thread_pool *ThreadPool = Worker->Pool;
+
+    if (Worker->Cpu >= 0 && !WebThreadPinToCpu((uz) Worker->Cpu)) {
+        WEB_LOG_FMT(WARN, THREAD, "Failed to pin a thread pool worker to CPU %zd", Worker->Cpu);
+    }
+
+    __atomic_store_n(&Worker->State, THREAD_POOL_WORKER_RUNNING, __ATOMIC_SEQ_CST);
+
+    __atomic_fetch_add(&ThreadPool->ReadyCount, 1, __ATOMIC_SEQ_CST);
+    ThreadPoolFutexWake(&ThreadPool->ReadyCount, INT_MAX);
+}
+
 static void *ThreadPoolWorkerProc(void *Arg) {
+    web_thread_pool_worker *Worker = (web_thread_pool_worker *)Arg;
+    ThreadPoolCurrentWorker = Worker;
+
+    ThreadPoolWorkerSetUp(Worker);
+
+    while (1) {
+        web_thread_pool_job Job;
+        b32 Found = 0;
+
+        for (uz Round = 0; Round < THREAD_POOL_SPIN_ROUNDS && !Found; ++Round) {
+            Found = ThreadPoolFindJob(Worker, &Job);
+            if (!Found) ThreadPoolCpuRelax();
+        }
+
+        if (!Found) {
+            if (ThreadPoolPark(Worker)) break;
+            continue;
+        }
+
+        ThreadPoolRunJob(Job);
+    }
+
+    // NOTE(oleh): Something may have been put into the inbox right before the worker retired.
+    if (ThreadPoolHasWork(Worker->Pool)) ThreadPoolWakeOne(Worker->Pool, Worker->Index + 1);
+
+    ThreadPoolCurrentWorker = NULL;
+    pthread_detach(pthread_self());
+    return NULL;
+}
+
+static b32 ThreadPoolStartWorker(web_thread_pool *ThreadPool, uz Index) {
+    web_thread_pool_worker *Worker = &ThreadPool->Workers[Index];
+
+    u32 Expected = THREAD_POOL_WORKER_STOPPED;
+    if (!__atomic_compare_exchange_n(&Worker->State, &Expected, THREAD_POOL_WORKER_STARTING, 0, __ATOMIC_SEQ_CST, __ATOMIC_RELAXED)) return 0;
+
+    __atomic_fetch_add(&ThreadPool->ActiveCount, 1, __ATOMIC_SEQ_CST);
+
+    if (!WebThreadLaunch(&ThreadPool->Threads[Index], ThreadPoolWorkerProc, Worker)) {
+        __atomic_fetch_sub(&ThreadPool->ActiveCount, 1, __ATOMIC_SEQ_CST);
+        __atomic_store_n(&Worker->State, THREAD_POOL_WORKER_STOPPED, __ATOMIC_SEQ_CST);
+        return 0;
+    }
+
+    return 1;
+}
+
+// NOTE(oleh): How long the oldest task in the queues has been waiting there. The deque slots are read
+// without synchronizing with their owners, which is good enough for an estimate.
+static u64 ThreadPoolOldestWaitNs(web_thread_pool *ThreadPool, u64 Now) {
+    u64 Oldest = Now;
+
+    for (uz I = 0; I < ThreadPool->ThreadsCount; ++I) {
+        for (uz Lane = 0; Lane < ThreadPool->LanesCount; ++Lane) {
+            web_thread_pool_queue *Queue = &ThreadPool->Workers[I].Queues[Lane];
+
+            s64 Top = __atomic_load_n(&Queue->Top, __ATOMIC_ACQUIRE);
+            s64 Bottom = __atomic_load_n(&Queue->Bottom, __ATOMIC_ACQUIRE);
+            if (Top < Bottom) {
+                web_thread_pool_deque_array *Array = __atomic_load_n(&Queue->Array, __ATOMIC_ACQUIRE);
+                Oldest = WEB_MIN(Oldest, ThreadPoolDequeLoad(Array, Top).QueuedAt);
+            }
+
+            if (__atomic_load_n(&Queue->InboxCount, __ATOMIC_RELAXED) > 0) {
+                WebMutexLock(&Queue->InboxMu);
+                if (Queue->InboxCount > 0) Oldest = WEB_MIN(Oldest, Queue->InboxItems[Queue->InboxHead].QueuedAt);
+                WebMutexUnlock(&Queue->InboxMu);
+            }
+        }
+    }
+
+    return Now - WEB_MIN(Oldest, Now);
+}
+
+// NOTE(oleh): Adds a worker whenever every worker is busy and tasks sit in the queues for longer than
+// the target, which is what happens once the handlers start blocking. Checks often while the pool is
+// busy and backs off while it is not.
+static void *ThreadPoolSupervisorProc(void *Arg) {
     web_thread_pool *ThreadPool = (web_thread_pool *)Arg;
+    u64 Interval = ThreadPool->QueueWaitTargetNs;
 
     while (1) {
-        WebMutexLock(&ThreadPool->QueueCondMu);
+        struct timespec Sleep = {.tv_sec = Interval / 1000000000ull, .tv_nsec = Interval % 1000000000ull};
+        nanosleep(&Sleep, NULL);
 
-        while (ThreadPool->QueueHead == ThreadPool->QueueTail) {
-            pthread_cond_wait(&ThreadPool->QueueCondVar, &ThreadPool->QueueCondMu.Inner);
+        b32 Saturated = __atomic_load_n(&ThreadPool->IdleCount, __ATOMIC_SEQ_CST) == 0;
+        if (!Saturated) {
+            Interval = WEB_MIN(Interval * 2, THREAD_POOL_SUPERVISOR_MAX_INTERVAL_NS);
+            continue;
         }
 
-        web_thread_pool_task Task = ThreadPool->QueueItems[ThreadPool->QueueHead];
-        ThreadPool->QueueHead = (ThreadPool->QueueHead + 1) % ThreadPool->QueueCapacity;
+        Interval = ThreadPool->QueueWaitTargetNs;
 
-        WebMutexUnlock(&ThreadPool->QueueCondMu);
+        if (__atomic_load_n(&ThreadPool->ActiveCount, __ATOMIC_SEQ_CST) >= ThreadPool->ThreadsCount) continue;
+        if (ThreadPoolOldestWaitNs(ThreadPool, ThreadPoolMonotonicNs()) <= ThreadPool->QueueWaitTargetNs) continue;
 
-        Task.Proc(Task.Arg);
+        for (uz I = 0; I < ThreadPool->ThreadsCount; ++I) {
+            if (ThreadPoolStartWorker(ThreadPool, I)) break;
+        }
     }
 
     return NULL;
 }
 
+// NOTE(oleh): Parses a sysfs CPU list like "0-3,8-11".
+static void ThreadPoolParseCpuList(const char *List, sz Node, sz *CpuNodes) {
+    const char *At = List;
+
+    while (*At >= '0' && *At <= '9') {
+        char *End;
+        long First = strtol(At, &End, 10);
+        long Last = First;
+
+        if (*End == '-') Last = strtol(End + 1, &End, 10);
+
+        for (long Cpu = First; Cpu <= Last && Cpu < CPU_SETSIZE; ++Cpu) CpuNodes[Cpu] = Node;
+
+        At = *End == ',' ? End + 1 : End;
+    }
+}
+
+// NOTE(oleh): Maps every CPU to its NUMA node. Everything is on node 0 if the kernel doesn't tell.
+static sz ThreadPoolReadCpuNodes(sz *CpuNodes) {
+    for (uz I = 0; I < CPU_SETSIZE; ++I) CpuNodes[I] = 0;
+
+    sz NodesCount = 1;
+
+    DIR *Dir = opendir("/sys/devices/system/node");
+    if (Dir == NULL) return NodesCount;
+
+    struct dirent *Entry;
+    while ((Entry = readdir(Dir)) != NULL) {
+        unsigned Node;
+        if (sscanf(Entry->d_name, "node%u", &Node) != 1) continue;
+
+        char Path[128];
+        snprintf(Path, sizeof(Path), "/sys/devices/system/node/node%u/cpulist", Node);
+
+        FILE *File = fopen(Path, "r");
+        if (File == NULL) continue;
+
+        char List[1024];
+        if (fgets(List, sizeof(List), File) != NULL) {
+            ThreadPoolParseCpuList(List, Node, CpuNodes);
+            NodesCount = WEB_MAX(NodesCount, (sz) Node + 1);
+        }
+
+        fclose(File);
+    }
+
+    closedir(Dir);
+    return NodesCount;
+}
+
+// NOTE(oleh): Decides where every worker runs. Returns 0 if the policy can't be satisfied.
+static b32 ThreadPoolPlaceWorkers(web_thread_pool *ThreadPool, web_thread_pool_config *Config) {
+    for (uz I = 0; I < ThreadPool->ThreadsCount; ++I) {
+        ThreadPool->Workers[I].Cpu = -1;
+        ThreadPool->Workers[I].Node = 0;
+    }
+
+    if (Config->Affinity == WEB_THREAD_AFFINITY_NONE) return 1;
+
+    sz *CpuNodes = malloc(CPU_SETSIZE * sizeof(*CpuNodes));
+    if (CpuNodes == NULL) return 0;
+    sz NodesCount = ThreadPoolReadCpuNodes(CpuNodes);
+
+    u32 Order[CPU_SETSIZE];
+    uz OrderCount = 0;
+
+    if (Config->Affinity == WEB_THREAD_AFFINITY_LIST) {
+        for (uz I = 0; I < Config->CpusCount && OrderCount < CPU_SETSIZE; ++I) {
+            if (Config->Cpus[I] < CPU_SETSIZE) Order[OrderCount++] = Config->Cpus[I];
+        }
+    } else {
+        cpu_set_t Allowed;
+        if (sched_getaffinity(0, sizeof(Allowed), &Allowed) != 0) {
+            free(CpuNodes);
+            return 0;
+        }
+
+        if (Config->Affinity == WEB_THREAD_AFFINITY_COMPACT) {
+            for (sz Node = 0; Node < NodesCount; ++Node) {
+                for (u32 Cpu = 0; Cpu < CPU_SETSIZE; ++Cpu) {
+                    if (CPU_ISSET(Cpu, &Allowed) && CpuNodes[Cpu] == Node) Order[OrderCount++] = Cpu;
+                }
+            }
+        } else {
+            // NOTE(oleh): Takes the next unused CPU of every node in turn.
+            uz AllowedCount = CPU_COUNT(&Allowed);
+            while (OrderCount < AllowedCount) {
+                for (sz Node = 0; Node < NodesCount; ++Node) {
+                    for (u32 Cpu = 0; Cpu < CPU_SETSIZE; ++Cpu) {
+                        if (!CPU_ISSET(Cpu, &Allowed) || CpuNodes[Cpu] != Node) continue;
+
+                        CPU_CLR(Cpu, &Allowed);
+                        Order[OrderCount++] = Cpu;
+                        break;
+                    }
+                }
+            }
+        }
+    }
+
+    if (OrderCount == 0) {
+        free(CpuNodes);
+        return 0;
+    }
+
+    for (uz I = 0; I < ThreadPool->ThreadsCount; ++I) {
+        u32 Cpu = Order[I % OrderCount];
+        ThreadPool->Workers[I].Cpu = Cpu;
+        ThreadPool->Workers[I].Node = CpuNodes[Cpu];
+    }
+
+    free(CpuNodes);
+    return 1;
+}
+
 b32 WebThreadPoolInit(web_thread_pool *ThreadPool, web_arena *Arena, web_thread_pool_config *Config) {
     ThreadPool->Arena = Arena;
-    ThreadPool->ThreadsCount = Config->NumThreads;
+    ThreadPool->MinThreadsCount = WEB_MAX(Config->NumThreads, 1);
+    ThreadPool->ThreadsCount = WEB_MAX(Config->MaxThreads, ThreadPool->MinThreadsCount);
+    ThreadPool->NextWorker = 0;
+    ThreadPool->IdleCount = 0;
+    ThreadPool->ActiveCount = 0;
+    ThreadPool->ReadyCount = 0;
+
+    u64 QueueWaitTargetUs = Config->QueueWaitTargetUs > 0 ? Config->QueueWaitTargetUs : THREAD_POOL_DEFAULT_QUEUE_WAIT_TARGET_US;
+    u64 IdleTimeoutMs = Config->IdleTimeoutMs > 0 ? Config->IdleTimeoutMs : THREAD_POOL_DEFAULT_IDLE_TIMEOUT_MS;
+    ThreadPool->QueueWaitTargetNs = QueueWaitTargetUs * 1000;
+    ThreadPool->IdleTimeoutNs = IdleTimeoutMs * 1000 * 1000;
 
     ThreadPool->Threads = WEB_ARENA_PUSH_ZERO(Arena, sizeof(*ThreadPool->Threads) * ThreadPool->ThreadsCount);
+    ThreadPool->Workers = WEB_ARENA_PUSH_ZERO(Arena, sizeof(*ThreadPool->Workers) * ThreadPool->ThreadsCount);
 
-    for (uz I = 0; I < ThreadPool->ThreadsCount; ++I) {
-        if (!WebThreadLaunch(&ThreadPool->Threads[I], ThreadPoolWorkerProc, ThreadPool)) return 0;
+    if (!ThreadPoolPlaceWorkers(ThreadPool, Config)) {
+        WEB_LOG(ERROR, THREAD, "Could not place the thread pool workers according to the affinity policy");
+        return 0;
+    }
+
+    ThreadPool->LanesCount = WEB_MIN(WEB_MAX(Config->LanesCount, 1), WEB_THREAD_POOL_MAX_LANES);
+    ThreadPool->StrictLanes = Config->LanePolicy == WEB_THREAD_POOL_LANES_STRICT;
+    ThreadPool->LaneWeightsTotal = 0;
+
+    for (uz Lane = 0; Lane < ThreadPool->LanesCount; ++Lane) {
+        u32 Weight = Config->LaneWeights[Lane];
+        if (Weight == 0) Weight = 1u << (ThreadPool->LanesCount - 1 - Lane);
+
+        ThreadPool->LaneWeights[Lane] = (s32) WEB_MIN(Weight, (u32) THREAD_POOL_MAX_LANE_WEIGHT);
+        ThreadPool->LaneWeightsTotal += ThreadPool->LaneWeights[Lane];
     }
 
-    ThreadPool->QueueHead = 0;
-    ThreadPool->QueueTail = 0;
+    for (uz I = 0; I < ThreadPool->ThreadsCount; ++I) {
+        web_thread_pool_worker *Worker = &ThreadPool->Workers[I];
+        Worker->Pool = ThreadPool;
+        Worker->Index = I;
+        for (uz Lane = 0; Lane < WEB_THREAD_POOL_MAX_LANES; ++Lane) WebMutexInit(&Worker->Queues[Lane].InboxMu);
 
-    ThreadPool->QueueCondVar = (pthread_cond_t) PTHREAD_COND_INITIALIZER;
-    WebMutexInit(&ThreadPool->QueueCondMu);
+        // NOTE(oleh): Every slot gets its queues up front, even the ones without a worker yet, since
+        // jobs may be put into the inbox of a slot that is still starting. A slot keeps them when its
+        // worker retires, the next one to take it over picks up where it left off.
+        for (uz Lane = 0; Lane < ThreadPool->LanesCount; ++Lane) {
+            web_thread_pool_queue *Queue = &Worker->Queues[Lane];
+            Queue->Array = ThreadPoolDequeArrayCreate(THREAD_POOL_DEQUE_INITIAL_CAPACITY);
+            Queue->InboxCapacity = THREAD_POOL_INBOX_INITIAL_CAPACITY;
+            Queue->InboxItems = malloc(Queue->InboxCapacity * sizeof(*Queue->InboxItems));
+            if (Queue->InboxItems == NULL) WEB_PANIC("Failed to allocate a thread pool inbox");
+        }
 
-    ThreadPool->QueueCapacity = 128;
-    ThreadPool->QueueItems = WEB_ARENA_PUSH_ZERO(Arena, sizeof(*ThreadPool->QueueItems) * ThreadPool->QueueCapacity);
+        Worker->State = THREAD_POOL_WORKER_STOPPED;
+        Worker->Random = 0x9E3779B97F4A7C15ull * (I + 1);
+    }
+
+    for (uz I = 0; I < ThreadPool->MinThreadsCount; ++I) {
+        if (!ThreadPoolStartWorker(ThreadPool, I)) return 0;
+    }
 
+    if (ThreadPool->ThreadsCount > ThreadPool->MinThreadsCount) {
+        web_thread Supervisor;
+        if (!WebThreadLaunch(&Supervisor, ThreadPoolSupervisorProc, ThreadPool)) return 0;
+        pthread_detach(Supervisor.Id);
+    }
+
+    ThreadPoolWaitReady(ThreadPool);
     return 1;
 }
 
+sz WebThreadPoolWorkerIndex(web_thread_pool *ThreadPool) {
+    web_thread_pool_worker *Current = ThreadPoolCurrentWorker;
+    if (Current == NULL || Current->Pool != ThreadPool) return -1;
+
+    return Current->Index;
+}
+
+static void ThreadPoolSubmit(web_thread_pool *ThreadPool, web_thread_pool_job *Jobs, uz Count) {
+    if (Count == 0) return;
+
+    // NOTE(oleh): Only the supervisor looks at the timestamps.
+    if (ThreadPool->ThreadsCount > ThreadPool->MinThreadsCount) {
+        u64 Now = ThreadPoolMonotonicNs();
+        for (uz I = 0; I < Count; ++I) Jobs[I].QueuedAt = Now;
+    }
+
+    for (uz I = 0; I < Count; ++I) Jobs[I].Task.Lane = WEB_MIN(Jobs[I].Task.Lane, ThreadPool->LanesCount - 1);
+
+    web_thread_pool_worker *Current = ThreadPoolCurrentWorker;
+
+    if (Current != NULL && Current->Pool == ThreadPool) {
+        for (uz I = 0; I < Count; ++I) ThreadPoolDequePush(&Current->Queues[Jobs[I].Task.Lane], Jobs[I]);
+        ThreadPoolWakeOne(ThreadPool, Current->Index + 1);
+        return;
+    }
+
+    // NOTE(oleh): Skips the slots without a running worker. If none is found the jobs go to whichever
+    // slot we end up at, its worker may still be starting. If the chosen one retires right after, the
+    // others steal the jobs from its inbox.
+    uz Index = __atomic_fetch_add(&ThreadPool->NextWorker, 1, __ATOMIC_RELAXED) % ThreadPool->ThreadsCount;
+    for (uz I = 0; I < ThreadPool->ThreadsCount; ++I) {
+        u32 State = __atomic_load_n(&ThreadPool->Workers[Index].State, __ATOMIC_SEQ_CST);
+        if (State == THREAD_POOL_WORKER_RUNNING || State == THREAD_POOL_WORKER_PARKED) break;
+
+        Index = (Index + 1) % ThreadPool->ThreadsCount;
+    }
+
+    // NOTE(oleh): One lock for every run of jobs going into the same lane.
+    web_thread_pool_worker *Worker = &ThreadPool->Workers[Index];
+    for (uz Start = 0, End = 0; Start < Count; Start = End) {
+        while (End < Count && Jobs[End].Task.Lane == Jobs[Start].Task.Lane) ++End;
+        ThreadPoolInboxPush(&Worker->Queues[Jobs[Start].Task.Lane], Jobs + Start, End - Start);
+    }
+
+    ThreadPoolWakeOne(ThreadPool, Index);
+}
+
+// NOTE(oleh): Wraps the tasks into jobs a batch at a time, so that large submissions don't need any
+// memory of their own.
+static void ThreadPoolSubmitTasks(web_thread_pool *ThreadPool, web_thread_pool_group *Group, web_thread_pool_task *Tasks, uz Count) {
+    web_thread_pool_job Jobs[THREAD_POOL_SUBMIT_BATCH];
+
+    for (uz Offset = 0; Offset < Count; Offset += THREAD_POOL_SUBMIT_BATCH) {
+        uz BatchCount = WEB_MIN(Count - Offset, THREAD_POOL_SUBMIT_BATCH);
+        for (uz I = 0; I < BatchCount; ++I) Jobs[I] = (web_thread_pool_job) {.Task = Tasks[Offset + I], .Group = Group, .QueuedAt = 0};
+
+        ThreadPoolSubmit(ThreadPool, Jobs, BatchCount);
+    }
+}
+
 void WebThreadPoolScheduleTask(web_thread_pool *ThreadPool, web_thread_pool_task Task) {
-    WebMutexLock(&ThreadPool->QueueCondMu);
+    web_thread_pool_job Job = {.Task = Task, .Group = NULL, .QueuedAt = 0};
+    ThreadPoolSubmit(ThreadPool, &Job, 1);
+}
 
-    b32 WakeUpWorkers = ThreadPool->QueueHead == ThreadPool->QueueTail;
+void WebThreadPoolScheduleTasks(web_thread_pool *ThreadPool, web_thread_pool_task *Tasks, uz Count) {
+    ThreadPoolSubmitTasks(ThreadPool, NULL, Tasks, Count);
+}
 
-    ThreadPool->QueueItems[ThreadPool->QueueTail] = Task;
+void WebThreadPoolGroupInit(web_thread_pool_group *Group, web_thread_pool *Pool) {
+    Group->Pool = Pool;
+    Group->Pending = 0;
+}
 
-    ThreadPool->QueueTail = (ThreadPool->QueueTail + 1) % ThreadPool->QueueCapacity;
+void WebThreadPoolGroupSpawn(web_thread_pool_group *Group, web_thread_pool_task Task) {
+    WebThreadPoolGroupSpawnMany(Group, &Task, 1);
+}
+
+void WebThreadPoolGroupSpawnMany(web_thread_pool_group *Group, web_thread_pool_task *Tasks, uz Count) {
+    if (Count == 0) return;
+
+    u32 Pending = __atomic_fetch_add(&Group->Pending, Count, __ATOMIC_SEQ_CST);
+    WEB_ASSERT((Pending & ~THREAD_POOL_GROUP_WAITING) + Count < THREAD_POOL_GROUP_WAITING);
+
+    ThreadPoolSubmitTasks(Group->Pool, Group, Tasks, Count);
+}
 
-    if (ThreadPool->QueueTail == ThreadPool->QueueHead) {
-        uz NewCapacity = ThreadPool->QueueCapacity * 2;
-        ThreadPool->QueueItems = WebArenaRealloc(ThreadPool->Arena,
-                                                 ThreadPool->QueueItems,
-                                                 sizeof(*ThreadPool->QueueItems) * ThreadPool->QueueCapacity,
-                                                 sizeof(*ThreadPool->QueueItems) * NewCapacity);
-        ThreadPool->QueueCapacity = NewCapacity;
+void WebThreadPoolGroupWait(web_thread_pool_group *Group) {
+    web_thread_pool_worker *Current = ThreadPoolCurrentWorker;
+
+    if (Current != NULL && Current->Pool == Group->Pool) {
+        for (uz Lane = 0; Lane < Group->Pool->LanesCount; ++Lane) {
+            web_thread_pool_queue *Queue = &Current->Queues[Lane];
+            web_thread_pool_job Job;
+
+            while ((__atomic_load_n(&Group->Pending, __ATOMIC_ACQUIRE) & ~THREAD_POOL_GROUP_WAITING) > 0
+                   && ThreadPoolDequeTake(Queue, &Job)) {
+                if (Job.Group == NULL) {
+                    // NOTE(oleh): Not ours to run. It goes to the inbox, out of the way of the group
+                    // jobs under it, for somebody else to pick up.
+                    ThreadPoolInboxPush(Queue, &Job, 1);
+                    ThreadPoolWakeOne(Group->Pool, Current->Index + 1);
+                    continue;
+                }
+
+                ThreadPoolRunJob(Job);
+            }
+        }
     }
 
-    WebMutexUnlock(&ThreadPool->QueueCondMu);
+    while (1) {
+        u32 Pending = __atomic_load_n(&Group->Pending, __ATOMIC_ACQUIRE);
+        if ((Pending & ~THREAD_POOL_GROUP_WAITING) == 0) break;
 
-    if (WakeUpWorkers) {
-        pthread_cond_broadcast(&ThreadPool->QueueCondVar);
+        if (!(Pending & THREAD_POOL_GROUP_WAITING)) {
+            if (!__atomic_compare_exchange_n(&Group->Pending, &Pending, Pending | THREAD_POOL_GROUP_WAITING, 0, __ATOMIC_SEQ_CST, __ATOMIC_RELAXED)) continue;
+            Pending |= THREAD_POOL_GROUP_WAITING;
+        }
+
+        ThreadPoolFutexWait(&Group->Pending, Pending, 0);
     }
+
+    // NOTE(oleh): Ready for the next round.
+    __atomic_store_n(&Group->Pending, 0, __ATOMIC_RELEASE);
+}
+
+typedef struct {
+    web_thread_pool_range_proc Proc;
+    void *Arg;
+    uz Count;
+    uz MinChunk;
+    uz Divisor;
+    uz Next;
+} thread_pool_parallel_for;
+
+// NOTE(oleh): Guided scheduling: every claim takes a share of whatever is left, so the first chunks are
+// big enough to keep the overhead down and the last ones are small enough to even out the finish.
+static b32 ThreadPoolParallelForClaim(thread_pool_parallel_for *For, uz *OutBegin, uz *OutEnd) {
+    uz Next = __atomic_load_n(&For->Next, __ATOMIC_RELAXED);
+
+    while (Next < For->Count) {
+        uz Remaining = For->Count - Next;
+        uz Chunk = WEB_MIN(Remaining, WEB_MAX(For->MinChunk, Remaining / For->Divisor));
+
+        if (__atomic_compare_exchange_n(&For->Next, &Next, Next + Chunk, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+            *OutBegin = Next;
+            *OutEnd = Next + Chunk;
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+static void ThreadPoolParallelForRun(void *Arg) {
+    thread_pool_parallel_for *For = (thread_pool_parallel_for *)Arg;
+
+    uz Begin, End;
+    while (ThreadPoolParallelForClaim(For, &Begin, &End)) For->Proc(For->Arg, Begin, End);
+}
+
+void WebThreadPoolParallelFor(web_thread_pool *ThreadPool, uz Count, uz MinChunk, web_thread_pool_range_proc Proc, void *Arg) {
+    if (Count == 0) return;
+    if (MinChunk == 0) MinChunk = 1;
+
+    uz ChunksCount = (Count + MinChunk - 1) / MinChunk;
+
+    // NOTE(oleh): The calling thread takes part too. It is one of the workers if it is inside the pool.
+    web_thread_pool_worker *Current = ThreadPoolCurrentWorker;
+    uz HelpersCount = __atomic_load_n(&ThreadPool->ActiveCount, __ATOMIC_RELAXED);
+    if (Current != NULL && Current->Pool == ThreadPool) --HelpersCount;
+    HelpersCount = WEB_MIN(HelpersCount, ChunksCount - 1);
+
+    thread_pool_parallel_for For = {
+        .Proc = Proc,
+        .Arg = Arg,
+        .Count = Count,
+        .MinChunk = MinChunk,
+        .Divisor = 2 * (HelpersCount + 1),
+        .Next = 0,
+    };
+
+    if (HelpersCount == 0) {
+        ThreadPoolParallelForRun(&For);
+        return;
+    }
+
+    web_thread_pool_group Group;
+    WebThreadPoolGroupInit(&Group, ThreadPool);
+
+    web_thread_pool_task Tasks[THREAD_POOL_SUBMIT_BATCH];
+    // NOTE(oleh): The helpers are as urgent as the task that called us.
+    u32 Lane = Current != NULL && Current->Pool == ThreadPool ? ThreadPoolCurrentLane : 0;
+    for (uz I = 0; I < THREAD_POOL_SUBMIT_BATCH; ++I) Tasks[I] = (web_thread_pool_task) {.Proc = ThreadPoolParallelForRun, .Arg = &For, .Lane = Lane};
+
+    for (uz Offset = 0; Offset < HelpersCount; Offset += THREAD_POOL_SUBMIT_BATCH) {
+        WebThreadPoolGroupSpawnMany(&Group, Tasks, WEB_MIN(HelpersCount - Offset, THREAD_POOL_SUBMIT_BATCH));
+    }
+
+    ThreadPoolParallelForRun(&For);
+    WebThreadPoolGroupWait(&Group);
 }
 
 void WebMutexInit(web_mutex *Mu) {
@@ -95,7 +962,7 @@ void WebMutexUnlock(web_mutex *Mu) {
 }
 
 b32 WebMutexTryLock(web_mutex *Mu) {
-    int Err = pthread_mutex_unlock(&Mu->Inner);
+    int Err = pthread_mutex_trylock(&Mu->Inner);
     if (Err == EINVAL) WEB_PANIC("Invalid mutex state. Was it properly initialized?");
     return Err != EBUSY;
 }
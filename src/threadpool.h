@@ -21,35 +21,184 @@ b32 WebMutexTryLock(web_mutex *);
 typedef void *(*web_thread_proc)(void *arg);
 
 b32 WebThreadLaunch(web_thread *Thread, web_thread_proc ThreadProc, void *ThreadProcArg);
+b32 WebThreadPinToCpu(uz Cpu);
+uz WebThreadAllowedCpus(u32 *Cpus, uz Capacity);
 
 typedef void (*web_thread_pool_task_proc)(void *arg);
 
+#define WEB_THREAD_POOL_MAX_LANES 4
+
 typedef struct {
     web_thread_pool_task_proc Proc;
     void *Arg;
+    // NOTE(oleh): The priority lane, 0 is the most urgent one. Lanes past the last one the pool has
+    // fall into the last one.
+    u32 Lane;
 } web_thread_pool_task;
 
+typedef struct web_thread_pool_group web_thread_pool_group;
+
+// NOTE(oleh): What the workers pass around, a task and the group it belongs to, if any.
 typedef struct {
+    web_thread_pool_task Task;
+    web_thread_pool_group *Group;
+    // NOTE(oleh): Monotonic nanoseconds, only set when the pool can grow.
+    u64 QueuedAt;
+} web_thread_pool_job;
+
+// NOTE(oleh): A growable ring of a Chase-Lev deque. Replaced arrays are kept around until the pool goes
+// away, a thief may still be reading from one.
+typedef struct web_thread_pool_deque_array web_thread_pool_deque_array;
+struct web_thread_pool_deque_array {
+    web_thread_pool_deque_array *Previous;
+    s64 Capacity;
+    web_thread_pool_job Items[];
+};
+
+typedef struct web_thread_pool web_thread_pool;
+
+// NOTE(oleh): A worker's queues for one of the lanes.
+typedef struct {
+    // NOTE(oleh): Only the owning worker pushes and takes at the bottom, everyone else steals from the top.
+    s64 Top;
+    s64 Bottom;
+    web_thread_pool_deque_array *Array;
+
+    // NOTE(oleh): Tasks scheduled from outside of the pool land here.
+    web_mutex InboxMu;
+    web_thread_pool_job *InboxItems;
+    uz InboxCapacity;
+    uz InboxHead;
+    uz InboxCount;
+} web_thread_pool_queue;
+
+typedef struct {
+    web_thread_pool *Pool;
+    uz Index;
+
+    web_thread_pool_queue Queues[WEB_THREAD_POOL_MAX_LANES];
+    // NOTE(oleh): The state of the weighted lane selection.
+    s32 LaneCredits[WEB_THREAD_POOL_MAX_LANES];
+
+    // NOTE(oleh): The futex word the worker sleeps on.
+    u32 State;
+    u64 Random;
+
+    // NOTE(oleh): -1 if the worker is not pinned. The node is 0 on machines without NUMA.
+    sz Cpu;
+    sz Node;
+
+    // NOTE(oleh): Keeps the next worker's deques off of this one's cache lines.
+    u8 Padding[64];
+} web_thread_pool_worker;
+
+struct web_thread_pool {
     web_arena *Arena;
 
+    // NOTE(oleh): There is a slot for every worker the pool may grow to, `ActiveCount` of them have a
+    // thread behind them at the moment.
     web_thread *Threads;
     uz ThreadsCount;
-
-    web_thread_pool_task *QueueItems;
-    uz QueueCapacity;
-    uz QueueHead;
-    uz QueueTail;
-
-    pthread_cond_t QueueCondVar;
-    web_mutex QueueCondMu;
-} web_thread_pool;
+    uz MinThreadsCount;
+    uz ActiveCount;
+    u64 QueueWaitTargetNs;
+    u64 IdleTimeoutNs;
+
+    web_thread_pool_worker *Workers;
+    uz LanesCount;
+    b32 StrictLanes;
+    s32 LaneWeights[WEB_THREAD_POOL_MAX_LANES];
+    s32 LaneWeightsTotal;
+    // NOTE(oleh): Round-robin over the inboxes for the tasks scheduled from outside.
+    uz NextWorker;
+    // NOTE(oleh): Workers that are parked or about to be.
+    uz IdleCount;
+    // NOTE(oleh): Workers that are done setting themselves up.
+    u32 ReadyCount;
+};
+
+typedef enum {
+    // NOTE(oleh): Every lane gets a share of the picks proportional to its weight, and the lanes with
+    // nothing to do give theirs to the others.
+    WEB_THREAD_POOL_LANES_WEIGHTED,
+    // NOTE(oleh): A lane is only looked at when all of the more urgent ones are empty.
+    WEB_THREAD_POOL_LANES_STRICT,
+} web_thread_pool_lane_policy;
+
+typedef enum {
+    // NOTE(oleh): Workers are left to the scheduler.
+    WEB_THREAD_AFFINITY_NONE,
+    // NOTE(oleh): Workers fill up the CPUs of one NUMA node before moving on to the next one.
+    WEB_THREAD_AFFINITY_COMPACT,
+    // NOTE(oleh): Workers go round-robin over the NUMA nodes.
+    WEB_THREAD_AFFINITY_SCATTER,
+    // NOTE(oleh): Worker I runs on `Cpus[I % CpusCount]`.
+    WEB_THREAD_AFFINITY_LIST,
+} web_thread_affinity;
 
 typedef struct {
+    // NOTE(oleh): The workers that are always there, at least 1.
     uz NumThreads;
+    // NOTE(oleh): If above `NumThreads`, a supervisor thread adds workers up to this many while all of
+    // them are busy and tasks wait in the queues for longer than `QueueWaitTargetUs` (1ms by
+    // default). The extra workers go away after `IdleTimeoutMs` (10s by default) without work.
+    uz MaxThreads;
+    u32 QueueWaitTargetUs;
+    u32 IdleTimeoutMs;
+
+    // NOTE(oleh): 1 by default, at most `WEB_THREAD_POOL_MAX_LANES`. The weights default to halving
+    // from one lane to the next.
+    uz LanesCount;
+    web_thread_pool_lane_policy LanePolicy;
+    u32 LaneWeights[WEB_THREAD_POOL_MAX_LANES];
+
+    // NOTE(oleh): Only the CPUs the process is allowed to run on are used by the compact and scatter
+    // policies.
+    web_thread_affinity Affinity;
+    u32 *Cpus;
+    uz CpusCount;
 } web_thread_pool_config;
 
+// NOTE(oleh): Every worker owns a deque, idle ones steal from random victims and park on a futex once
+// there is nothing left anywhere. A task scheduled by one of the workers goes to the front of its own
+// deque, tasks from other threads are spread over the workers' inboxes. Either way at most one parked
+// worker is woken up.
+// Workers pin themselves first and then allocate their own queues, so that with Linux's first-touch
+// policy the memory ends up on their node. Returns once all of them are ready.
 b32 WebThreadPoolInit(web_thread_pool *, web_arena *, web_thread_pool_config *);
 
+// NOTE(oleh): The index of the calling thread among the pool's workers, -1 if it is not one of them.
+// Lets the callers keep per-worker state, which stays local to the worker's node when it is pinned.
+sz WebThreadPoolWorkerIndex(web_thread_pool *);
+
 void WebThreadPoolScheduleTask(web_thread_pool *, web_thread_pool_task);
+// NOTE(oleh): Same as scheduling them one by one, but takes at most one lock and wakes at most one
+// worker. The workers that pick them up wake up more of their peers while there is enough left.
+void WebThreadPoolScheduleTasks(web_thread_pool *, web_thread_pool_task *Tasks, uz Count);
+
+// NOTE(oleh): Tracks a set of tasks so that they can be waited on. Results are passed back through the
+// tasks' arguments, they are visible to the waiter once `WebThreadPoolGroupWait` returns. A group can
+// be reused after that.
+struct web_thread_pool_group {
+    web_thread_pool *Pool;
+    // NOTE(oleh): The number of unfinished tasks, the top bit is set while somebody is waiting for them.
+    u32 Pending;
+};
+
+void WebThreadPoolGroupInit(web_thread_pool_group *Group, web_thread_pool *Pool);
+void WebThreadPoolGroupSpawn(web_thread_pool_group *Group, web_thread_pool_task Task);
+void WebThreadPoolGroupSpawnMany(web_thread_pool_group *Group, web_thread_pool_task *Tasks, uz Count);
+// NOTE(oleh): Waiting from inside one of the pool's workers runs the group tasks that are still on
+// the worker's own deque instead of blocking on them. Anything else found there, connection tasks
+// included, is left for the other workers, so that a handler doesn't end up serving another
+// connection.
+void WebThreadPoolGroupWait(web_thread_pool_group *Group);
+
+typedef void (*web_thread_pool_range_proc)(void *Arg, uz Begin, uz End);
+
+// NOTE(oleh): Calls `Proc` on subranges of [0, Count) on the pool and the calling thread, and returns
+// once all of them are done. The chunks start large and shrink as the range runs out, but never go
+// below `MinChunk` elements, so the iterations that are cheap to run should get a bigger one.
+void WebThreadPoolParallelFor(web_thread_pool *ThreadPool, uz Count, uz MinChunk, web_thread_pool_range_proc Proc, void *Arg);
 
 #endif // THREADPOOL_H_
@@ -0,0 +1,170 @@
+#include "uring.h"
+
+#include <errno.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+
+static int UringSetup(u32 Entries, struct io_uring_params *Params) {
+    return (int) syscall(__NR_io_uring_setup, Entries, Params);
+}
+
+static int UringEnter(int Fd, u32 ToSubmit, u32 MinComplete, u32 Flags) {
+    return (int) syscall(__NR_io_uring_enter, Fd, ToSubmit, MinComplete, Flags, NULL, 0);
+}
+
+static int UringRegister(int Fd, u32 Opcode, void *Arg, u32 ArgsCount) {
+    return (int) syscall(__NR_io_uring_register, Fd, Opcode, Arg, ArgsCount);
+}
+
+b32 WebUringInit(web_uring *Ring, u32 Entries) {
+    WEB_STRUCT_ZERO(Ring);
+
+    struct io_uring_params Params = {0};
+    Params.flags = IORING_SETUP_CQSIZE;
+    Params.cq_entries = Entries * 4;
+
+    Ring->Fd = UringSetup(Entries, &Params);
+    if (Ring->Fd < 0) return 0;
+
+    // NOTE(oleh): We rely on features from 5.19 anyway (multishot accept, provided buffer rings),
+    // which all have the single mmap feature.
+    if (!(Params.features & IORING_FEAT_SINGLE_MMAP)) {
+        close(Ring->Fd);
+        return 0;
+    }
+
+    Ring->SqRingSize = Params.sq_off.array + Params.sq_entries * sizeof(u32);
+    Ring->CqRingSize = Params.cq_off.cqes + Params.cq_entries * sizeof(struct io_uring_cqe);
+    if (Ring->CqRingSize > Ring->SqRingSize) Ring->SqRingSize = Ring->CqRingSize;
+    Ring->CqRingSize = Ring->SqRingSize;
+
+    Ring->SqRing = mmap(NULL, Ring->SqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                        Ring->Fd, IORING_OFF_SQ_RING);
+    if (Ring->SqRing == MAP_FAILED) {
+        close(Ring->Fd);
+        return 0;
+    }
+    Ring->CqRing = Ring->SqRing;
+
+    Ring->SqesSize = Params.sq_entries * sizeof(struct io_uring_sqe);
+    Ring->Sqes = mmap(NULL, Ring->SqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                      Ring->Fd, IORING_OFF_SQES);
+    if (Ring->Sqes == MAP_FAILED) {
+        munmap(Ring->SqRing, Ring->SqRingSize);
+        close(Ring->Fd);
+        return 0;
+    }
+
+    u8 *Sq = (u8 *) Ring->SqRing;
+    Ring->SqHead = (u32 *) (Sq + Params.sq_off.head);
+    Ring->SqTail = (u32 *) (Sq + Params.sq_off.tail);
+    Ring->SqArray = (u32 *) (Sq + Params.sq_off.array);
+    Ring->SqMask = *(u32 *) (Sq + Params.sq_off.ring_mask);
+    Ring->SqEntries = Params.sq_entries;
+
+    u8 *Cq = (u8 *) Ring->CqRing;
+    Ring->CqHead = (u32 *) (Cq + Params.cq_off.head);
+    Ring->CqTail = (u32 *) (Cq + Params.cq_off.tail);
+    Ring->CqMask = *(u32 *) (Cq + Params.cq_off.ring_mask);
+    Ring->Cqes = (struct io_uring_cqe *) (Cq + Params.cq_off.cqes);
+
+    return 1;
+}
+
+static u32 UringFlushSq(web_uring *Ring) {
+    u32 Tail = *Ring->SqTail;
+    u32 ToSubmit = Ring->SqeTail - Ring->SqeHead;
+
+    for (u32 I = 0; I < ToSubmit; ++I) {
+        Ring->SqArray[Tail & Ring->SqMask] = Ring->SqeHead & Ring->SqMask;
+        ++Tail;
+        ++Ring->SqeHead;
+    }
+
+    __atomic_store_n(Ring->SqTail, Tail, __ATOMIC_RELEASE);
+    return ToSubmit;
+}
+
+sz WebUringSubmitAndWait(web_uring *Ring, u32 WaitCount) {
+    u32 ToSubmit = UringFlushSq(Ring);
+    ++Ring->SubmitGeneration;
+
+    u32 Flags = WaitCount > 0 ? IORING_ENTER_GETEVENTS : 0;
+    if (ToSubmit == 0 && WaitCount == 0) return 0;
+
+    while (1) {
+        int Result = UringEnter(Ring->Fd, ToSubmit, WaitCount, Flags);
+        if (Result < 0 && errno == EINTR) continue;
+        return Result;
+    }
+}
+
+struct io_uring_sqe *WebUringGetSqe(web_uring *Ring) {
+    u32 Head = __atomic_load_n(Ring->SqHead, __ATOMIC_ACQUIRE);
+
+    if (Ring->SqeTail - Head >= Ring->SqEntries) {
+        WebUringSubmitAndWait(Ring, 0);
+        Head = __atomic_load_n(Ring->SqHead, __ATOMIC_ACQUIRE);
+        if (Ring->SqeTail - Head >= Ring->SqEntries) return NULL;
+    }
+
+    struct io_uring_sqe *Sqe = &Ring->Sqes[Ring->SqeTail & Ring->SqMask];
+    ++Ring->SqeTail;
+
+    WEB_STRUCT_ZERO(Sqe);
+    return Sqe;
+}
+
+struct io_uring_cqe *WebUringPeekCqe(web_uring *Ring) {
+    u32 Head = *Ring->CqHead;
+    u32 Tail = __atomic_load_n(Ring->CqTail, __ATOMIC_ACQUIRE);
+
+    if (Head == Tail) return NULL;
+    return &Ring->Cqes[Head & Ring->CqMask];
+}
+
+void WebUringCqeSeen(web_uring *Ring) {
+    __atomic_store_n(Ring->CqHead, *Ring->CqHead + 1, __ATOMIC_RELEASE);
+}
+
+b32 WebUringBufRingInit(web_uring *Ring, web_uring_buf_ring *BufRing, u16 GroupId, u32 Count, u32 BufferSize) {
+    WEB_ASSERT((Count & (Count - 1)) == 0);
+
+    uz RingSize = Count * sizeof(struct io_uring_buf);
+    void *RingMemory = mmap(NULL, RingSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (RingMemory == MAP_FAILED) return 0;
+
+    BufRing->Ring = (struct io_uring_buf_ring *) RingMemory;
+    BufRing->Buffers = malloc((uz) Count * BufferSize);
+    BufRing->Count = Count;
+    BufRing->BufferSize = BufferSize;
+    BufRing->GroupId = GroupId;
+    BufRing->Tail = 0;
+
+    struct io_uring_buf_reg Reg = {0};
+    Reg.ring_addr = (u64) (uintptr_t) RingMemory;
+    Reg.ring_entries = Count;
+    Reg.bgid = GroupId;
+
+    if (UringRegister(Ring->Fd, IORING_REGISTER_PBUF_RING, &Reg, 1) < 0) {
+        munmap(RingMemory, RingSize);
+        free(BufRing->Buffers);
+        return 0;
+    }
+
+    for (u32 I = 0; I < Count; ++I) {
+        WebUringBufRingRecycle(BufRing, (u16) I);
+    }
+
+    return 1;
+}
+
+void WebUringBufRingRecycle(web_uring_buf_ring *BufRing, u16 BufferId) {
+    struct io_uring_buf *Buf = &BufRing->Ring->bufs[BufRing->Tail & (BufRing->Count - 1)];
+    Buf->addr = (u64) (uintptr_t) WebUringBufRingGet(BufRing, BufferId);
+    Buf->len = BufRing->BufferSize;
+    Buf->bid = BufferId;
+
+    ++BufRing->Tail;
+    __atomic_store_n(&BufRing->Ring->tail, BufRing->Tail, __ATOMIC_RELEASE);
+}
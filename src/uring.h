@@ -0,0 +1,76 @@
+#ifndef URING_H_
+#define URING_H_
+
+#include "common.h"
+
+#include <linux/io_uring.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif // __cplusplus
+
+// NOTE(oleh): A minimal io_uring wrapper on top of the raw syscalls, just enough for the HTTP
+// server. Not thread-safe, every ring is meant to be owned by a single thread.
+typedef struct {
+    int Fd;
+
+    u32 *SqHead;
+    u32 *SqTail;
+    u32 *SqArray;
+    u32 SqMask;
+    u32 SqEntries;
+    struct io_uring_sqe *Sqes;
+
+    // NOTE(oleh): The SQEs in [SqeHead, SqeTail) are handed out but not yet submitted.
+    u32 SqeHead;
+    u32 SqeTail;
+
+    // NOTE(oleh): Bumped on every submission, lets callers tell if an SQE they handed out earlier
+    // was already submitted (and so can't be linked to anymore).
+    u64 SubmitGeneration;
+
+    u32 *CqHead;
+    u32 *CqTail;
+    u32 CqMask;
+    struct io_uring_cqe *Cqes;
+
+    void *SqRing;
+    uz SqRingSize;
+    void *CqRing;
+    uz CqRingSize;
+    uz SqesSize;
+} web_uring;
+
+b32 WebUringInit(web_uring *, u32 Entries);
+
+// NOTE(oleh): Returns a zeroed SQE. Submits the pending ones if the submission queue is full.
+struct io_uring_sqe *WebUringGetSqe(web_uring *);
+
+sz WebUringSubmitAndWait(web_uring *, u32 WaitCount);
+
+struct io_uring_cqe *WebUringPeekCqe(web_uring *);
+void WebUringCqeSeen(web_uring *);
+
+// NOTE(oleh): A ring of provided buffers the kernel picks from for receives with
+// `IOSQE_BUFFER_SELECT`.
+typedef struct {
+    struct io_uring_buf_ring *Ring;
+    u8 *Buffers;
+    u32 Count;
+    u32 BufferSize;
+    u16 GroupId;
+    u16 Tail;
+} web_uring_buf_ring;
+
+b32 WebUringBufRingInit(web_uring *, web_uring_buf_ring *, u16 GroupId, u32 Count, u32 BufferSize);
+void WebUringBufRingRecycle(web_uring_buf_ring *, u16 BufferId);
+
+static inline u8 *WebUringBufRingGet(web_uring_buf_ring *BufRing, u16 BufferId) {
+    return BufRing->Buffers + (uz) BufferId * BufRing->BufferSize;
+}
+
+#ifdef __cplusplus
+}
+#endif // __cplusplus
+
+#endif // URING_H_
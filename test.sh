@@ -2,6 +2,6 @@
 
 set -xe
 
-./build.sh -e
-cc -ggdb -O0 -Wall -Wextra -Werror -pedantic -o test tests/test.c -lweb -L. $(pkg-config --cflags --libs openssl)
+./build.sh -e -z
+cc -ggdb -O0 -Wall -Wextra -Werror -pedantic -o test tests/test.c -lweb -L. $(pkg-config --cflags --libs openssl) $(pkg-config --libs zlib)
 ./test
@@ -1,5 +1,11 @@
 #include "../src/base64.h"
 #include "../src/json.h"
+#include "../src/http.h"
+#include "../src/compress.h"
+#include "../src/http2.h"
+#include "../src/dns.h"
+#include "../src/threadpool.h"
+#include "../src/log.h"
 
 #define SV_EQUAL(Lhs, Rhs) do { \
 if (!WebStringViewEqual((Lhs), (Rhs))) WEB_PANIC_FMT("Assertion failed: '" WEB_SV_FMT "' != '" WEB_SV_FMT "'", WEB_SV_ARG((Lhs)), WEB_SV_ARG((Rhs))); \
@@ -49,7 +55,240 @@ void TestJsonEncoding(void) {
     TestJsonEncoding_StringEscaping(&Arena);
 }
 
+void TestHttpRequestParse(void) {
+    web_arena Arena;
+    WebArenaInit(&Arena, 4096);
+
+    // NOTE(oleh): Long enough for the delimiters to land past the first 16 and 32 byte blocks.
+    web_string_view Input = WEB_SV_LIT("DELETE /api/v1/organizations/42/members/1337?force=true HTTP/1.1\r\n"
+                                       "Host: example.com\r\n"
+                                       "X-Some-Rather-Long-Header-Name-For-Testing:\t  value with spaces\r\n"
+                                       "Content-Length: 4\r\n"
+                                       "\r\n"
+                                       "body");
+
+    web_http_request Request;
+    web_string_view Error;
+    WEB_ASSERT(WebHttpRequestParse(&Arena, Input, &Request, &Error));
+
+    WEB_ASSERT(Request.Method == HTTP_DELETE);
+    WEB_ASSERT(Request.Version == HTTP_1_1);
+    SV_EQUAL(Request.Path, WEB_SV_LIT("/api/v1/organizations/42/members/1337?force=true"));
+
+    WEB_ASSERT(Request.Headers.Count == 3);
+    SV_EQUAL(Request.Headers.Items[0].Name, WEB_SV_LIT("Host"));
+    SV_EQUAL(Request.Headers.Items[0].Value, WEB_SV_LIT("example.com"));
+    SV_EQUAL(Request.Headers.Items[1].Name, WEB_SV_LIT("X-Some-Rather-Long-Header-Name-For-Testing"));
+    SV_EQUAL(Request.Headers.Items[1].Value, WEB_SV_LIT("value with spaces"));
+    SV_EQUAL(Request.Body, WEB_SV_LIT("body"));
+
+    web_string_view Value;
+    WEB_ASSERT(WebHttpRequestGetKnownHeader(&Request, HTTP_HEADER_CONTENT_LENGTH, &Value));
+    SV_EQUAL(Value, WEB_SV_LIT("4"));
+    WEB_ASSERT(WebHttpRequestGetHeader(&Request, WEB_SV_LIT("hOST"), &Value));
+    SV_EQUAL(Value, WEB_SV_LIT("example.com"));
+    WEB_ASSERT(WebHttpRequestGetHeader(&Request, WEB_SV_LIT("x-some-rather-long-header-name-for-testing"), &Value));
+    WEB_ASSERT(!WebHttpRequestGetKnownHeader(&Request, HTTP_HEADER_AUTHORIZATION, &Value));
+
+    WEB_ASSERT(!WebHttpRequestParse(&Arena, WEB_SV_LIT("GETS / HTTP/1.1\r\n\r\n"), &Request, &Error));
+    WEB_ASSERT(!WebHttpRequestParse(&Arena, WEB_SV_LIT("GET / HTTP/1.10\r\n\r\n"), &Request, &Error));
+    WEB_ASSERT(!WebHttpRequestParse(&Arena, WEB_SV_LIT("GET / HTTP/1.1\r\nNo colon here\r\nA: b\r\n\r\n"), &Request, &Error));
+}
+
+void TestHttpResponseParse(void) {
+    web_arena Arena;
+    WebArenaInit(&Arena, 4096);
+
+    web_http_response Response;
+    WEB_ASSERT(WebHttpResponseParse(&Arena, WEB_SV_LIT("HTTP/1.1 200 Ok\r\nContent-Length: 2\r\n\r\nhi"), &Response));
+    WEB_ASSERT(Response.Status == HTTP_STATUS_OK);
+    SV_EQUAL(Response.Reason, WEB_SV_LIT("Ok"));
+    SV_EQUAL(Response.Body, WEB_SV_LIT("hi"));
+
+    WEB_ASSERT(WebHttpResponseParse(&Arena, WEB_SV_LIT("HTTP/1.1 200 \r\n\r\n"), &Response));
+    WEB_ASSERT(Response.Status == HTTP_STATUS_OK && Response.Reason.Count == 0);
+    WEB_ASSERT(WebHttpResponseParse(&Arena, WEB_SV_LIT("HTTP/1.0 299\r\n\r\n"), &Response));
+    WEB_ASSERT(Response.Status == 299);
+
+    WEB_ASSERT(!WebHttpResponseParse(&Arena, WEB_SV_LIT("HTTP/1.1 20 OK\r\n\r\n"), &Response));
+    WEB_ASSERT(!WebHttpResponseParse(&Arena, WEB_SV_LIT("HTTP/1.1 2000 OK\r\n\r\n"), &Response));
+}
+
+void TestHttpHeaderId(void) {
+    u8 Lower[64];
+
+#define X(Name, String) do {                                            \
+        WEB_ASSERT(WebHttpHeaderId(WEB_SV_LIT(String)) == HTTP_HEADER_##Name); \
+        uz Count = strlen(String);                                      \
+        for (uz I = 0; I < Count; ++I) Lower[I] = WebCharToLower(String[I]); \
+        web_string_view LowerSv = {.Items = Lower, .Count = Count};     \
+        WEB_ASSERT(WebHttpHeaderId(LowerSv) == HTTP_HEADER_##Name);     \
+    } while (0);
+
+    WEB_ENUM_HTTP_KNOWN_HEADERS
+#undef X
+
+    WEB_ASSERT(WebHttpHeaderId(WEB_SV_LIT("Content-Lengths")) == HTTP_HEADER_UNKNOWN);
+    WEB_ASSERT(WebHttpHeaderId(WEB_SV_LIT("X-Custom")) == HTTP_HEADER_UNKNOWN);
+    WEB_ASSERT(WebHttpHeaderId(WEB_SV_LIT("")) == HTTP_HEADER_UNKNOWN);
+}
+
+// NOTE(oleh): test.sh builds the library with zlib but without zstd.
+void TestCompressionNegotiate(void) {
+    WEB_ASSERT(WebCompressionNegotiate(WEB_SV_LIT("gzip, deflate, br, zstd")) == WEB_COMPRESSION_GZIP);
+    WEB_ASSERT(WebCompressionNegotiate(WEB_SV_LIT("deflate;q=0.9, gzip;q=0.5")) == WEB_COMPRESSION_DEFLATE);
+    WEB_ASSERT(WebCompressionNegotiate(WEB_SV_LIT("gzip;q=0, *")) == WEB_COMPRESSION_DEFLATE);
+    WEB_ASSERT(WebCompressionNegotiate(WEB_SV_LIT("X-GZIP ; Q=1.0")) == WEB_COMPRESSION_GZIP);
+    WEB_ASSERT(WebCompressionNegotiate(WEB_SV_LIT("br, identity")) == WEB_COMPRESSION_IDENTITY);
+    WEB_ASSERT(WebCompressionNegotiate(WEB_SV_LIT("*;q=0")) == WEB_COMPRESSION_IDENTITY);
+    WEB_ASSERT(WebCompressionNegotiate(WEB_SV_LIT("")) == WEB_COMPRESSION_IDENTITY);
+}
+
+typedef struct {
+    web_arena Arena;
+    uz DispatchedCount;
+    http2_request Requests[2];
+} test_http2_state;
+
+static sz TestHttp2SendV(void *Data, struct iovec *Iov, int IovCount) {
+    (void) Data;
+
+    sz Total = 0;
+    for (int I = 0; I < IovCount; ++I) Total += Iov[I].iov_len;
+    return Total;
+}
+
+static web_arena *TestHttp2OpenStream(void *Data, void **OutStreamData) {
+    *OutStreamData = NULL;
+    return &((test_http2_state *) Data)->Arena;
+}
+
+static void TestHttp2Dispatch(void *Data, http2_stream *Stream, void *StreamData, http2_request *Request) {
+    (void) Stream;
+    (void) StreamData;
+
+    test_http2_state *State = (test_http2_state *) Data;
+    State->Requests[State->DispatchedCount++] = *Request;
+}
+
+static void TestHttp2CloseStream(void *Data, void *StreamData) {
+    (void) Data;
+    (void) StreamData;
+}
+
+// NOTE(oleh): The requests of https://datatracker.ietf.org/doc/html/rfc7541#appendix-C.4, the second one
+// refers to the dynamic table entry added by the first.
+void TestHttp2Hpack(void) {
+    test_http2_state State = {0};
+    WebArenaInit(&State.Arena, 1024 * 1024);
+
+    http2_callbacks Callbacks = {
+        .Data = &State,
+        .SendV = TestHttp2SendV,
+        .OpenStream = TestHttp2OpenStream,
+        .Dispatch = TestHttp2Dispatch,
+        .CloseStream = TestHttp2CloseStream,
+    };
+
+    u8 Input[] = {
+        0x00, 0x00, 0x00, 0x04, 0x00, 0x00, 0x00, 0x00, 0x00,
+        0x00, 0x00, 0x11, 0x01, 0x05, 0x00, 0x00, 0x00, 0x01,
+        0x82, 0x86, 0x84, 0x41, 0x8c, 0xf1, 0xe3, 0xc2, 0xe5, 0xf2, 0x3a, 0x6b, 0xa0, 0xab, 0x90, 0xf4, 0xff,
+        0x00, 0x00, 0x0c, 0x01, 0x05, 0x00, 0x00, 0x00, 0x03,
+        0x82, 0x86, 0x84, 0xbe, 0x58, 0x86, 0xa8, 0xeb, 0x10, 0x64, 0x9c, 0xbf,
+    };
+
+    http2_connection *Conn = Http2ConnectionCreate(Callbacks, 1024 * 1024);
+    WEB_ASSERT(Http2ConnectionStart(Conn));
+
+    // NOTE(oleh): Byte by byte, frames can be split anywhere.
+    for (uz I = 0; I < sizeof(Input); ++I) WEB_ASSERT(Http2ConnectionReceive(Conn, Input + I, 1));
+
+    WEB_ASSERT(State.DispatchedCount == 2);
+    SV_EQUAL(State.Requests[0].Method, WEB_SV_LIT("GET"));
+    SV_EQUAL(State.Requests[0].Scheme, WEB_SV_LIT("http"));
+    SV_EQUAL(State.Requests[0].Path, WEB_SV_LIT("/"));
+    SV_EQUAL(State.Requests[0].Authority, WEB_SV_LIT("www.example.com"));
+    WEB_ASSERT(State.Requests[0].Headers.Count == 0);
+
+    SV_EQUAL(State.Requests[1].Authority, WEB_SV_LIT("www.example.com"));
+    WEB_ASSERT(State.Requests[1].Headers.Count == 1);
+    SV_EQUAL(State.Requests[1].Headers.Items[0].Name, WEB_SV_LIT("cache-control"));
+    SV_EQUAL(State.Requests[1].Headers.Items[0].Value, WEB_SV_LIT("no-cache"));
+
+    // NOTE(oleh): Anything but SETTINGS first is a connection error.
+    http2_connection *Bad = Http2ConnectionCreate(Callbacks, 1024 * 1024);
+    WEB_ASSERT(!Http2ConnectionReceive(Bad, Input + 9, 9 + 0x11));
+
+    Http2ConnectionDestroy(Bad);
+    Http2ConnectionDestroy(Conn);
+}
+
+void TestDnsResolve(void) {
+    web_dns_addresses Addresses;
+
+    WEB_ASSERT(WebDnsResolve(WEB_SV_LIT("127.0.0.1"), &Addresses));
+    WEB_ASSERT(Addresses.Count == 1);
+    WEB_ASSERT(Addresses.Items[0].sin_addr.s_addr == htonl(INADDR_LOOPBACK));
+
+    // NOTE(oleh): The second lookup is answered from the cache, names are not case sensitive.
+    WEB_ASSERT(WebDnsResolve(WEB_SV_LIT("localhost"), &Addresses));
+    WEB_ASSERT(WebDnsResolve(WEB_SV_LIT("LocalHost"), &Addresses));
+    WEB_ASSERT(Addresses.Count >= 1);
+    WEB_ASSERT(Addresses.Items[0].sin_family == AF_INET);
+
+    WEB_ASSERT(!WebDnsResolve(WEB_SV_LIT(""), &Addresses));
+
+    WebDnsFlush();
+}
+
+static web_thread_pool TestPool;
+
+static void TestThreadPoolSumRange(void *Arg, uz Begin, uz End) {
+    u64 Sum = 0;
+    for (uz I = Begin; I < End; ++I) Sum += I;
+    __atomic_fetch_add((u64 *)Arg, Sum, __ATOMIC_RELAXED);
+}
+
+static void TestThreadPoolNestedSum(void *Arg) {
+    u64 *Sum = (u64 *)Arg;
+    WebThreadPoolParallelFor(&TestPool, 1000, 16, TestThreadPoolSumRange, Sum);
+}
+
+void TestThreadPool(void) {
+    web_arena Arena;
+    WebArenaInit(&Arena, 1 << 16);
+
+    web_thread_pool_config Config = {.NumThreads = 4};
+    WEB_ASSERT(WebThreadPoolInit(&TestPool, &Arena, &Config));
+
+    u64 Sum = 0;
+    WebThreadPoolParallelFor(&TestPool, 100000, 1, TestThreadPoolSumRange, &Sum);
+    WEB_ASSERT(Sum == 100000ull * 99999 / 2);
+
+    // NOTE(oleh): The tasks run parallel loops of their own from inside the pool.
+    u64 Sums[16] = {0};
+    web_thread_pool_task Tasks[16];
+    for (uz I = 0; I < 16; ++I) Tasks[I] = (web_thread_pool_task) {.Proc = TestThreadPoolNestedSum, .Arg = &Sums[I]};
+
+    web_thread_pool_group Group;
+    WebThreadPoolGroupInit(&Group, &TestPool);
+    WebThreadPoolGroupSpawnMany(&Group, Tasks, 16);
+    WebThreadPoolGroupWait(&Group);
+
+    for (uz I = 0; I < 16; ++I) WEB_ASSERT(Sums[I] == 1000ull * 999 / 2);
+}
+
 int main() {
+    WebLogSetDestination(stderr);
+
     TestBase64();
     TestJsonEncoding();
+    TestHttpRequestParse();
+    TestHttpResponseParse();
+    TestHttpHeaderId();
+    TestCompressionNegotiate();
+    TestHttp2Hpack();
+    TestDnsResolve();
+    TestThreadPool();
 }